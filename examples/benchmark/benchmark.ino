@@ -1,4 +1,5 @@
 #include <XenoLanguage.h>
+#include "xeno_bench_suite.h"
 
 class Benchmark {
 private:
@@ -178,6 +179,11 @@ void setup() {
     bench.runXenoBenchmark();
     bench.runFinalComparison();
     
+    // Same micro-benchmarks as the host build (extras/host), one JSON line per case
+    Serial.println();
+    Serial.println("=== XENO MICRO-BENCHMARKS (JSON) ===");
+    runXenoBenchSuite(Serial);
+    
     Serial.println();
     Serial.println("Benchmark completed!");
 }
@@ -0,0 +1,197 @@
+// Xeno micro-benchmark suite shared by benchmark.ino and the host build (extras/host).
+// Every case prints one JSON line:
+// {"bench":"arith_loop","ok":true,"ops":2000,"us":1234,"ns_per_op":61.7,"instructions":180000,"instr_per_sec":145867098,"allocs":3}
+// "allocs" is null when the platform has no allocation counter.
+
+#ifndef XENO_BENCH_SUITE_H
+#define XENO_BENCH_SUITE_H
+
+#include <XenoLanguage.h>
+
+struct XenoBenchConfig {
+    uint32_t scale = 1;                         // Multiplies loop counts: 1 on a device, ~100 on a PC
+    uint8_t repeats = 3;                        // The best of the repeats is reported
+    uint32_t (*alloc_count)() = nullptr;        // Cumulative allocation counter, if available
+};
+
+struct XenoBenchResult {
+    uint32_t us = 0;
+    uint32_t instructions = 0;
+    uint32_t allocs = 0;
+    bool ok = false;
+};
+
+inline String xenoBenchLoop(const String& setup, const String& body, uint32_t count) {
+    return setup +
+        "set i 0\n"
+        "while i < " + String(count) + "\n" +
+        body +
+        "    set i i + 1\n"
+        "endwhile\n"
+        "halt\n";
+}
+
+inline void xenoBenchReport(Print& out, const char* name, uint32_t ops, const XenoBenchResult& result,
+                            const XenoBenchConfig& config, bool vm_case = true) {
+    out.print("{\"bench\":\"");
+    out.print(name);
+    out.print("\",\"ok\":");
+    out.print(result.ok ? "true" : "false");
+    out.print(",\"ops\":");
+    out.print(ops);
+    out.print(",\"us\":");
+    out.print(result.us);
+    out.print(",\"ns_per_op\":");
+    out.print(ops != 0 ? result.us * 1000.0 / ops : 0.0, 1);
+    out.print(",\"instructions\":");
+    out.print(result.instructions);
+    out.print(",\"instr_per_sec\":");
+    if (vm_case && result.us != 0) {
+        out.print(static_cast<unsigned long>(result.instructions * 1000000.0 / result.us));
+    } else {
+        out.print("null");
+    }
+    out.print(",\"allocs\":");
+    if (config.alloc_count != nullptr) {
+        out.print(result.allocs);
+    } else {
+        out.print("null");
+    }
+    out.println("}");
+}
+
+// The C++ counterpart of the scripted add() in the function_calls case
+inline XenoValue xenoBenchAdd(XenoNativeCall& call) {
+    return XenoValue::makeInt(call.getInt(0) + call.getInt(1));
+}
+
+// Runs a compiled script to completion in large slices: runFor has no iteration limit,
+// unlike run(), and prints nothing besides the script's own output.
+// Script output is silenced so printing does not distort the timings
+inline XenoBenchResult xenoBenchRun(const String& source, const XenoBenchConfig& config, bool natives = false) {
+    XenoBenchResult best;
+    for (uint8_t r = 0; r < config.repeats; ++r) {
+        XenoLanguage xeno;
+        xeno.setOutputMode(XENO_OUTPUT_SILENT);
+        if (natives) xeno.registerNative("add", 2, xenoBenchAdd, TYPE_INT);
+        if (!xeno.compile(source)) return best;
+
+        const uint32_t allocs_before = config.alloc_count != nullptr ? config.alloc_count() : 0;
+        const unsigned long start = micros();
+        XenoRunStatus status;
+        do {
+            status = xeno.runFor(1000000);
+        } while (status == XENO_YIELDED);
+        const uint32_t elapsed = micros() - start;
+
+        XenoBenchResult result;
+        result.us = elapsed;
+        result.instructions = xeno.getInstructionCount();
+        result.allocs = config.alloc_count != nullptr ? config.alloc_count() - allocs_before : 0;
+        result.ok = status == XENO_HALTED && result.instructions != 0;
+        if (r == 0 || result.us < best.us) best = result;
+    }
+    return best;
+}
+
+inline XenoBenchResult xenoBenchCompile(const String& source, const XenoBenchConfig& config) {
+    XenoBenchResult best;
+    for (uint8_t r = 0; r < config.repeats; ++r) {
+        XenoLanguage xeno;
+        const uint32_t allocs_before = config.alloc_count != nullptr ? config.alloc_count() : 0;
+        const unsigned long start = micros();
+        const bool compiled = xeno.compile(source);
+        const uint32_t elapsed = micros() - start;
+
+        XenoBenchResult result;
+        result.us = elapsed;
+        result.allocs = config.alloc_count != nullptr ? config.alloc_count() - allocs_before : 0;
+        result.ok = compiled;
+        if (r == 0 || result.us < best.us) best = result;
+    }
+    return best;
+}
+
+// A long program of independent blocks, roughly what a large script looks like
+inline String xenoBenchLargeSource(uint32_t blocks) {
+    String source;
+    source.reserve(blocks * 160);
+    for (uint32_t b = 0; b < blocks; ++b) {
+        const String n = String(b);
+        source += "set a" + n + " " + n + " * 2 + 1\n";
+        source += "set s" + n + " \"block\" + a" + n + "\n";
+        source += "if a" + n + " > 10 then\n";
+        source += "    set a" + n + " a" + n + " / 2\n";
+        source += "else\n";
+        source += "    set a" + n + " a" + n + " + 10\n";
+        source += "endif\n";
+        source += "print $a" + n + "\n";
+    }
+    source += "halt\n";
+    return source;
+}
+
+static const uint32_t XENO_BENCH_MAX_BLOCKS = 300;
+
+// Lines of source in xenoBenchLargeSource(blocks)
+inline uint32_t xenoBenchLargeLines(uint32_t blocks) { return blocks * 8 + 1; }
+
+inline void runXenoBenchSuite(Print& out, const XenoBenchConfig& config = XenoBenchConfig()) {
+    const uint32_t n = 2000 * config.scale;
+
+    // Integer arithmetic
+    xenoBenchReport(out, "arith_loop", n, xenoBenchRun(xenoBenchLoop(
+        "set sum 0\n",
+        "    set sum (sum + i * 3 + 1) % 1000\n", n), config), config);
+
+    // Float arithmetic
+    xenoBenchReport(out, "float_loop", n, xenoBenchRun(xenoBenchLoop(
+        "set f 0.5\n",
+        "    set f f * 0.5 + 1.25\n", n), config), config);
+
+    // String concatenation: a new heap string per iteration
+    xenoBenchReport(out, "string_concat", n, xenoBenchRun(xenoBenchLoop(
+        "set s \"\"\n",
+        "    set s \"item\" + \" \" + i\n", n), config), config);
+
+    // String comparison
+    xenoBenchReport(out, "string_compare", n, xenoBenchRun(xenoBenchLoop(
+        "set a \"Hello\"\n"
+        "set b \"World\"\n"
+        "set c 0\n",
+        "    if a == \"Hello\" then\n"
+        "        set c c + 1\n"
+        "    endif\n"
+        "    if a != b then\n"
+        "        set c c + 1\n"
+        "    endif\n", n), config), config);
+
+    // Array sweep: every element of a 16-element array is written per iteration
+    String sweep;
+    for (int k = 0; k < 16; ++k) {
+        sweep += "    array set arr " + String(k) + " i\n";
+    }
+    const uint32_t sweeps = n / 4;
+    xenoBenchReport(out, "array_sweep", sweeps * 16, xenoBenchRun(xenoBenchLoop(
+        "array new arr 16 int\n", sweep, sweeps), config), config);
+
+    // Function calls
+    xenoBenchReport(out, "function_calls", n, xenoBenchRun(xenoBenchLoop(
+        "func add(a, b)\n"
+        "    return a + b\n"
+        "endfunc\n",
+        "    set r add(i, 1)\n", n), config), config);
+
+    // The same call bound to a native function
+    xenoBenchReport(out, "native_calls", n, xenoBenchRun(xenoBenchLoop(
+        "", "    set r add(i, 1)\n", n), config, true), config);
+
+    // Compile time of a large source, ops are source lines.
+    // The verifier accepts at most 10000 instructions, so the source stops growing at that size
+    uint32_t blocks = 50 * config.scale;
+    if (blocks > XENO_BENCH_MAX_BLOCKS) blocks = XENO_BENCH_MAX_BLOCKS;
+    xenoBenchReport(out, "compile_large", xenoBenchLargeLines(blocks),
+                    xenoBenchCompile(xenoBenchLargeSource(blocks), config), config, false);
+}
+
+#endif  // XENO_BENCH_SUITE_H
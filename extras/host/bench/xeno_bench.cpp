@@ -0,0 +1,54 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Набор бенчмарков из examples/benchmark на компьютере.
+// Вывод - по строке JSON на тест; аргументы: [scale] [repeats]
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "xeno_bench_suite.h"
+
+// Счётчик выделений памяти: все new программы проходят через эти операторы
+static std::atomic<uint32_t> host_allocs{0};
+
+void* operator new(size_t size) {
+    host_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size != 0 ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+static uint32_t hostAllocCount() { return host_allocs.load(std::memory_order_relaxed); }
+
+int main(int argc, char** argv) {
+    XenoBenchConfig config;
+    config.scale = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100;
+    config.repeats = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+    config.alloc_count = hostAllocCount;
+    if (config.scale == 0) config.scale = 1;
+    if (config.repeats == 0) config.repeats = 1;
+
+    runXenoBenchSuite(Serial, config);
+    Serial.flush();
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Минимальная замена Arduino API для сборки компилятора и VM на компьютере:
+// String поверх std::string, Serial в stdout, время через std::chrono.
+// Покрывает только то, что использует библиотека.
+
+#ifndef EXTRAS_HOST_SHIM_ARDUINO_H_
+#define EXTRAS_HOST_SHIM_ARDUINO_H_
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <cctype>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+#define LED_BUILTIN 2
+
+#define PROGMEM
+#define IRAM_ATTR
+#define F(s) (s)
+
+using std::min;
+using std::max;
+using std::abs;
+using std::sqrt;
+using std::pow;
+using std::sin;
+using std::cos;
+using std::tan;
+using std::fabs;
+
+class String {
+ public:
+    String() {}
+    String(const char* s) : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    explicit String(char c) : s_(1, c) {}
+    String(int v) : s_(std::to_string(v)) {}
+    String(unsigned int v) : s_(std::to_string(v)) {}
+    String(long v) : s_(std::to_string(v)) {}
+    String(unsigned long v) : s_(std::to_string(v)) {}
+    String(long long v) : s_(std::to_string(v)) {}
+    String(unsigned long long v) : s_(std::to_string(v)) {}
+    String(float v, unsigned char decimals = 2) { format(v, decimals); }
+    String(double v, unsigned char decimals = 2) { format(v, decimals); }
+
+    unsigned int length() const { return s_.size(); }
+    bool isEmpty() const { return s_.empty(); }
+    const char* c_str() const { return s_.c_str(); }
+    void reserve(unsigned int size) { s_.reserve(size); }
+    char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+    char& operator[](unsigned int i) { return s_[i]; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    String substring(unsigned int from) const { return from >= s_.size() ? String() : String(s_.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        if (from >= s_.size()) return String();
+        if (to > s_.size()) to = s_.size();
+        return String(s_.substr(from, to - from));
+    }
+    int indexOf(char c, unsigned int from = 0) const { return position(s_.find(c, from)); }
+    int indexOf(const String& str, unsigned int from = 0) const { return position(s_.find(str.s_, from)); }
+    int indexOf(const char* str, unsigned int from = 0) const { return indexOf(String(str), from); }
+    int lastIndexOf(char c) const { return position(s_.rfind(c)); }
+    int lastIndexOf(const String& str) const { return position(s_.rfind(str.s_)); }
+    bool startsWith(const String& prefix) const {
+        return s_.size() >= prefix.s_.size() && s_.compare(0, prefix.s_.size(), prefix.s_) == 0;
+    }
+    bool endsWith(const String& suffix) const {
+        return s_.size() >= suffix.s_.size() &&
+               s_.compare(s_.size() - suffix.s_.size(), suffix.s_.size(), suffix.s_) == 0;
+    }
+    void trim() {
+        size_t begin = 0, end = s_.size();
+        while (begin < end && isspace(static_cast<unsigned char>(s_[begin]))) ++begin;
+        while (end > begin && isspace(static_cast<unsigned char>(s_[end - 1]))) --end;
+        s_ = s_.substr(begin, end - begin);
+    }
+    void toLowerCase() { for (char& c : s_) c = tolower(static_cast<unsigned char>(c)); }
+    void toUpperCase() { for (char& c : s_) c = toupper(static_cast<unsigned char>(c)); }
+    long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(s_.c_str(), nullptr); }
+    int compareTo(const String& other) const { return s_.compare(other.s_); }
+    bool equals(const String& other) const { return s_ == other.s_; }
+    bool concat(const String& other) { s_ += other.s_; return true; }
+    bool concat(const char* str, unsigned int length) { s_.append(str, length); return true; }
+    bool concat(char c) { s_ += c; return true; }
+
+    String& operator+=(const String& other) { s_ += other.s_; return *this; }
+    String& operator+=(const char* str) { s_ += str; return *this; }
+    String& operator+=(char c) { s_ += c; return *this; }
+    String& operator+=(int v) { s_ += std::to_string(v); return *this; }
+    String& operator+=(unsigned int v) { s_ += std::to_string(v); return *this; }
+    String& operator+=(long v) { s_ += std::to_string(v); return *this; }
+    String& operator+=(unsigned long v) { s_ += std::to_string(v); return *this; }
+
+    friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+    friend String operator+(const String& a, const char* b) { return String(a.s_ + b); }
+    friend String operator+(const char* a, const String& b) { return String(std::string(a) + b.s_); }
+    friend String operator+(const String& a, char b) { return String(a.s_ + b); }
+    friend bool operator==(const String& a, const String& b) { return a.s_ == b.s_; }
+    friend bool operator==(const String& a, const char* b) { return a.s_ == b; }
+    friend bool operator!=(const String& a, const String& b) { return a.s_ != b.s_; }
+    friend bool operator!=(const String& a, const char* b) { return a.s_ != b; }
+    friend bool operator<(const String& a, const String& b) { return a.s_ < b.s_; }
+    friend bool operator>(const String& a, const String& b) { return a.s_ > b.s_; }
+
+ private:
+    std::string s_;
+
+    static int position(size_t pos) { return pos == std::string::npos ? -1 : static_cast<int>(pos); }
+    void format(double v, unsigned char decimals) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, v);
+        s_ = buffer;
+    }
+};
+
+class Print {
+ public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t written = 0;
+        while (size--) written += write(*buffer++);
+        return written;
+    }
+    size_t write(const char* str) { return write(reinterpret_cast<const uint8_t*>(str), strlen(str)); }
+    size_t write(const char* buffer, size_t size) { return write(reinterpret_cast<const uint8_t*>(buffer), size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const String& str) { return write(str.c_str(), str.length()); }
+    size_t print(const char* str) { return write(str); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(int v) { return print(String(v)); }
+    size_t print(unsigned int v) { return print(String(v)); }
+    size_t print(long v) { return print(String(v)); }
+    size_t print(unsigned long v) { return print(String(v)); }
+    size_t print(long long v) { return print(String(v)); }
+    size_t print(unsigned long long v) { return print(String(v)); }
+    size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& v) { return print(v) + println(); }
+    size_t println(double v, int decimals) { return print(v, decimals) + println(); }
+};
+
+class Stream : public Print {
+ public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t readBytes(char* buffer, size_t size) {
+        size_t count = 0;
+        while (count < size) {
+            int c = read();
+            if (c < 0) break;
+            buffer[count++] = static_cast<char>(c);
+        }
+        return count;
+    }
+    String readString() {
+        String str;
+        int c;
+        while ((c = read()) >= 0) str += static_cast<char>(c);
+        return str;
+    }
+};
+
+// Serial пишет в stdout; ввода нет, INPUT скрипта получает таймаут или provideInput
+class HostSerial : public Stream {
+ public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { fputc(c, stdout); return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override { fflush(stdout); }
+    explicit operator bool() const { return true; }
+};
+
+extern HostSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+#endif  // EXTRAS_HOST_SHIM_ARDUINO_H_
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Файловая система Arduino поверх stdio: пути считаются от корневого каталога FS
+#ifndef EXTRAS_HOST_SHIM_FS_H_
+#define EXTRAS_HOST_SHIM_FS_H_
+
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+
+namespace fs {
+
+class File : public Stream {
+ public:
+    File() {}
+    explicit File(std::FILE* file) { if (file != nullptr) file_.reset(file, &std::fclose); }
+    explicit operator bool() const { return file_ != nullptr; }
+
+    size_t write(uint8_t c) override { return file_ && std::fputc(c, file_.get()) != EOF ? 1 : 0; }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        return file_ ? std::fwrite(buffer, 1, size, file_.get()) : 0;
+    }
+    using Print::write;
+    int available() override { return file_ ? static_cast<int>(size() - position()) : 0; }
+    int read() override { return file_ ? std::fgetc(file_.get()) : -1; }
+    int peek() override {
+        if (!file_) return -1;
+        int c = std::fgetc(file_.get());
+        if (c != EOF) std::ungetc(c, file_.get());
+        return c;
+    }
+    size_t read(uint8_t* buffer, size_t size) { return file_ ? std::fread(buffer, 1, size, file_.get()) : 0; }
+    size_t readBytes(char* buffer, size_t size) override { return read(reinterpret_cast<uint8_t*>(buffer), size); }
+    size_t size() {
+        if (!file_) return 0;
+        long current = std::ftell(file_.get());
+        std::fseek(file_.get(), 0, SEEK_END);
+        long end = std::ftell(file_.get());
+        std::fseek(file_.get(), current, SEEK_SET);
+        return static_cast<size_t>(end);
+    }
+    bool seek(uint32_t pos) { return file_ && std::fseek(file_.get(), pos, SEEK_SET) == 0; }
+    size_t position() { return file_ ? static_cast<size_t>(std::ftell(file_.get())) : 0; }
+    time_t getLastWrite() { return 0; }
+    void close() { file_.reset(); }
+
+ private:
+    std::shared_ptr<std::FILE> file_;
+};
+
+class FS {
+ public:
+    explicit FS(const std::string& root = ".") : root_(root) {}
+    File open(const String& path, const char* mode = FILE_READ) {
+        std::string binary_mode = mode;
+        if (binary_mode.find('b') == std::string::npos) binary_mode += "b";
+        return File(std::fopen(fullPath(path).c_str(), binary_mode.c_str()));
+    }
+    bool exists(const String& path) { return static_cast<bool>(open(path)); }
+    bool remove(const String& path) { return std::remove(fullPath(path).c_str()) == 0; }
+
+ private:
+    std::string root_;
+
+    std::string fullPath(const String& path) const { return root_ + "/" + path.c_str(); }
+};
+
+}  // namespace fs
+
+using fs::File;
+
+#endif  // EXTRAS_HOST_SHIM_FS_H_
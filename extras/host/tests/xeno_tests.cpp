@@ -0,0 +1,587 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Регрессионные тесты компилятора и VM на компьютере (ctest).
+// Скрипт компилируется и выполняется, вывод print сравнивается с ожидаемым.
+// Аргумент: имя теста (без аргумента - все тесты)
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <FS.h>
+#include "XenoLanguage.h"
+
+// Собирает вывод print в строку, переводы строк приводятся к '\n'
+class CapturePrint : public Print {
+ public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        if (c != '\r') text += static_cast<char>(c);
+        return 1;
+    }
+};
+
+static int checks_failed = 0;
+
+#define XENO_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            ++checks_failed; \
+        } \
+    } while (0)
+
+// Компилирует и выполняет скрипт; пустая строка - ошибка компиляции или выполнения
+static std::string runScript(XenoLanguage& xeno, const char* source) {
+    CapturePrint capture;
+    xeno.setOutput(capture);
+    if (!xeno.compile(source) || !xeno.run()) return std::string();
+    return capture.text;
+}
+
+static std::string runScript(const char* source) {
+    XenoLanguage xeno;
+    return runScript(xeno, source);
+}
+
+static void expectOutput(const char* source, const char* expected) {
+    const std::string actual = runScript(source);
+    if (actual != expected) {
+        std::printf("  FAILED output\n--- script\n%s--- expected\n%s--- actual\n%s---\n",
+                    source, expected, actual.c_str());
+        ++checks_failed;
+    }
+}
+
+// ---- Язык ----
+
+// Выражения, переменные, условия, циклы и функции: общий вывод, на который опираются остальные тесты
+static void testLanguageBasics() {
+    expectOutput(
+        "set x 2 + 3 * 4\n"
+        "print $x\n"
+        "set y (2 + 3) * 4\n"
+        "print $y\n"
+        "set f 7.5 / 2.5\n"
+        "print $f\n"
+        "print \"text\"\n"
+        "halt\n",
+        "14\n20\n3.00\ntext\n");
+
+    expectOutput(
+        "for i = 1 to 3\n"
+        "  print $i\n"
+        "endfor\n"
+        "set sum 0\n"
+        "set n 1\n"
+        "while n <= 10\n"
+        "  set sum sum + n\n"
+        "  set n n + 1\n"
+        "endwhile\n"
+        "print $sum\n"
+        "if sum > 50 then\n"
+        "  print \"big\"\n"
+        "else\n"
+        "  print \"small\"\n"
+        "endif\n"
+        "halt\n",
+        "1\n2\n3\n55\nbig\n");
+
+    expectOutput(
+        "func add3(a, b, c)\n"
+        "  return a + b + c\n"
+        "endfunc\n"
+        "set r add3(1, 2, 3)\n"
+        "print $r\n"
+        "halt\n",
+        "6\n");
+}
+
+// Одиночный '-' - оператор вычитания, а не число 0; отрицательные литералы по-прежнему числа
+static void testBinaryMinus() {
+    expectOutput(
+        "set a 10\n"
+        "set b 4\n"
+        "set d a - b\n"
+        "print $d\n"
+        "set d a - b - 1\n"
+        "print $d\n"
+        "set d 2 - 5\n"
+        "print $d\n"
+        "set d -3\n"
+        "print $d\n"
+        "set f 7.5 - 2.25\n"
+        "print $f\n"
+        "halt\n",
+        "6\n5\n-3\n-3\n5.25\n");
+
+    expectOutput(
+        "func diff(a, b)\n"
+        "  return a - b\n"
+        "endfunc\n"
+        "set r diff(9, 2)\n"
+        "print $r\n"
+        "set r diff(2.5, 0.5)\n"
+        "print $r\n"
+        "halt\n",
+        "7\n2.00\n");
+}
+
+// ---- Типизированные опкоды ----
+
+// Параметр функции имеет тип ANY, поэтому компилятор выдаёт общий опкод, а VM переписывает
+// его при первом выполнении. Оба вызова должны дать одно и то же: первый идёт через quicken(),
+// второй - через уже переписанный типизированный опкод
+static void testQuickenFirstRun() {
+    expectOutput(
+        "func g(a)\n"
+        "  set t a * 1.5\n"
+        "  print $t\n"
+        "endfunc\n"
+        "set r g(2.0)\n"
+        "set r g(2.0)\n"
+        "halt\n",
+        "3.00\n3.00\n");
+
+    expectOutput(
+        "func ints(a, b)\n"
+        "  set s a + b\n"
+        "  print $s\n"
+        "  set s a - b\n"
+        "  print $s\n"
+        "  set s a * b\n"
+        "  print $s\n"
+        "  set s a / b\n"
+        "  print $s\n"
+        "  set s a % b\n"
+        "  print $s\n"
+        "endfunc\n"
+        "set r ints(7, 2)\n"
+        "set r ints(7, 2)\n"
+        "halt\n",
+        "9\n5\n14\n3\n1\n"
+        "9\n5\n14\n3\n1\n");
+
+#if XENO_FEATURE_MATH
+    expectOutput(
+        "func power(a, b)\n"
+        "  set s a ^ b\n"
+        "  print $s\n"
+        "endfunc\n"
+        "set r power(7, 2)\n"
+        "set r power(7, 2)\n"
+        "halt\n",
+        "49\n49\n");
+#endif
+
+    expectOutput(
+        "func floats(a, b)\n"
+        "  set s a + b\n"
+        "  print $s\n"
+        "  set s a - b\n"
+        "  print $s\n"
+        "  set s a * b\n"
+        "  print $s\n"
+        "  set s a / b\n"
+        "  print $s\n"
+        "endfunc\n"
+        "set r floats(7.5, 2.5)\n"
+        "set r floats(7.5, 2.5)\n"
+        "halt\n",
+        "10.00\n5.00\n18.75\n3.00\n"
+        "10.00\n5.00\n18.75\n3.00\n");
+
+    expectOutput(
+        "func cmp(a, b)\n"
+        "  if a < b then\n"
+        "    print \"lt\"\n"
+        "  endif\n"
+        "  if a == b then\n"
+        "    print \"eq\"\n"
+        "  endif\n"
+        "  if a > b then\n"
+        "    print \"gt\"\n"
+        "  endif\n"
+        "endfunc\n"
+        "set r cmp(1, 2)\n"
+        "set r cmp(2, 2)\n"
+        "set r cmp(2.5, 1.5)\n"
+        "halt\n",
+        "lt\neq\ngt\n");
+}
+
+// ---- Оптимизатор ----
+
+// Выполняет скрипт на уровне оптимизации level; executed - число выполненных инструкций
+static std::string runAtLevel(const char* source, uint8_t level, uint32_t& executed) {
+    XenoLanguage xeno;
+    XENO_CHECK(xeno.setOptimizationLevel(level));
+    const std::string output = runScript(xeno, source);
+    executed = xeno.getInstructionCount();
+    return output;
+}
+
+// Вывод одинаков на уровнях 0, 1 и 2. Начиная с уровня faster_from код выполняет меньше
+// инструкций, чем без оптимизации, и более высокий уровень никогда не выполняет больше
+static void expectSameAtEveryLevel(const char* source, const char* expected, uint8_t faster_from) {
+    uint32_t executed[3] = { };
+    for (uint8_t level = 0; level <= 2; ++level) {
+        const std::string actual = runAtLevel(source, level, executed[level]);
+        if (actual != expected) {
+            std::printf("  FAILED output at level %u\n--- script\n%s--- expected\n%s--- actual\n%s---\n",
+                        level, source, expected, actual.c_str());
+            ++checks_failed;
+        }
+    }
+    XENO_CHECK(executed[1] <= executed[0]);
+    XENO_CHECK(executed[2] <= executed[1]);
+    XENO_CHECK(executed[faster_from] < executed[0]);
+}
+
+// По скрипту на каждое преобразование: свёртка констант, свёртка NOT после EQ/NEQ,
+// сквозные переходы, удаление мёртвого кода и слияние инкремента (только уровень 2)
+static void testOptimizerLevelsAgree() {
+    expectSameAtEveryLevel(
+        "set x 2 + 3 * 4\n"
+        "set y (10 - 4) / 2\n"
+        "set f 1.5 * 4.0\n"
+        "set b 7 > 3\n"
+        "print $x\n"
+        "print $y\n"
+        "print $f\n"
+        "print $b\n"
+        "halt\n",
+        "14\n3\n6.00\n0\n", 1);
+
+    expectSameAtEveryLevel(
+        "set a 3\n"
+        "set b 4\n"
+        "if !(a == b) then\n"
+        "  print \"ne\"\n"
+        "endif\n"
+        "if !(a != b) then\n"
+        "  print \"eq\"\n"
+        "endif\n"
+        "halt\n",
+        "ne\n", 1);
+
+    // JUMP_IF на конец if попадает на обратный JUMP цикла и уходит сразу к условию
+    // (граница в переменной, поэтому условие не сливается в CMP_JUMP)
+    expectSameAtEveryLevel(
+        "set n 0\n"
+        "set i 0\n"
+        "set m 5\n"
+        "while i < m\n"
+        "  set i i + 1\n"
+        "  if i > 2 then\n"
+        "    set n n + 10\n"
+        "  endif\n"
+        "endwhile\n"
+        "print $n\n"
+        "halt\n",
+        "30\n", 1);
+
+    // Ложное условие-константа становится JUMP, тело if и код после return - мёртвые
+    expectSameAtEveryLevel(
+        "func pick(a)\n"
+        "  if a > 0 then\n"
+        "    return 1\n"
+        "  endif\n"
+        "  return 2\n"
+        "  print \"unreachable\"\n"
+        "endfunc\n"
+        "if 1 > 2 then\n"
+        "  print \"never\"\n"
+        "endif\n"
+        "set r pick(5)\n"
+        "print $r\n"
+        "set r pick(0)\n"
+        "print $r\n"
+        "halt\n"
+        "print \"after halt\"\n",
+        "1\n2\n", 1);
+
+    expectSameAtEveryLevel(
+        "set s 0\n"
+        "set k 0\n"
+        "while k < 100\n"
+        "  set s s + 3\n"
+        "  set k k + 1\n"
+        "endwhile\n"
+        "print $s\n"
+        "halt\n",
+        "300\n", 2);
+}
+
+// Слитое условие while проверяется и в обратном переходе: итерация тела из
+// LOAD, PUSH, ADD, STORE стоит 5 инструкций, а не 6 (CMP_JUMP + JUMP)
+static void testWhileBackEdgeFused() {
+    uint32_t ten = 0;
+    uint32_t twenty = 0;
+    runAtLevel("set i 0\nwhile i < 10\n  set i i + 1\nendwhile\nhalt\n", 0, ten);
+    runAtLevel("set i 0\nwhile i < 20\n  set i i + 1\nendwhile\nhalt\n", 0, twenty);
+    XENO_CHECK(twenty - ten == 10 * 5);
+
+    expectSameAtEveryLevel(
+        "func count(n)\n"
+        "  set k 0\n"
+        "  while k < 4\n"
+        "    set n n + k\n"
+        "    set k k + 1\n"
+        "  endwhile\n"
+        "  return n\n"
+        "endfunc\n"
+        "set z 9\n"
+        "while z < 3\n"
+        "  print \"never\"\n"
+        "endwhile\n"
+        "set r count(1)\n"
+        "print $r\n"
+        "halt\n",
+        "7\n", 2);
+}
+
+// Цикл без выхода делает завершающий HALT недостижимым. Оптимизатор не должен его удалять:
+// программа длиннее 10 инструкций без HALT не проходит проверку при загрузке
+static void testInfiniteLoopKeepsHalt() {
+    static const char* source =
+        "set i 0\n"
+        "while 1 == 1\n"
+        "  set i i + 1\n"
+        "  set j i * 2\n"
+        "  set k j + i\n"
+        "endwhile\n"
+        "halt\n";
+    for (uint8_t level = 0; level <= 2; ++level) {
+        XenoLanguage xeno;
+        XENO_CHECK(xeno.setOptimizationLevel(level));
+        XENO_CHECK(xeno.compile(source));
+        XENO_CHECK(xeno.runFor(1000) == XENO_YIELDED);
+        XENO_CHECK(xeno.isRunning());
+    }
+}
+
+// ---- Горячая замена ----
+
+// Многократная замена функции между квантами runFor: программа и арена не растут от замены
+// к замене, а вызов после последней замены идёт в её тело. Квант кончается на переходе назад:
+// и в цикле внутри f, и в основном цикле, поэтому работают оба пути - дописывание тел
+// и сборка программы заново
+static void testUpdateFunctionsBounded() {
+    static const char* source =
+        "func f(a)\n"
+        "  return a + 1\n"
+        "endfunc\n"
+        "set n 0\n"
+        "while n < 200\n"
+        "  set r f(n)\n"
+        "  set n n + 1\n"
+        "endwhile\n"
+        "print $r\n"
+        "halt\n";
+    static uint8_t buffer[16 * 1024];
+    XenoLanguage xeno;
+    xeno.setMemoryArena(buffer, sizeof(buffer));
+    CapturePrint capture;
+    xeno.setOutput(capture);
+    XENO_CHECK(xeno.compile(source));
+
+    size_t peak[2] = { };                  // Наибольшая занятость арены в первой и второй половине замен
+    for (int update = 0; update < 100; ++update) {
+        XENO_CHECK(xeno.runFor(3 + update % 5) == XENO_YIELDED);
+        String body = "func f(a)\n  set k 0\n  while k < 2\n    set k k + 1\n  endwhile\n  return a + ";
+        body += update;
+        body += "\nendfunc\n";
+        XENO_CHECK(xeno.updateFunctions(body));
+        size_t& half = peak[update < 50 ? 0 : 1];
+        half = std::max(half, xeno.getMemoryUsage().used);
+    }
+    XENO_CHECK(peak[1] <= peak[0]);
+    XENO_CHECK(xeno.getMemoryUsage().overflow == 0);
+
+    XENO_CHECK(xeno.updateFunctions("func f(a)\n  return a * 2\nendfunc\n"));
+    XenoRunStatus status = XENO_YIELDED;
+    while (status == XENO_YIELDED) {
+        status = xeno.runFor(1000);
+    }
+    XENO_CHECK(status == XENO_HALTED);
+    XENO_CHECK(capture.text == "398\n");
+}
+
+// ---- Функции хоста ----
+
+static XenoValue nativeTwice(XenoNativeCall& call) {
+    return XenoValue::makeInt(call.getInt(0) * 2);
+}
+
+// Образ с вызовом функции хоста загружается, только если она зарегистрирована с тем же номером
+// и арностью: и с файла, и на месте. Иначе loadBytecode возвращает false, а не run() молча
+static void testImageNativesChecked() {
+    static const char* path = "xeno_test_natives.xbc";
+    fs::FS fs(".");
+    {
+        XenoLanguage xeno;
+        XENO_CHECK(xeno.registerNative("twice", 1, nativeTwice, TYPE_INT));
+        XENO_CHECK(xeno.compile("set r twice(21)\nprint $r\nhalt\n"));
+        XENO_CHECK(xeno.saveBytecode(fs, path));
+    }
+
+    std::vector<uint32_t> storage;      // uint32_t: образ на месте выровнен как во flash
+    size_t size = 0;
+    {
+        File file = fs.open(path, FILE_READ);
+        XENO_CHECK(static_cast<bool>(file));
+        size = file.size();
+        storage.resize((size + 3) / 4);
+        XENO_CHECK(file.read(reinterpret_cast<uint8_t*>(storage.data()), size) == size);
+    }
+    const uint8_t* image = reinterpret_cast<const uint8_t*>(storage.data());
+
+    {
+        XenoLanguage unregistered;
+        XENO_CHECK(!unregistered.loadBytecode(image, size));
+        XENO_CHECK(!unregistered.loadBytecode(fs, path));
+    }
+    {
+        XenoLanguage other_arity;
+        XENO_CHECK(other_arity.registerNative("twice", 2, nativeTwice, TYPE_INT));
+        XENO_CHECK(!other_arity.loadBytecode(image, size));
+    }
+    {
+        XenoLanguage registered;
+        XENO_CHECK(registered.registerNative("twice", 1, nativeTwice, TYPE_INT));
+        CapturePrint capture;
+        registered.setOutput(capture);
+        XENO_CHECK(registered.loadBytecode(image, size));
+        XENO_CHECK(registered.run());
+        XENO_CHECK(capture.text == "42\n");
+    }
+    fs.remove(path);
+}
+
+// ---- Проверка образа ----
+
+// CRC32 данных образа (как XenoImage), чтобы подделанный образ прошёл проверку целостности
+static uint32_t imageCrc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// Номер пина в образе - весь 32-битный arg1. 0xFFFFFF0D не должен пройти как разрешённый
+// пин 13 (и затем выйти за массив банков при настройке выхода)
+static void testImagePinRangeChecked() {
+    static const char* path = "xeno_test_pin.xbc";
+    fs::FS fs(".");
+    {
+        XenoLanguage xeno;
+        XENO_CHECK(xeno.setAllowedPins({13}));
+        XENO_CHECK(xeno.compile("led 13 on\nhalt\n"));
+        XENO_CHECK(xeno.saveBytecode(fs, path));
+    }
+
+    std::vector<uint32_t> storage;
+    size_t size = 0;
+    {
+        File file = fs.open(path, FILE_READ);
+        XENO_CHECK(static_cast<bool>(file));
+        size = file.size();
+        storage.resize((size + 3) / 4);
+        XENO_CHECK(file.read(reinterpret_cast<uint8_t*>(storage.data()), size) == size);
+    }
+    uint8_t* image = reinterpret_cast<uint8_t*>(storage.data());
+    {
+        XenoLanguage genuine;
+        XENO_CHECK(genuine.setAllowedPins({13}));
+        XENO_CHECK(genuine.loadBytecode(image, size));
+    }
+
+    uint32_t code_count = 0;
+    memcpy(&code_count, image + 8, sizeof(code_count));
+    XenoCompactInstruction* code = reinterpret_cast<XenoCompactInstruction*>(image + XenoImage::HEADER_SIZE);
+    bool patched = false;
+    for (uint32_t i = 0; i < code_count; ++i) {
+        if (code[i].opcode == OP_LED_ON) {
+            code[i].arg1 = 0xFFFFFF0D;
+            patched = true;
+        }
+    }
+    XENO_CHECK(patched);
+    const uint32_t crc = imageCrc32(image + XenoImage::HEADER_SIZE, size - XenoImage::HEADER_SIZE);
+    memcpy(image + 24, &crc, sizeof(crc));
+
+    {
+        XenoLanguage forged;
+        XENO_CHECK(forged.setAllowedPins({13}));
+        XENO_CHECK(!forged.loadBytecode(image, size));
+    }
+    {
+        File file = fs.open(path, FILE_WRITE);
+        XENO_CHECK(static_cast<bool>(file));
+        XENO_CHECK(file.write(image, size) == size);
+    }
+    {
+        XenoLanguage forged;
+        XENO_CHECK(forged.setAllowedPins({13}));
+        XENO_CHECK(!forged.loadBytecode(fs, path));
+    }
+    fs.remove(path);
+}
+
+struct XenoTestCase {
+    const char* name;
+    void (*run)();
+};
+
+static const XenoTestCase test_cases[] = {
+    {"language_basics", testLanguageBasics},
+    {"binary_minus", testBinaryMinus},
+    {"quicken_first_run", testQuickenFirstRun},
+    {"optimizer_levels_agree", testOptimizerLevelsAgree},
+    {"while_back_edge_fused", testWhileBackEdgeFused},
+    {"infinite_loop_keeps_halt", testInfiniteLoopKeepsHalt},
+    {"update_functions_bounded", testUpdateFunctionsBounded},
+    {"image_natives_checked", testImageNativesChecked},
+    {"image_pin_range_checked", testImagePinRangeChecked},
+};
+
+int main(int argc, char** argv) {
+    const char* only = argc > 1 ? argv[1] : nullptr;
+    int failed_tests = 0;
+    int ran = 0;
+    for (const XenoTestCase& test : test_cases) {
+        if (only && std::strcmp(only, test.name) != 0) continue;
+        const int before = checks_failed;
+        test.run();
+        ++ran;
+        const bool ok = checks_failed == before;
+        if (!ok) ++failed_tests;
+        std::printf("%s %s\n", ok ? "PASS" : "FAIL", test.name);
+    }
+    if (ran == 0) {
+        std::printf("No test named %s\n", only ? only : "");
+        return 1;
+    }
+    return failed_tests == 0 ? 0 : 1;
+}
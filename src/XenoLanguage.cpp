@@ -16,10 +16,16 @@
 
 #include <vector>
 #include "XenoLanguage.h"
+#include "xeno/optimizer/xeno_optimizer.h"
+#include "xeno/image/xeno_image.h"
+#include "xeno/debug/xeno_debug_tools.h"
 
 XenoLanguage::XenoLanguage() {
-    compiler = new XenoCompiler(security_config);
-    vm = new XenoVM(security_config);
+    compiler = new XenoCompiler(security_config, &arena);
+    compiler->setImportCache(&import_cache);
+    compiler->setNatives(&natives);
+    vm = new XenoVM(security_config, &arena);
+    vm->setNatives(&natives);
     filesystem = nullptr;
 }
 
@@ -31,30 +37,244 @@ XenoLanguage::~XenoLanguage() {
 void XenoLanguage::recreateObjects() {
     delete compiler;
     delete vm;
-    compiler = new XenoCompiler(security_config);
+    arena.reset();
+    compiler = new XenoCompiler(security_config, &arena);
     if (filesystem != nullptr) {
         compiler->setFileSystem(filesystem);
     }
-    vm = new XenoVM(security_config);
+    compiler->setOptimizationLevel(optimization_level);
+    compiler->setImportCache(&import_cache);
+    compiler->setNatives(&natives);
+    vm = new XenoVM(security_config, &arena);
+    vm->setNatives(&natives);
+    vm->setOutput(*output);
+    vm->setOutputConfig(output_config);
+    vm->setProfiling(profiling);
+    vm->setTracing(trace_depth);
+    sliced_loaded = false;
+    attestation.reset();
+}
+
+void XenoLanguage::setMemoryArena(void* buffer, size_t size) {
+    // Компилятор и VM держат блоки прежнего буфера: удаляются до смены арены
+    delete compiler;
+    delete vm;
+    compiler = nullptr;
+    vm = nullptr;
+    arena.attach(buffer, size);
+    image_in_place = false;
+    recreateObjects();
+}
+
+void XenoLanguage::setOutput(XenoOutputCallback callback, void* user) {
+    vm->flushOutput();
+    callback_output.setCallback(callback, user);
+    setOutput(callback_output);
+}
+
+void XenoLanguage::setOutputMode(XenoOutputMode mode) {
+    output_config.mode = mode;
+    vm->setOutputConfig(output_config);
+}
+
+bool XenoLanguage::setOutputBuffer(uint16_t records, uint16_t text_bytes) {
+    if (records < XenoOutputConfig::MIN_RECORDS || records > XenoOutputConfig::MAX_RECORDS ||
+        text_bytes > XenoOutputConfig::MAX_TEXT_BYTES) {
+        Serial.println("ERROR: Invalid output buffer size");
+        return false;
+    }
+    output_config.records = records;
+    output_config.text_bytes = text_bytes;
+    vm->setOutputConfig(output_config);
+    return true;
+}
+
+void XenoLanguage::setOutputOverflow(XenoOutputOverflow policy) {
+    output_config.overflow = policy;
+    vm->setOutputConfig(output_config);
+}
+
+void XenoLanguage::setOutputRateLimit(uint16_t lines_per_second) {
+    output_config.max_lines_per_second = lines_per_second;
+    vm->setOutputConfig(output_config);
 }
 
 bool XenoLanguage::compile(const String& source_code) {
+    image_in_place = false;
     recreateObjects();
     compiler->compile(source_code);
+    return !compiler->hasErrors();
+}
+
+bool XenoLanguage::saveBytecode(fs::FS& fs, const String& path) {
+    if (compiler->hasErrors() || compiler->getBytecode().empty()) {
+        Serial.println("ERROR: No compiled program to save");
+        return false;
+    }
+    return XenoImage::save(fs, path, compiler->getBytecode(), compiler->getStringTable(),
+                           compiler->getFunctions());
+}
+
+// Образ проверяется по таблице функций хоста при загрузке, как вызовы из исходника при компиляции:
+// иначе loadBytecode вернул бы true, а программа не запустилась бы
+static bool refuseNative(const char* name) {
+    Serial.print("SECURITY: Native function '");
+    Serial.print(name);
+    Serial.println("' is not registered - refusing to load");
+    return false;
+}
+
+static bool nativesRegistered(const std::vector<XenoInstruction>& code, const std::vector<String>& strings,
+                              const XenoNativeTable& natives) {
+    for (const XenoInstruction& instr : code) {
+        if (instr.opcode != OP_CALL_NATIVE) continue;
+        const String& name = strings[instr.arg2];
+        if (!natives.binds(instr.arg1, name.c_str(), name.length())) return refuseNative(name.c_str());
+    }
+    return true;
+}
+
+static bool nativesRegistered(const XenoImageView& image, const XenoNativeTable& natives) {
+    for (uint32_t i = 0; i < image.code_count; ++i) {
+        const XenoCompactInstruction& instr = image.code[i];
+        if (instr.opcode != OP_CALL_NATIVE) continue;
+        uint16_t length = 0;
+        const char* name = image.string(instr.arg2, length);
+        if (!natives.binds(instr.arg1, name, length)) return refuseNative(name);
+    }
+    return true;
+}
+
+bool XenoLanguage::loadBytecode(fs::FS& fs, const String& path) {
+    std::vector<XenoInstruction> code;
+    std::vector<String> strings;
+    std::map<String, FunctionInfo> functions;
+    if (!XenoImage::load(fs, path, code, strings, functions)) {
+        return false;
+    }
+
+    XenoSecurity security(security_config);
+    XenoAttestation verified;
+    if (!security.attest(code, strings, verified)) {
+        Serial.println("SECURITY: Bytecode image verification failed - refusing to load");
+        return false;
+    }
+    if (verified.native_calls && !nativesRegistered(code, strings, natives)) {
+        return false;
+    }
+
+    image_in_place = false;
+    recreateObjects();
+    compiler->adoptProgram(code, strings, functions);
+    attestation = verified;
+    return true;
+}
+
+bool XenoLanguage::loadBytecode(const uint8_t* image, size_t size) {
+    image_in_place = false;
+    XenoImageView loaded;
+    if (!XenoImage::view(image, size, loaded)) {
+        return false;
+    }
+
+    XenoSecurity security(security_config);
+    XenoAttestation verified;
+    if (!security.attest(loaded.code, loaded.code_count, loaded.string_count, verified)) {
+        Serial.println("SECURITY: Bytecode image verification failed - refusing to load");
+        return false;
+    }
+    if (verified.native_calls && !nativesRegistered(loaded, natives)) {
+        return false;
+    }
+
+    recreateObjects();
+    image_view = loaded;
+    image_in_place = true;
+    attestation = verified;
     return true;
 }
 
+void XenoLanguage::loadIntoVM(bool less_output) {
+    if (image_in_place) {
+        vm->loadProgram(image_view, less_output, &attestation);
+        vm->setFunctionTable(image_view.functions);
+    } else {
+        vm->loadProgram(compiler->getBytecode(), compiler->getStringTable(), less_output, &attestation);
+        vm->setFunctionTable(compiler->getFunctions());
+    }
+}
+
 bool XenoLanguage::run(bool less_output) {
-    vm->loadProgram(compiler->getBytecode(), compiler->getStringTable(), less_output);
-    vm->setFunctionTable(compiler->getFunctions());
+    loadIntoVM(less_output);
+    sliced_loaded = false;
     vm->run(less_output);
     return true;
 }
 
+XenoRunStatus XenoLanguage::runFor(uint32_t budget) {
+    if (!sliced_loaded) {
+        loadIntoVM(true);
+        sliced_loaded = true;
+    }
+    return vm->runFor(budget);
+}
+
+bool XenoLanguage::updateFunctions(const String& source) {
+    if (image_in_place || !compiler->canPatch()) {
+        Serial.println("ERROR: Only a program compiled from source can be updated");
+        return false;
+    }
+
+    size_t base = compiler->getBytecode().size();
+    if (!compiler->compileFunctions(source)) {
+        return false;
+    }
+    // Программа ещё не в VM: следующая загрузка возьмёт её целиком и проверит заново
+    if (!sliced_loaded) {
+        compiler->compactFunctions();
+        compiler->commitFunctions();
+        attestation.reset();
+        return true;
+    }
+
+    // Пока ни одна функция не выполняется, заменённые тела выбрасываются и программа не растёт;
+    // иначе новые тела дописываются, а прежние уйдут при следующей такой замене
+    if (vm->getCallDepth() == 0) {
+        base = compiler->compactFunctions();
+    }
+    const std::vector<XenoInstruction>& bytecode = compiler->getBytecode();
+    const std::vector<XenoInstruction> patch(bytecode.begin() + base, bytecode.end());
+    if (!vm->patchFunctions(patch, compiler->getStringTable(), compiler->getFunctions(), base)) {
+        compiler->rollbackFunctions();
+        return false;
+    }
+    compiler->commitFunctions();
+    return true;
+}
+
+bool XenoLanguage::compileFile(fs::FS& fs, const String& path) {
+    File file = fs.open(path, FILE_READ);
+    if (!file) {
+        Serial.print("ERROR: Cannot open source file: ");
+        Serial.println(path);
+        return false;
+    }
+
+    image_in_place = false;
+    recreateObjects();
+    if (filesystem == nullptr) {
+        compiler->setFileSystem(&fs);
+    }
+    compiler->compileStream(file);
+    file.close();
+    return !compiler->hasErrors();
+}
+
 bool XenoLanguage::compile_and_run(const String& source_code, bool less_output) {
+    image_in_place = false;
     recreateObjects();
     compiler->compile(source_code);
-    vm->loadProgram(compiler->getBytecode(), compiler->getStringTable(), less_output);
+    vm->loadProgram(compiler->getBytecode(), compiler->getStringTable(), less_output, &attestation);
     vm->setFunctionTable(compiler->getFunctions());
     vm->run(less_output);
     return true;
@@ -84,10 +304,79 @@ void XenoLanguage::printCompiledCode() {
     compiler->printCompiledCode();
 }
 
+void XenoLanguage::printProfile() {
+#if XENO_PROFILE
+    const XenoProfile* profile = vm->getProfile();
+    if (profile == nullptr) {
+        Serial.println("Profiler is off: call setProfiling(true) before run()");
+        return;
+    }
+    if (image_in_place) {
+        // В образе нет строк исходника, инструкции распаковываются только для отчёта
+        std::vector<XenoInstruction> code;
+        code.reserve(image_view.code_count);
+        for (uint32_t i = 0; i < image_view.code_count; ++i) {
+            code.push_back(image_view.code[i].unpack());
+        }
+        Debugger::printProfile(*profile, code, std::vector<String>(), std::vector<uint16_t>());
+    } else {
+        Debugger::printProfile(*profile, compiler->getBytecode(), compiler->getStringTable(),
+                               compiler->getLineTable());
+    }
+#else
+    Serial.println("Profiler is not compiled in: build with -DXENO_PROFILE=1");
+#endif
+}
+
+bool XenoLanguage::setTracing(uint16_t depth) {
+#if XENO_TRACE
+    if (!vm->setTracing(depth)) return false;
+    trace_depth = depth;
+    return true;
+#else
+    if (depth == 0) return true;
+    Serial.println("Tracing is not compiled in: build with -DXENO_TRACE=1");
+    return false;
+#endif
+}
+
+size_t XenoLanguage::getTrace(XenoTraceEntry* out, size_t max) const {
+    const XenoTrace* trace = vm->getTrace();
+    if (trace == nullptr) return 0;
+    const size_t count = trace->size() < max ? trace->size() : max;
+    // Не влезает всё - отдаются самые новые
+    const size_t skip = trace->size() - count;
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = trace->at(skip + i);
+    }
+    return count;
+}
+
+void XenoLanguage::printTrace() {
+#if XENO_TRACE
+    const XenoTrace* trace = vm->getTrace();
+    if (trace == nullptr) {
+        Serial.println("Tracing is off: call setTracing(depth) before run()");
+        return;
+    }
+    Debugger::printTrace(*trace);
+#else
+    Serial.println("Tracing is not compiled in: build with -DXENO_TRACE=1");
+#endif
+}
+
 bool XenoLanguage::setMaxInstructions(uint32_t max_instr) {
     return security_config.setCurrentMaxInstructions(max_instr);
 }
 
+bool XenoLanguage::setOptimizationLevel(uint8_t level) {
+    if (level > XenoOptimizer::MAX_LEVEL) {
+        return false;
+    }
+    optimization_level = level;
+    return true;
+}
+
 const XenoSecurityConfig& XenoLanguage::getSecurityConfig() const {
     return security_config;
 }
@@ -22,6 +22,8 @@
 #include "xeno/main/xeno_compiler.h"
 #include "xeno/main/xeno_vm.h"
 #include "xeno/security/xeno_security_config.h"
+#include "xeno/scheduler/xeno_scheduler.h"
+#include "xeno/rtos/xeno_task.h"
 
 class XenoLanguage {
  private:
@@ -35,8 +37,24 @@ class XenoLanguage {
     XenoVM* vm;
 
     fs::FS* filesystem = nullptr;   // Указатель на файловую систему для импорта
+    uint8_t optimization_level = 1; // Уровень оптимизатора байткода (0 - выключен)
+    XenoImageView image_view;       // Образ для выполнения на месте
+    bool image_in_place = false;
+    XenoImportCache import_cache;   // Скомпилированные модули import, переживают recreateObjects
+    bool sliced_loaded = false;     // Программа загружена в VM для runFor
+    Print* output = &Serial;        // Вывод print скрипта
+    XenoCallbackPrint callback_output;  // Цель setOutput(callback)
+    XenoOutputConfig output_config;
+    bool profiling = false;         // Профилировщик VM (только в сборке с XENO_PROFILE)
+    uint16_t trace_depth = 0;       // Кольцо трассировки VM (только в сборке с XENO_TRACE)
+    XenoNativeTable natives;        // Функции хоста, переживают recreateObjects
+    XenoAttestation attestation;    // Проверка текущей программы: повторный run() её не повторяет
+    XenoArena arena;                // Буфер setMemoryArena; сбрасывается при каждом recreateObjects
 
     void recreateObjects();
+    void loadIntoVM(bool less_output);
+
+    friend class XenoScheduler;     // Берёт скомпилированную программу для общих образов
 
     // Запрещаем копирование и присваивание
     XenoLanguage(const XenoLanguage&) = delete;
@@ -46,22 +64,107 @@ class XenoLanguage {
     XenoLanguage();
     ~XenoLanguage();
 
+    // Фиксированный буфер под память компилятора и VM: временные буферы компиляции (лексемы,
+    // стеки if/циклов) возвращаются в него после compile, программа, стек операндов, кадры и
+    // глобальные живут в нём до следующей компиляции или загрузки. Что не поместилось, берётся из
+    // кучи (getMemoryUsage().overflow). Текущая программа выгружается; nullptr - снова только куча.
+    // Строки и массивы скрипта остаются в куче
+    void setMemoryArena(void* buffer, size_t size);
+    XenoMemoryUsage getMemoryUsage() const { return arena.usage(); }
+
     // Установка файловой системы для импорта
     void setFileSystem(fs::FS& fs) { filesystem = &fs; }
 
+    // Функция хоста, вызываемая из скрипта как name(a, b, ...): компилятор разрешает имя в номер,
+    // аргументы передаются окном стека без копирования. С типом результата (не TYPE_ANY) вызов можно
+    // использовать в арифметике, VM проверяет тип возвращённого значения. Регистрировать до compile
+    // и loadBytecode; пины функция проверяет через call.checkPin, как встроенные команды
+    bool registerNative(const String& name, uint8_t arity, XenoNativeFunction function,
+                        XenoDataType result = TYPE_ANY, void* user = nullptr) {
+        return natives.add(name, arity, function, result, user);
+    }
+
     bool compile(const String& source_code);
+    // Компиляция файла порциями: память не зависит от размера скрипта.
+    // Импорты ищутся в setFileSystem, а если она не задана - в fs
+    bool compileFile(fs::FS& fs, const String& path);
+
+    // Двоичный образ байткода: loadBytecode не компилирует, а только проверяет программу,
+    // в том числе что все вызванные в ней функции хоста зарегистрированы (registerNative до загрузки)
+    bool saveBytecode(fs::FS& fs, const String& path);
+    bool loadBytecode(fs::FS& fs, const String& path);
+    // Выполнение на месте: инструкции и строки читаются из буфера (PROGMEM, mmap раздела),
+    // буфер выровнен на 4 байта и не должен меняться, пока программа загружена
+    bool loadBytecode(const uint8_t* image, size_t size);
     bool run(bool less_output = true);
+    // Выполнение квантами из loop(): не больше budget инструкций за вызов (лимит проверяется
+    // на переходах назад и CALL). DELAY и INPUT не блокируют, а возвращают статус;
+    // после XENO_HALTED программа не перезапускается до новой компиляции или загрузки.
+    // Обработчики on pin/on timer вызываются в начале кванта; XENO_WAITING_EVENT - основной код
+    // завершён и VM ждёт события (ближайший таймер в getWakeTime())
+    XenoRunStatus runFor(uint32_t budget);
+    // Горячая замена между runFor: source содержит только блоки func. Вызовы идут в новые тела
+    // со следующего CALL; глобальные переменные и стек сохраняются. Если ни одна функция не
+    // выполняется, заменённые тела удаляются и программа не растёт; иначе новые тела дописываются
+    // в конец, а прежние удаляются при следующей такой замене. Число параметров менять нельзя;
+    // только для программ, скомпилированных из исходника
+    bool updateFunctions(const String& source);
+    uint32_t getWakeTime() const { return vm->getWakeTime(); }
+    void provideInput(const String& input) { vm->provideInput(input); }
+    // Куда идёт вывод print (Serial, XenoOutputQueue и т.д.); сообщения об ошибках остаются в Serial
+    void setOutput(Print& target) { output = &target; vm->setOutput(target); }
+    // Вывод print в функцию: callback(data, length, user) получает текст блоками
+    void setOutput(XenoOutputCallback callback, void* user = nullptr);
+    // XENO_OUTPUT_DIRECT - каждый print сразу; XENO_OUTPUT_BUFFERED - кольцо строк, числа форматируются
+    // только в flushOutput (и при заполнении кольца, завершении программы, смене цели);
+    // XENO_OUTPUT_SILENT - print ничего не делает
+    void setOutputMode(XenoOutputMode mode);
+    bool setOutputBuffer(uint16_t records, uint16_t text_bytes);
+    // Полное кольцо: выгрузить целиком (по умолчанию) или отбросить новые строки
+    void setOutputOverflow(XenoOutputOverflow policy);
+    // Не больше lines строк в секунду, лишние отбрасываются; 0 - без ограничения
+    void setOutputRateLimit(uint16_t lines_per_second);
+    // Выгружает накопленные строки в цель вывода, вызывать из loop() между runFor
+    size_t flushOutput(size_t max_lines = SIZE_MAX) { return vm->flushOutput(max_lines); }
+    size_t getPendingOutput() const { return vm->getPendingOutput(); }
+    // Отброшенные строки с последней загрузки программы
+    uint32_t getDroppedOutput() const { return vm->getDroppedOutput(); }
     void step();
     void stop();
     bool isRunning() const;
     void dumpState();
     void disassemble();
     void printCompiledCode();
+    // Профиль выполнения по опкодам, адресам и строкам исходника: сборка с -DXENO_PROFILE=1,
+    // setProfiling(true) до run(); счётчики обнуляются при каждой загрузке программы
+    void setProfiling(bool enabled) { profiling = enabled; vm->setProfiling(enabled); }
+    void printProfile();
+    // Последние depth инструкций (адрес, опкод, глубина стека): сборка с -DXENO_TRACE=1, 0 - выключить.
+    // Кольцо очищается при загрузке программы и остаётся после остановки по лимиту или ошибке
+    bool setTracing(uint16_t depth);
+    // До max записей от старых к новым; возвращает их число
+    size_t getTrace(XenoTraceEntry* out, size_t max) const;
+    void printTrace();
+    // Счётчики с последней загрузки программы: недорогой опрос из loop(), например для отправки по MQTT
+    XenoMetrics getMetrics() const { return vm->getMetrics(); }
+
+    // Куча строк времени выполнения (строки программы не учитываются)
+    uint16_t getStringHeapCount() const { return vm->getStringHeapCount(); }
+    uint32_t getStringHeapBytes() const { return vm->getStringHeapBytes(); }
+    // Выполненные инструкции с последней загрузки программы
+    uint32_t getInstructionCount() const { return vm->getInstructionCount(); }
+    // Память элементов живых массивов; недостижимые массивы освобождаются сборкой
+    uint32_t getArrayMemoryUsed() const { return vm->getArrayBytes(); }
 
     bool compile_and_run(const String& source_code, bool less_output = true);
 
     bool setMaxInstructions(uint32_t max_instr);
 
+    // Оптимизация байткода: 0 - выключена, 1 - свёртка констант и переходов,
+    // 2 - дополнительно суперинструкции. Применяется при следующей компиляции.
+    bool setOptimizationLevel(uint8_t level);
+    uint8_t getOptimizationLevel() const { return optimization_level; }
+
     const XenoSecurityConfig& getSecurityConfig() const;
 
     bool setStringLimit(uint16_t length);
@@ -70,6 +173,8 @@ class XenoLanguage {
     bool setLoopDepth(uint16_t depth);
     bool setIfDepth(uint16_t depth);
     bool setStackSize(uint16_t size);
+    bool setCallDepth(uint16_t depth) { return security_config.setMaxCallDepth(depth); }
+    bool setArrayMemoryLimit(uint32_t bytes) { return security_config.setMaxArrayMemory(bytes); }
     bool setAllowedPins(const std::vector<uint8_t>& pins);
     bool addAllowedPin(uint8_t pin);
     bool removeAllowedPin(uint8_t pin);
@@ -77,6 +182,11 @@ class XenoLanguage {
     // Новые методы для настройки импорта
     bool setImportDepth(uint16_t depth) { return security_config.setMaxImportDepth(depth); }
     bool setImportCount(uint16_t count) { return security_config.setMaxImportCount(count); }
+    // Кеш импорта: неизменённый модуль (по хешу исходника и контексту) не разбирается повторно
+    void setImportCache(bool enabled) { import_cache.enabled = enabled; if (!enabled) import_cache.clear(); }
+    void clearImportCache() { import_cache.clear(); }
+    uint32_t getImportCacheHits() const { return import_cache.hits; }
+    uint32_t getImportCacheMisses() const { return import_cache.misses; }
 
     bool validateSecurityConfig() const;
 
@@ -88,7 +198,9 @@ class XenoLanguage {
     uint16_t getMaxLoopDepth() const { return security_config.getMaxLoopDepth(); }
     uint16_t getMaxIfDepth() const { return security_config.getMaxIfDepth(); }
     uint16_t getMaxStackSize() const { return security_config.getMaxStackSize(); }
+    uint16_t getMaxCallDepth() const { return security_config.getMaxCallDepth(); }
     uint32_t getCurrentMaxInstructions() const { return security_config.getCurrentMaxInstructions(); }
+    uint32_t getMaxArrayMemory() const { return security_config.getMaxArrayMemory(); }
     const std::vector<uint8_t>& getAllowedPins() const { return security_config.getAllowedPins(); }
     uint16_t getMaxImportDepth() const { return security_config.getMaxImportDepth(); }
     uint16_t getMaxImportCount() const { return security_config.getMaxImportCount(); }
@@ -105,8 +217,12 @@ class XenoLanguage {
     static constexpr uint16_t getMaxIfDepthLimit() { return XenoSecurityConfig::getMaxIfDepthLimit(); }
     static constexpr uint16_t getMinStackSize() { return XenoSecurityConfig::getMinStackSize(); }
     static constexpr uint16_t getMaxStackSizeLimit() { return XenoSecurityConfig::getMaxStackSizeLimit(); }
+    static constexpr uint16_t getMinCallDepth() { return XenoSecurityConfig::getMinCallDepth(); }
+    static constexpr uint16_t getMaxCallDepthLimit() { return XenoSecurityConfig::getMaxCallDepthLimit(); }
     static constexpr uint32_t getMinInstructionsLimit() { return XenoSecurityConfig::getMinInstructionsLimit(); }
     static constexpr uint32_t getMaxInstructionsLimitValue() { return XenoSecurityConfig::getMaxInstructionsLimitValue(); }
+    static constexpr uint32_t getMinArrayMemory() { return XenoSecurityConfig::getMinArrayMemory(); }
+    static constexpr uint32_t getMaxArrayMemoryLimit() { return XenoSecurityConfig::getMaxArrayMemoryLimit(); }
     static constexpr uint8_t getMinPinNumber() { return XenoSecurityConfig::getMinPinNumber(); }
     static constexpr uint8_t getMaxPinNumber() { return XenoSecurityConfig::getMaxPinNumber(); }
     static constexpr uint16_t getMinImportDepth() { return XenoSecurityConfig::getMinImportDepth(); }
@@ -14,9 +14,14 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <map>
+#include <utility>
 #include <vector>
 #include "xeno_debug_tools.h"
 
+// Без XENO_FEATURE_DEBUG остаются только имена опкодов для профилировщика и трассировки
+#if XENO_FEATURE_DEBUG
 void Debugger::disassemble(const std::vector<XenoInstruction>& instructions,
                         const std::vector<String>& string_table,
                         const String& title,
@@ -77,13 +82,11 @@ void Debugger::printInstruction(size_t index, const XenoInstruction& instr,
         case OP_OR:  mnemonic = "OR"; break;
         case OP_NOT: mnemonic = "NOT"; break;
         case OP_NEG: mnemonic = "NEG"; break;
-        case OP_ARRAY_NEW: mnemonic = "ARRAY_NEW"; break;
         case OP_ARRAY_GET: mnemonic = "ARRAY_GET"; break;
         case OP_ARRAY_SET: mnemonic = "ARRAY_SET"; break;
         case OP_ARRAY_LEN: mnemonic = "ARRAY_LEN"; break;
         case OP_ANALOG_READ: mnemonic = "ANALOG_READ"; break;
         case OP_DIGITAL_READ: mnemonic = "DIGITAL_READ"; break;
-        case OP_CALL: mnemonic = "CALL"; break;
         case OP_RETURN: mnemonic = "RETURN"; break;
 
         // OP_ANALOG_WRITE имеет аргументы, поэтому обрабатываем отдельно
@@ -101,6 +104,40 @@ void Debugger::printInstruction(size_t index, const XenoInstruction& instr,
             hasArg = true;
             break;
 
+        case OP_DIGITAL_READ_PINS:
+        case OP_DIGITAL_WRITE_PINS:
+        case OP_ANALOG_READ_PINS:
+            Serial.print(opcodeName(instr.opcode));
+            Serial.print(" pins=");
+            for (uint32_t rest = instr.arg1, first = 1; rest != 0; rest &= rest - 1, first = 0) {
+                if (!first) Serial.print(",");
+                Serial.print(pinGroupBank(instr.arg2) * 32 + __builtin_ctz(rest));
+            }
+            if (instr.opcode == OP_ANALOG_READ_PINS) {
+                Serial.print(" samples=");
+                Serial.print(pinGroupSamples(instr.arg2));
+            }
+            hasArg = true;
+            break;
+
+        case OP_EVENT_BIND:
+            Serial.print("EVENT_BIND ");
+            if (eventKind(instr.arg1) == XENO_EVENT_TIMER) {
+                Serial.print("timer=");
+                Serial.print(eventPeriod(instr.arg1));
+                Serial.print("ms");
+            } else {
+                static const char* const edges[] = { "change", "rising", "falling" };
+                Serial.print("pin=");
+                Serial.print(eventPin(instr.arg1));
+                Serial.print(" ");
+                Serial.print(eventEdge(instr.arg1) <= XENO_EDGE_FALLING ? edges[eventEdge(instr.arg1)] : "?");
+            }
+            Serial.print(" func #");
+            Serial.print(instr.arg2);
+            hasArg = true;
+            break;
+
         case OP_LED_ON:
             Serial.print("LED_ON pin=");
             Serial.print(instr.arg1);
@@ -155,13 +192,88 @@ void Debugger::printInstruction(size_t index, const XenoInstruction& instr,
 
         case OP_STORE:
             Serial.print("STORE ");
-            printStringArg(instr.arg1, string_table, false);
+            printStringArg(instr.arg2, string_table, false);
             hasArg = true;
             break;
 
         case OP_LOAD:
             Serial.print("LOAD ");
-            printStringArg(instr.arg1, string_table, false);
+            printStringArg(instr.arg2, string_table, false);
+            hasArg = true;
+            break;
+
+        case OP_STORE_LOCAL:
+            Serial.print("STORE_LOCAL ");
+            printStringArg(instr.arg2, string_table, false);
+            Serial.print(" #");
+            Serial.print(instr.arg1);
+            hasArg = true;
+            break;
+
+        case OP_LOAD_LOCAL:
+            Serial.print("LOAD_LOCAL ");
+            printStringArg(instr.arg2, string_table, false);
+            Serial.print(" #");
+            Serial.print(instr.arg1);
+            hasArg = true;
+            break;
+
+        case OP_CMP_JUMP_GLOBAL:
+        case OP_CMP_JUMP_LOCAL:
+        case OP_INC_JUMP_GLOBAL:
+        case OP_INC_JUMP_LOCAL:
+        case OP_LOOP_JUMP_GLOBAL:
+        case OP_LOOP_JUMP_LOCAL: {
+            static const char* const compare_names[] = {"EQ", "NEQ", "LT", "GT", "LTE", "GTE"};
+            uint8_t compare_op = slotCompareOp(instr.arg1);
+            bool jumps_on_true = (instr.opcode != OP_CMP_JUMP_GLOBAL && instr.opcode != OP_CMP_JUMP_LOCAL);
+            Serial.print(opcodeName(instr.opcode));
+            Serial.print(" #");
+            Serial.print(slotCompareSlot(instr.arg1));
+            Serial.print(" ");
+            Serial.print(compare_op <= OP_GTE ? compare_names[compare_op - OP_EQ] : "?");
+            Serial.print(" ");
+            Serial.print(slotCompareImm(instr.arg1));
+            Serial.print(jumps_on_true ? ", true -> " : ", false -> ");
+            Serial.print(instr.arg2);
+            hasArg = true;
+            break;
+        }
+
+        case OP_CALL:
+            Serial.print("CALL ");
+            printStringArg(instr.arg2, string_table, false);
+            Serial.print(" #");
+            Serial.print(instr.arg1);
+            hasArg = true;
+            break;
+
+        case OP_CALL_NATIVE:
+            Serial.print("CALL_NATIVE ");
+            printStringArg(instr.arg2, string_table, false);
+            Serial.print(" #");
+            Serial.print(nativeCallIndex(instr.arg1));
+            Serial.print(" /");
+            Serial.print(nativeCallArity(instr.arg1));
+            hasArg = true;
+            break;
+
+        case OP_ARRAY_NEW: {
+            static const char* const kind_names[] = {"", " int", " float", " byte"};
+            Serial.print("ARRAY_NEW");
+            Serial.print(instr.arg1 <= ARRAY_UINT8 ? kind_names[instr.arg1] : " ?");
+            hasArg = true;
+            break;
+        }
+
+        case OP_INC_GLOBAL:
+        case OP_INC_LOCAL:
+            Serial.print(instr.opcode == OP_INC_GLOBAL ? "INC_GLOBAL " : "INC_LOCAL ");
+            printStringArg(instr.arg1 >> 16, string_table, false);
+            Serial.print(" #");
+            Serial.print(instr.arg1 & 0xFFFF);
+            Serial.print(" += ");
+            Serial.print(static_cast<int16_t>(instr.arg2));
             hasArg = true;
             break;
 
@@ -178,6 +290,10 @@ void Debugger::printInstruction(size_t index, const XenoInstruction& instr,
             break;
 
         default:
+            if (isTypedOpcode(instr.opcode)) {
+                mnemonic = opcodeName(instr.opcode);
+                break;
+            }
             Serial.print("UNKNOWN ");
             Serial.print(instr.opcode);
             hasArg = true;
@@ -199,4 +315,212 @@ void Debugger::printStringArg(uint32_t arg, const std::vector<String>& string_ta
     } else {
         Serial.print("<invalid>");
     }
-}
\ No newline at end of file
+}
+#endif  // XENO_FEATURE_DEBUG
+
+#if XENO_FEATURE_DEBUG || XENO_PROFILE || XENO_TRACE
+const char* Debugger::opcodeName(uint8_t opcode) {
+    switch (opcode) {
+        case OP_NOP: return "NOP";
+        case OP_PRINT: return "PRINT";
+        case OP_LED_ON: return "LED_ON";
+        case OP_LED_OFF: return "LED_OFF";
+        case OP_DELAY: return "DELAY";
+        case OP_PUSH: return "PUSH";
+        case OP_POP: return "POP";
+        case OP_ADD: return "ADD";
+        case OP_SUB: return "SUB";
+        case OP_MUL: return "MUL";
+        case OP_DIV: return "DIV";
+        case OP_JUMP: return "JUMP";
+        case OP_JUMP_IF: return "JUMP_IF";
+        case OP_PRINT_NUM: return "PRINT_NUM";
+        case OP_STORE: return "STORE";
+        case OP_LOAD: return "LOAD";
+        case OP_MOD: return "MOD";
+        case OP_ABS: return "ABS";
+        case OP_POW: return "POW";
+        case OP_EQ: return "EQ";
+        case OP_NEQ: return "NEQ";
+        case OP_LT: return "LT";
+        case OP_GT: return "GT";
+        case OP_LTE: return "LTE";
+        case OP_GTE: return "GTE";
+        case OP_PUSH_FLOAT: return "PUSH_FLOAT";
+        case OP_PUSH_STRING: return "PUSH_STRING";
+        case OP_MAX: return "MAX";
+        case OP_MIN: return "MIN";
+        case OP_SQRT: return "SQRT";
+        case OP_INPUT: return "INPUT";
+        case OP_PUSH_BOOL: return "PUSH_BOOL";
+        case OP_SIN: return "SIN";
+        case OP_COS: return "COS";
+        case OP_TAN: return "TAN";
+        case OP_AND: return "AND";
+        case OP_OR: return "OR";
+        case OP_NOT: return "NOT";
+        case OP_NEG: return "NEG";
+        case OP_ARRAY_NEW: return "ARRAY_NEW";
+        case OP_ARRAY_GET: return "ARRAY_GET";
+        case OP_ARRAY_SET: return "ARRAY_SET";
+        case OP_ARRAY_LEN: return "ARRAY_LEN";
+        case OP_ANALOG_READ: return "ANALOG_READ";
+        case OP_ANALOG_WRITE: return "ANALOG_WRITE";
+        case OP_DIGITAL_READ: return "DIGITAL_READ";
+        case OP_CONVERT_TO_FLOAT: return "CONVERT_TO_FLOAT";
+        case OP_CALL: return "CALL";
+        case OP_CALL_NATIVE: return "CALL_NATIVE";
+        case OP_DIGITAL_READ_PINS: return "DIGITAL_READ_PINS";
+        case OP_DIGITAL_WRITE_PINS: return "DIGITAL_WRITE_PINS";
+        case OP_ANALOG_READ_PINS: return "ANALOG_READ_PINS";
+        case OP_EVENT_BIND: return "EVENT_BIND";
+        case OP_RETURN: return "RETURN";
+        case OP_LOAD_LOCAL: return "LOAD_LOCAL";
+        case OP_STORE_LOCAL: return "STORE_LOCAL";
+        case OP_INC_GLOBAL: return "INC_GLOBAL";
+        case OP_INC_LOCAL: return "INC_LOCAL";
+        case OP_CMP_JUMP_GLOBAL: return "CMP_JUMP_GLOBAL";
+        case OP_CMP_JUMP_LOCAL: return "CMP_JUMP_LOCAL";
+        case OP_INC_JUMP_GLOBAL: return "INC_JUMP_GLOBAL";
+        case OP_INC_JUMP_LOCAL: return "INC_JUMP_LOCAL";
+        case OP_LOOP_JUMP_GLOBAL: return "LOOP_JUMP_GLOBAL";
+        case OP_LOOP_JUMP_LOCAL: return "LOOP_JUMP_LOCAL";
+        case OP_ADD_INT: return "ADD_INT";
+        case OP_SUB_INT: return "SUB_INT";
+        case OP_MUL_INT: return "MUL_INT";
+        case OP_DIV_INT: return "DIV_INT";
+        case OP_MOD_INT: return "MOD_INT";
+        case OP_ADD_FLOAT: return "ADD_FLOAT";
+        case OP_SUB_FLOAT: return "SUB_FLOAT";
+        case OP_MUL_FLOAT: return "MUL_FLOAT";
+        case OP_DIV_FLOAT: return "DIV_FLOAT";
+        case OP_EQ_INT: return "EQ_INT";
+        case OP_NEQ_INT: return "NEQ_INT";
+        case OP_LT_INT: return "LT_INT";
+        case OP_GT_INT: return "GT_INT";
+        case OP_LTE_INT: return "LTE_INT";
+        case OP_GTE_INT: return "GTE_INT";
+        case OP_EQ_FLOAT: return "EQ_FLOAT";
+        case OP_NEQ_FLOAT: return "NEQ_FLOAT";
+        case OP_LT_FLOAT: return "LT_FLOAT";
+        case OP_GT_FLOAT: return "GT_FLOAT";
+        case OP_LTE_FLOAT: return "LTE_FLOAT";
+        case OP_GTE_FLOAT: return "GTE_FLOAT";
+        case OP_HALT: return "HALT";
+        default: return "UNKNOWN";
+    }
+}
+#endif  // XENO_FEATURE_DEBUG || XENO_PROFILE || XENO_TRACE
+
+#if XENO_PROFILE
+void Debugger::printProfileRow(uint32_t count, uint64_t cycles, uint64_t total) {
+    Serial.print(count);
+    Serial.print(" x, ");
+    Serial.print(static_cast<double>(cycles), 0);
+    Serial.print(" " XENO_CYCLE_UNIT " (");
+    Serial.print(total != 0 ? 100.0 * static_cast<double>(cycles) / static_cast<double>(total) : 0.0, 1);
+    Serial.print("%)");
+}
+
+void Debugger::printProfile(const XenoProfile& profile,
+                            const std::vector<XenoInstruction>& instructions,
+                            const std::vector<String>& string_table,
+                            const std::vector<uint16_t>& lines,
+                            size_t top) {
+    Serial.println("=== Profile ===");
+
+    uint32_t total_count = 0;
+    uint64_t total_cycles = 0;
+    std::vector<uint8_t> opcodes;
+    for (int op = 0; op < 256; ++op) {
+        if (profile.opcode_count[op] == 0) continue;
+        total_count += profile.opcode_count[op];
+        total_cycles += profile.opcode_cycles[op];
+        opcodes.push_back(static_cast<uint8_t>(op));
+    }
+    Serial.print("Executed: ");
+    printProfileRow(total_count, total_cycles, total_cycles);
+    Serial.println();
+    if (total_count == 0) return;
+
+    Serial.println("By opcode:");
+    std::sort(opcodes.begin(), opcodes.end(), [&profile](uint8_t a, uint8_t b) {
+        return profile.opcode_cycles[a] > profile.opcode_cycles[b];
+    });
+    for (uint8_t op : opcodes) {
+        Serial.print("  ");
+        Serial.print(opcodeName(op));
+        Serial.print(": ");
+        printProfileRow(profile.opcode_count[op], profile.opcode_cycles[op], total_cycles);
+        Serial.println();
+    }
+
+    std::vector<size_t> addresses;
+    for (size_t i = 0; i < profile.address_count.size(); ++i) {
+        if (profile.address_count[i] != 0) addresses.push_back(i);
+    }
+    std::sort(addresses.begin(), addresses.end(), [&profile](size_t a, size_t b) {
+        return profile.address_cycles[a] > profile.address_cycles[b];
+    });
+    if (addresses.size() > top) addresses.resize(top);
+
+    Serial.println("Hot addresses:");
+    for (size_t address : addresses) {
+        Serial.print("  ");
+        printProfileRow(profile.address_count[address], profile.address_cycles[address], total_cycles);
+        if (address < lines.size() && lines[address] != 0) {
+            Serial.print(" line ");
+            Serial.print(lines[address]);
+        }
+        Serial.print(" | ");
+        if (address < instructions.size()) {
+            printInstruction(address, instructions[address], string_table);
+        } else {
+            Serial.println(address);
+        }
+    }
+
+    if (lines.empty()) return;
+
+    // Строки: сумма по всем инструкциям, сгенерированным из строки
+    std::map<uint16_t, std::pair<uint32_t, uint64_t>> by_line;
+    for (size_t i = 0; i < profile.address_count.size() && i < lines.size(); ++i) {
+        if (profile.address_count[i] == 0 || lines[i] == 0) continue;
+        std::pair<uint32_t, uint64_t>& entry = by_line[lines[i]];
+        entry.first += profile.address_count[i];
+        entry.second += profile.address_cycles[i];
+    }
+    std::vector<std::pair<uint16_t, std::pair<uint32_t, uint64_t>>> hot_lines(by_line.begin(), by_line.end());
+    std::sort(hot_lines.begin(), hot_lines.end(),
+              [](const std::pair<uint16_t, std::pair<uint32_t, uint64_t>>& a,
+                 const std::pair<uint16_t, std::pair<uint32_t, uint64_t>>& b) {
+                  return a.second.second > b.second.second;
+              });
+    if (hot_lines.size() > top) hot_lines.resize(top);
+
+    Serial.println("Hot lines:");
+    for (const auto& line : hot_lines) {
+        Serial.print("  line ");
+        Serial.print(line.first);
+        Serial.print(": ");
+        printProfileRow(line.second.first, line.second.second, total_cycles);
+        Serial.println();
+    }
+}
+#endif  // XENO_PROFILE
+
+#if XENO_TRACE
+void Debugger::printTrace(const XenoTrace& trace) {
+    Serial.print("=== Trace: last ");
+    Serial.print(trace.size());
+    Serial.println(" instructions ===");
+    for (size_t i = 0; i < trace.size(); ++i) {
+        const XenoTraceEntry& entry = trace.at(i);
+        Serial.print(entry.pc);
+        Serial.print(": ");
+        Serial.print(opcodeName(entry.opcode));
+        Serial.print(" sp=");
+        Serial.println(entry.sp);
+    }
+}
+#endif  // XENO_TRACE
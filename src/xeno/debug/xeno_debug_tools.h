@@ -20,21 +20,35 @@
 
 #include <vector>
 #include "../xeno_common.h"
+#include "xeno_profile.h"
+#include "xeno_trace.h"
 
 class Debugger {
  protected:
     friend class XenoCompiler;
     friend class XenoVM;
+    friend class XenoLanguage;
     static void disassemble(const std::vector<XenoInstruction>& instructions,
                           const std::vector<String>& string_table,
                           const String& title = "Disassembly",
                           bool show_string_table = false);
+    // Отчёт профилировщика: опкоды, самые горячие адреса и строки исходника
+    // (lines может быть пустым - например, для загруженного образа)
+    static void printProfile(const XenoProfile& profile,
+                             const std::vector<XenoInstruction>& instructions,
+                             const std::vector<String>& string_table,
+                             const std::vector<uint16_t>& lines,
+                             size_t top = 10);
+    // Кольцо трассировки от старых записей к новым
+    static void printTrace(const XenoTrace& trace);
 
  private:
     static void printInstruction(size_t index, const XenoInstruction& instr,
                                const std::vector<String>& string_table);
 
     static void printStringArg(uint32_t arg, const std::vector<String>& string_table, bool quoted = true);
+    static const char* opcodeName(uint8_t opcode);
+    static void printProfileRow(uint32_t count, uint64_t cycles, uint64_t total);
 };
 
 #endif
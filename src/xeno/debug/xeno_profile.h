@@ -0,0 +1,64 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_DEBUG_XENO_PROFILE_H_
+#define SRC_XENO_DEBUG_XENO_PROFILE_H_
+
+#include <Arduino.h>
+#include <vector>
+
+// Профилировщик VM: -DXENO_PROFILE=1. Без флага замеры не компилируются в цикл VM.
+#ifndef XENO_PROFILE
+#define XENO_PROFILE 0
+#endif
+
+// Счётчик тактов процессора; на платформах без него - микросекунды
+#if defined(ARDUINO_ARCH_ESP32) || defined(ESP8266)
+inline uint32_t xenoCycleCount() { return ESP.getCycleCount(); }
+#define XENO_CYCLE_UNIT "cycles"
+#else
+inline uint32_t xenoCycleCount() { return micros(); }
+#define XENO_CYCLE_UNIT "us"
+#endif
+
+// Число выполнений и накопленное время по опкодам и по адресам байткода.
+// Время инструкции - от её выборки до выборки следующей, вместе с накладными расходами замера.
+struct XenoProfile {
+    uint32_t opcode_count[256];
+    uint64_t opcode_cycles[256];
+    std::vector<uint32_t> address_count;
+    std::vector<uint64_t> address_cycles;
+
+    void reset(size_t program_size) {
+        for (int i = 0; i < 256; ++i) {
+            opcode_count[i] = 0;
+            opcode_cycles[i] = 0;
+        }
+        address_count.assign(program_size, 0);
+        address_cycles.assign(program_size, 0);
+    }
+
+    void record(uint32_t address, uint8_t opcode, uint32_t cycles) {
+        opcode_count[opcode]++;
+        opcode_cycles[opcode] += cycles;
+        if (address < address_count.size()) {
+            address_count[address]++;
+            address_cycles[address] += cycles;
+        }
+    }
+};
+
+#endif  // SRC_XENO_DEBUG_XENO_PROFILE_H_
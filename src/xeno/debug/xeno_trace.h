@@ -0,0 +1,72 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_DEBUG_XENO_TRACE_H_
+#define SRC_XENO_DEBUG_XENO_TRACE_H_
+
+#include <Arduino.h>
+#include <vector>
+
+// Трассировка VM: -DXENO_TRACE=1. Без флага запись не компилируется в цикл VM.
+#ifndef XENO_TRACE
+#define XENO_TRACE 0
+#endif
+
+// Выполненная инструкция: адрес, опкод и глубина стека перед ней
+struct XenoTraceEntry {
+    uint32_t pc;
+    uint16_t sp;
+    uint8_t opcode;
+};
+
+// Кольцо последних инструкций: после остановки по лимиту или ошибки видно, чем была занята VM.
+// Размер - степень двойки, запись - три поля и сдвиг позиции без ветвлений по переполнению
+struct XenoTrace {
+    static const uint16_t MAX_DEPTH = 1024;
+
+    std::vector<XenoTraceEntry> entries;
+    uint32_t head = 0;                  // Куда пойдёт следующая запись
+    bool full = false;
+
+    // depth округляется вверх до степени двойки
+    explicit XenoTrace(uint16_t depth) {
+        size_t size = 1;
+        while (size < depth) size <<= 1;
+        entries.resize(size);
+    }
+
+    void reset() {
+        head = 0;
+        full = false;
+    }
+
+    void record(uint32_t pc, uint8_t opcode, uint32_t sp) {
+        XenoTraceEntry& entry = entries[head];
+        entry.pc = pc;
+        entry.sp = sp;
+        entry.opcode = opcode;
+        head = (head + 1) & (entries.size() - 1);
+        full |= head == 0;
+    }
+
+    size_t size() const { return full ? entries.size() : head; }
+    // index 0 - самая старая из сохранённых записей
+    const XenoTraceEntry& at(size_t index) const {
+        return entries[(head - size() + index) & (entries.size() - 1)];
+    }
+};
+
+#endif  // SRC_XENO_DEBUG_XENO_TRACE_H_
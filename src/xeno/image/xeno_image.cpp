@@ -0,0 +1,335 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <vector>
+#include "xeno_image.h"
+
+static const uint8_t IMAGE_MAGIC[4] = {'X', 'E', 'N', 'B'};
+
+// ------------------------------------------------------------------
+// Запись little-endian
+// ------------------------------------------------------------------
+static void putU16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+static void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    putU16(out, value & 0xFFFF);
+    putU16(out, value >> 16);
+}
+
+static void putString(std::vector<uint8_t>& out, const String& str) {
+    putU16(out, str.length());
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(str.c_str());
+    out.insert(out.end(), bytes, bytes + str.length());
+}
+
+static void patchU32(std::vector<uint8_t>& out, size_t pos, uint32_t value) {
+    out[pos] = value & 0xFF;
+    out[pos + 1] = (value >> 8) & 0xFF;
+    out[pos + 2] = (value >> 16) & 0xFF;
+    out[pos + 3] = value >> 24;
+}
+
+// ------------------------------------------------------------------
+// Чтение с проверкой границ: при выходе за буфер ok становится false
+// ------------------------------------------------------------------
+struct ImageReader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    bool ok;
+
+    bool need(size_t n) {
+        if (!ok || size - pos < n) ok = false;
+        return ok;
+    }
+    uint16_t u16() {
+        if (!need(2)) return 0;
+        uint16_t value = data[pos] | (data[pos + 1] << 8);
+        pos += 2;
+        return value;
+    }
+    uint32_t u32() {
+        uint32_t low = u16();
+        return low | (static_cast<uint32_t>(u16()) << 16);
+    }
+    String str() {
+        uint16_t length = u16();
+        String value;
+        if (!need(length)) return value;
+        value.reserve(length);
+        value.concat(reinterpret_cast<const char*>(data + pos), length);
+        pos += length;
+        return value;
+    }
+};
+
+// CRC-32 (IEEE 802.3), побитовая: образ проверяется один раз при загрузке
+uint32_t XenoImage::crc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t readU32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+const char* XenoImageView::string(uint32_t index, uint16_t& length) const {
+    const uint8_t* entry = data + readU32(reinterpret_cast<const uint8_t*>(code + code_count) + index * 4);
+    length = entry[0] | (entry[1] << 8);
+    return reinterpret_cast<const char*>(entry + 2);
+}
+
+// ------------------------------------------------------------------
+// Кодирование / декодирование
+// ------------------------------------------------------------------
+void XenoImage::encode(const std::vector<XenoInstruction>& code,
+                       const std::vector<String>& strings,
+                       const std::map<String, FunctionInfo>& functions,
+                       std::vector<uint8_t>& out) {
+    out.clear();
+    out.reserve(HEADER_SIZE + code.size() * sizeof(XenoCompactInstruction) + strings.size() * 12);
+
+    out.insert(out.end(), IMAGE_MAGIC, IMAGE_MAGIC + 4);
+    putU16(out, FORMAT_VERSION);
+    putU16(out, HEADER_SIZE);
+    putU32(out, code.size());
+    putU32(out, strings.size());
+    putU32(out, functions.size());
+    putU32(out, 0);     // размер данных (заполняется ниже)
+    putU32(out, 0);     // CRC32 данных
+    putU32(out, 0);     // резерв
+
+    for (const XenoInstruction& instr : code) {
+        out.push_back(instr.opcode);
+        out.push_back(0);
+        putU16(out, instr.arg2);
+        putU32(out, instr.arg1);
+    }
+
+    size_t offsets = out.size();
+    out.resize(offsets + strings.size() * 4);
+    for (size_t i = 0; i < strings.size(); ++i) {
+        patchU32(out, offsets + i * 4, out.size());
+        putString(out, strings[i]);
+        out.push_back(0);
+    }
+
+    for (const auto& entry : functions) {
+        const FunctionInfo& info = entry.second;
+        putU16(out, info.index);
+        putU16(out, info.arity);
+        putU32(out, info.address);
+        putString(out, info.name);
+        for (const String& param : info.parameters) {
+            putString(out, param);
+        }
+    }
+
+    size_t payload = out.size() - HEADER_SIZE;
+    patchU32(out, 20, payload);
+    patchU32(out, 24, crc32(out.data() + HEADER_SIZE, payload));
+}
+
+bool XenoImage::view(const uint8_t* data, size_t size, XenoImageView& out) {
+    if (size < HEADER_SIZE || memcmp(data, IMAGE_MAGIC, 4) != 0) {
+        Serial.println("ERROR: Not a Xeno bytecode image");
+        return false;
+    }
+
+    ImageReader header = {data, size, 4, true};
+    uint16_t version = header.u16();
+    uint16_t header_size = header.u16();
+    uint32_t code_count = header.u32();
+    uint32_t string_count = header.u32();
+    uint32_t function_count = header.u32();
+    uint32_t payload = header.u32();
+    uint32_t checksum = header.u32();
+
+    if (version != FORMAT_VERSION || header_size != HEADER_SIZE) {
+        Serial.print("ERROR: Unsupported bytecode image version ");
+        Serial.print(version);
+        Serial.print(" (expected ");
+        Serial.print(FORMAT_VERSION);
+        Serial.println(")");
+        return false;
+    }
+    if (payload != size - HEADER_SIZE || crc32(data + HEADER_SIZE, payload) != checksum) {
+        Serial.println("ERROR: Bytecode image is truncated or corrupted (checksum mismatch)");
+        return false;
+    }
+    // Инструкции читаются на месте как XenoCompactInstruction
+    if (reinterpret_cast<uintptr_t>(data) % alignof(XenoCompactInstruction) != 0) {
+        Serial.println("ERROR: Bytecode image buffer must be 4-byte aligned");
+        return false;
+    }
+    // Счётчики ограничены размером данных: каждая запись занимает хотя бы 4 байта
+    if (code_count > payload / sizeof(XenoCompactInstruction) || string_count > payload / 4 ||
+        function_count > payload / 4) {
+        Serial.println("ERROR: Bytecode image has invalid section sizes");
+        return false;
+    }
+
+    ImageReader reader = {data, size, HEADER_SIZE, true};
+    reader.need(code_count * sizeof(XenoCompactInstruction));
+    reader.pos += reader.ok ? code_count * sizeof(XenoCompactInstruction) : 0;
+
+    // Строки идут подряд сразу за таблицей смещений
+    size_t offsets = reader.pos;
+    reader.need(string_count * 4);
+    reader.pos += reader.ok ? string_count * 4 : 0;
+    for (uint32_t i = 0; i < string_count && reader.ok; ++i) {
+        if (readU32(data + offsets + i * 4) != reader.pos) {
+            reader.ok = false;
+            break;
+        }
+        uint16_t length = reader.u16();
+        if (!reader.need(length + 1) || data[reader.pos + length] != 0) {
+            reader.ok = false;
+            break;
+        }
+        reader.pos += length + 1;
+    }
+
+    std::map<String, FunctionInfo> functions;
+    std::vector<bool> seen_index(function_count, false);
+    for (uint32_t i = 0; i < function_count && reader.ok; ++i) {
+        FunctionInfo info;
+        info.index = reader.u16();
+        info.arity = reader.u16();
+        info.address = reader.u32();
+        info.name = reader.str();
+        for (int p = 0; p < info.arity && reader.ok; ++p) {
+            info.parameters.push_back(reader.str());
+        }
+        // Номера функций уникальны и плотны: VM индексирует ими таблицу
+        if (static_cast<uint32_t>(info.index) >= function_count || seen_index[info.index] ||
+            static_cast<uint32_t>(info.address) >= code_count) {
+            reader.ok = false;
+            break;
+        }
+        seen_index[info.index] = true;
+        functions[info.name] = info;
+    }
+
+    if (!reader.ok || reader.pos != size || functions.size() != function_count) {
+        Serial.println("ERROR: Bytecode image is malformed");
+        return false;
+    }
+
+    out.data = data;
+    out.size = size;
+    out.code = reinterpret_cast<const XenoCompactInstruction*>(data + HEADER_SIZE);
+    out.code_count = code_count;
+    out.string_count = string_count;
+    out.functions.swap(functions);
+    return true;
+}
+
+bool XenoImage::decode(const uint8_t* data, size_t size,
+                       std::vector<XenoInstruction>& code,
+                       std::vector<String>& strings,
+                       std::map<String, FunctionInfo>& functions) {
+    XenoImageView image;
+    if (!view(data, size, image)) {
+        return false;
+    }
+
+    code.clear();
+    code.reserve(image.code_count);
+    const uint8_t* record = data + HEADER_SIZE;
+    for (uint32_t i = 0; i < image.code_count; ++i, record += sizeof(XenoCompactInstruction)) {
+        uint16_t arg2 = record[2] | (record[3] << 8);
+        code.push_back(XenoInstruction(record[0], readU32(record + 4), arg2));
+    }
+
+    strings.clear();
+    strings.reserve(image.string_count);
+    for (uint32_t i = 0; i < image.string_count; ++i) {
+        uint16_t length;
+        const char* str = image.string(i, length);
+        String value;
+        value.reserve(length);
+        value.concat(str, length);
+        strings.push_back(value);
+    }
+
+    functions.swap(image.functions);
+    return true;
+}
+
+// ------------------------------------------------------------------
+// Файловые операции
+// ------------------------------------------------------------------
+bool XenoImage::save(fs::FS& fs, const String& path,
+                     const std::vector<XenoInstruction>& code,
+                     const std::vector<String>& strings,
+                     const std::map<String, FunctionInfo>& functions) {
+    std::vector<uint8_t> image;
+    encode(code, strings, functions, image);
+
+    File file = fs.open(path, FILE_WRITE);
+    if (!file) {
+        Serial.print("ERROR: Cannot open file for writing: ");
+        Serial.println(path);
+        return false;
+    }
+    size_t written = file.write(image.data(), image.size());
+    file.close();
+    if (written != image.size()) {
+        Serial.print("ERROR: Failed to write bytecode image: ");
+        Serial.println(path);
+        return false;
+    }
+    return true;
+}
+
+bool XenoImage::load(fs::FS& fs, const String& path,
+                     std::vector<XenoInstruction>& code,
+                     std::vector<String>& strings,
+                     std::map<String, FunctionInfo>& functions) {
+    File file = fs.open(path, FILE_READ);
+    if (!file) {
+        Serial.print("ERROR: Cannot open bytecode image: ");
+        Serial.println(path);
+        return false;
+    }
+    size_t size = file.size();
+    if (size > MAX_IMAGE_SIZE) {
+        Serial.println("ERROR: Bytecode image too large");
+        file.close();
+        return false;
+    }
+
+    std::vector<uint8_t> image(size);
+    size_t read = file.read(image.data(), size);
+    file.close();
+    if (read != size) {
+        Serial.print("ERROR: Failed to read bytecode image: ");
+        Serial.println(path);
+        return false;
+    }
+    return decode(image.data(), image.size(), code, strings, functions);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_IMAGE_XENO_IMAGE_H_
+#define SRC_XENO_IMAGE_XENO_IMAGE_H_
+
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+#include <map>
+#include "../xeno_common.h"
+
+// Двоичный образ скомпилированной программы (little-endian):
+//   заголовок HEADER_SIZE байт: "XENB", версия, размер заголовка, число инструкций,
+//   строк и функций, размер данных, CRC32 данных;
+//   инструкции по 8 байт (раскладка XenoCompactInstruction), сразу за заголовком;
+//   таблица смещений строк (u32 от начала образа), строки: u16 длина + байты + '\0';
+//   функции: u16 номер, u16 арность, u32 адрес, имя, параметры (строки без '\0').
+// Инструкции и строки можно читать прямо из образа (выполнение на месте).
+struct XenoImageView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const XenoCompactInstruction* code = nullptr;
+    uint32_t code_count = 0;
+    uint32_t string_count = 0;
+    std::map<String, FunctionInfo> functions;
+
+    // Строка пула (с завершающим '\0') и её длина
+    const char* string(uint32_t index, uint16_t& length) const;
+};
+
+class XenoImage {
+ public:
+    static const uint16_t FORMAT_VERSION = 2;
+    static const uint16_t HEADER_SIZE = 32;
+
+ protected:
+    friend class XenoLanguage;
+    friend class XenoScheduler;
+
+    static bool save(fs::FS& fs, const String& path,
+                     const std::vector<XenoInstruction>& code,
+                     const std::vector<String>& strings,
+                     const std::map<String, FunctionInfo>& functions);
+    static bool load(fs::FS& fs, const String& path,
+                     std::vector<XenoInstruction>& code,
+                     std::vector<String>& strings,
+                     std::map<String, FunctionInfo>& functions);
+
+    static void encode(const std::vector<XenoInstruction>& code,
+                       const std::vector<String>& strings,
+                       const std::map<String, FunctionInfo>& functions,
+                       std::vector<uint8_t>& out);
+    static bool decode(const uint8_t* data, size_t size,
+                       std::vector<XenoInstruction>& code,
+                       std::vector<String>& strings,
+                       std::map<String, FunctionInfo>& functions);
+    // Проверяет образ и разбирает его без копирования инструкций и строк.
+    // Буфер должен быть выровнен на 4 байта и жить, пока используется view.
+    static bool view(const uint8_t* data, size_t size, XenoImageView& out);
+
+ private:
+    static const uint32_t MAX_IMAGE_SIZE = 256 * 1024;
+
+    static uint32_t crc32(const uint8_t* data, size_t size);
+};
+
+#endif  // SRC_XENO_IMAGE_XENO_IMAGE_H_
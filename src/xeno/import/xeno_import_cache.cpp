@@ -0,0 +1,77 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "xeno_import_cache.h"
+
+XenoImportEntry* XenoImportCache::find(fs::FS* filesystem, const String& path,
+                                       uint32_t content_hash, uint32_t context_hash) {
+    for (XenoImportEntry& entry : entries) {
+        if (entry.filesystem == filesystem && entry.content_hash == content_hash &&
+            entry.context_hash == context_hash && entry.path == path) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void XenoImportCache::store(XenoImportEntry& entry) {
+    // Та же пара путь/контекст заменяется, иначе вытесняется самая старая запись
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].filesystem == entry.filesystem && entries[i].path == entry.path &&
+            entries[i].context_hash == entry.context_hash) {
+            entries.erase(entries.begin() + i);
+            break;
+        }
+    }
+    if (entries.size() >= MAX_ENTRIES) {
+        entries.erase(entries.begin());
+    }
+    entries.emplace_back();
+    std::swap(entries.back(), entry);
+}
+
+void XenoImportCache::clear() {
+    entries.clear();
+    entries.shrink_to_fit();
+    hits = 0;
+    misses = 0;
+}
+
+uint32_t XenoImportCache::hash(uint32_t seed, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        seed = (seed ^ bytes[i]) * 16777619u;
+    }
+    return seed;
+}
+
+uint32_t XenoImportCache::hashFile(File& file) {
+    uint8_t chunk[128];
+    uint32_t result = HASH_SEED;
+    size_t count;
+    while ((count = file.read(chunk, sizeof(chunk))) > 0) {
+        result = hash(result, chunk, count);
+    }
+    return result;
+}
+
+bool XenoImportCache::hashFile(fs::FS& fs, const String& path, uint32_t& out) {
+    File file = fs.open(path, "r");
+    if (!file) return false;
+    out = hashFile(file);
+    file.close();
+    return true;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_IMPORT_XENO_IMPORT_CACHE_H_
+#define SRC_XENO_IMPORT_XENO_IMPORT_CACHE_H_
+
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+#include <map>
+#include <utility>
+#include "../xeno_common.h"
+
+// Скомпилированный модуль импорта. Операнды переносимые: строки и глобальные переменные
+// пронумерованы в порядке первого использования внутри модуля, переходы - от начала фрагмента.
+// При повторном импорте фрагмент перелинковывается в текущую программу без разбора исходника.
+struct XenoImportEntry {
+    fs::FS* filesystem = nullptr;
+    String path;
+    uint32_t content_hash = 0;                          // Хеш исходника модуля
+    uint32_t context_hash = 0;                          // Хеш состояния компилятора перед импортом
+    std::vector<std::pair<String, uint32_t>> dependencies;  // Вложенные импорты и хеши их исходников
+    std::vector<XenoInstruction> code;                  // Основной код модуля
+    std::vector<XenoInstruction> function_code;         // Тела функций модуля
+    std::vector<String> strings;
+    std::vector<String> globals;
+    std::vector<FunctionInfo> functions;                // Объявленные функции, адрес от начала function_code
+    std::map<String, XenoValue> variables;              // Добавленные или изменённые переменные
+    std::vector<String> removed_variables;
+    std::vector<String> arrays;
+    std::vector<String> imports;                        // Вложенные импорты по порядку
+    uint16_t nested_depth = 0;                          // Глубина вложенных импортов
+};
+
+class XenoImportCache {
+ public:
+    static const size_t MAX_ENTRIES = 16;
+
+ protected:
+    friend class XenoCompiler;
+    friend class XenoLanguage;
+
+    std::vector<XenoImportEntry> entries;
+    bool enabled = true;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+
+    XenoImportEntry* find(fs::FS* filesystem, const String& path, uint32_t content_hash, uint32_t context_hash);
+    void store(XenoImportEntry& entry);
+    void clear();
+
+    // FNV-1a: ключ кеша, а не защита от подделки
+    static uint32_t hash(uint32_t seed, const void* data, size_t size);
+    static uint32_t hash(uint32_t seed, const String& str) { return hash(seed, str.c_str(), str.length() + 1); }
+    static uint32_t hashFile(File& file);
+    static bool hashFile(fs::FS& fs, const String& path, uint32_t& out);
+
+    static const uint32_t HASH_SEED = 2166136261u;
+};
+
+#endif  // SRC_XENO_IMPORT_XENO_IMPORT_CACHE_H_
@@ -17,35 +17,41 @@
 #include <stack>
 #include <algorithm>
 #include <vector>
+#include <limits>
 #include "xeno_compiler.h"
 #include "../debug/xeno_debug_tools.h"
+#include "../optimizer/xeno_optimizer.h"
 
 const XenoCompiler::MathFunctionInfo XenoCompiler::math_functions[] = {
     {"abs(", '[', ']', OP_ABS, 1},
     {"max(", '{', '}', OP_MAX, 2},
     {"min(", '|', '|', OP_MIN, 2},
+#if XENO_FEATURE_MATH
     {"sqrt(", '~', '~', OP_SQRT, 1},
     {"sin(", '#', '#', OP_SIN, 1},
     {"cos(", '@', '@', OP_COS, 1},
     {"tan(", '&', '&', OP_TAN, 1}
+#endif
 };
 
 const size_t XenoCompiler::math_functions_count = sizeof(math_functions) / sizeof(math_functions[0]);
 
 const XenoCompiler::SimpleCommand XenoCompiler::simple_commands[] = {
-    {"pop", OP_POP},
-    {"add", OP_ADD},
-    {"sub", OP_SUB},
-    {"mul", OP_MUL},
-    {"div", OP_DIV},
-    {"mod", OP_MOD},
-    {"abs", OP_ABS},
-    {"pow", OP_POW},
-    {"max", OP_MAX},
-    {"min", OP_MIN},
-    {"sqrt", OP_SQRT},
-    {"printnum", OP_PRINT_NUM},
-    {"halt", OP_HALT}
+    {KW_POP, OP_POP},
+    {KW_ADD, OP_ADD},
+    {KW_SUB, OP_SUB},
+    {KW_MUL, OP_MUL},
+    {KW_DIV, OP_DIV},
+    {KW_MOD, OP_MOD},
+    {KW_ABS, OP_ABS},
+    {KW_MAX, OP_MAX},
+    {KW_MIN, OP_MIN},
+#if XENO_FEATURE_MATH
+    {KW_POW, OP_POW},
+    {KW_SQRT, OP_SQRT},
+#endif
+    {KW_PRINTNUM, OP_PRINT_NUM},
+    {KW_HALT, OP_HALT}
 };
 
 const size_t XenoCompiler::simple_commands_count = sizeof(simple_commands) / sizeof(simple_commands[0]);
@@ -53,6 +59,11 @@ const size_t XenoCompiler::simple_commands_count = sizeof(simple_commands) / siz
 // ------------------------------------------------------------------
 // Вспомогательные функции для проверки типов (без изменений)
 // ------------------------------------------------------------------
+// Сравнение среза с литералом без создания String
+static inline bool textIs(const char* text, size_t length, const char* literal) {
+    return strlen(literal) == length && memcmp(text, literal, length) == 0;
+}
+
 static inline bool isNumericType(XenoDataType t) {
     return t == TYPE_INT || t == TYPE_FLOAT;
 }
@@ -148,12 +159,34 @@ static XenoDataType getUnaryResultType(XenoDataType operand, uint8_t opcode) {
     }
 }
 
+// Оба операнда одного числового типа - опкод без разбора типов в VM
+static uint8_t typedOpcode(uint8_t opcode, XenoDataType left, XenoDataType right) {
+    uint8_t typed = OP_NOP;
+    if (left == TYPE_INT && right == TYPE_INT) {
+        typed = intOpcodeFor(opcode);
+    } else if (left == TYPE_FLOAT && right == TYPE_FLOAT) {
+        typed = floatOpcodeFor(opcode);
+    }
+    return typed != OP_NOP ? typed : opcode;
+}
+
+// Сдвигает адреса переходов в code[from..] на delta (код перенесён в другой буфер)
+static void relocateJumps(std::vector<XenoInstruction>& code, size_t from, uint32_t delta) {
+    for (size_t i = from; i < code.size(); ++i) {
+        if (isJumpOpcode(code[i].opcode)) {
+            setJumpTarget(code[i], getJumpTarget(code[i]) + delta);
+        }
+    }
+}
+
 // ------------------------------------------------------------------
 // Реализация методов компилятора
 // ------------------------------------------------------------------
 
-XenoCompiler::XenoCompiler(XenoSecurityConfig& config)
-    : security_config(config), security(config), compile_error(false) {
+XenoCompiler::XenoCompiler(XenoSecurityConfig& config, XenoArena* arena)
+    : arena(arena), if_chain_stack(arena), loop_stack(arena), while_stack(arena),
+      security_config(config), security(config), compile_error(false),
+      optimization_level(1), unoptimized_size(0) {
     bytecode.reserve(128);
     string_table.reserve(32);
     if_chain_stack.reserve(security_config.getMaxIfDepth());
@@ -164,35 +197,88 @@ XenoCompiler::XenoCompiler(XenoSecurityConfig& config)
     function_param_names.clear();
     filesystem = nullptr;
     import_depth = 0;
+    import_cache = nullptr;
+    natives = nullptr;
+    patchable = false;
+    patching = false;
+    patch_pending = false;
+    token_text_capacity = 0;
+    compile_start_us = 0;
+    compile_time_us = 0;
+    compiled_lines = 0;
+    lexed_tokens = 0;
+    frontend_allocations = 0;
 }
 
 // ---- Публичный compile: сбрасывает состояние и запускает компиляцию ----
 void XenoCompiler::compile(const String& source_code) {
+    resetState();
+    {
+        XenoArenaScope temporaries(arena);
+        compileStringInternal(source_code);
+        finishCompile();
+        releaseTemporaries();
+    }
+    patchable = true;
+}
+
+// ---- Потоковая компиляция: исходник читается порциями, целиком в памяти не хранится ----
+void XenoCompiler::compileStream(Stream& input) {
+    resetState();
+    {
+        XenoArenaScope temporaries(arena);
+        compileStreamInternal(input);
+        finishCompile();
+        releaseTemporaries();
+    }
+    patchable = true;
+}
+
+void XenoCompiler::releaseTemporaries() {
+    if_chain_stack.clear();
+    loop_stack.clear();
+    while_stack.clear();
+}
+
+void XenoCompiler::resetState() {
     bytecode.clear();
     string_table.clear();
+    string_index.clear();
     variable_map.clear();
+    global_slots.clear();
     is_array.clear();
     if_chain_stack.clear();
     loop_stack.clear();
     while_stack.clear();
     functions.clear();
+    body_starts.clear();
     function_code.clear();
     current_function_code.clear();
     function_param_names.clear();
     inside_function_declaration = false;
     current_output = &bytecode;
+    current_line = 0;
     compile_error = false;
     imported_files.clear();    // очищаем список импортированных при новой компиляции
+    import_recordings.clear();
     import_depth = 0;
+    unoptimized_size = 0;
+    compile_start_us = micros();
+    compile_time_us = 0;
+    compiled_lines = 0;
+    lexed_tokens = 0;
+    frontend_allocations = 0;
+}
 
-    compileStringInternal(source_code);
-
+void XenoCompiler::finishCompile() {
     if (compile_error) {
+        compile_time_us = micros() - compile_start_us;
         Serial.println("Compilation aborted due to errors.");
         return;
     }
 
     if (inside_function_declaration) {
+        compile_time_us = micros() - compile_start_us;
         Serial.println("ERROR: Missing ENDFUNC for function");
         compile_error = true;
         return;
@@ -207,35 +293,232 @@ void XenoCompiler::compile(const String& source_code) {
     if (!function_code.empty()) {
         size_t main_size = bytecode.size();
         bytecode.insert(bytecode.end(), function_code.begin(), function_code.end());
+        relocateJumps(bytecode, main_size, main_size);
         for (auto& entry : functions) {
             FunctionInfo& info = entry.second;
             info.address += main_size;
         }
     }
+
+    unoptimized_size = bytecode.size();
+    XenoOptimizer::optimize(bytecode, functions, optimization_level);
+    recordBodyStarts(functions);
+    compile_time_us = micros() - compile_start_us;
+}
+
+void XenoCompiler::recordBodyStarts(const std::map<String, FunctionInfo>& bodies) {
+    for (const auto& entry : bodies) {
+        body_starts.push_back(entry.second.address);
+    }
+    std::sort(body_starts.begin(), body_starts.end());
+    body_starts.erase(std::unique(body_starts.begin(), body_starts.end()), body_starts.end());
+}
+
+void XenoCompiler::adoptProgram(std::vector<XenoInstruction>& code, std::vector<String>& strings,
+                                std::map<String, FunctionInfo>& funcs) {
+    bytecode.swap(code);
+    string_table.swap(strings);
+    rebuildStringIndex();
+    functions.swap(funcs);
+    compile_error = false;
+    patchable = false;              // Слоты и типы глобальных в образе не сохраняются
+    unoptimized_size = bytecode.size();
+    compile_time_us = 0;
+    compiled_lines = 0;
+    lexed_tokens = 0;
+    frontend_allocations = 0;
+}
+
+// ---- Горячая замена функций ----
+bool XenoCompiler::compileFunctions(const String& source) {
+    if (!canPatch() || patch_pending) {
+        Serial.println("ERROR: No compiled program to update");
+        return false;
+    }
+    patch_snapshot = PatchSnapshot{bytecode.size(), {}, body_starts, string_table, variable_map, global_slots,
+                                   is_array, functions};
+    patch_pending = true;
+
+    patching = true;
+    patched_functions.clear();
+    function_code.clear();
+    current_function_code.clear();
+    function_param_names.clear();
+    inside_function_declaration = false;
+    current_output = &bytecode;
+    compile_start_us = micros();
+    compiled_lines = 0;
+    lexed_tokens = 0;
+    frontend_allocations = 0;
+
+    {
+        XenoArenaScope temporaries(arena);
+        compileStringInternal(source);
+        releaseTemporaries();
+    }
+    patching = false;
+    if (!compile_error && inside_function_declaration) {
+        Serial.println("ERROR: Missing ENDFUNC for function");
+        compile_error = true;
+    }
+    if (compile_error || patched_functions.empty()) {
+        if (!compile_error) Serial.println("ERROR: No functions to update");
+        rollbackFunctions();
+        return false;
+    }
+
+    // Тела оптимизируются отдельно: основной код и прежние тела уже исполняются в VM
+    std::map<String, FunctionInfo> patched;
+    for (const String& name : patched_functions) {
+        patched[name] = functions[name];
+    }
+    XenoOptimizer::optimize(function_code, patched, optimization_level);
+    const size_t base = bytecode.size();
+    bytecode.insert(bytecode.end(), function_code.begin(), function_code.end());
+    relocateJumps(bytecode, base, base);
+    for (auto& entry : patched) {
+        entry.second.address += base;
+        functions[entry.first].address = entry.second.address;
+    }
+    recordBodyStarts(patched);
+    function_code.clear();
+    compile_time_us = micros() - compile_start_us;
+    return true;
+}
+
+size_t XenoCompiler::compactFunctions() {
+    const size_t main_size = body_starts.empty() ? bytecode.size() : body_starts.front();
+    std::vector<FunctionInfo*> live;
+    live.reserve(functions.size());
+    for (auto& entry : functions) {
+        live.push_back(&entry.second);
+    }
+    std::sort(live.begin(), live.end(), [](const FunctionInfo* a, const FunctionInfo* b) {
+        return a->address < b->address;
+    });
+
+    std::vector<XenoInstruction> code(bytecode.begin(), bytecode.begin() + main_size);
+    std::vector<uint32_t> starts;
+    starts.reserve(live.size());
+    for (FunctionInfo* info : live) {
+        const uint32_t from = info->address;
+        auto next = std::upper_bound(body_starts.begin(), body_starts.end(), from);
+        const size_t end = next == body_starts.end() ? bytecode.size() : *next;
+        const uint32_t to = code.size();
+        code.insert(code.end(), bytecode.begin() + from, bytecode.begin() + end);
+        relocateJumps(code, to, to - from);     // По модулю 2^32: тело может сдвинуться назад
+        info->address = to;
+        starts.push_back(to);
+    }
+
+    // Прежний байткод нужен rollbackFunctions, если VM отвергнет замену
+    if (patch_pending) {
+        patch_snapshot.code.swap(bytecode);
+    }
+    bytecode.swap(code);
+    body_starts.swap(starts);
+    return main_size;
+}
+
+void XenoCompiler::commitFunctions() {
+    patch_snapshot = PatchSnapshot();
+    patch_pending = false;
+}
+
+void XenoCompiler::rollbackFunctions() {
+    if (!patch_pending) return;
+    if (!patch_snapshot.code.empty()) {
+        bytecode.swap(patch_snapshot.code);
+    }
+    bytecode.resize(patch_snapshot.code_size);
+    body_starts.swap(patch_snapshot.body_starts);
+    string_table.swap(patch_snapshot.string_table);
+    rebuildStringIndex();
+    variable_map.swap(patch_snapshot.variable_map);
+    global_slots.swap(patch_snapshot.global_slots);
+    is_array.swap(patch_snapshot.is_array);
+    functions.swap(patch_snapshot.functions);
+    function_code.clear();
+    current_function_code.clear();
+    inside_function_declaration = false;
+    current_output = &bytecode;
+    if_chain_stack.clear();
+    loop_stack.clear();
+    while_stack.clear();
+    compile_error = false;
+    commitFunctions();
 }
 
 // ---- Внутренний метод: компилирует строку без сброса глобального состояния ----
 void XenoCompiler::compileStringInternal(const String& source_code, int line_offset) {
     int line_number = 0 + line_offset;
-    int startPos = 0;
-    int endPos = source_code.indexOf('\n');
+    const char* source = source_code.c_str();
+    size_t length = source_code.length();
+    String line;                    // Один буфер на все строки вместо substring на каждую
+    line.reserve(64);
 
-    while (endPos >= 0) {
-        String line = source_code.substring(startPos, endPos);
+    size_t start = 0;
+    while (start <= length) {
+        const char* newline = static_cast<const char*>(memchr(source + start, '\n', length - start));
+        size_t end = newline ? newline - source : length;
         ++line_number;
-        if (!line.isEmpty()) {
+        if (end > start) {
+            line = "";
+            line.concat(source + start, end - start);
             compileLine(line, line_number);
             if (compile_error) {
                 return;
             }
         }
-        startPos = endPos + 1;
-        endPos = source_code.indexOf('\n', startPos);
+        if (!newline) break;
+        start = end + 1;
+    }
+}
+
+// ---- Внутренний метод: компилирует поток построчно, буфер фиксированного размера ----
+void XenoCompiler::compileStreamInternal(Stream& input, int line_offset) {
+    int line_number = 0 + line_offset;
+    char chunk[STREAM_CHUNK_SIZE];
+    String line;
+    line.reserve(64);
+    bool line_overflow = false;
+
+    size_t count;
+    while ((count = input.readBytes(chunk, sizeof(chunk))) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (chunk[i] != '\n') {
+                if (line.length() < MAX_SOURCE_LINE_LENGTH) {
+                    line += chunk[i];
+                } else {
+                    line_overflow = true;
+                }
+                continue;
+            }
+            ++line_number;
+            if (line_overflow) {
+                Serial.print("ERROR: Line too long at line ");
+                Serial.println(line_number);
+                compile_error = true;
+                return;
+            }
+            if (!line.isEmpty()) {
+                compileLine(line, line_number);
+                if (compile_error) {
+                    return;
+                }
+            }
+            line = "";
+        }
     }
 
-    String lastLine = source_code.substring(startPos);
-    if (!lastLine.isEmpty()) {
-        compileLine(lastLine, ++line_number);
+    if (line_overflow) {
+        Serial.print("ERROR: Line too long at line ");
+        Serial.println(line_number + 1);
+        compile_error = true;
+        return;
+    }
+    if (!line.isEmpty()) {
+        compileLine(line, ++line_number);
     }
 }
 
@@ -288,11 +571,8 @@ void XenoCompiler::handleImport(const String& args, int line_number) {
     }
 
     // Проверяем, не импортирован ли уже этот файл
-    for (const String& f : imported_files) {
-        if (f == filename) {
-            // Уже импортирован, пропускаем
-            return;
-        }
+    if (imported_files.count(filename) > 0) {
+        return;
     }
 
     // Открываем файл
@@ -304,35 +584,359 @@ void XenoCompiler::handleImport(const String& args, int line_number) {
         return;
     }
 
-    // Читаем содержимое
-    String content;
-    while (file.available()) {
-        content += (char)file.read();
-    }
-    file.close();
-
-    if (content.isEmpty()) {
+    if (file.available() <= 0) {
+        file.close();
         Serial.print("ERROR: Imported file is empty: ");
         Serial.println(filename);
         compile_error = true;
         return;
     }
 
+    // Неизменённый модуль в том же контексте перелинковывается из кеша без разбора
+    bool use_cache = import_cache != nullptr && import_cache->enabled;
+    bool cacheable = use_cache && importCacheable();
+    uint32_t content_hash = 0;
+    uint32_t context_hash = 0;
+    if (use_cache) {
+        content_hash = XenoImportCache::hashFile(file);
+        file.seek(0);
+    }
+    if (cacheable) {
+        context_hash = importContextHash();
+        const XenoImportEntry* entry = import_cache->find(filesystem, filename, content_hash, context_hash);
+        if (entry != nullptr && importDependenciesCurrent(*entry) && linkImport(*entry)) {
+            file.close();
+            noteImport(filename, content_hash, entry);
+            imported_files.insert(filename);
+            ++import_cache->hits;
+            return;
+        }
+        ++import_cache->misses;
+    }
+    if (use_cache) {
+        noteImport(filename, content_hash, nullptr);
+    }
+
     // Добавляем в список импортированных
-    imported_files.push_back(filename);
+    imported_files.insert(filename);
     import_depth++;
 
-    // Рекурсивно компилируем содержимое
-    compileStringInternal(content, line_number);
+    ImportRecording recording;
+    if (cacheable) {
+        recording.entry.filesystem = filesystem;
+        recording.entry.path = filename;
+        recording.entry.content_hash = content_hash;
+        recording.entry.context_hash = context_hash;
+        recording.variables_before = variable_map;
+        recording.arrays_before = is_array;
+        recording.code_start = bytecode.size();
+        recording.function_start = function_code.size();
+        recording.base_depth = import_depth;
+        import_recordings.push_back(&recording);
+    }
+    for (ImportRecording* rec : import_recordings) {
+        rec->entry.nested_depth = std::max<uint16_t>(rec->entry.nested_depth, import_depth - rec->base_depth);
+    }
+
+    // Рекурсивно компилируем содержимое, читая файл порциями
+    compileStreamInternal(file, line_number);
+    file.close();
 
     import_depth--;
 
+    if (cacheable) {
+        import_recordings.pop_back();
+        finishImportRecording(recording);
+    }
+
     if (compile_error) {
         Serial.print("ERROR: Compilation error in imported file: ");
         Serial.println(filename);
     }
 }
 
+// ------------------------------------------------------------------
+// Кеш импорта
+// ------------------------------------------------------------------
+
+// Какой аргумент инструкции - индекс строки, какой - слот глобальной (0 - нет)
+static void linkOperands(uint8_t opcode, uint8_t& string_arg, uint8_t& slot_arg) {
+    string_arg = 0;
+    slot_arg = 0;
+    switch (opcode) {
+        case OP_PRINT: case OP_PUSH_STRING:
+            string_arg = 1;
+            break;
+        case OP_INPUT:
+            string_arg = 1;
+            slot_arg = 2;
+            break;
+        case OP_LOAD: case OP_STORE:
+            slot_arg = 1;
+            string_arg = 2;
+            break;
+        case OP_LOAD_LOCAL: case OP_STORE_LOCAL: case OP_CALL: case OP_CALL_NATIVE:
+            string_arg = 2;
+            break;
+        case OP_INC_GLOBAL: case OP_CMP_JUMP_GLOBAL: case OP_INC_JUMP_GLOBAL: case OP_LOOP_JUMP_GLOBAL:
+            slot_arg = 1;
+            break;
+    }
+}
+
+// Переводит индексы строк и слоты инструкции по таблицам (-1 - нет соответствия)
+static bool remapOperands(XenoInstruction& instr, const std::vector<int>& strings, const std::vector<int>& slots) {
+    uint8_t string_arg, slot_arg;
+    linkOperands(instr.opcode, string_arg, slot_arg);
+
+    if (string_arg != 0) {
+        uint32_t index = (string_arg == 1) ? instr.arg1 : instr.arg2;
+        if (index >= strings.size() || strings[index] < 0) return false;
+        if (string_arg == 1) {
+            instr.arg1 = strings[index];
+        } else {
+            instr.arg2 = strings[index];
+        }
+    }
+
+    if (slot_arg != 0) {
+        bool packed = isSlotCompareJump(instr.opcode);
+        uint32_t slot = (slot_arg == 2) ? instr.arg2 : (packed ? slotCompareSlot(instr.arg1) : instr.arg1);
+        if (slot >= slots.size() || slots[slot] < 0) return false;
+        uint32_t mapped = slots[slot];
+        if (packed) {
+            // Слитые сравнения адресуют только первые слоты
+            if (mapped > XENO_MAX_COMPARE_SLOT) return false;
+            instr.arg1 = (instr.arg1 & ~static_cast<uint32_t>(XENO_MAX_COMPARE_SLOT)) | mapped;
+        } else if (slot_arg == 1) {
+            instr.arg1 = mapped;
+        } else {
+            instr.arg2 = mapped;
+        }
+    }
+    return true;
+}
+
+// Сдвигает переходы фрагмента; цели должны лежать внутри [from, to]
+static bool moveJumps(std::vector<XenoInstruction>& code, int64_t delta, uint32_t from, uint32_t to) {
+    for (XenoInstruction& instr : code) {
+        if (!isJumpOpcode(instr.opcode)) continue;
+        uint32_t target = getJumpTarget(instr);
+        if (target < from || target > to) return false;
+        setJumpTarget(instr, static_cast<uint32_t>(target + delta));
+    }
+    return true;
+}
+
+int16_t XenoCompiler::findNative(const String& name) const {
+    return natives != nullptr ? natives->find(name) : XenoNativeTable::NOT_FOUND;
+}
+
+// Модуль кешируется только на верхнем уровне: вне функций и незакрытых блоков
+bool XenoCompiler::importCacheable() const {
+    return !inside_function_declaration && current_output == &bytecode &&
+           if_chain_stack.empty() && loop_stack.empty() && while_stack.empty();
+}
+
+// От этого состояния зависит результат компиляции модуля: типы переменных, функции, лимиты
+uint32_t XenoCompiler::importContextHash() {
+    uint32_t limits[] = {
+        static_cast<uint32_t>(security_config.getMaxStringLength()),
+        static_cast<uint32_t>(security_config.getMaxVariableNameLength()),
+        static_cast<uint32_t>(security_config.getMaxExpressionDepth()),
+        static_cast<uint32_t>(security_config.getMaxIfDepth()),
+        static_cast<uint32_t>(security_config.getMaxLoopDepth())
+    };
+    uint32_t h = XenoImportCache::hash(XenoImportCache::HASH_SEED, limits, sizeof(limits));
+    for (const auto& var : variable_map) {
+        uint8_t type = var.second.type;
+        h = XenoImportCache::hash(XenoImportCache::hash(h, var.first), &type, 1);
+    }
+    for (const auto& func : functions) {
+        int32_t arity = func.second.arity;
+        h = XenoImportCache::hash(XenoImportCache::hash(h, func.first), &arity, sizeof(arity));
+    }
+    for (size_t i = 0; natives != nullptr && i < natives->size(); ++i) {
+        const uint8_t signature[] = {(*natives)[i].arity, (*natives)[i].result};
+        h = XenoImportCache::hash(XenoImportCache::hash(h, (*natives)[i].name), signature, sizeof(signature));
+    }
+    h = XenoImportCache::hash(h, "|", 1);
+    for (const auto& arr : is_array) {
+        h = XenoImportCache::hash(h, arr.first);
+    }
+    h = XenoImportCache::hash(h, "|", 1);
+    for (const String& file : imported_files) {
+        h = XenoImportCache::hash(h, file);
+    }
+    return h;
+}
+
+bool XenoCompiler::importDependenciesCurrent(const XenoImportEntry& entry) {
+    for (const auto& dep : entry.dependencies) {
+        uint32_t current;
+        if (!XenoImportCache::hashFile(*filesystem, dep.first, current) || current != dep.second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Вложенный импорт попадает в записи всех модулей, которые сейчас компилируются
+void XenoCompiler::noteImport(const String& filename, uint32_t content_hash, const XenoImportEntry* cached) {
+    for (ImportRecording* rec : import_recordings) {
+        rec->entry.imports.push_back(filename);
+        rec->entry.dependencies.push_back(std::make_pair(filename, content_hash));
+        if (cached != nullptr) {
+            rec->entry.imports.insert(rec->entry.imports.end(), cached->imports.begin(), cached->imports.end());
+            rec->entry.dependencies.insert(rec->entry.dependencies.end(),
+                                           cached->dependencies.begin(), cached->dependencies.end());
+            rec->entry.nested_depth = std::max<uint16_t>(rec->entry.nested_depth,
+                                                    import_depth + 1 + cached->nested_depth - rec->base_depth);
+        }
+    }
+}
+
+bool XenoCompiler::linkImport(const XenoImportEntry& entry) {
+    if (import_depth + entry.nested_depth >= security_config.getMaxImportDepth() ||
+        imported_files.size() + 1 + entry.imports.size() > security_config.getMaxImportCount()) {
+        return false;   // Лимиты проверит и сообщит обычная компиляция
+    }
+
+    // Строки и слоты добавляются в порядке первого использования, как при разборе исходника
+    std::vector<int> strings(entry.strings.size());
+    for (size_t i = 0; i < entry.strings.size(); ++i) {
+        strings[i] = addString(entry.strings[i]);
+    }
+    std::vector<int> slots(entry.globals.size());
+    for (size_t i = 0; i < entry.globals.size(); ++i) {
+        slots[i] = getGlobalSlot(entry.globals[i]);
+    }
+    if (compile_error) return false;
+
+    const size_t code_start = bytecode.size();
+    const size_t function_start = function_code.size();
+    std::vector<XenoInstruction> code = entry.code;
+    std::vector<XenoInstruction> funcs = entry.function_code;
+    if (!moveJumps(code, code_start, 0, code.size()) ||
+        !moveJumps(funcs, function_start, 0, funcs.size())) {
+        return false;
+    }
+    for (std::vector<XenoInstruction>* part : {&code, &funcs}) {
+        for (XenoInstruction& instr : *part) {
+            if (!remapOperands(instr, strings, slots)) return false;
+            // Номер функции хоста берётся из текущей таблицы по имени
+            if (instr.opcode == OP_CALL_NATIVE) {
+                const uint8_t arity = nativeCallArity(instr.arg1);
+                const int16_t native = findNative(string_table[instr.arg2]);
+                if (native < 0 || (*natives)[native].arity != arity) return false;  // Тип результата - в хеше контекста
+                instr.arg1 = packNativeCall(native, arity);
+                continue;
+            }
+            if (instr.opcode != OP_CALL) continue;
+            const String& name = string_table[instr.arg2];
+            bool declared = functions.count(name) > 0;
+            for (const FunctionInfo& info : entry.functions) {
+                declared = declared || info.name == name;
+            }
+            if (!declared) return false;
+        }
+    }
+
+    // Проверки пройдены: объявляем функции модуля и разрешаем номера вызовов
+    for (const FunctionInfo& info : entry.functions) {
+        FunctionInfo declared = info;
+        declared.address += function_start;
+        auto existing = functions.find(info.name);
+        declared.index = (existing != functions.end()) ? existing->second.index : functions.size();
+        functions[info.name] = declared;
+        for (ImportRecording* rec : import_recordings) {
+            rec->function_names.push_back(info.name);
+        }
+    }
+    for (std::vector<XenoInstruction>* part : {&code, &funcs}) {
+        for (XenoInstruction& instr : *part) {
+            if (instr.opcode == OP_CALL) {
+                instr.arg1 = functions[string_table[instr.arg2]].index;
+            }
+            instr.line = current_line;
+        }
+    }
+    bytecode.insert(bytecode.end(), code.begin(), code.end());
+    function_code.insert(function_code.end(), funcs.begin(), funcs.end());
+
+    for (const String& name : entry.removed_variables) {
+        variable_map.erase(name);
+    }
+    for (const auto& var : entry.variables) {
+        variable_map[var.first] = var.second;
+    }
+    for (const String& name : entry.arrays) {
+        is_array[name] = true;
+    }
+    imported_files.insert(entry.imports.begin(), entry.imports.end());
+    return true;
+}
+
+// Переводит код, только что скомпилированный из модуля, в переносимый вид и кладёт в кеш
+void XenoCompiler::finishImportRecording(ImportRecording& rec) {
+    if (compile_error || !importCacheable()) return;
+    XenoImportEntry& entry = rec.entry;
+
+    std::vector<int> strings(string_table.size(), -1);
+    for (size_t i = 0; i < string_table.size(); ++i) {
+        auto it = rec.string_index.find(string_table[i]);
+        if (it != rec.string_index.end()) strings[i] = it->second;
+    }
+    std::vector<int> slots(global_slots.size(), -1);
+    for (const auto& slot : global_slots) {
+        auto it = rec.global_index.find(slot.first);
+        if (it != rec.global_index.end() && slot.second < slots.size()) slots[slot.second] = it->second;
+    }
+
+    entry.code.assign(bytecode.begin() + rec.code_start, bytecode.end());
+    entry.function_code.assign(function_code.begin() + rec.function_start, function_code.end());
+    if (!moveJumps(entry.code, -static_cast<int64_t>(rec.code_start), rec.code_start, bytecode.size()) ||
+        !moveJumps(entry.function_code, -static_cast<int64_t>(rec.function_start),
+                   rec.function_start, function_code.size())) {
+        return;
+    }
+    for (std::vector<XenoInstruction>* part : {&entry.code, &entry.function_code}) {
+        for (XenoInstruction& instr : *part) {
+            if (!remapOperands(instr, strings, slots)) return;
+            if (instr.opcode == OP_CALL) instr.arg1 = 0;    // Номер разрешается при линковке
+            // У EVENT_BIND номер функции без имени: такой модуль компилируется заново при каждом import
+            if (instr.opcode == OP_EVENT_BIND) return;
+        }
+    }
+
+    for (const String& name : rec.function_names) {
+        auto it = functions.find(name);
+        if (it == functions.end() || it->second.address < static_cast<int>(rec.function_start)) return;
+        FunctionInfo info = it->second;
+        info.address -= rec.function_start;
+        entry.functions.push_back(info);
+    }
+
+    for (const auto& var : variable_map) {
+        auto before = rec.variables_before.find(var.first);
+        if (before == rec.variables_before.end() || before->second.type != var.second.type) {
+            entry.variables[var.first] = var.second;
+        }
+    }
+    for (const auto& var : rec.variables_before) {
+        if (variable_map.find(var.first) == variable_map.end()) {
+            entry.removed_variables.push_back(var.first);
+        }
+    }
+    for (const auto& arr : is_array) {
+        if (rec.arrays_before.find(arr.first) == rec.arrays_before.end()) {
+            entry.arrays.push_back(arr.first);
+        }
+    }
+
+    import_cache->store(entry);
+}
+
 // ------------------------------------------------------------------
 // Компиляция выражений (без изменений)
 // ------------------------------------------------------------------
@@ -348,48 +952,102 @@ XenoDataType XenoCompiler::compileExpressionWithType(const String& expr) {
         return TYPE_ANY;
     }
 
-    String processedExpr = processFunctions(expr);
-    std::vector<String> tokens = tokenizeExpression(processedExpr);
-    std::vector<String> postfix = infixToPostfix(tokens);
-    return compilePostfix(postfix);
+    // Без математических функций выражение разбирается прямо в исходной строке
+    const String* source = &expr;
+    String processedExpr;
+    for (size_t i = 0; i < math_functions_count; i++) {
+        if (strstr(expr.c_str(), math_functions[i].name) != nullptr) {
+            processedExpr = processFunctions(expr);
+            source = &processedExpr;
+            ++frontend_allocations;
+            break;
+        }
+    }
+
+    // Лексемы выражения живут только до конца этого вызова
+    XenoArenaScope temporaries(arena);
+    TokenVector tokens(arena);
+    TokenVector postfix(arena);
+    tokenizeExpression(*source, tokens);
+    infixToPostfix(source->c_str(), tokens, postfix);
+    return compilePostfix(source->c_str(), postfix);
+}
+
+// Код бинарного оператора постфиксной записи или -1
+static int binaryOpcode(const char* text, size_t length) {
+    if (length == 1) {
+        switch (text[0]) {
+            case '+': return OP_ADD;
+            case '-': return OP_SUB;
+            case '*': return OP_MUL;
+            case '/': return OP_DIV;
+            case '%': return OP_MOD;
+            case '^': return OP_POW;
+            case '<': return OP_LT;
+            case '>': return OP_GT;
+        }
+    } else if (length == 2) {
+        if (textIs(text, length, "==")) return OP_EQ;
+        if (textIs(text, length, "!=")) return OP_NEQ;
+        if (textIs(text, length, "<=")) return OP_LTE;
+        if (textIs(text, length, ">=")) return OP_GTE;
+        if (textIs(text, length, "&&")) return OP_AND;
+        if (textIs(text, length, "||")) return OP_OR;
+    }
+    return -1;
 }
 
-XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
+XenoDataType XenoCompiler::compilePostfix(const char* source, const TokenVector& postfix) {
     if (postfix.size() > 100) {
         Serial.println("ERROR: Postfix expression too complex");
         compile_error = true;
         return TYPE_ANY;
     }
 
-    std::stack<XenoDataType> typeStack;
+    std::stack<XenoDataType, XenoArenaVector<XenoDataType>> typeStack{XenoArenaVector<XenoDataType>(arena)};
+
+    for (const Token& token : postfix) {
+        const char* text = source + token.start;
+        int opcode = -1;
 
-    for (const String& token : postfix) {
         // ---- ОПЕРАНДЫ ----
-        if (isInteger(token)) {
-            int32_t value = token.toInt();
+        if (token.kind == TOKEN_INT) {
+            char digits[17];
+            memcpy(digits, text, token.length);
+            digits[token.length] = '\0';
+            int32_t value = atol(digits);
             emitInstruction(OP_PUSH, static_cast<uint32_t>(value));
             typeStack.push(TYPE_INT);
         }
-        else if (isFloat(token)) {
-            float fval = token.toFloat();
+        else if (token.kind == TOKEN_FLOAT) {
+            char digits[33];
+            memcpy(digits, text, token.length);
+            digits[token.length] = '\0';
+            float fval = atof(digits);
             uint32_t fbits;
             memcpy(&fbits, &fval, sizeof(float));
             emitInstruction(OP_PUSH_FLOAT, fbits);
             typeStack.push(TYPE_FLOAT);
         }
-        else if (isBool(token)) {
-            bool bval = (token == "true");
+        else if (token.kind == TOKEN_BOOL) {
+            bool bval = (token.length == 4);
             emitInstruction(OP_PUSH_BOOL, bval);
             typeStack.push(TYPE_BOOL);
         }
-        else if (isQuotedString(token)) {
-            String str = token.substring(1, token.length() - 1);
-            if (!validateString(str)) str = "";
+        else if (token.kind == TOKEN_STRING) {
+            // Копия нужна только для таблицы строк программы
+            String str;
+            size_t length = token.length >= 2 ? token.length - 2 : 0;
+            if (length > 0) {
+                str.concat(text + 1, length);
+                ++frontend_allocations;
+            }
+            if (!validateString(length)) str = "";
             int str_id = addString(str);
             emitInstruction(OP_PUSH_STRING, str_id);
             typeStack.push(TYPE_STRING);
         }
-        else if (token == "UNARY_NOT") {
+        else if (token.kind == TOKEN_UNARY_NOT) {
             if (typeStack.empty()) {
                 Serial.println("ERROR: Type stack underflow in UNARY_NOT");
                 compile_error = true;
@@ -404,7 +1062,7 @@ XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
             emitInstruction(OP_NOT);
             typeStack.push(TYPE_BOOL);
         }
-        else if (token == "UNARY_NEG") {
+        else if (token.kind == TOKEN_UNARY_NEG) {
             if (typeStack.empty()) {
                 Serial.println("ERROR: Type stack underflow in UNARY_NEG");
                 compile_error = true;
@@ -419,69 +1077,44 @@ XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
             emitInstruction(OP_NEG);
             typeStack.push(operand);
         }
-        else if (isValidVariable(token)) {
-            auto it = variable_map.find(token);
+        else if (token.kind == TOKEN_VARIABLE) {
+            const String& name = tokenString(source, token);
+            auto it = variable_map.find(name);
             if (it == variable_map.end()) {
                 Serial.print("ERROR: Variable '");
-                Serial.print(token);
+                Serial.print(name);
                 Serial.println("' used before assignment");
                 compile_error = true;
                 return TYPE_ANY;
             }
             XenoDataType varType = it->second.type;
-            int var_index = getVariableIndex(token);
-            emitInstruction(OP_LOAD, var_index);
+            emitLoadVariable(name);
             typeStack.push(varType);
         }
         // ---- БИНАРНЫЕ ОПЕРАТОРЫ ----
-        else if (token == "+" || token == "-" || token == "*" || token == "/" ||
-                 token == "%" || token == "^" || token == "==" || token == "!=" ||
-                 token == "<" || token == ">" || token == "<=" || token == ">=" ||
-                 token == "&&" || token == "||") {
+        else if (token.kind != TOKEN_CALL && (opcode = binaryOpcode(text, token.length)) >= 0) {
             if (typeStack.size() < 2) {
                 Serial.print("ERROR: Type stack underflow for binary operator ");
-                Serial.println(token);
+                Serial.println(tokenString(source, token));
                 compile_error = true;
                 return TYPE_ANY;
             }
             XenoDataType right = typeStack.top(); typeStack.pop();
             XenoDataType left  = typeStack.top(); typeStack.pop();
 
-            uint8_t opcode;
-            if (token == "+") opcode = OP_ADD;
-            else if (token == "-") opcode = OP_SUB;
-            else if (token == "*") opcode = OP_MUL;
-            else if (token == "/") opcode = OP_DIV;
-            else if (token == "%") opcode = OP_MOD;
-            else if (token == "^") opcode = OP_POW;
-            else if (token == "==") opcode = OP_EQ;
-            else if (token == "!=") opcode = OP_NEQ;
-            else if (token == "<") opcode = OP_LT;
-            else if (token == ">") opcode = OP_GT;
-            else if (token == "<=") opcode = OP_LTE;
-            else if (token == ">=") opcode = OP_GTE;
-            else if (token == "&&") opcode = OP_AND;
-            else if (token == "||") opcode = OP_OR;
-            else {
-                Serial.print("ERROR: Unknown binary operator ");
-                Serial.println(token);
-                compile_error = true;
-                return TYPE_ANY;
-            }
-
             if (!isValidBinaryOp(left, right, opcode)) {
                 Serial.print("ERROR: Type mismatch for operator ");
-                Serial.println(token);
+                Serial.println(tokenString(source, token));
                 compile_error = true;
                 return TYPE_ANY;
             }
 
-            emitInstruction(opcode);
+            emitInstruction(typedOpcode(opcode, left, right));
 
             XenoDataType resultType = getBinaryResultType(left, right, opcode);
             if (resultType == TYPE_ANY) {
                 Serial.print("ERROR: Cannot determine result type for ");
-                Serial.println(token);
+                Serial.println(tokenString(source, token));
                 compile_error = true;
                 return TYPE_ANY;
             }
@@ -490,10 +1123,9 @@ XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
         // ---- МАТЕМАТИЧЕСКИЕ ФУНКЦИИ (специальные скобки) ----
         else {
             bool function_processed = false;
-            for (size_t i = 0; i < math_functions_count; i++) {
+            for (size_t i = 0; i < math_functions_count && token.kind != TOKEN_CALL; i++) {
                 const MathFunctionInfo& func = math_functions[i];
-                if (token.startsWith(String(func.open_bracket)) &&
-                    token.endsWith(String(func.close_bracket))) {
+                if (text[0] == func.open_bracket && text[token.length - 1] == func.close_bracket) {
                     // Проверка типов аргументов (они уже скомпилированы)
                     if (func.num_args == 1) {
                         if (typeStack.empty()) {
@@ -509,7 +1141,7 @@ XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
                             return TYPE_ANY;
                         }
                         XenoDataType resultType = getUnaryResultType(argType, func.opcode);
-                        compileMathFunction(token, func);
+                        compileMathFunction(text, token.length, func);
                         typeStack.push(resultType);
                     } else if (func.num_args == 2) {
                         if (typeStack.size() < 2) {
@@ -526,10 +1158,10 @@ XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
                             return TYPE_ANY;
                         }
                         XenoDataType resultType = getBinaryResultType(left, right, func.opcode);
-                        compileMathFunction(token, func);
+                        compileMathFunction(text, token.length, func);
                         typeStack.push(resultType);
                     } else {
-                        compileMathFunction(token, func);
+                        compileMathFunction(text, token.length, func);
                         typeStack.push(TYPE_ANY);
                     }
                     function_processed = true;
@@ -537,9 +1169,30 @@ XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
                 }
             }
             // ---- Обработка вызова пользовательской функции ----
-            if (!function_processed && token.startsWith("CALL:")) {
-                String funcName = token.substring(5);
+            if (!function_processed && token.kind == TOKEN_CALL) {
+                const String& funcName = tokenString(source, token);
                 auto it = functions.find(funcName);
+                const int16_t native = it == functions.end() ? findNative(funcName) : XenoNativeTable::NOT_FOUND;
+                if (native >= 0) {
+                    const uint8_t arity = (*natives)[native].arity;
+                    if (typeStack.size() < arity) {
+                        Serial.print("ERROR: Not enough arguments for native function '");
+                        Serial.print(funcName);
+                        Serial.print("' (expected ");
+                        Serial.print(arity);
+                        Serial.print(", got ");
+                        Serial.print(typeStack.size());
+                        Serial.println(")");
+                        compile_error = true;
+                        return TYPE_ANY;
+                    }
+                    for (uint8_t i = 0; i < arity; ++i) {
+                        typeStack.pop();
+                    }
+                    emitInstruction(OP_CALL_NATIVE, packNativeCall(native, arity), addString(funcName));
+                    typeStack.push((*natives)[native].result);
+                    continue;
+                }
                 if (it == functions.end()) {
                     Serial.print("ERROR: Function '");
                     Serial.print(funcName);
@@ -562,13 +1215,14 @@ XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
                 for (int i = 0; i < funcInfo.arity; ++i) {
                     typeStack.pop();
                 }
+                // arg1 - номер функции, arg2 - имя (для диагностики)
                 int funcNameIndex = addString(funcName);
-                emitInstruction(OP_CALL, funcNameIndex);
+                emitInstruction(OP_CALL, funcInfo.index, funcNameIndex);
                 typeStack.push(TYPE_ANY);
             }
             else if (!function_processed) {
                 Serial.print("ERROR: Unknown operator in expression: ");
-                Serial.println(token);
+                Serial.println(tokenString(source, token));
                 compile_error = true;
                 return TYPE_ANY;
             }
@@ -584,8 +1238,13 @@ XenoDataType XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
     return typeStack.top();
 }
 
-void XenoCompiler::compileMathFunction(const String& token, const MathFunctionInfo& func) {
-    String innerExpr = token.substring(1, token.length() - 1);
+void XenoCompiler::compileMathFunction(const char* token, size_t length, const MathFunctionInfo& func) {
+    // Аргументы компилируются рекурсивно: копия внутренней части, срезы лексем ссылаются на неё
+    String innerExpr;
+    if (length > 2) {
+        innerExpr.concat(token + 1, length - 2);
+        ++frontend_allocations;
+    }
 
     if (func.num_args == 1) {
         compileExpression(innerExpr);
@@ -595,6 +1254,7 @@ void XenoCompiler::compileMathFunction(const String& token, const MathFunctionIn
         if (commaPos > 0) {
             String arg1 = innerExpr.substring(0, commaPos);
             String arg2 = innerExpr.substring(commaPos + 1);
+            frontend_allocations += 2;
             compileExpression(arg1);
             compileExpression(arg2);
             emitInstruction(func.opcode);
@@ -606,6 +1266,7 @@ void XenoCompiler::compileMathFunction(const String& token, const MathFunctionIn
 }
 
 void XenoCompiler::compileSimpleCommand(const String& command, uint8_t opcode) {
+    (void)command;
     emitInstruction(opcode);
 }
 
@@ -672,8 +1333,7 @@ void XenoCompiler::handleSetCommand(const String& args, int line_number) {
         variable_map[var_name] = createValueFromString("0", varType);
     }
 
-    int var_index = getVariableIndex(var_name);
-    emitInstruction(OP_STORE, var_index);
+    emitStoreVariable(var_name);
 }
 
 void XenoCompiler::handleAnalogWrite(const String& args, int line_number) {
@@ -739,6 +1399,28 @@ void XenoCompiler::handleArrayCommand(const String& args, int line_number) {
         String sizeStr = rest.substring(secondSpace + 1);
         var_name.trim();
         sizeStr.trim();
+        // Необязательный вид элементов: array new name size [int|float|byte]
+        uint8_t kind = ARRAY_VALUES;
+        int kindSpace = sizeStr.indexOf(' ');
+        if (kindSpace > 0) {
+            String kindStr = sizeStr.substring(kindSpace + 1);
+            kindStr.trim();
+            sizeStr = sizeStr.substring(0, kindSpace);
+            if (kindStr == "int") {
+                kind = ARRAY_INT32;
+            } else if (kindStr == "float") {
+                kind = ARRAY_FLOAT;
+            } else if (kindStr == "byte") {
+                kind = ARRAY_UINT8;
+            } else {
+                Serial.print("ERROR: Unknown array element type '");
+                Serial.print(kindStr);
+                Serial.print("' at line ");
+                Serial.println(line_number);
+                compile_error = true;
+                return;
+            }
+        }
         if (!validateVariableName(var_name)) {
             Serial.print("ERROR: Invalid array name at line ");
             Serial.println(line_number);
@@ -759,9 +1441,8 @@ void XenoCompiler::handleArrayCommand(const String& args, int line_number) {
             return;
         }
         emitInstruction(OP_PUSH, static_cast<uint32_t>(size));
-        emitInstruction(OP_ARRAY_NEW);
-        int var_index = getVariableIndex(var_name);
-        emitInstruction(OP_STORE, var_index);
+        emitInstruction(OP_ARRAY_NEW, kind);
+        emitStoreVariable(var_name);
         is_array[var_name] = true;
         variable_map[var_name] = XenoValue::makeArray(0);
     }
@@ -808,8 +1489,7 @@ void XenoCompiler::handleArrayCommand(const String& args, int line_number) {
             compile_error = true;
             return;
         }
-        int var_index = getVariableIndex(var_name);
-        emitInstruction(OP_LOAD, var_index);
+        emitLoadVariable(var_name);
         emitInstruction(OP_PUSH, static_cast<uint32_t>(index));
         compileExpression(valueStr);
         if (compile_error) return;
@@ -837,8 +1517,7 @@ void XenoCompiler::handleArrayCommand(const String& args, int line_number) {
             compile_error = true;
             return;
         }
-        int var_index = getVariableIndex(var_name);
-        emitInstruction(OP_LOAD, var_index);
+        emitLoadVariable(var_name);
         emitInstruction(OP_ARRAY_LEN);
     }
     else {
@@ -848,9 +1527,79 @@ void XenoCompiler::handleArrayCommand(const String& args, int line_number) {
     }
 }
 
+bool XenoCompiler::parsePinGroup(const String& pins, int line_number, uint8_t& bank, uint32_t& mask) {
+    mask = 0;
+    bank = 0;
+    int start = 0;
+    while (start <= static_cast<int>(pins.length())) {
+        int comma = pins.indexOf(',', start);
+        if (comma < 0) comma = pins.length();
+        String pinStr = pins.substring(start, comma);
+        pinStr.trim();
+        start = comma + 1;
+
+        if (!isInteger(pinStr) || pinStr.toInt() < 0 || pinStr.toInt() > 255) {
+            Serial.print("ERROR: Invalid pin number at line ");
+            Serial.println(line_number);
+            compile_error = true;
+            return false;
+        }
+        uint8_t pin = pinStr.toInt();
+        if (!security.isPinAllowed(pin)) {
+            Serial.print("ERROR: Pin not allowed at line ");
+            Serial.println(line_number);
+            compile_error = true;
+            return false;
+        }
+        if (mask != 0 && pin / 32 != bank) {
+            Serial.print("ERROR: Grouped pins must be in one bank of 32 (0-31, 32-63, ...) at line ");
+            Serial.println(line_number);
+            compile_error = true;
+            return false;
+        }
+        bank = pin / 32;
+        mask |= 1u << (pin % 32);
+    }
+    return true;
+}
+
+// analogread <pin> - значение на стек; analogread <pins> <array> [samples] - замеры в массив
 void XenoCompiler::handleAnalogRead(const String& args, int line_number) {
     String pinStr = args;
     pinStr.trim();
+    int space = pinStr.indexOf(' ');
+    if (space > 0) {
+        String rest = pinStr.substring(space + 1);
+        pinStr = pinStr.substring(0, space);
+        rest.trim();
+        String samplesStr = "1";
+        int second = rest.indexOf(' ');
+        if (second > 0) {
+            samplesStr = rest.substring(second + 1);
+            samplesStr.trim();
+            rest = rest.substring(0, second);
+        }
+        uint8_t bank;
+        uint32_t mask;
+        if (!parsePinGroup(pinStr, line_number, bank, mask)) return;
+        if (!isInteger(samplesStr) || samplesStr.toInt() < 1 || samplesStr.toInt() > 255) {
+            Serial.print("ERROR: analogRead samples must be 1-255 at line ");
+            Serial.println(line_number);
+            compile_error = true;
+            return;
+        }
+        auto it = variable_map.find(rest);
+        if (it == variable_map.end() || it->second.type != TYPE_ARRAY) {
+            Serial.print("ERROR: Variable '");
+            Serial.print(rest);
+            Serial.println("' is not an array");
+            compile_error = true;
+            return;
+        }
+        emitLoadVariable(rest);
+        emitInstruction(OP_ANALOG_READ_PINS, mask, packPinGroup(bank, samplesStr.toInt()));
+        return;
+    }
     if (!isInteger(pinStr)) {
         Serial.print("ERROR: analogRead requires pin number at line ");
         Serial.println(line_number);
@@ -867,9 +1616,39 @@ void XenoCompiler::handleAnalogRead(const String& args, int line_number) {
     emitInstruction(OP_ANALOG_READ, pin);
 }
 
+// digitalread <pin> - уровень на стек; digitalread <pins> <var> - уровни битами в переменную
 void XenoCompiler::handleDigitalRead(const String& args, int line_number) {
     String pinStr = args;
     pinStr.trim();
+    int space = pinStr.indexOf(' ');
+    if (space > 0) {
+        String var_name = pinStr.substring(space + 1);
+        pinStr = pinStr.substring(0, space);
+        var_name.trim();
+        uint8_t bank;
+        uint32_t mask;
+        if (!parsePinGroup(pinStr, line_number, bank, mask)) return;
+        if (!validateVariableName(var_name)) {
+            Serial.print("ERROR: Invalid variable name in digitalRead at line ");
+            Serial.println(line_number);
+            compile_error = true;
+            return;
+        }
+        auto it = variable_map.find(var_name);
+        if (it != variable_map.end() && it->second.type != TYPE_INT && it->second.type != TYPE_ANY) {
+            Serial.print("ERROR: digitalRead target '");
+            Serial.print(var_name);
+            Serial.println("' must be an integer");
+            compile_error = true;
+            return;
+        }
+        if (it == variable_map.end()) {
+            variable_map[var_name] = XenoValue::makeInt(0);
+        }
+        emitInstruction(OP_DIGITAL_READ_PINS, mask, packPinGroup(bank));
+        emitStoreVariable(var_name);
+        return;
+    }
     if (!isInteger(pinStr)) {
         Serial.print("ERROR: digitalRead requires pin number at line ");
         Serial.println(line_number);
@@ -886,12 +1665,43 @@ void XenoCompiler::handleDigitalRead(const String& args, int line_number) {
     emitInstruction(OP_DIGITAL_READ, pin);
 }
 
+// digitalwrite <pins> <expr>: бит (пин % 32) значения задаёт уровень пина, все пины - одной записью
+void XenoCompiler::handleDigitalWrite(const String& args, int line_number) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        Serial.print("ERROR: digitalWrite requires pins and value at line ");
+        Serial.println(line_number);
+        compile_error = true;
+        return;
+    }
+    String pinStr = args.substring(0, space);
+    String valStr = args.substring(space + 1);
+    valStr.trim();
+    uint8_t bank;
+    uint32_t mask;
+    if (!parsePinGroup(pinStr, line_number, bank, mask)) return;
+
+    XenoDataType valType = compileExpressionWithType(valStr);
+    if (compile_error) return;
+    if (valType != TYPE_INT && valType != TYPE_ANY) {
+        Serial.print("ERROR: digitalWrite value must be an integer bit mask at line ");
+        Serial.println(line_number);
+        compile_error = true;
+        return;
+    }
+    emitInstruction(OP_DIGITAL_WRITE_PINS, mask, packPinGroup(bank));
+}
+
 // ------------------------------------------------------------------
 // Остальные методы (validateString, etc.) без изменений
 // ------------------------------------------------------------------
 
 bool XenoCompiler::validateString(const String& str) {
-    if (str.length() > security_config.getMaxStringLength()) {
+    return validateString(str.length());
+}
+
+bool XenoCompiler::validateString(size_t length) {
+    if (length > security_config.getMaxStringLength()) {
         Serial.println("ERROR: String too long");
         return false;
     }
@@ -910,115 +1720,318 @@ bool XenoCompiler::validateVariableName(const String& name) {
     return true;
 }
 
-String XenoCompiler::cleanLine(const String& line) {
-    String cleaned = line;
-    int commentIndex = cleaned.indexOf("//");
-    if (commentIndex >= 0) {
-        cleaned = cleaned.substring(0, commentIndex);
+// Границы строки без комментария и пробелов по краям (без копирования)
+void XenoCompiler::cleanLine(const String& line, size_t& begin, size_t& end) {
+    const char* text = line.c_str();
+    const char* comment = strstr(text, "//");
+    begin = 0;
+    end = comment ? comment - text : line.length();
+    while (begin < end && isspace(static_cast<unsigned char>(text[begin]))) ++begin;
+    while (end > begin && isspace(static_cast<unsigned char>(text[end - 1]))) --end;
+}
+
+// Первое использование строки или глобальной внутри модулей, которые пишутся в кеш
+static void noteName(std::map<String, uint16_t>& index, std::vector<String>& names, const String& name) {
+    if (index.find(name) == index.end()) {
+        index[name] = names.size();
+        names.push_back(name);
     }
-    cleaned.trim();
-    return cleaned;
 }
 
 int XenoCompiler::addString(const String& str) {
     if (!validateString(str)) {
         return 0;
     }
-
-    for (int i = string_table.size() - 1; i >= 0; --i) {
-        if (string_table[i] == str) return i;
+    for (ImportRecording* rec : import_recordings) {
+        noteName(rec->string_index, rec->entry.strings, str);
     }
 
+    const uint32_t key = XenoStringIndex::hash(str);
+    const uint16_t found = string_index.find(str.c_str(), str.length(), key,
+                                             [this](uint16_t i) { return string_table[i].c_str(); });
+    if (found != XenoStringIndex::NONE) return found;
+
     if (string_table.size() >= 65535) {
         Serial.println("ERROR: String table overflow");
         return 0;
     }
 
     string_table.push_back(str);
+    string_index.insert(key, str.length(), string_table.size() - 1);
     return string_table.size() - 1;
 }
 
-int XenoCompiler::getVariableIndex(const String& var_name) {
-    return validateVariableName(var_name) ? addString(var_name) : 0;
+// Таблица строк заменена целиком (образ, откат замены функций)
+void XenoCompiler::rebuildStringIndex() {
+    string_index.clear();
+    string_index.reserve(string_table.size());
+    for (size_t i = 0; i < string_table.size(); ++i) {
+        const String& str = string_table[i];
+        const uint32_t key = XenoStringIndex::hash(str);
+        if (string_index.find(str.c_str(), str.length(), key,
+                              [this](uint16_t j) { return string_table[j].c_str(); }) == XenoStringIndex::NONE) {
+            string_index.insert(key, str.length(), i);
+        }
+    }
+}
+
+// ---- Слоты переменных: имена разрешаются при компиляции ----
+int XenoCompiler::getGlobalSlot(const String& var_name) {
+    for (ImportRecording* rec : import_recordings) {
+        noteName(rec->global_index, rec->entry.globals, var_name);
+    }
+    auto it = global_slots.find(var_name);
+    if (it != global_slots.end()) {
+        return it->second;
+    }
+    if (global_slots.size() >= 65535) {
+        Serial.println("ERROR: Too many global variables");
+        compile_error = true;
+        return 0;
+    }
+    uint16_t slot = global_slots.size();
+    global_slots[var_name] = slot;
+    return slot;
+}
+
+int XenoCompiler::getLocalSlot(const String& var_name) {
+    if (!inside_function_declaration) return -1;
+    for (size_t i = 0; i < function_param_names.size(); ++i) {
+        if (function_param_names[i] == var_name) return i;
+    }
+    return -1;
+}
+
+void XenoCompiler::emitLoadVariable(const String& var_name) {
+    if (!validateVariableName(var_name)) {
+        compile_error = true;
+        return;
+    }
+    int name_index = addString(var_name);
+    int local_slot = getLocalSlot(var_name);
+    if (local_slot >= 0) {
+        emitInstruction(OP_LOAD_LOCAL, local_slot, name_index);
+    } else {
+        emitInstruction(OP_LOAD, getGlobalSlot(var_name), name_index);
+    }
+}
+
+void XenoCompiler::emitStoreVariable(const String& var_name) {
+    if (!validateVariableName(var_name)) {
+        compile_error = true;
+        return;
+    }
+    int name_index = addString(var_name);
+    int local_slot = getLocalSlot(var_name);
+    if (local_slot >= 0) {
+        emitInstruction(OP_STORE_LOCAL, local_slot, name_index);
+    } else {
+        emitInstruction(OP_STORE, getGlobalSlot(var_name), name_index);
+    }
 }
 
 bool XenoCompiler::isInteger(const String& str) {
-    if (str.isEmpty() || str.length() > 16) return false;
+    return isInteger(str.c_str(), str.length());
+}
+
+bool XenoCompiler::isInteger(const char* str, size_t length) {
+    if (length == 0 || length > 16) return false;
 
-    const char* cstr = str.c_str();
     size_t start = 0;
-    if (cstr[0] == '-') start = 1;
+    if (str[0] == '-') start = 1;
+    if (start == length) return false;    // Одиночный '-' - оператор, а не число
 
-    for (size_t i = start; i < str.length(); ++i) {
-        if (!isdigit(cstr[i])) return false;
+    for (size_t i = start; i < length; ++i) {
+        if (!isdigit(str[i])) return false;
     }
 
-    long long_val = str.toInt();
+    char digits[17];
+    memcpy(digits, str, length);
+    digits[length] = '\0';
+    long long_val = atol(digits);
     return !(long_val > 2147483647L || long_val < -2147483648L);
 }
 
 bool XenoCompiler::isFloat(const String& str) {
-    if (str.isEmpty() || str.length() > 32) return false;
+    return isFloat(str.c_str(), str.length());
+}
+
+bool XenoCompiler::isFloat(const char* str, size_t length) {
+    if (length == 0 || length > 32) return false;
 
-    const char* cstr = str.c_str();
     bool has_decimal = false;
     size_t start = 0;
 
-    if (cstr[0] == '-') start = 1;
+    if (str[0] == '-') start = 1;
 
-    for (size_t i = start; i < str.length(); ++i) {
-        if (cstr[i] == '.') {
+    for (size_t i = start; i < length; ++i) {
+        if (str[i] == '.') {
             if (has_decimal) return false;
             has_decimal = true;
-        } else if (!isdigit(cstr[i])) {
+        } else if (!isdigit(str[i])) {
             return false;
         }
     }
-    return has_decimal && str.length() > 1;
+    return has_decimal && length > 1;
 }
 
 bool XenoCompiler::isBool(const String& str) {
-    return str == "true" || str == "false";
+    return isBool(str.c_str(), str.length());
+}
+
+bool XenoCompiler::isBool(const char* str, size_t length) {
+    return (length == 4 && memcmp(str, "true", 4) == 0) ||
+           (length == 5 && memcmp(str, "false", 5) == 0);
 }
 
 bool XenoCompiler::isQuotedString(const String& str) {
-    return str.length() >= 2 &&
+    return isQuotedString(str.c_str(), str.length());
+}
+
+bool XenoCompiler::isQuotedString(const char* str, size_t length) {
+    return length >= 2 &&
            str[0] == '"' &&
-           str[str.length() - 1] == '"';
+           str[length - 1] == '"';
 }
 
 bool XenoCompiler::isValidVariable(const String& str) {
-    if (str.isEmpty() || str.length() > security_config.getMaxVariableNameLength()) return false;
+    return isValidVariable(str.c_str(), str.length());
+}
+
+bool XenoCompiler::isValidVariable(const char* str, size_t length) {
+    if (length == 0 || length > security_config.getMaxVariableNameLength()) return false;
 
     const char first = str[0];
     if (!isalpha(first) && first != '_') return false;
 
-    for (size_t i = 1; i < str.length(); ++i) {
+    for (size_t i = 1; i < length; ++i) {
         const char c = str[i];
         if (!isalnum(c) && c != '_') return false;
     }
     return true;
 }
 
-bool XenoCompiler::isComparisonOperator(const String& str) {
-    return str == "==" || str == "!=" ||
-           str == "<"  || str == ">"  ||
-           str == "<=" || str == ">=";
+bool XenoCompiler::isComparisonOperator(const char* op, size_t length) {
+    return textIs(op, length, "==") || textIs(op, length, "!=") ||
+           textIs(op, length, "<")  || textIs(op, length, ">")  ||
+           textIs(op, length, "<=") || textIs(op, length, ">=");
 }
 
-int XenoCompiler::getPrecedence(const String& op) {
-    if (op == "^") return 4;
-    if (op == "*" || op == "/" || op == "%") return 3;
-    if (op == "+" || op == "-") return 2;
-    if (isComparisonOperator(op)) return 1;
-    if (op == "&&") return 2;
-    if (op == "||") return 1;
-    if (op == ",") return 0;
+int XenoCompiler::getPrecedence(const char* source, const Token& op) {
+    if (op.kind == TOKEN_UNARY_NOT || op.kind == TOKEN_UNARY_NEG) return 0;
+    const char* text = source + op.start;
+    if (textIs(text, op.length, "^")) return 4;
+    if (textIs(text, op.length, "*") || textIs(text, op.length, "/") || textIs(text, op.length, "%")) return 3;
+    if (textIs(text, op.length, "+") || textIs(text, op.length, "-")) return 2;
+    if (isComparisonOperator(text, op.length)) return 1;
+    if (textIs(text, op.length, "&&")) return 2;
+    if (textIs(text, op.length, "||")) return 1;
     return 0;
 }
 
-bool XenoCompiler::isRightAssociative(const String& op) {
-    return op == "^";
+bool XenoCompiler::isRightAssociative(const char* source, const Token& op) {
+    return textIs(source + op.start, op.length, "^");
+}
+
+// Ключевые слова: выбор кандидата по длине и первой букве, затем одно сравнение без учёта регистра
+static bool keywordIs(const char* word, size_t length, const char* keyword) {
+    for (size_t i = 0; i < length; ++i) {
+        if (tolower(static_cast<unsigned char>(word[i])) != keyword[i]) return false;
+    }
+    return keyword[length] == '\0';
+}
+
+// Команды выключенных семейств (xeno_features.h) остаются ключевыми словами, чтобы дать ошибку, а не предупреждение
+bool XenoCompiler::commandEnabled(uint8_t command) {
+    switch (command) {
+        case KW_POW: case KW_SQRT: return XENO_FEATURE_MATH;
+        case KW_ARRAY: return XENO_FEATURE_ARRAYS;
+        case KW_ANALOGREAD: case KW_ANALOGWRITE: return XENO_FEATURE_ANALOG;
+        case KW_INPUT: return XENO_FEATURE_INPUT;
+        case KW_ON: return XENO_FEATURE_EVENTS;
+        default: return true;
+    }
+}
+
+uint8_t XenoCompiler::lookupKeyword(const char* word, size_t length) {
+    if (length < 2 || length > 12) return KW_NONE;
+    const char first = tolower(static_cast<unsigned char>(word[0]));
+
+    switch (length) {
+        case 2:
+            if (keywordIs(word, length, "if")) return KW_IF;
+            if (keywordIs(word, length, "on")) return KW_ON;
+            break;
+        case 3:
+            switch (first) {
+                case 'a':
+                    if (keywordIs(word, length, "add")) return KW_ADD;
+                    if (keywordIs(word, length, "abs")) return KW_ABS;
+                    break;
+                case 'd': if (keywordIs(word, length, "div")) return KW_DIV; break;
+                case 'f': if (keywordIs(word, length, "for")) return KW_FOR; break;
+                case 'l': if (keywordIs(word, length, "led")) return KW_LED; break;
+                case 'm':
+                    if (keywordIs(word, length, "mul")) return KW_MUL;
+                    if (keywordIs(word, length, "mod")) return KW_MOD;
+                    if (keywordIs(word, length, "max")) return KW_MAX;
+                    if (keywordIs(word, length, "min")) return KW_MIN;
+                    break;
+                case 'p':
+                    if (keywordIs(word, length, "pop")) return KW_POP;
+                    if (keywordIs(word, length, "pow")) return KW_POW;
+                    break;
+                case 's':
+                    if (keywordIs(word, length, "set")) return KW_SET;
+                    if (keywordIs(word, length, "sub")) return KW_SUB;
+                    break;
+            }
+            break;
+        case 4:
+            switch (first) {
+                case 'e': if (keywordIs(word, length, "else")) return KW_ELSE; break;
+                case 'f': if (keywordIs(word, length, "func")) return KW_FUNC; break;
+                case 'h': if (keywordIs(word, length, "halt")) return KW_HALT; break;
+                case 'p': if (keywordIs(word, length, "push")) return KW_PUSH; break;
+                case 's': if (keywordIs(word, length, "sqrt")) return KW_SQRT; break;
+            }
+            break;
+        case 5:
+            switch (first) {
+                case 'a': if (keywordIs(word, length, "array")) return KW_ARRAY; break;
+                case 'd': if (keywordIs(word, length, "delay")) return KW_DELAY; break;
+                case 'e': if (keywordIs(word, length, "endif")) return KW_ENDIF; break;
+                case 'i': if (keywordIs(word, length, "input")) return KW_INPUT; break;
+                case 'p': if (keywordIs(word, length, "print")) return KW_PRINT; break;
+                case 'w': if (keywordIs(word, length, "while")) return KW_WHILE; break;
+            }
+            break;
+        case 6:
+            switch (first) {
+                case 'e': if (keywordIs(word, length, "endfor")) return KW_ENDFOR; break;
+                case 'i': if (keywordIs(word, length, "import")) return KW_IMPORT; break;
+                case 'r': if (keywordIs(word, length, "return")) return KW_RETURN; break;
+            }
+            break;
+        case 7:
+            if (keywordIs(word, length, "endfunc")) return KW_ENDFUNC;
+            break;
+        case 8:
+            if (first == 'p' && keywordIs(word, length, "printnum")) return KW_PRINTNUM;
+            if (first == 'e' && keywordIs(word, length, "endwhile")) return KW_ENDWHILE;
+            break;
+        case 10:
+            if (keywordIs(word, length, "analogread")) return KW_ANALOGREAD;
+            break;
+        case 11:
+            if (first == 'a' && keywordIs(word, length, "analogwrite")) return KW_ANALOGWRITE;
+            if (first == 'd' && keywordIs(word, length, "digitalread")) return KW_DIGITALREAD;
+            break;
+        case 12:
+            if (keywordIs(word, length, "digitalwrite")) return KW_DIGITALWRITE;
+            break;
+    }
+    return KW_NONE;
 }
 
 String XenoCompiler::processFunctions(const String& expr) {
@@ -1071,7 +2084,7 @@ String XenoCompiler::processFunctions(const String& expr) {
 
 int XenoCompiler::findMatchingParenthesis(const String& expr, int start) {
     int count = 1;
-    for (int i = start + 1; i < expr.length(); ++i) {
+    for (int i = start + 1; i < static_cast<int>(expr.length()); ++i) {
         if (expr[i] == '(') ++count;
         else if (expr[i] == ')') --count;
 
@@ -1080,31 +2093,63 @@ int XenoCompiler::findMatchingParenthesis(const String& expr, int start) {
     return -1;
 }
 
-// ---- infixToPostfix с поддержкой вызовов (без изменений) ----
-std::vector<String> XenoCompiler::infixToPostfix(const std::vector<String>& tokens) {
-    std::vector<String> output;
-    std::stack<String> operators;
-    output.reserve(tokens.size());
+// Вид лексемы определяется один раз при разборе, дальше парсер сравнивает только виды
+uint8_t XenoCompiler::classifyToken(const char* token, size_t length) {
+    if (isInteger(token, length)) return TOKEN_INT;
+    if (isFloat(token, length)) return TOKEN_FLOAT;
+    if (isBool(token, length)) return TOKEN_BOOL;
+    if (isQuotedString(token, length)) return TOKEN_STRING;
+    if (isValidVariable(token, length)) return TOKEN_VARIABLE;
+
+    const char first = token[0];
+    const char last = token[length - 1];
+    if ((first == '[' && last == ']') || (first == '{' && last == '}') ||
+        (first == '|' && last == '|') || (first == '~' && last == '~')) {
+        return TOKEN_GROUP;
+    }
+    if (length == 1 && first == '(') return TOKEN_LPAREN;
+    if (length == 1 && first == ')') return TOKEN_RPAREN;
+    if (length == 1 && first == ',') return TOKEN_COMMA;
+    return TOKEN_OPERATOR;
+}
+
+// Текст лексемы в переиспользуемом буфере: для поиска в таблицах с ключом String
+const String& XenoCompiler::tokenString(const char* source, const Token& token) {
+    if (token.length > token_text_capacity) {
+        token_text_capacity = token.length;
+        ++frontend_allocations;
+    }
+    token_text = "";
+    token_text.concat(source + token.start, token.length);
+    return token_text;
+}
+
+void XenoCompiler::infixToPostfix(const char* source, const TokenVector& tokens,
+                                  TokenVector& output) {
+    output.clear();
 
     if (tokens.size() > 100) {
         Serial.println("ERROR: Too many tokens in expression");
-        return output;
+        return;
     }
 
+    TokenVector operators(arena);
+    output.reserve(tokens.size());
+    operators.reserve(tokens.size());
+    if (!tokens.empty()) frontend_allocations += 2;
+
     bool expect_operand = true;
 
     for (size_t i = 0; i < tokens.size(); ++i) {
-        const String& token = tokens[i];
-
-        if (isInteger(token) || isFloat(token) || isBool(token) || isQuotedString(token) ||
-            isValidVariable(token) ||
-            (token.startsWith("[") && token.endsWith("]")) ||
-            (token.startsWith("{") && token.endsWith("}")) ||
-            (token.startsWith("|") && token.endsWith("|")) ||
-            (token.startsWith("~") && token.endsWith("~"))) {
-            if (isValidVariable(token) && functions.find(token) != functions.end() &&
-                i + 1 < tokens.size() && tokens[i + 1] == "(") {
-                operators.push("FUNC:" + token);
+        const Token& token = tokens[i];
+
+        if (token.kind <= TOKEN_GROUP) {
+            if (token.kind == TOKEN_VARIABLE && i + 1 < tokens.size() && tokens[i + 1].kind == TOKEN_LPAREN &&
+                (functions.find(tokenString(source, token)) != functions.end() ||
+                 findNative(tokenString(source, token)) >= 0)) {
+                Token marker = token;
+                marker.kind = TOKEN_FUNC;
+                operators.push_back(marker);
                 ++i;
                 expect_operand = true;
                 continue;
@@ -1112,175 +2157,170 @@ std::vector<String> XenoCompiler::infixToPostfix(const std::vector<String>& toke
             output.push_back(token);
             expect_operand = false;
         }
-        else if (token == "(") {
-            operators.push(token);
+        else if (token.kind == TOKEN_LPAREN) {
+            operators.push_back(token);
             expect_operand = true;
         }
-        else if (token == ")") {
-            while (!operators.empty() && operators.top() != "(" &&
-                   !operators.top().startsWith("FUNC:")) {
-                output.push_back(operators.top());
-                operators.pop();
+        else if (token.kind == TOKEN_RPAREN) {
+            while (!operators.empty() && operators.back().kind != TOKEN_LPAREN &&
+                   operators.back().kind != TOKEN_FUNC) {
+                output.push_back(operators.back());
+                operators.pop_back();
             }
             if (operators.empty()) {
                 Serial.println("ERROR: Mismatched parentheses");
                 compile_error = true;
-                return output;
+                return;
             }
-            if (operators.top().startsWith("FUNC:")) {
-                String funcMarker = operators.top();
-                operators.pop();
-                String funcName = funcMarker.substring(5);
-                output.push_back("CALL:" + funcName);
-                expect_operand = false;
+            if (operators.back().kind == TOKEN_FUNC) {
+                Token call = operators.back();
+                operators.pop_back();
+                call.kind = TOKEN_CALL;
+                output.push_back(call);
             } else {
-                operators.pop();
-                expect_operand = false;
+                operators.pop_back();
             }
+            expect_operand = false;
         }
-        else if (token == ",") {
-            while (!operators.empty() && operators.top() != "(" &&
-                   !operators.top().startsWith("FUNC:")) {
-                output.push_back(operators.top());
-                operators.pop();
+        else if (token.kind == TOKEN_COMMA) {
+            while (!operators.empty() && operators.back().kind != TOKEN_LPAREN &&
+                   operators.back().kind != TOKEN_FUNC) {
+                output.push_back(operators.back());
+                operators.pop_back();
             }
-            if (operators.empty() ||
-                (operators.top() != "(" && !operators.top().startsWith("FUNC:"))) {
+            if (operators.empty()) {
                 Serial.println("ERROR: Comma outside function call");
                 compile_error = true;
-                return output;
+                return;
             }
             expect_operand = true;
         }
-        else if (token == "!" || token == "-") {
-            if (expect_operand) {
-                operators.push(token == "!" ? "UNARY_NOT" : "UNARY_NEG");
-            } else {
-                int token_precedence = getPrecedence(token);
-                while (!operators.empty() &&
-                        operators.top() != "(" &&
-                        !operators.top().startsWith("FUNC:") &&
-                        (getPrecedence(operators.top()) > token_precedence ||
-                        (getPrecedence(operators.top()) == token_precedence &&
-                        !isRightAssociative(token))))  {
-                    output.push_back(operators.top());
-                    operators.pop();
-                }
-                operators.push(token);
-                expect_operand = true;
-            }
-        }
         else {
-            int token_precedence = getPrecedence(token);
+            const char* text = source + token.start;
+            if (expect_operand && (textIs(text, token.length, "!") || textIs(text, token.length, "-"))) {
+                Token unary = token;
+                unary.kind = (text[0] == '!') ? TOKEN_UNARY_NOT : TOKEN_UNARY_NEG;
+                operators.push_back(unary);
+                continue;
+            }
+            int token_precedence = getPrecedence(source, token);
             while (!operators.empty() &&
-                    operators.top() != "(" &&
-                    !operators.top().startsWith("FUNC:") &&
-                    (getPrecedence(operators.top()) > token_precedence ||
-                    (getPrecedence(operators.top()) == token_precedence &&
-                    !isRightAssociative(token))))  {
-                output.push_back(operators.top());
-                operators.pop();
+                    operators.back().kind != TOKEN_LPAREN &&
+                    operators.back().kind != TOKEN_FUNC &&
+                    (getPrecedence(source, operators.back()) > token_precedence ||
+                    (getPrecedence(source, operators.back()) == token_precedence &&
+                    !isRightAssociative(source, token))))  {
+                output.push_back(operators.back());
+                operators.pop_back();
             }
-            operators.push(token);
+            operators.push_back(token);
             expect_operand = true;
         }
     }
 
     while (!operators.empty()) {
-        if (operators.top() == "(" || operators.top().startsWith("FUNC:")) {
+        if (operators.back().kind == TOKEN_LPAREN || operators.back().kind == TOKEN_FUNC) {
             Serial.println("ERROR: Mismatched parentheses or function call");
             compile_error = true;
-            return output;
+            return;
         }
-        output.push_back(operators.top());
-        operators.pop();
+        output.push_back(operators.back());
+        operators.pop_back();
     }
-
-    return output;
 }
 
-std::vector<String> XenoCompiler::tokenizeExpression(const String& expr) {
-    std::vector<String> tokens;
-    String currentToken;
-    bool inQuotes = false;
-    bool inSpecial = false;
-    char specialChar = 0;
-    tokens.reserve(expr.length() / 2);
+// Лексемы - срезы expr: строка выражения не копируется, String на лексему не создаётся
+void XenoCompiler::tokenizeExpression(const String& expr, TokenVector& tokens) {
+    tokens.clear();
 
     if (expr.length() > 1024) {
         Serial.println("ERROR: Expression too long");
-        return tokens;
+        return;
     }
 
-    for (size_t i = 0; i < expr.length(); ++i) {
-        char c = expr[i];
+    const char* source = expr.c_str();
+    const size_t length = expr.length();
+    size_t token_start = 0;
+    size_t token_length = 0;
+    bool inQuotes = false;
+    bool inSpecial = false;
+    char specialChar = 0;
+    tokens.reserve(length / 2);
+    if (length / 2 > 0) ++frontend_allocations;
+
+    auto flush = [&]() {
+        if (token_length > 0) {
+            Token token = {static_cast<uint16_t>(token_start), static_cast<uint16_t>(token_length),
+                           classifyToken(source + token_start, token_length)};
+            tokens.push_back(token);
+            token_length = 0;
+        }
+    };
+    auto append = [&](size_t i) {
+        if (token_length == 0) token_start = i;
+        ++token_length;
+    };
+
+    for (size_t i = 0; i < length; ++i) {
+        char c = source[i];
 
         if (c == '"' && !inSpecial) {
             if (inQuotes) {
-                currentToken += c;
-                if (!validateString(currentToken)) {
-                    currentToken = "\"\"";
+                append(i);
+                if (!validateString(token_length)) {
+                    // Слишком длинный литерал заменяется пустой строкой
+                    Token empty = {static_cast<uint16_t>(token_start), 0, TOKEN_STRING};
+                    tokens.push_back(empty);
+                    token_length = 0;
+                } else {
+                    flush();
                 }
-                tokens.push_back(currentToken);
-                currentToken = "";
                 inQuotes = false;
             } else {
-                if (!currentToken.isEmpty()) {
-                    tokens.push_back(currentToken);
-                    currentToken = "";
-                }
+                flush();
                 inQuotes = true;
-                currentToken += c;
+                append(i);
             }
             continue;
         }
 
         if (inQuotes) {
-            currentToken += c;
+            append(i);
             continue;
         }
 
         if ((c == '[' || c == '{' || c == '|' || c == '~' || c == '#' || c == '@' || c == '&') && !inSpecial) {
-            if (!currentToken.isEmpty()) {
-                tokens.push_back(currentToken);
-                currentToken = "";
-            }
+            flush();
             inSpecial = true;
             specialChar = c;
-            currentToken += c;
+            append(i);
             continue;
         } else if (inSpecial && c == specialChar) {
-            currentToken += c;
-            tokens.push_back(currentToken);
-            currentToken = "";
+            append(i);
+            flush();
             inSpecial = false;
             specialChar = 0;
             continue;
         }
 
         if (inSpecial) {
-            currentToken += c;
+            append(i);
             continue;
         }
 
         if (isspace(c)) {
-            if (!currentToken.isEmpty()) {
-                tokens.push_back(currentToken);
-                currentToken = "";
-            }
+            flush();
             continue;
         }
 
-        if (i + 1 < expr.length()) {
-            String twoChar = expr.substring(i, i + 2);
-            if (twoChar == "==" || twoChar == "!=" ||
-                twoChar == "<=" || twoChar == ">=" ||
-                twoChar == "&&" || twoChar == "||") {
-                if (!currentToken.isEmpty()) {
-                    tokens.push_back(currentToken);
-                    currentToken = "";
-                }
-                tokens.push_back(twoChar);
+        if (i + 1 < length) {
+            const char next = source[i + 1];
+            if ((next == '=' && (c == '=' || c == '!' || c == '<' || c == '>')) ||
+                (c == '&' && next == '&') || (c == '|' && next == '|')) {
+                flush();
+                append(i);
+                append(i + 1);
+                flush();
                 ++i;
                 continue;
             }
@@ -1290,21 +2330,16 @@ std::vector<String> XenoCompiler::tokenizeExpression(const String& expr) {
             c == '%' || c == '^' || c == '<' || c == '>' ||
             c == '(' || c == ')' || c == '!' || c == '[' || c == ']' ||
             c == ',') {
-            if (!currentToken.isEmpty()) {
-                tokens.push_back(currentToken);
-                currentToken = "";
-            }
-            tokens.push_back(String(c));
+            flush();
+            append(i);
+            flush();
         } else {
-            currentToken += c;
+            append(i);
         }
     }
 
-    if (!currentToken.isEmpty()) {
-        tokens.push_back(currentToken);
-    }
-
-    return tokens;
+    flush();
+    lexed_tokens += tokens.size();
 }
 
 // ------------------------------------------------------------------
@@ -1332,7 +2367,9 @@ void XenoCompiler::parseFunctionDeclaration(const String& args, int line_number)
         return;
     }
 
-    if (functions.find(funcName) != functions.end()) {
+    // При замене уже объявленная функция переопределяется, но только один раз
+    const bool replacing = patching && functions.count(funcName) > 0 && patched_functions.count(funcName) == 0;
+    if ((functions.find(funcName) != functions.end() && !replacing) || findNative(funcName) >= 0) {
         Serial.print("ERROR: Function '");
         Serial.print(funcName);
         Serial.print("' already defined at line ");
@@ -1346,7 +2383,7 @@ void XenoCompiler::parseFunctionDeclaration(const String& args, int line_number)
     std::vector<String> parameters;
     if (!paramsStr.isEmpty()) {
         int start = 0;
-        while (start < paramsStr.length()) {
+        while (start < static_cast<int>(paramsStr.length())) {
             int comma = paramsStr.indexOf(',', start);
             String param;
             if (comma >= 0) {
@@ -1381,13 +2418,29 @@ void XenoCompiler::parseFunctionDeclaration(const String& args, int line_number)
         }
     }
 
+    // Вызовы в основном коде уже кладут прежнее число аргументов
+    if (replacing && functions[funcName].arity != static_cast<int>(parameters.size())) {
+        Serial.print("ERROR: Function '");
+        Serial.print(funcName);
+        Serial.print("' must keep its parameter count to be updated, line ");
+        Serial.println(line_number);
+        compile_error = true;
+        return;
+    }
+    if (patching) patched_functions.insert(funcName);
+
     FunctionInfo funcInfo;
     funcInfo.name = funcName;
     funcInfo.parameters = parameters;
     funcInfo.arity = parameters.size();
     funcInfo.address = 0;
+    auto existing = functions.find(funcName);
+    funcInfo.index = (existing != functions.end()) ? existing->second.index : functions.size();
 
     functions[funcName] = funcInfo;
+    for (ImportRecording* rec : import_recordings) {
+        rec->function_names.push_back(funcName);
+    }
 
     inside_function_declaration = true;
     pending_function = funcInfo;
@@ -1400,41 +2453,140 @@ void XenoCompiler::parseFunctionDeclaration(const String& args, int line_number)
     }
 }
 
+// on pin <pin> [change|rising|falling] <func> / on timer <ms> <func>: функция объявлена выше,
+// у неё не больше одного параметра (уровень пина или номер срабатывания таймера)
+void XenoCompiler::handleOnCommand(const String& args, int line_number) {
+    std::vector<String> parts;
+    for (int start = 0; start < static_cast<int>(args.length());) {
+        int space = args.indexOf(' ', start);
+        if (space < 0) space = args.length();
+        String part = args.substring(start, space);
+        part.trim();
+        if (!part.isEmpty()) parts.push_back(part);
+        start = space + 1;
+    }
+
+    const bool is_pin = parts.size() >= 3 && keywordIs(parts[0].c_str(), parts[0].length(), "pin");
+    const bool is_timer = parts.size() == 3 && keywordIs(parts[0].c_str(), parts[0].length(), "timer");
+    if ((!is_pin && !is_timer) || parts.size() > 4 || !isInteger(parts[1])) {
+        Serial.print("ERROR: on requires 'pin <pin> [change|rising|falling] <func>' or 'timer <ms> <func>' at line ");
+        Serial.println(line_number);
+        compile_error = true;
+        return;
+    }
+
+    uint32_t source;
+    const long value = parts[1].toInt();
+    if (is_pin) {
+        uint8_t edge = XENO_EDGE_CHANGE;
+        if (parts.size() == 4) {
+            if (keywordIs(parts[2].c_str(), parts[2].length(), "rising")) {
+                edge = XENO_EDGE_RISING;
+            } else if (keywordIs(parts[2].c_str(), parts[2].length(), "falling")) {
+                edge = XENO_EDGE_FALLING;
+            } else if (!keywordIs(parts[2].c_str(), parts[2].length(), "change")) {
+                Serial.print("ERROR: Unknown pin edge '");
+                Serial.print(parts[2]);
+                Serial.print("' at line ");
+                Serial.println(line_number);
+                compile_error = true;
+                return;
+            }
+        }
+        if (value < 0 || value > 255 || !security.isPinAllowed(value)) {
+            Serial.print("ERROR: Pin not allowed at line ");
+            Serial.println(line_number);
+            compile_error = true;
+            return;
+        }
+        source = packPinEvent(value, edge);
+    } else {
+        if (value <= 0 || value > static_cast<long>(XENO_MAX_EVENT_PERIOD)) {
+            Serial.print("ERROR: Timer period out of range at line ");
+            Serial.println(line_number);
+            compile_error = true;
+            return;
+        }
+        source = packEventSource(XENO_EVENT_TIMER, value);
+    }
+
+    auto it = functions.find(parts.back());
+    if (it == functions.end()) {
+        Serial.print("ERROR: Function '");
+        Serial.print(parts.back());
+        Serial.print("' not defined at line ");
+        Serial.println(line_number);
+        compile_error = true;
+        return;
+    }
+    if (it->second.arity > 1) {
+        Serial.print("ERROR: Event handler '");
+        Serial.print(parts.back());
+        Serial.print("' must take at most one parameter at line ");
+        Serial.println(line_number);
+        compile_error = true;
+        return;
+    }
+    emitInstruction(OP_EVENT_BIND, source, it->second.index);
+}
+
 // ------------------------------------------------------------------
 // Главный метод компиляции строки (добавлен import)
 // ------------------------------------------------------------------
 
 void XenoCompiler::compileLine(const String& line, int line_number) {
-    String cleanedLine = cleanLine(line);
-    if (cleanedLine.isEmpty()) return;
+    size_t begin, end;
+    cleanLine(line, begin, end);
+    if (begin == end) return;
 
-    if (cleanedLine.length() > 512) {
+    if (end - begin > 512) {
         Serial.print("ERROR: Line too long at line ");
         Serial.println(line_number);
         compile_error = true;
         return;
     }
+    ++compiled_lines;
+    if (import_depth == 0) {
+        current_line = static_cast<uint16_t>(std::min<int>(line_number, 0xFFFF));
+    }
 
-    int firstSpace = cleanedLine.indexOf(' ');
-    String command = (firstSpace > 0) ? cleanedLine.substring(0, firstSpace) : cleanedLine;
-    String args = (firstSpace > 0) ? cleanedLine.substring(firstSpace + 1) : "";
-    args.trim();
-    command.toLowerCase();
+    // Команда распознаётся прямо в строке, копируются только аргументы
+    const char* text = line.c_str();
+    const char* space = static_cast<const char*>(memchr(text + begin, ' ', end - begin));
+    size_t command_end = space ? space - text : end;
+    size_t args_begin = space ? command_end + 1 : end;
+    while (args_begin < end && isspace(static_cast<unsigned char>(text[args_begin]))) ++args_begin;
+
+    const uint8_t command = lookupKeyword(text + begin, command_end - begin);
+    String args;
+    if (args_begin < end) {
+        args.concat(text + args_begin, end - args_begin);
+        ++frontend_allocations;
+    }
+
+    // ---- При замене функций основной код не меняется ----
+    if (patching && (command == KW_IMPORT || (!inside_function_declaration && command != KW_FUNC))) {
+        Serial.print("ERROR: Only func blocks can be updated, line ");
+        Serial.println(line_number);
+        compile_error = true;
+        return;
+    }
 
     // ---- Обработка import (всегда, даже внутри функций) ----
-    if (command == "import") {
+    if (command == KW_IMPORT) {
         handleImport(args, line_number);
         return;
     }
 
     // ---- Если мы внутри функции, обрабатываем только endfunc и return ----
     if (inside_function_declaration) {
-        if (command == "endfunc") {
+        if (command == KW_ENDFUNC) {
             emitInstruction(OP_RETURN);
             inside_function_declaration = false;
 
             int offset = function_code.size();
             function_code.insert(function_code.end(), current_function_code.begin(), current_function_code.end());
+            relocateJumps(function_code, offset, offset);
             auto it = functions.find(pending_function.name);
             if (it != functions.end()) {
                 it->second.address = offset;
@@ -1447,7 +2599,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             function_param_names.clear();
 
             return;
-        } else if (command == "return") {
+        } else if (command == KW_RETURN) {
             if (!args.isEmpty()) {
                 compileExpression(args);
                 if (compile_error) return;
@@ -1460,14 +2612,14 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
     }
 
     // ---- Обработка FUNC (вне функции) ----
-    if (command == "func" && !inside_function_declaration) {
+    if (command == KW_FUNC && !inside_function_declaration) {
         args.trim();
         parseFunctionDeclaration(args, line_number);
         return;
     }
 
     // ---- Обработка RETURN (вне функции) - ошибка ----
-    if (command == "return" && !inside_function_declaration) {
+    if (command == KW_RETURN && !inside_function_declaration) {
         Serial.print("ERROR: RETURN outside function at line ");
         Serial.println(line_number);
         compile_error = true;
@@ -1477,7 +2629,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
     // ---- Остальные команды ----
     bool simple_command_found = false;
     for (size_t i = 0; i < simple_commands_count; i++) {
-        if (command == simple_commands[i].name) {
+        if (command == simple_commands[i].keyword) {
             emitInstruction(simple_commands[i].opcode);
             simple_command_found = true;
             break;
@@ -1488,31 +2640,51 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
         return;
     }
 
-    if (command == "array") {
+    if (!commandEnabled(command)) {
+        Serial.print("ERROR: Command not compiled into this build at line ");
+        Serial.println(line_number);
+        compile_error = true;
+        return;
+    }
+#if XENO_FEATURE_ARRAYS
+    if (command == KW_ARRAY) {
         handleArrayCommand(args, line_number);
         return;
     }
-    if (command == "analogread") {
+#endif
+#if XENO_FEATURE_ANALOG
+    if (command == KW_ANALOGREAD) {
         handleAnalogRead(args, line_number);
         return;
     }
-    if (command == "analogwrite") {
+    if (command == KW_ANALOGWRITE) {
         handleAnalogWrite(args, line_number);
         return;
     }
-    if (command == "digitalread") {
+#endif
+    if (command == KW_DIGITALREAD) {
         handleDigitalRead(args, line_number);
         return;
     }
+    if (command == KW_DIGITALWRITE) {
+        handleDigitalWrite(args, line_number);
+        return;
+    }
+#if XENO_FEATURE_EVENTS
+    if (command == KW_ON) {
+        handleOnCommand(args, line_number);
+        return;
+    }
+#endif
 
-    if (command == "print") {
+    if (command == KW_PRINT) {
         String text = args;
         String var_name = extractVariableName(text);
         if (!var_name.isEmpty()) {
             if (isValidVariable(var_name)) {
-                int var_index = getVariableIndex(var_name);
-                emitInstruction(OP_LOAD, var_index);
+                emitLoadVariable(var_name);
                 emitInstruction(OP_PRINT_NUM);
+                emitInstruction(OP_POP);    // PRINT_NUM оставляет значение на стеке: иначе print в цикле копит стек
             } else {
                 Serial.print("ERROR: Invalid variable name in print at line ");
                 Serial.println(line_number);
@@ -1528,7 +2700,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             int str_id = addString(text);
             emitInstruction(OP_PRINT, str_id);
         }
-    } else if (command == "led") {
+    } else if (command == KW_LED) {
         int spaceIndex = args.indexOf(' ');
         if (spaceIndex > 0) {
             String pin_str = args.substring(0, spaceIndex);
@@ -1556,7 +2728,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             Serial.print("WARNING: Invalid LED command at line ");
             Serial.println(line_number);
         }
-    } else if (command == "delay") {
+    } else if (command == KW_DELAY) {
         int delay_time = args.toInt();
         if (delay_time < 0 || delay_time > 60000) {
             Serial.print("WARNING: Delay time out of range at line ");
@@ -1564,10 +2736,9 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             delay_time = min(max(delay_time, 0), 60000);
         }
         emitInstruction(OP_DELAY, delay_time);
-    } else if (command == "push") {
+    } else if (command == KW_PUSH) {
         if (isValidVariable(args)) {
-            int var_index = getVariableIndex(args);
-            emitInstruction(OP_LOAD, var_index);
+            emitLoadVariable(args);
         } else if (isFloat(args)) {
             float fval = args.toFloat();
             uint32_t fbits;
@@ -1587,7 +2758,8 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             int32_t value = args.toInt();
             emitInstruction(OP_PUSH, static_cast<uint32_t>(value));
         }
-    } else if (command == "input") {
+#if XENO_FEATURE_INPUT
+    } else if (command == KW_INPUT) {
         String var_name = args;
         if (!validateVariableName(var_name)) {
             Serial.print("ERROR: Invalid variable name for input at line ");
@@ -1595,11 +2767,12 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             compile_error = true;
             return;
         }
-        int var_index = getVariableIndex(var_name);
-        emitInstruction(OP_INPUT, var_index);
-    } else if (command == "set") {
+        // INPUT всегда пишет в глобальную переменную
+        emitInstruction(OP_INPUT, addString(var_name), getGlobalSlot(var_name));
+#endif
+    } else if (command == KW_SET) {
         handleSetCommand(args, line_number);
-    } else if (command == "if") {
+    } else if (command == KW_IF) {
         if (if_chain_stack.size() >= security_config.getMaxIfDepth()) {
             Serial.print("ERROR: IF nesting too deep at line ");
             Serial.println(line_number);
@@ -1614,7 +2787,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
 
             int jump_addr = getCurrentAddress();
             emitInstruction(OP_JUMP_IF, 0);
-            IfContext ctx;
+            IfContext ctx(arena);
             ctx.if_jumps.push_back(jump_addr);
             if_chain_stack.push_back(ctx);
         } else {
@@ -1622,7 +2795,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             Serial.println(line_number);
             compile_error = true;
         }
-    } else if (command == "else") {
+    } else if (command == KW_ELSE) {
         if (if_chain_stack.empty()) {
             Serial.print("ERROR: ELSE without IF at line ");
             Serial.println(line_number);
@@ -1638,7 +2811,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             IfContext& ctx = if_chain_stack.back();
             if (!ctx.if_jumps.empty()) {
                 int last_if = ctx.if_jumps.back();
-                bytecode[last_if].arg1 = getCurrentAddress();
+                (*current_output)[last_if].arg1 = getCurrentAddress();
             } else {
                 Serial.print("ERROR: No if jump to fix at line ");
                 Serial.println(line_number);
@@ -1666,7 +2839,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             IfContext& ctx = if_chain_stack.back();
             if (!ctx.if_jumps.empty()) {
                 int last_if = ctx.if_jumps.back();
-                bytecode[last_if].arg1 = getCurrentAddress();
+                (*current_output)[last_if].arg1 = getCurrentAddress();
             } else {
                 Serial.print("ERROR: No if jump to fix at line ");
                 Serial.println(line_number);
@@ -1675,7 +2848,7 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             }
             ctx.else_jumps.push_back(jump_else);
         }
-    } else if (command == "endif") {
+    } else if (command == KW_ENDIF) {
         if (if_chain_stack.empty()) {
             Serial.print("ERROR: ENDIF without IF at line ");
             Serial.println(line_number);
@@ -1686,16 +2859,16 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
         if_chain_stack.pop_back();
         int end_addr = getCurrentAddress();
         for (int addr : ctx.if_jumps) {
-            if (addr < bytecode.size()) {
-                bytecode[addr].arg1 = end_addr;
+            if (static_cast<size_t>(addr) < current_output->size()) {
+                (*current_output)[addr].arg1 = end_addr;
             }
         }
         for (int addr : ctx.else_jumps) {
-            if (addr < bytecode.size()) {
-                bytecode[addr].arg1 = end_addr;
+            if (static_cast<size_t>(addr) < current_output->size()) {
+                (*current_output)[addr].arg1 = end_addr;
             }
         }
-    } else if (command == "while") {
+    } else if (command == KW_WHILE) {
         if (while_stack.size() >= security_config.getMaxLoopDepth()) {
             Serial.print("ERROR: While loop nesting too deep at line ");
             Serial.println(line_number);
@@ -1707,14 +2880,17 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
         compileExpression(args);
         if (compile_error) return;
 
-        int jump_if_addr = getCurrentAddress();
-        emitInstruction(OP_JUMP_IF, 0);
+        int jump_if_addr = loop_start;
+        if (!fuseLoopCondition(loop_start)) {
+            jump_if_addr = getCurrentAddress();
+            emitInstruction(OP_JUMP_IF, 0);
+        }
 
         LoopInfo info;
         info.start_address = loop_start;
         info.condition_address = jump_if_addr;
         while_stack.push_back(info);
-    } else if (command == "endwhile") {
+    } else if (command == KW_ENDWHILE) {
         if (while_stack.empty()) {
             Serial.print("ERROR: ENDWHILE without WHILE at line ");
             Serial.println(line_number);
@@ -1725,17 +2901,26 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
         LoopInfo info = while_stack.back();
         while_stack.pop_back();
 
-        emitInstruction(OP_JUMP, info.start_address);
+        // Слитое условие: обратный переход сразу проверяет его и ведёт в тело
+        XenoInstruction check = (info.condition_address == info.start_address &&
+                                 static_cast<size_t>(info.condition_address) < current_output->size())
+                                    ? (*current_output)[info.condition_address] : XenoInstruction(OP_NOP);
+        if (isSlotCompareJump(check.opcode)) {
+            uint8_t back_op = (check.opcode == OP_CMP_JUMP_LOCAL) ? OP_LOOP_JUMP_LOCAL : OP_LOOP_JUMP_GLOBAL;
+            emitInstruction(back_op, check.arg1, info.start_address + 1);
+        } else {
+            emitInstruction(OP_JUMP, info.start_address);
+        }
 
         int end_addr = getCurrentAddress();
-        if (info.condition_address < bytecode.size()) {
-            bytecode[info.condition_address].arg1 = end_addr;
+        if (static_cast<size_t>(info.condition_address) < current_output->size()) {
+            setJumpTarget((*current_output)[info.condition_address], end_addr);
         } else {
             Serial.print("ERROR: Invalid condition address in ENDWHILE at line ");
             Serial.println(line_number);
             compile_error = true;
         }
-    } else if (command == "for") {
+    } else if (command == KW_FOR) {
         if (loop_stack.size() >= security_config.getMaxLoopDepth()) {
             Serial.print("ERROR: Loop nesting too deep at line ");
             Serial.println(line_number);
@@ -1770,6 +2955,10 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
                 compile_error = true;
                 return;
             }
+            emitStoreVariable(var_name);
+
+            int loop_start = getCurrentAddress();
+            emitLoadVariable(var_name);
             XenoDataType endType = compileExpressionWithType(end_expr);
             if (compile_error) return;
             if (!isNumericType(endType)) {
@@ -1778,18 +2967,17 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
                 compile_error = true;
                 return;
             }
-
-            int var_index = getVariableIndex(var_name);
-            compileExpression(start_expr);
-            emitInstruction(OP_STORE, var_index);
-
-            int loop_start = getCurrentAddress();
-            emitInstruction(OP_LOAD, var_index);
-            compileExpression(end_expr);
             emitInstruction(OP_LTE);
 
-            int condition_jump = getCurrentAddress();
-            emitInstruction(OP_JUMP_IF, 0);
+            // Константная граница: проверка один раз перед телом,
+            // затем OP_INC_JUMP_* в endfor (один переход на итерацию)
+            int condition_jump = loop_start;
+            if (fuseLoopCondition(loop_start)) {
+                loop_start = getCurrentAddress();
+            } else {
+                condition_jump = getCurrentAddress();
+                emitInstruction(OP_JUMP_IF, 0);
+            }
 
             LoopInfo loop_info;
             loop_info.var_name = var_name;
@@ -1802,12 +2990,22 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
             Serial.println(line_number);
             compile_error = true;
         }
-    } else if (command == "endfor") {
+    } else if (command == KW_ENDFOR) {
         if (!loop_stack.empty()) {
             LoopInfo loop_info = loop_stack.back();
             loop_stack.pop_back();
 
-            emitInstruction(OP_LOAD, getVariableIndex(loop_info.var_name));
+            if (static_cast<size_t>(loop_info.condition_address) < current_output->size()) {
+                XenoInstruction check = (*current_output)[loop_info.condition_address];
+                if (isSlotCompareJump(check.opcode)) {
+                    uint8_t step_op = (check.opcode == OP_CMP_JUMP_LOCAL) ? OP_INC_JUMP_LOCAL : OP_INC_JUMP_GLOBAL;
+                    emitInstruction(step_op, check.arg1, loop_info.start_address);
+                    (*current_output)[loop_info.condition_address].arg2 = getCurrentAddress();
+                    return;
+                }
+            }
+
+            emitLoadVariable(loop_info.var_name);
             auto var_it = variable_map.find(loop_info.var_name);
             if (var_it != variable_map.end() &&
                 var_it->second.type == TYPE_FLOAT) {
@@ -1819,11 +3017,11 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
                 emitInstruction(OP_PUSH, 1);
             }
             emitInstruction(OP_ADD);
-            emitInstruction(OP_STORE, getVariableIndex(loop_info.var_name));
+            emitStoreVariable(loop_info.var_name);
             emitInstruction(OP_JUMP, loop_info.start_address);
 
-            if (loop_info.condition_address < bytecode.size()) {
-                bytecode[loop_info.condition_address].arg1 = getCurrentAddress();
+            if (static_cast<size_t>(loop_info.condition_address) < current_output->size()) {
+                setJumpTarget((*current_output)[loop_info.condition_address], getCurrentAddress());
             }
         } else {
             Serial.print("ERROR: ENDFOR without FOR at line ");
@@ -1834,7 +3032,10 @@ void XenoCompiler::compileLine(const String& line, int line_number) {
         Serial.print("WARNING: Unknown command at line ");
         Serial.print(line_number);
         Serial.print(": ");
-        Serial.println(command);
+        String word;
+        word.concat(text + begin, command_end - begin);
+        word.toLowerCase();
+        Serial.println(word);
     }
 }
 
@@ -1875,6 +3076,7 @@ XenoValue XenoCompiler::createValueFromString(const String& str, XenoDataType ty
             value.bool_val = (str == "true");
             break;
         case TYPE_ARRAY:
+        case TYPE_ANY:
             break;
     }
     return value;
@@ -1889,7 +3091,40 @@ void XenoCompiler::emitInstruction(uint8_t opcode, uint32_t arg1, uint16_t arg2)
         compile_error = true;
         return;
     }
+    // Операции выключенных семейств (xeno_features.h), например a ^ b или элемент массива в выражении
+    if (!opcodeEnabled(opcode)) {
+        Serial.print("ERROR: Operation not compiled into this build at line ");
+        Serial.println(current_line);
+        compile_error = true;
+        return;
+    }
     current_output->emplace_back(opcode, arg1, arg2);
+    current_output->back().line = current_line;
+}
+
+// Условие цикла вида "var cmp константа" (LOAD, PUSH, cmp с адреса start) заменяется
+// одной инструкцией OP_CMP_JUMP_*; адрес выхода дописывается при закрытии цикла.
+bool XenoCompiler::fuseLoopCondition(int start) {
+    std::vector<XenoInstruction>& code = *current_output;
+    if (code.size() != static_cast<size_t>(start) + 3) return false;
+
+    const XenoInstruction& load = code[start];
+    const XenoInstruction& push = code[start + 1];
+    uint8_t compare_op = genericOpcode(code[start + 2].opcode);
+    if ((load.opcode != OP_LOAD && load.opcode != OP_LOAD_LOCAL) || load.arg1 > XENO_MAX_COMPARE_SLOT ||
+        push.opcode != OP_PUSH || !isComparisonOpcode(compare_op)) {
+        return false;
+    }
+    int32_t imm = static_cast<int32_t>(push.arg1);
+    if (imm < std::numeric_limits<int16_t>::min() || imm > std::numeric_limits<int16_t>::max()) {
+        return false;
+    }
+
+    uint8_t opcode = (load.opcode == OP_LOAD_LOCAL) ? OP_CMP_JUMP_LOCAL : OP_CMP_JUMP_GLOBAL;
+    uint32_t operand = packSlotCompare(load.arg1, compare_op, imm);
+    code.resize(start);
+    emitInstruction(opcode, operand, 0);
+    return true;
 }
 
 int XenoCompiler::getCurrentAddress() {
@@ -1903,6 +3138,44 @@ String XenoCompiler::extractVariableName(const String& text) {
 const std::vector<XenoInstruction>& XenoCompiler::getBytecode() const { return bytecode; }
 const std::vector<String>& XenoCompiler::getStringTable() const { return string_table; }
 
+std::vector<uint16_t> XenoCompiler::getLineTable() const {
+    std::vector<uint16_t> lines(bytecode.size());
+    for (size_t i = 0; i < bytecode.size(); ++i) {
+        lines[i] = bytecode[i].line;
+    }
+    return lines;
+}
+
 void XenoCompiler::printCompiledCode() {
+#if XENO_FEATURE_DEBUG
     Debugger::disassemble(bytecode, string_table, "Compiled Xeno Program", true);
+#else
+    Serial.println("Disassembler is not compiled in: build with -DXENO_FEATURE_DEBUG=1");
+#endif
+    if (compile_error) return;
+    Serial.print("Optimization level ");
+    Serial.print(optimization_level);
+    Serial.print(": ");
+    Serial.print(unoptimized_size);
+    Serial.print(" -> ");
+    Serial.print(bytecode.size());
+    Serial.println(" instructions");
+    Serial.print("Compile time: ");
+    Serial.print(compile_time_us);
+    Serial.print(" us, ");
+    Serial.print(compiled_lines);
+    Serial.print(" lines, ");
+    Serial.print(lexed_tokens);
+    Serial.print(" tokens, ");
+    Serial.print(frontend_allocations);
+    Serial.println(" front-end allocations");
+    if (import_cache != nullptr && import_cache->hits + import_cache->misses > 0) {
+        Serial.print("Import cache: ");
+        Serial.print(import_cache->hits);
+        Serial.print(" hits, ");
+        Serial.print(import_cache->misses);
+        Serial.print(" misses, ");
+        Serial.print(import_cache->entries.size());
+        Serial.println(" modules cached");
+    }
 }
\ No newline at end of file
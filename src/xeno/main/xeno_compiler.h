@@ -19,25 +19,35 @@
 
 #include <vector>
 #include <map>
+#include <set>
 #include <stack>
 #include <algorithm>
 #include <FS.h>                     // Для работы с файловыми системами
 #include "../xeno_common.h"
 #include "../security/xeno_security.h"
+#include "../import/xeno_import_cache.h"
+#include "../native/xeno_native.h"
+#include "../memory/xeno_arena.h"
+#include "../memory/xeno_string_index.h"
 
 class XenoCompiler {
  private:
     std::vector<XenoInstruction> bytecode;
     std::vector<String> string_table;
+    XenoStringIndex string_index;               // Текст -> номер в string_table
     std::map<String, XenoValue> variable_map;
+    std::map<String, uint16_t> global_slots;    // Имя глобальной переменной -> слот
     std::map<String, bool> is_array;
-    std::vector<IfContext> if_chain_stack;
-    std::vector<LoopInfo> loop_stack;
-    std::vector<LoopInfo> while_stack;
+    XenoArena* arena;                           // Временные буферы компиляции (может быть nullptr - куча)
+    XenoArenaVector<IfContext> if_chain_stack;
+    XenoArenaVector<LoopInfo> loop_stack;
+    XenoArenaVector<LoopInfo> while_stack;
     XenoSecurityConfig& security_config;
     XenoSecurity security;
 
     bool compile_error;
+    uint8_t optimization_level;                 // Уровень XenoOptimizer (0 - выключен)
+    size_t unoptimized_size;                    // Размер байткода до оптимизации
 
     // ---- Таблица функций ----
     std::map<String, FunctionInfo> functions;
@@ -53,12 +63,54 @@ class XenoCompiler {
     std::vector<XenoInstruction> function_code;
     std::vector<XenoInstruction> current_function_code;
     std::vector<XenoInstruction>* current_output;
+    uint16_t current_line;                  // Строка основного исходника для новых инструкций
 
     // ---- Поддержка импорта ----
     fs::FS* filesystem;                     // Указатель на файловую систему
-    std::vector<String> imported_files;     // Список уже импортированных файлов
+    std::set<String> imported_files;        // Уже импортированные файлы
     uint16_t import_depth;                  // Текущая глубина импорта (для проверки)
 
+    // ---- Кеш импорта: запись модуля, компилируемого из исходника ----
+    struct ImportRecording {
+        XenoImportEntry entry;
+        std::map<String, uint16_t> string_index;    // Строка -> номер в entry.strings
+        std::map<String, uint16_t> global_index;    // Имя -> номер в entry.globals
+        std::vector<String> function_names;         // Объявленные функции по порядку
+        std::map<String, XenoValue> variables_before;
+        std::map<String, bool> arrays_before;
+        size_t code_start;
+        size_t function_start;
+        uint16_t base_depth;
+    };
+
+    XenoImportCache* import_cache;          // Принадлежит XenoLanguage, живёт между компиляциями
+    std::vector<ImportRecording*> import_recordings;    // Вложенные модули пишутся одновременно
+
+    const XenoNativeTable* natives;         // Функции хоста, принадлежит XenoLanguage (может быть nullptr)
+    int16_t findNative(const String& name) const;
+
+    // ---- Горячая замена функций (compileFunctions) ----
+    // Состояние до замены: восстанавливается, если компиляция или VM её отвергли
+    struct PatchSnapshot {
+        size_t code_size = 0;
+        std::vector<XenoInstruction> code;      // Весь байткод до compactFunctions (иначе пуст)
+        std::vector<uint32_t> body_starts;
+        std::vector<String> string_table;
+        std::map<String, XenoValue> variable_map;
+        std::map<String, uint16_t> global_slots;
+        std::map<String, bool> is_array;
+        std::map<String, FunctionInfo> functions;
+    };
+    bool patchable;                         // Программа скомпилирована из исходника, а не взята из образа
+    bool patching;                          // Идёт compileFunctions: разрешены только блоки func
+    std::set<String> patched_functions;     // Функции, объявленные в текущей замене
+    PatchSnapshot patch_snapshot;
+    bool patch_pending;                     // Замена скомпилирована, но ещё не принята или отвергнута
+    // Начала всех тел функций в байткоде по возрастанию, включая тела, уже заменённые новыми:
+    // тело продолжается до следующего начала, первое начало - конец основного кода
+    std::vector<uint32_t> body_starts;
+    void recordBodyStarts(const std::map<String, FunctionInfo>& bodies);
+
     struct MathFunctionInfo {
         const char* name;
         char open_bracket;
@@ -70,37 +122,90 @@ class XenoCompiler {
     static const MathFunctionInfo math_functions[];
     static const size_t math_functions_count;
 
-    void compileMathFunction(const String& token, const MathFunctionInfo& func);
+    void compileMathFunction(const char* token, size_t length, const MathFunctionInfo& func);
     void compileSimpleCommand(const String& command, uint8_t opcode);
 
+    // ---- Ключевые слова команд (распознаются без копирования строки) ----
+    enum Keyword : uint8_t {
+        KW_NONE, KW_IMPORT, KW_FUNC, KW_ENDFUNC, KW_RETURN, KW_ARRAY, KW_ANALOGREAD, KW_ANALOGWRITE,
+        KW_DIGITALREAD, KW_PRINT, KW_LED, KW_DELAY, KW_PUSH, KW_INPUT, KW_SET, KW_IF, KW_ELSE, KW_ENDIF,
+        KW_WHILE, KW_ENDWHILE, KW_FOR, KW_ENDFOR,
+        KW_POP, KW_ADD, KW_SUB, KW_MUL, KW_DIV, KW_MOD, KW_ABS, KW_POW, KW_MAX, KW_MIN, KW_SQRT,
+        KW_PRINTNUM, KW_HALT, KW_DIGITALWRITE, KW_ON
+    };
+
     struct SimpleCommand {
-        const char* name;
+        uint8_t keyword;
         uint8_t opcode;
     };
 
     static const SimpleCommand simple_commands[];
     static const size_t simple_commands_count;
 
+    // ---- Лексема выражения: срез строки выражения (смещение + длина), без копии ----
+    enum TokenKind : uint8_t {
+        TOKEN_INT, TOKEN_FLOAT, TOKEN_BOOL, TOKEN_STRING, TOKEN_VARIABLE,
+        TOKEN_GROUP,            // Свёрнутая математическая функция: [..] {..} |..| ~..~
+        TOKEN_LPAREN, TOKEN_RPAREN, TOKEN_COMMA,
+        TOKEN_OPERATOR,         // Операторы и прочие лексемы (в том числе #..# @..@ &..&)
+        TOKEN_UNARY_NOT, TOKEN_UNARY_NEG,
+        TOKEN_FUNC,             // Маркер вызова в стеке операторов, срез - имя функции
+        TOKEN_CALL              // Вызов функции в постфиксной записи, срез - имя функции
+    };
+
+    struct Token {
+        uint16_t start;
+        uint16_t length;        // 0 у строкового литерала, заменённого пустой строкой
+        uint8_t kind;
+    };
+
+    typedef XenoArenaVector<Token> TokenVector;
+
+    String token_text;                      // Переиспользуемый буфер для поиска имени лексемы в таблицах
+    size_t token_text_capacity;
+
+    // ---- Метрики последней компиляции ----
+    uint32_t compile_start_us;
+    uint32_t compile_time_us;
+    uint32_t compiled_lines;
+    uint32_t lexed_tokens;
+    uint32_t frontend_allocations;          // Буферы лексем и копии строк, сделанные лексером и парсером
+
     friend class XenoLanguage;
+    friend class XenoScheduler;
 
     bool validateString(const String& str);
+    bool validateString(size_t length);
     bool validateVariableName(const String& name);
-    String cleanLine(const String& line);
+    void cleanLine(const String& line, size_t& begin, size_t& end);
+    static uint8_t lookupKeyword(const char* word, size_t length);
+    static bool commandEnabled(uint8_t command);
     int addString(const String& str);
-    int getVariableIndex(const String& var_name);
+    void rebuildStringIndex();
+    int getGlobalSlot(const String& var_name);
+    int getLocalSlot(const String& var_name);
+    void emitLoadVariable(const String& var_name);
+    void emitStoreVariable(const String& var_name);
     bool isInteger(const String& str);
+    bool isInteger(const char* str, size_t length);
     bool isFloat(const String& str);
+    bool isFloat(const char* str, size_t length);
     bool isBool(const String& str);
+    bool isBool(const char* str, size_t length);
     bool isQuotedString(const String& str);
+    bool isQuotedString(const char* str, size_t length);
     bool isValidVariable(const String& str);
-    bool isComparisonOperator(const String& str);
-    int getPrecedence(const String& op);
-    bool isRightAssociative(const String& op);
+    bool isValidVariable(const char* str, size_t length);
+    bool isComparisonOperator(const char* op, size_t length);
+    int getPrecedence(const char* source, const Token& op);
+    bool isRightAssociative(const char* source, const Token& op);
     String processFunctions(const String& expr);
     int findMatchingParenthesis(const String& expr, int start);
-    std::vector<String> infixToPostfix(const std::vector<String>& tokens);
-    std::vector<String> tokenizeExpression(const String& expr);
-    XenoDataType compilePostfix(const std::vector<String>& postfix);
+    uint8_t classifyToken(const char* token, size_t length);
+    const String& tokenString(const char* source, const Token& token);
+    void tokenizeExpression(const String& expr, TokenVector& tokens);
+    void infixToPostfix(const char* source, const TokenVector& tokens, TokenVector& output);
+    XenoDataType compilePostfix(const char* source, const TokenVector& postfix);
     void compileExpression(const String& expr);
     XenoDataType compileExpressionWithType(const String& expr);
     String extractVariableName(const String& text);
@@ -108,32 +213,78 @@ class XenoCompiler {
     XenoValue createValueFromString(const String& str, XenoDataType type);
     void emitInstruction(uint8_t opcode, uint32_t arg1 = 0, uint16_t arg2 = 0);
     int getCurrentAddress();
+    bool fuseLoopCondition(int start);
     void compileLine(const String& line, int line_number);
 
     void handleArrayCommand(const String& args, int line_number);
     void handleAnalogRead(const String& args, int line_number);
     void handleAnalogWrite(const String& args, int line_number);
     void handleDigitalRead(const String& args, int line_number);
+    void handleDigitalWrite(const String& args, int line_number);
+    // Список пинов "2,4,5" одного банка из 32 пинов: банк и маска для групповых опкодов
+    bool parsePinGroup(const String& pins, int line_number, uint8_t& bank, uint32_t& mask);
+    void handleOnCommand(const String& args, int line_number);
     void handleSetCommand(const String& args, int line_number);
 
     void parseFunctionDeclaration(const String& args, int line_number);
 
     // ---- Обработка импорта ----
     void handleImport(const String& args, int line_number);
+    bool importCacheable() const;
+    uint32_t importContextHash();
+    bool importDependenciesCurrent(const XenoImportEntry& entry);
+    bool linkImport(const XenoImportEntry& entry);
+    void noteImport(const String& filename, uint32_t content_hash, const XenoImportEntry* cached);
+    void finishImportRecording(ImportRecording& rec);
 
     // ---- Внутренний метод компиляции строки (без сброса состояния) ----
     void compileStringInternal(const String& source_code, int line_offset = 0);
+    void compileStreamInternal(Stream& input, int line_offset = 0);
+    void resetState();
+    void finishCompile();
+    // Стеки if/циклов держат память арены выше метки компиляции: очищаются до отката
+    void releaseTemporaries();
+
+    static const size_t STREAM_CHUNK_SIZE = 128;        // Буфер чтения потока (на стеке)
+    static const size_t MAX_SOURCE_LINE_LENGTH = 1024;  // Строка исходника до удаления комментария
 
  protected:
-    explicit XenoCompiler(XenoSecurityConfig& config);
+    // arena - временные буферы компиляции; после compile они возвращаются в арену целиком
+    explicit XenoCompiler(XenoSecurityConfig& config, XenoArena* arena = nullptr);
     void compile(const String& source_code);
+    void compileStream(Stream& input);
     const std::vector<XenoInstruction>& getBytecode() const;
     const std::vector<String>& getStringTable() const;
     const std::map<String, FunctionInfo>& getFunctions() const { return functions; }
+    bool hasErrors() const { return compile_error; }
     void printCompiledCode();
+    // Строка исходника для каждой инструкции итогового байткода (0 - неизвестна).
+    // Код импортированного модуля относится к строке с его import
+    std::vector<uint16_t> getLineTable() const;
+
+    // Готовая программа из двоичного образа вместо компиляции
+    void adoptProgram(std::vector<XenoInstruction>& code, std::vector<String>& strings,
+                      std::map<String, FunctionInfo>& funcs);
+
+    void setOptimizationLevel(uint8_t level) { optimization_level = level; }
 
     // Установка файловой системы
     void setFileSystem(fs::FS* fs) { filesystem = fs; }
+    void setImportCache(XenoImportCache* cache) { import_cache = cache; }
+
+    // Компилирует только блоки func и дописывает их в конец байткода. Изменённая функция сохраняет
+    // номер и число параметров, новые получают следующие номера; глобальные, строки и типы
+    // переменных берутся из уже скомпилированной программы. false - программа не изменилась
+    bool compileFunctions(const String& source);
+    // После compileFunctions: собирает байткод заново из основного кода и текущих тел функций,
+    // заменённые тела выбрасываются. Возвращает адрес, с которого байткод изменился
+    // (конец основного кода). Делать только когда VM не выполняет ни одну функцию
+    size_t compactFunctions();
+    // Итог замены: commit - оставить, rollback - вернуть программу до compileFunctions
+    void commitFunctions();
+    void rollbackFunctions();
+    bool canPatch() const { return patchable && !compile_error; }
+    void setNatives(const XenoNativeTable* table) { natives = table; }
 };
 
 #endif  // SRC_XENO_XENO_COMPILER_H_
\ No newline at end of file
@@ -15,93 +15,271 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
+#include <memory>
 #include <vector>
+#include <utility>
 #include "xeno_vm.h"
 #include "../debug/xeno_debug_tools.h"
 
+#if defined(ARDUINO_ARCH_ESP32)
+#include <soc/gpio_reg.h>          // Регистры GPIO_IN / GPIO_OUT_W1TS / W1TC для групповых опкодов
+#endif
+
+// ------------------------------------------------------------------
+// Список обработчиков: общий для диспетчерской таблицы step()
+// и для быстрого цикла execute(), чтобы семантика совпадала
+// ------------------------------------------------------------------
+#define XENO_OPCODE_HANDLERS(X) \
+    X(OP_NOP, handleNOP) \
+    X(OP_PRINT, handlePRINT) \
+    X(OP_LED_ON, handleLED_ON) \
+    X(OP_LED_OFF, handleLED_OFF) \
+    X(OP_DELAY, handleDELAY) \
+    X(OP_PUSH, handlePUSH) \
+    X(OP_POP, handlePOP) \
+    X(OP_ADD, handleBINARY_OP) \
+    X(OP_SUB, handleBINARY_OP) \
+    X(OP_MUL, handleBINARY_OP) \
+    X(OP_DIV, handleBINARY_OP) \
+    X(OP_MOD, handleBINARY_OP) \
+    X(OP_MAX, handleBINARY_OP) \
+    X(OP_MIN, handleBINARY_OP) \
+    X(OP_PRINT_NUM, handlePRINT_NUM) \
+    X(OP_STORE, handleSTORE) \
+    X(OP_LOAD, handleLOAD) \
+    X(OP_ABS, handleUNARY_MATH) \
+    X(OP_EQ, handleEQ) \
+    X(OP_NEQ, handleNEQ) \
+    X(OP_LT, handleLT) \
+    X(OP_GT, handleGT) \
+    X(OP_LTE, handleLTE) \
+    X(OP_GTE, handleGTE) \
+    X(OP_PUSH_FLOAT, handlePUSH_FLOAT) \
+    X(OP_PUSH_STRING, handlePUSH_STRING) \
+    X(OP_PUSH_BOOL, handlePUSH_BOOL) \
+    X(OP_HALT, handleHALT) \
+    X(OP_AND, handleAND) \
+    X(OP_OR, handleOR) \
+    X(OP_NOT, handleNOT) \
+    X(OP_NEG, handleNEG) \
+    X(OP_DIGITAL_READ, handleDIGITAL_READ) \
+    X(OP_CONVERT_TO_FLOAT, handleCONVERT_TO_FLOAT) \
+    X(OP_RETURN, handleRETURN) \
+    X(OP_LOAD_LOCAL, handleLOAD_LOCAL) \
+    X(OP_STORE_LOCAL, handleSTORE_LOCAL) \
+    X(OP_INC_GLOBAL, handleINC_GLOBAL) \
+    X(OP_INC_LOCAL, handleINC_LOCAL) \
+    X(OP_ADD_INT, handleADD_INT) \
+    X(OP_SUB_INT, handleSUB_INT) \
+    X(OP_MUL_INT, handleMUL_INT) \
+    X(OP_DIV_INT, handleDIV_INT) \
+    X(OP_MOD_INT, handleMOD_INT) \
+    X(OP_ADD_FLOAT, handleADD_FLOAT) \
+    X(OP_SUB_FLOAT, handleSUB_FLOAT) \
+    X(OP_MUL_FLOAT, handleMUL_FLOAT) \
+    X(OP_DIV_FLOAT, handleDIV_FLOAT) \
+    X(OP_EQ_INT, handleEQ_INT) \
+    X(OP_NEQ_INT, handleNEQ_INT) \
+    X(OP_LT_INT, handleLT_INT) \
+    X(OP_GT_INT, handleGT_INT) \
+    X(OP_LTE_INT, handleLTE_INT) \
+    X(OP_GTE_INT, handleGTE_INT) \
+    X(OP_EQ_FLOAT, handleEQ_FLOAT) \
+    X(OP_NEQ_FLOAT, handleNEQ_FLOAT) \
+    X(OP_LT_FLOAT, handleLT_FLOAT) \
+    X(OP_GT_FLOAT, handleGT_FLOAT) \
+    X(OP_LTE_FLOAT, handleLTE_FLOAT) \
+    X(OP_GTE_FLOAT, handleGTE_FLOAT) \
+    X(OP_CALL_NATIVE, handleCALL_NATIVE) \
+    X(OP_DIGITAL_READ_PINS, handleDIGITAL_READ_PINS) \
+    X(OP_DIGITAL_WRITE_PINS, handleDIGITAL_WRITE_PINS) \
+    XENO_MATH_HANDLERS(X) \
+    XENO_ARRAY_HANDLERS(X) \
+    XENO_ANALOG_HANDLERS(X) \
+    XENO_INPUT_HANDLERS(X) \
+    XENO_EVENT_HANDLERS(X)
+
+// Семейства из xeno_features.h: выключенное не попадает ни в таблицу, ни в execute()
+#if XENO_FEATURE_MATH
+#define XENO_MATH_HANDLERS(X) \
+    X(OP_POW, handleBINARY_OP) \
+    X(OP_SQRT, handleUNARY_MATH) \
+    X(OP_SIN, handleUNARY_MATH) \
+    X(OP_COS, handleUNARY_MATH) \
+    X(OP_TAN, handleUNARY_MATH)
+#else
+#define XENO_MATH_HANDLERS(X)
+#endif
+
+#if XENO_FEATURE_ARRAYS
+#define XENO_ARRAY_HANDLERS(X) \
+    X(OP_ARRAY_NEW, handleARRAY_NEW) \
+    X(OP_ARRAY_GET, handleARRAY_GET) \
+    X(OP_ARRAY_SET, handleARRAY_SET) \
+    X(OP_ARRAY_LEN, handleARRAY_LEN)
+#else
+#define XENO_ARRAY_HANDLERS(X)
+#endif
+
+#if XENO_FEATURE_ANALOG
+#define XENO_ANALOG_HANDLERS(X) \
+    X(OP_ANALOG_READ, handleANALOG_READ) \
+    X(OP_ANALOG_WRITE, handleANALOG_WRITE) \
+    XENO_ANALOG_ARRAY_HANDLERS(X)
+#else
+#define XENO_ANALOG_HANDLERS(X)
+#endif
+
+#if XENO_FEATURE_ANALOG && XENO_FEATURE_ARRAYS
+#define XENO_ANALOG_ARRAY_HANDLERS(X) \
+    X(OP_ANALOG_READ_PINS, handleANALOG_READ_PINS)
+#else
+#define XENO_ANALOG_ARRAY_HANDLERS(X)
+#endif
+
+#if XENO_FEATURE_INPUT
+#define XENO_INPUT_HANDLERS(X) \
+    X(OP_INPUT, handleINPUT)
+#else
+#define XENO_INPUT_HANDLERS(X)
+#endif
+
+#if XENO_FEATURE_EVENTS
+#define XENO_EVENT_HANDLERS(X) \
+    X(OP_EVENT_BIND, handleEVENT_BIND)
+#else
+#define XENO_EVENT_HANDLERS(X)
+#endif
+
+// Переходы и вызовы: после них execute() проверяет лимиты
+#define XENO_BRANCH_HANDLERS(X) \
+    X(OP_JUMP, handleJUMP) \
+    X(OP_JUMP_IF, handleJUMP_IF) \
+    X(OP_CALL, handleCALL) \
+    X(OP_CMP_JUMP_GLOBAL, handleCMP_JUMP_GLOBAL) \
+    X(OP_CMP_JUMP_LOCAL, handleCMP_JUMP_LOCAL) \
+    X(OP_INC_JUMP_GLOBAL, handleINC_JUMP_GLOBAL) \
+    X(OP_INC_JUMP_LOCAL, handleINC_JUMP_LOCAL) \
+    X(OP_LOOP_JUMP_GLOBAL, handleLOOP_JUMP_GLOBAL) \
+    X(OP_LOOP_JUMP_LOCAL, handleLOOP_JUMP_LOCAL)
+
+// Замены для программ с доказанной глубиной стека (stack_verified), только в execute()
+#define XENO_FAST_HANDLERS(X) \
+    X(OP_PUSH, fastPUSH) \
+    X(OP_PUSH_FLOAT, fastPUSH_FLOAT) \
+    X(OP_PUSH_STRING, fastPUSH_STRING) \
+    X(OP_PUSH_BOOL, fastPUSH_BOOL) \
+    X(OP_POP, fastPOP) \
+    X(OP_STORE, fastSTORE) \
+    X(OP_LOAD, fastLOAD) \
+    X(OP_STORE_LOCAL, fastSTORE_LOCAL) \
+    X(OP_LOAD_LOCAL, fastLOAD_LOCAL)
+
+#define XENO_FAST_BRANCH_HANDLERS(X) \
+    X(OP_JUMP_IF, fastJUMP_IF)
+
+// GCC/Clang: диспетчеризация через адреса меток (computed goto)
+#if defined(__GNUC__) && !defined(XENO_NO_COMPUTED_GOTO)
+#define XENO_COMPUTED_GOTO 1
+#else
+#define XENO_COMPUTED_GOTO 0
+#endif
+
+#if XENO_COMPUTED_GOTO
+// Таблицы меток execute(): метки видны только внутри execute(), поэтому там задаются пары
+// {опкод, метка}, а таблицы по 256 адресов строятся из них в инициализаторе статической
+// переменной - один раз и потокобезопасно (VM могут работать в разных задачах)
+struct XenoLabelEntry {
+    uint8_t opcode;
+    void* label;
+};
+
+struct XenoLabelTables {
+    void* labels[256];
+    void* fast_labels[256];      // Те же метки, но операции стека из XENO_FAST_HANDLERS идут без проверок границ
+
+    template <size_t N, size_t F>
+    XenoLabelTables(void* unknown, const XenoLabelEntry (&entries)[N], const XenoLabelEntry (&fast_entries)[F]) {
+        for (int i = 0; i < 256; ++i) {
+            labels[i] = unknown;
+        }
+        for (const XenoLabelEntry& entry : entries) {
+            labels[entry.opcode] = entry.label;
+        }
+        for (int i = 0; i < 256; ++i) {
+            fast_labels[i] = labels[i];
+        }
+        for (const XenoLabelEntry& entry : fast_entries) {
+            fast_labels[entry.opcode] = entry.label;
+        }
+    }
+};
+#endif
+
 // ------------------------------------------------------------------
-// Инициализация диспетчерской таблицы
+// Диспетчерская таблица: константа времени компиляции, лежит во flash (.rodata)
+// и не заполняется при старте
 // ------------------------------------------------------------------
-void XenoVM::initializeDispatchTable() {
-    for (int i = 0; i < 256; i++) {
-        dispatch_table[i] = nullptr;
-    }
-
-    dispatch_table[OP_NOP] = &XenoVM::handleNOP;
-    dispatch_table[OP_PRINT] = &XenoVM::handlePRINT;
-    dispatch_table[OP_LED_ON] = &XenoVM::handleLED_ON;
-    dispatch_table[OP_LED_OFF] = &XenoVM::handleLED_OFF;
-    dispatch_table[OP_DELAY] = &XenoVM::handleDELAY;
-    dispatch_table[OP_PUSH] = &XenoVM::handlePUSH;
-    dispatch_table[OP_POP] = &XenoVM::handlePOP;
-    dispatch_table[OP_ADD] = &XenoVM::handleBINARY_OP;
-    dispatch_table[OP_SUB] = &XenoVM::handleBINARY_OP;
-    dispatch_table[OP_MUL] = &XenoVM::handleBINARY_OP;
-    dispatch_table[OP_DIV] = &XenoVM::handleBINARY_OP;
-    dispatch_table[OP_MOD] = &XenoVM::handleBINARY_OP;
-    dispatch_table[OP_POW] = &XenoVM::handleBINARY_OP;
-    dispatch_table[OP_MAX] = &XenoVM::handleBINARY_OP;
-    dispatch_table[OP_MIN] = &XenoVM::handleBINARY_OP;
-    dispatch_table[OP_JUMP] = &XenoVM::handleJUMP;
-    dispatch_table[OP_JUMP_IF] = &XenoVM::handleJUMP_IF;
-    dispatch_table[OP_PRINT_NUM] = &XenoVM::handlePRINT_NUM;
-    dispatch_table[OP_STORE] = &XenoVM::handleSTORE;
-    dispatch_table[OP_LOAD] = &XenoVM::handleLOAD;
-    dispatch_table[OP_ABS] = &XenoVM::handleUNARY_MATH;
-    dispatch_table[OP_SQRT] = &XenoVM::handleUNARY_MATH;
-    dispatch_table[OP_SIN] = &XenoVM::handleUNARY_MATH;
-    dispatch_table[OP_COS] = &XenoVM::handleUNARY_MATH;
-    dispatch_table[OP_TAN] = &XenoVM::handleUNARY_MATH;
-    dispatch_table[OP_INPUT] = &XenoVM::handleINPUT;
-    dispatch_table[OP_EQ] = &XenoVM::handleEQ;
-    dispatch_table[OP_NEQ] = &XenoVM::handleNEQ;
-    dispatch_table[OP_LT] = &XenoVM::handleLT;
-    dispatch_table[OP_GT] = &XenoVM::handleGT;
-    dispatch_table[OP_LTE] = &XenoVM::handleLTE;
-    dispatch_table[OP_GTE] = &XenoVM::handleGTE;
-    dispatch_table[OP_PUSH_FLOAT] = &XenoVM::handlePUSH_FLOAT;
-    dispatch_table[OP_PUSH_STRING] = &XenoVM::handlePUSH_STRING;
-    dispatch_table[OP_PUSH_BOOL] = &XenoVM::handlePUSH_BOOL;
-    dispatch_table[OP_HALT] = &XenoVM::handleHALT;
-
-    // Новые
-    dispatch_table[OP_AND] = &XenoVM::handleAND;
-    dispatch_table[OP_OR]  = &XenoVM::handleOR;
-    dispatch_table[OP_NOT] = &XenoVM::handleNOT;
-    dispatch_table[OP_NEG] = &XenoVM::handleNEG;
-    dispatch_table[OP_ARRAY_NEW] = &XenoVM::handleARRAY_NEW;
-    dispatch_table[OP_ARRAY_GET] = &XenoVM::handleARRAY_GET;
-    dispatch_table[OP_ARRAY_SET] = &XenoVM::handleARRAY_SET;
-    dispatch_table[OP_ARRAY_LEN] = &XenoVM::handleARRAY_LEN;
-    dispatch_table[OP_ANALOG_READ] = &XenoVM::handleANALOG_READ;
-    dispatch_table[OP_ANALOG_WRITE] = &XenoVM::handleANALOG_WRITE;
-    dispatch_table[OP_DIGITAL_READ] = &XenoVM::handleDIGITAL_READ;
-    dispatch_table[OP_CONVERT_TO_FLOAT] = &XenoVM::handleCONVERT_TO_FLOAT;
-
-    // Функции
-    dispatch_table[OP_CALL] = &XenoVM::handleCALL;
-    dispatch_table[OP_RETURN] = &XenoVM::handleRETURN;
+#define XENO_HANDLER_SELECT(op, handler) opcode == op ? &XenoVM::handler :
+
+constexpr XenoVM::InstructionHandler XenoVM::handlerFor(uint8_t opcode) {
+    return XENO_OPCODE_HANDLERS(XENO_HANDLER_SELECT)
+           XENO_BRANCH_HANDLERS(XENO_HANDLER_SELECT)
+           nullptr;
 }
+#undef XENO_HANDLER_SELECT
+
+#define XENO_DISPATCH_4(n) handlerFor(n), handlerFor(n + 1), handlerFor(n + 2), handlerFor(n + 3),
+#define XENO_DISPATCH_16(n) XENO_DISPATCH_4(n) XENO_DISPATCH_4(n + 4) XENO_DISPATCH_4(n + 8) XENO_DISPATCH_4(n + 12)
+#define XENO_DISPATCH_64(n) XENO_DISPATCH_16(n) XENO_DISPATCH_16(n + 16) XENO_DISPATCH_16(n + 32) XENO_DISPATCH_16(n + 48)
+
+const XenoVM::InstructionHandler XenoVM::dispatch_table[256] = {
+    XENO_DISPATCH_64(0) XENO_DISPATCH_64(64) XENO_DISPATCH_64(128) XENO_DISPATCH_64(192)
+};
+
+#undef XENO_DISPATCH_64
+#undef XENO_DISPATCH_16
+#undef XENO_DISPATCH_4
 
 // ------------------------------------------------------------------
 // Конструктор, деструктор, resetState
 // ------------------------------------------------------------------
-XenoVM::XenoVM(XenoSecurityConfig& config)
-    : security_config(config),
+XenoVM::XenoVM(XenoSecurityConfig& config, XenoArena* arena)
+    : arena(arena),
+      program(arena),
+      max_stack_size(config.getMaxStackSize()),
+      stack_capacity(config.getMaxStackSize()),
+      globals(arena),
       security(config),
-      max_stack_size(config.getMaxStackSize()) {
-    initializeDispatchTable();
-
-    stack = new XenoValue[max_stack_size];
+      security_config(config),
+      max_call_depth(config.getMaxCallDepth()),
+      attestation(&own_attestation),
+      natives(nullptr),
+      output(&Serial),
+      output_window(0),
+      output_window_lines(0),
+      output_dropped(0),
+      profile(nullptr),
+      trace(nullptr) {
+    stack = allocateStack(stack_capacity);
+    call_stack = XenoArenaAllocator<CallFrame>(arena).allocate(max_call_depth);
+    event_count = 0;
+    event_depth = 0;
+    events_dropped.store(0, std::memory_order_relaxed);
 
     resetState();
-    program.reserve(128);
     string_table.reserve(32);
 }
 
 XenoVM::~XenoVM() {
-    delete[] stack;
+    releaseEvents();
+    flushOutput();
+    releaseStack();
+    XenoArenaAllocator<CallFrame>(arena).deallocate(call_stack, max_call_depth);
+    delete profile;
+    delete trace;
 }
 
 void XenoVM::resetState() {
@@ -111,18 +289,104 @@ void XenoVM::resetState() {
     instruction_count = 0;
     iteration_count = 0;
     max_instructions = security_config.getCurrentMaxInstructions();
-    variables.clear();
-    string_lookup.clear();
+    time_sliced = false;
+    wait_status = XENO_YIELDED;
+    wake_time = 0;
+    input_started = 0;
+    pending_input = "";
+    input_ready = false;
+    globals.clear();
+    global_names.clear();
+    string_index.clear();
+    strings_unique = true;
+    string_pool_size = 0;
+    string_base = 0;
+    pool_cache.clear();
+    image = nullptr;
+    program_code = program.data();
+    program_size = program.size();
+    quickening = false;
+    string_heap_bytes = 0;
+    string_heap_peak = 0;
+    string_collections = 0;
+    string_collect_count = STRING_HEAP_MIN_COLLECT;
+    string_collect_bytes = STRING_HEAP_MIN_COLLECT_BYTES;
     arrays.clear();
-    call_stack.clear();
+    free_arrays.clear();
+    array_bytes = 0;
+    array_peak_bytes = 0;
+    array_collections = 0;
+    arrays_since_collect = 0;
+    call_depth = 0;
+    call_peak = 0;
+    busy_us = 0;
+    blocked_us = 0;
+    delay_ms = 0;
+    input_ms = 0;
+    for (uint32_t i = 0; i < stack_capacity; ++i) {
+        stack[i].type = UNTOUCHED_SLOT;
+    }
     function_table.clear();
+    stack_verified = false;
+    frame_stack_depth.clear();
+    output_window_lines = 0;
+    output_dropped = 0;
+    memset(output_pins, 0, sizeof(output_pins));
+    releaseEvents();
+    events_dropped.store(0, std::memory_order_relaxed);
 }
 
 // ------------------------------------------------------------------
 // Установка таблицы функций
 // ------------------------------------------------------------------
 void XenoVM::setFunctionTable(const std::map<String, FunctionInfo>& functions) {
-    function_table = functions;
+    function_table.assign(functions.size(), FunctionInfo());
+    for (const auto& entry : functions) {
+        if (entry.second.index >= 0 && static_cast<size_t>(entry.second.index) < function_table.size()) {
+            function_table[entry.second.index] = entry.second;
+        }
+    }
+
+    // Глубину стека можно доказать только теперь, когда известны адреса и арности функций
+    security.attestStack(program_code, program_size, function_table, max_stack_size, *attestation);
+    applyStackProof();
+}
+
+// Без рекурсии стек программы ограничен доказанной границей: память под него выделяется точно
+void XenoVM::applyStackProof(bool shrink) {
+    stack_verified = program_size != 0 && attestation->stack_proven;
+    frame_stack_depth = attestation->frame_depth;
+    const uint32_t bound = attestation->stack_bound;
+    uint32_t capacity = max_stack_size;
+    if (stack_verified && call_depth == 0 && bound != 0 && bound <= max_stack_size && bound >= stack_pointer) {
+        capacity = bound;
+    }
+    if (shrink || capacity > stack_capacity) {
+        resizeStack(capacity);
+    }
+}
+
+void XenoVM::resizeStack(uint32_t capacity) {
+    if (capacity == stack_capacity) return;
+    XenoValue* resized = allocateStack(capacity);
+    for (uint32_t i = 0; i < stack_pointer && i < capacity; ++i) {
+        resized[i] = stack[i];
+    }
+    releaseStack();
+    stack = resized;
+    stack_capacity = capacity;
+}
+
+XenoValue* XenoVM::allocateStack(uint32_t capacity) {
+    XenoValue* block = XenoArenaAllocator<XenoValue>(arena).allocate(capacity);
+    XenoValue untouched;
+    untouched.type = UNTOUCHED_SLOT;
+    std::uninitialized_fill_n(block, capacity, untouched);
+    return block;
+}
+
+void XenoVM::releaseStack() {
+    XenoArenaAllocator<XenoValue>(arena).deallocate(stack, stack_capacity);
 }
 
 // ------------------------------------------------------------------
@@ -135,7 +399,7 @@ String XenoVM::convertToString(const XenoValue& val) {
         case TYPE_FLOAT:
             return String(val.float_val, 3);
         case TYPE_STRING:
-            return string_table[val.string_index];
+            return stringAt(val.string_index);
         case TYPE_BOOL:
             return val.bool_val ? "true" : "false";
         case TYPE_ARRAY:
@@ -150,7 +414,7 @@ float XenoVM::toFloat(const XenoValue& v) {
 }
 
 bool XenoVM::Push(const XenoValue& value) {
-    if (stack_pointer >= max_stack_size) {
+    if (stack_pointer >= stack_capacity) {
         Serial.println("CRITICAL ERROR: Stack overflow - terminating execution");
         running = false;
         return false;
@@ -511,8 +775,14 @@ bool XenoVM::performComparison(const XenoValue& a, const XenoValue& b, uint8_t o
             break;
 
         case TYPE_STRING: {
-            const String& str_a = string_table[a.string_index];
-            const String& str_b = string_table[b.string_index];
+            // Строки интернированы: при уникальном пуле равенство решается по индексам
+            if (op == OP_EQ || op == OP_NEQ) {
+                if (a.string_index == b.string_index || strings_unique) {
+                    return (a.string_index == b.string_index) == (op == OP_EQ);
+                }
+            }
+            const String& str_a = stringAt(a.string_index);
+            const String& str_b = stringAt(b.string_index);
             int comparison = str_a.compareTo(str_b);
 
             switch (op) {
@@ -544,32 +814,184 @@ bool XenoVM::performComparison(const XenoValue& a, const XenoValue& b, uint8_t o
     }
 }
 
+// ---- Доступ к строкам: пул программы (в RAM или в образе) и куча ----
+const String& XenoVM::stringAt(uint16_t index) {
+    if (index >= string_base) {
+        return string_table[index - string_base];
+    }
+    // Строка образа: копия создаётся при первом обращении как к String
+    auto it = pool_cache.find(index);
+    if (it != pool_cache.end()) {
+        return it->second;
+    }
+    uint16_t length;
+    const char* str = image->string(index, length);
+    String value;
+    value.reserve(length);
+    value.concat(str, length);
+    return pool_cache.emplace(index, security.sanitizeString(value)).first->second;
+}
+
+// Текст без копирования в String: строка образа читается прямо из него, если не пришлось её чистить
+const char* XenoVM::stringData(uint16_t index, uint16_t& length) const {
+    if (index >= string_base) {
+        const String& str = string_table[index - string_base];
+        length = str.length();
+        return str.c_str();
+    }
+    auto it = pool_cache.find(index);
+    if (it != pool_cache.end()) {
+        length = it->second.length();
+        return it->second.c_str();
+    }
+    return image->string(index, length);
+}
+
+// Строки пула [from, to) попадают в индекс; повтор текста (образ не из компилятора,
+// чистка свела две строки к одной) отключает сравнение строк по индексу
+void XenoVM::internPoolStrings(uint16_t from, uint16_t to) {
+    string_index.reserve(string_index.size() + (to - from));
+    for (uint16_t i = from; i < to; ++i) {
+        uint16_t length;
+        const char* str = stringData(i, length);
+        const uint32_t key = XenoStringIndex::hash(str, length);
+        if (string_index.find(str, length, key, [this](uint16_t j) {
+                uint16_t unused;
+                return stringData(j, unused);
+            }) != XenoStringIndex::NONE) {
+            strings_unique = false;
+        } else {
+            string_index.insert(key, length, i);
+        }
+    }
+}
+
+const String& XenoVM::globalName(uint16_t slot) {
+    static const String unnamed;
+    return global_names[slot] == NO_NAME ? unnamed : stringAt(global_names[slot]);
+}
+
+void XenoVM::printString(uint16_t index) {
+    if (index < string_base && pool_cache.find(index) == pool_cache.end()) {
+        uint16_t length;
+        const char* str = image->string(index, length);
+        output->write(reinterpret_cast<const uint8_t*>(str), length);
+        output->println();
+        return;
+    }
+    output->println(stringAt(index));
+}
+
+bool XenoVM::stringEmpty(uint16_t index) const {
+    if (index >= string_base) {
+        return string_table[index - string_base].isEmpty();
+    }
+    uint16_t length;
+    image->string(index, length);
+    return length == 0;
+}
+
 uint16_t XenoVM::addString(const String& str) {
     String safe_str = security.sanitizeString(str);
 
-    auto it = string_lookup.find(safe_str);
-    if (it != string_lookup.end()) {
-        return it->second;
+    const uint32_t key = XenoStringIndex::hash(safe_str);
+    const uint16_t found = string_index.find(safe_str.c_str(), safe_str.length(), key, [this](uint16_t i) {
+        uint16_t unused;
+        return stringData(i, unused);
+    });
+    if (found != XenoStringIndex::NONE) {
+        return found;
     }
 
-    for (size_t i = 0; i < string_table.size(); ++i) {
-        if (string_table[i] == safe_str) {
-            string_lookup[safe_str] = i;
-            return i;
-        }
+    // Сборка перед добавлением: операнды текущей инструкции уже сняты со стека
+    // и больше не нужны, а результат ещё не создан
+    if (getStringHeapCount() >= string_collect_count || string_heap_bytes >= string_collect_bytes ||
+        stringCount() >= 65535) {
+        collectStrings();
     }
 
-    if (string_table.size() >= 65535) {
+    if (stringCount() >= 65535) {
         Serial.println("ERROR: String table overflow");
         return 0;
     }
 
     string_table.push_back(safe_str);
-    uint16_t new_index = string_table.size() - 1;
-    string_lookup[safe_str] = new_index;
+    uint16_t new_index = stringCount() - 1;
+    string_index.insert(key, safe_str.length(), new_index);
+    string_heap_bytes += safe_str.length();
+    string_heap_peak = max(string_heap_peak, getStringHeapCount());
     return new_index;
 }
 
+// ---- Куча строк: mark/compact ----
+// Живые строки - те, на которые ссылаются стек, глобальные и локальные
+// переменные и массивы. Остальные удаляются, живые сдвигаются к началу кучи.
+void XenoVM::collectStrings() {
+    size_t heap_count = getStringHeapCount();
+    if (heap_count == 0) return;
+
+    std::vector<uint16_t> remap(heap_count, 0);
+    traceStringRoots(remap, false);
+    size_t heap_start = string_pool_size - string_base;    // Начало кучи внутри string_table
+
+    uint16_t live = 0;
+    string_heap_bytes = 0;
+    for (size_t i = 0; i < heap_count; ++i) {
+        String& str = string_table[heap_start + i];
+        if (remap[i] == 0) {
+            remap[i] = XenoStringIndex::NONE;
+            continue;
+        }
+        remap[i] = live;
+        string_heap_bytes += str.length();
+        if (live != i) {
+            string_table[heap_start + live] = std::move(str);
+        }
+        live++;
+    }
+    string_table.resize(heap_start + live);
+    traceStringRoots(remap, true);
+    string_index.remap([this, &remap](uint16_t index) -> uint16_t {
+        if (index < string_pool_size) return index;
+        const uint16_t moved = remap[index - string_pool_size];
+        return moved == XenoStringIndex::NONE ? moved : string_pool_size + moved;
+    });
+
+    string_collections++;
+    // Следующая сборка - когда куча вырастет вдвое относительно живых строк
+    uint32_t next_count = static_cast<uint32_t>(live) * 2;
+    string_collect_count = next_count < STRING_HEAP_MIN_COLLECT ? STRING_HEAP_MIN_COLLECT :
+                           (next_count > 65535 ? 65535 : next_count);
+    uint32_t next_bytes = string_heap_bytes * 2;
+    string_collect_bytes = next_bytes < STRING_HEAP_MIN_COLLECT_BYTES ? STRING_HEAP_MIN_COLLECT_BYTES : next_bytes;
+}
+
+void XenoVM::traceStringRoots(std::vector<uint16_t>& remap, bool rewrite) {
+    for (uint32_t i = 0; i < stack_pointer; ++i) {
+        traceString(stack[i], remap, rewrite);
+    }
+    for (XenoValue& value : globals) {
+        traceString(value, remap, rewrite);
+    }
+    for (XenoArray& array : arrays) {
+        for (XenoValue& value : array.values) {
+            traceString(value, remap, rewrite);
+        }
+    }
+}
+
+// Без rewrite - отмечает строку живой, с rewrite - переводит индекс на новое место
+void XenoVM::traceString(XenoValue& value, std::vector<uint16_t>& remap, bool rewrite) {
+    if (value.type != TYPE_STRING || value.string_index < string_pool_size) return;
+    size_t heap_index = value.string_index - string_pool_size;
+    if (heap_index >= remap.size()) return;
+    if (rewrite) {
+        value.string_index = string_pool_size + remap[heap_index];
+    } else {
+        remap[heap_index] = 1;
+    }
+}
+
 bool XenoVM::isInteger(const String& str) {
     if (str.isEmpty()) return false;
     const char* cstr = str.c_str();
@@ -606,45 +1028,46 @@ bool XenoVM::isBool(const String& str) {
 // Обработчики инструкций
 // ------------------------------------------------------------------
 
-void XenoVM::handleNOP(const XenoInstruction& instr) { /* Do nothing */ }
+void XenoVM::handleNOP(const XenoCompactInstruction& instr) { (void)instr; }
 
-void XenoVM::handlePRINT(const XenoInstruction& instr) {
-    if (instr.arg1 < string_table.size()) {
-        Serial.println(string_table[instr.arg1]);
+void XenoVM::handlePRINT(const XenoCompactInstruction& instr) {
+    if (instr.arg1 < stringCount()) {
+        outputValue(XenoValue::makeString(instr.arg1));
     } else {
         Serial.println("ERROR: Invalid string index");
     }
 }
 
-void XenoVM::handleLED_ON(const XenoInstruction& instr) {
-    if (!security.isPinAllowed(instr.arg1)) {
-        Serial.print("ERROR: Pin not allowed: ");
-        Serial.println(instr.arg1);
-        return;
-    }
-    pinMode(instr.arg1, OUTPUT);
+// Пины инструкций ввода-вывода проверены верификатором при загрузке: разрешённые пины,
+// изменённые после загрузки, действуют со следующей загрузки программы
+void XenoVM::handleLED_ON(const XenoCompactInstruction& instr) {
+    configureOutputs(instr.arg1 >> 5, 1u << (instr.arg1 & 31));
     digitalWrite(instr.arg1, HIGH);
     Serial.print("LED ON pin ");
     Serial.println(instr.arg1);
 }
 
-void XenoVM::handleLED_OFF(const XenoInstruction& instr) {
-    if (!security.isPinAllowed(instr.arg1)) {
-        Serial.print("ERROR: Pin not allowed: ");
-        Serial.println(instr.arg1);
-        return;
-    }
-    pinMode(instr.arg1, OUTPUT);
+void XenoVM::handleLED_OFF(const XenoCompactInstruction& instr) {
+    configureOutputs(instr.arg1 >> 5, 1u << (instr.arg1 & 31));
     digitalWrite(instr.arg1, LOW);
     Serial.print("LED OFF pin ");
     Serial.println(instr.arg1);
 }
 
-void XenoVM::handleDELAY(const XenoInstruction& instr) {
-    delay(instr.arg1);
+void XenoVM::handleDELAY(const XenoCompactInstruction& instr) {
+    delay_ms += instr.arg1;
+    if (!time_sliced) {
+        delay(instr.arg1);
+        blocked_us += static_cast<uint64_t>(instr.arg1) * 1000;
+        return;
+    }
+    // Вместо блокировки - срок пробуждения; running сбрасывается, чтобы выйти из execute()
+    wake_time = millis() + instr.arg1;
+    wait_status = XENO_SLEEPING;
+    running = false;
 }
 
-void XenoVM::handlePushOp(const XenoInstruction& instr, XenoDataType type) {
+void XenoVM::handlePushOp(const XenoCompactInstruction& instr, XenoDataType type) {
     XenoValue value;
 
     switch (type) {
@@ -670,23 +1093,31 @@ void XenoVM::handlePushOp(const XenoInstruction& instr, XenoDataType type) {
     if (!Push(value)) return;
 }
 
-void XenoVM::handlePUSH(const XenoInstruction& instr) { handlePushOp(instr, TYPE_INT); }
-void XenoVM::handlePUSH_FLOAT(const XenoInstruction& instr) { handlePushOp(instr, TYPE_FLOAT); }
-void XenoVM::handlePUSH_STRING(const XenoInstruction& instr) { handlePushOp(instr, TYPE_STRING); }
-void XenoVM::handlePUSH_BOOL(const XenoInstruction& instr) { handlePushOp(instr, TYPE_BOOL); }
+void XenoVM::handlePUSH(const XenoCompactInstruction& instr) { handlePushOp(instr, TYPE_INT); }
+void XenoVM::handlePUSH_FLOAT(const XenoCompactInstruction& instr) { handlePushOp(instr, TYPE_FLOAT); }
+void XenoVM::handlePUSH_STRING(const XenoCompactInstruction& instr) { handlePushOp(instr, TYPE_STRING); }
+void XenoVM::handlePUSH_BOOL(const XenoCompactInstruction& instr) { handlePushOp(instr, TYPE_BOOL); }
 
-void XenoVM::handlePOP(const XenoInstruction& instr) {
+void XenoVM::handlePOP(const XenoCompactInstruction& instr) {
+    (void)instr;
     XenoValue temp;
     if (!Pop(temp)) return;
 }
 
-void XenoVM::handleBINARY_OP(const XenoInstruction& instr) {
+void XenoVM::handleBINARY_OP(const XenoCompactInstruction& instr) {
+    // instr - ссылка на ячейку программы, quicken() перепишет в ней опкод
+    const uint8_t op = instr.opcode;
+    quicken(instr);
+    binaryOperation(op);
+}
+
+void XenoVM::binaryOperation(uint8_t op) {
     XenoValue a, b;
     if (!PopTwo(a, b)) return;
 
     XenoValue result;
 
-    switch (instr.opcode) {
+    switch (op) {
         case OP_ADD:
             result = performAddition(a, b);
             break;
@@ -702,9 +1133,11 @@ void XenoVM::handleBINARY_OP(const XenoInstruction& instr) {
         case OP_MOD:
             result = performModulo(a, b);
             break;
+#if XENO_FEATURE_MATH
         case OP_POW:
             result = performPower(a, b);
             break;
+#endif
         case OP_MAX:
             result = Max(a, b);
             break;
@@ -718,7 +1151,7 @@ void XenoVM::handleBINARY_OP(const XenoInstruction& instr) {
     if (!Push(result)) return;
 }
 
-void XenoVM::handleUNARY_MATH(const XenoInstruction& instr) {
+void XenoVM::handleUNARY_MATH(const XenoCompactInstruction& instr) {
     XenoValue a;
     if (!Peek(a)) return;
 
@@ -728,6 +1161,7 @@ void XenoVM::handleUNARY_MATH(const XenoInstruction& instr) {
         case OP_ABS:
             result = performAbs(a);
             break;
+#if XENO_FEATURE_MATH
         case OP_SQRT:
             result = Sqrt(a);
             break;
@@ -740,6 +1174,7 @@ void XenoVM::handleUNARY_MATH(const XenoInstruction& instr) {
         case OP_TAN:
             result = XenoValue::makeFloat(tan(toFloat(a)));
             break;
+#endif
         default:
             return;
     }
@@ -747,22 +1182,32 @@ void XenoVM::handleUNARY_MATH(const XenoInstruction& instr) {
     stack[stack_pointer - 1] = result;
 }
 
-void XenoVM::handleINPUT(const XenoInstruction& instr) {
-    if (instr.arg1 >= string_table.size()) {
+void XenoVM::handleINPUT(const XenoCompactInstruction& instr) {
+    if (instr.arg1 >= stringCount()) {
         Serial.println("ERROR: Invalid variable name index in INPUT");
         running = false;
         return;
     }
 
-    String var_name = string_table[instr.arg1];
+    String var_name = stringAt(instr.arg1);
+    String input_str = "";
+
+    if (time_sliced) {
+        if (!pollInput(var_name, input_str)) {
+            --program_counter;  // INPUT выполнится снова при следующем runFor
+            return;
+        }
+        storeInput(instr.arg2, input_str);
+        return;
+    }
+
     Serial.print("INPUT ");
     Serial.print(var_name);
     Serial.print(": ");
 
     unsigned long startTime = millis();
-    String input_str = "";
 
-    while (millis() - startTime < 30000) {
+    while (millis() - startTime < INPUT_TIMEOUT_MS) {
         if (Serial.available() > 0) {
             input_str = Serial.readString();
             input_str.trim();
@@ -770,10 +1215,45 @@ void XenoVM::handleINPUT(const XenoInstruction& instr) {
         }
         delay(100);
     }
+    const uint32_t waited = millis() - startTime;
+    input_ms += waited;
+    blocked_us += static_cast<uint64_t>(waited) * 1000;
+
+    storeInput(instr.arg2, input_str);
+}
+
+// Неблокирующий INPUT: false - строки ещё нет, VM приостановлена до следующего runFor
+bool XenoVM::pollInput(const String& var_name, String& input_str) {
+    if (wait_status != XENO_WAITING_INPUT) {
+        Serial.print("INPUT ");
+        Serial.print(var_name);
+        Serial.print(": ");
+        input_started = millis();
+    }
+
+    if (input_ready) {
+        input_str = pending_input;
+        input_str.trim();
+        pending_input = "";
+        input_ready = false;
+    } else if (Serial.available() > 0) {
+        input_str = Serial.readString();
+        input_str.trim();
+    } else if (millis() - input_started < INPUT_TIMEOUT_MS) {
+        wait_status = XENO_WAITING_INPUT;
+        running = false;
+        return false;
+    }
+
+    input_ms += millis() - input_started;
+    wait_status = XENO_YIELDED;
+    return true;
+}
 
+void XenoVM::storeInput(uint16_t slot, String& input_str) {
     if (input_str.isEmpty()) {
         Serial.println("TIMEOUT - using default value 0");
-        variables[var_name] = XenoValue::makeInt(0);
+        globals[slot] = XenoValue::makeInt(0);
         return;
     }
 
@@ -788,12 +1268,17 @@ void XenoVM::handleINPUT(const XenoInstruction& instr) {
         input_value = XenoValue::makeString(addString(input_str));
     }
 
-    variables[var_name] = input_value;
+    globals[slot] = input_value;
     Serial.print("-> ");
     Serial.println(input_str);
 }
 
-void XenoVM::handleComparisonOp(const XenoInstruction& instr, uint8_t op) {
+void XenoVM::handleComparisonOp(const XenoCompactInstruction& instr, uint8_t op) {
+    quicken(instr);
+    comparison(op);
+}
+
+void XenoVM::comparison(uint8_t op) {
     XenoValue a, b;
     if (!PopTwo(a, b)) return;
 
@@ -801,80 +1286,448 @@ void XenoVM::handleComparisonOp(const XenoInstruction& instr, uint8_t op) {
     if (!Push(XenoValue::makeInt(result ? 0 : 1))) return;
 }
 
-void XenoVM::handleEQ(const XenoInstruction& instr) { handleComparisonOp(instr, OP_EQ); }
-void XenoVM::handleNEQ(const XenoInstruction& instr) { handleComparisonOp(instr, OP_NEQ); }
-void XenoVM::handleLT(const XenoInstruction& instr) { handleComparisonOp(instr, OP_LT); }
-void XenoVM::handleGT(const XenoInstruction& instr) { handleComparisonOp(instr, OP_GT); }
-void XenoVM::handleLTE(const XenoInstruction& instr) { handleComparisonOp(instr, OP_LTE); }
-void XenoVM::handleGTE(const XenoInstruction& instr) { handleComparisonOp(instr, OP_GTE); }
+// ---- Типизированные опкоды ----
+// Общий опкод над двумя int или двумя float переписывается в своей копии кода на типизированный:
+// следующие выполнения пропускают PopTwo и разбор типов. Образ на месте (flash, общий
+// для нескольких VM) не меняется - там работают только опкоды, выбранные компилятором.
+void XenoVM::quicken(const XenoCompactInstruction& instr) {
+    if (!quickening || instr.arg1 == QUICKEN_OFF || stack_pointer < 2) return;
+    const uint8_t left = stack[stack_pointer - 2].type;
+    if (left != stack[stack_pointer - 1].type) return;
+
+    uint8_t typed = OP_NOP;
+    if (left == TYPE_INT) {
+        typed = intOpcodeFor(instr.opcode);
+    } else if (left == TYPE_FLOAT) {
+        typed = floatOpcodeFor(instr.opcode);
+    }
+    if (typed != OP_NOP) program[program_counter - 1].opcode = typed;
+}
+
+// Операнды другого типа (или их нет): общая операция со всеми проверками и сообщениями.
+// Переписанное место возвращается к общему опкоду и больше не переписывается.
+void XenoVM::typeMiss(uint8_t generic_op) {
+    if (quickening) {
+        XenoCompactInstruction& slot = program[program_counter - 1];
+        slot.opcode = generic_op;
+        slot.arg1 = QUICKEN_OFF;
+    }
+    if (isComparisonOpcode(generic_op)) {
+        comparison(generic_op);
+    } else {
+        binaryOperation(generic_op);
+    }
+}
+
+// Результат пишется на место левого операнда (тип уже нужный), правый снимается со стека.
+// Оба операнда берутся со стека, поэтому instr типизированным обработчикам не нужен
+#define XENO_TYPED_GUARD(type_tag, generic_op) \
+    (void)instr; \
+    XenoValue* top = stack + stack_pointer; \
+    if (stack_pointer < 2 || top[-2].type != type_tag || top[-1].type != type_tag) { \
+        typeMiss(generic_op); \
+        return; \
+    }
+
+// Переполнение int даёт 0, как в performAddition и т.п.
+#define XENO_INT_ARITH(name, generic_op, helper) \
+    void XenoVM::handle##name(const XenoCompactInstruction& instr) { \
+        XENO_TYPED_GUARD(TYPE_INT, generic_op) \
+        int32_t result; \
+        top[-2].int_val = helper(top[-2].int_val, top[-1].int_val, result) ? result : 0; \
+        --stack_pointer; \
+    }
+
+#define XENO_FLOAT_ARITH(name, generic_op, operator_token) \
+    void XenoVM::handle##name(const XenoCompactInstruction& instr) { \
+        XENO_TYPED_GUARD(TYPE_FLOAT, generic_op) \
+        top[-2].float_val = top[-2].float_val operator_token top[-1].float_val; \
+        --stack_pointer; \
+    }
+
+// Сравнения кладут 0 для истины и 1 для лжи (как handleComparisonOp)
+#define XENO_TYPED_COMPARE(name, generic_op, type_tag, condition) \
+    void XenoVM::handle##name(const XenoCompactInstruction& instr) { \
+        XENO_TYPED_GUARD(type_tag, generic_op) \
+        const XenoValue& a = top[-2]; \
+        const XenoValue& b = top[-1]; \
+        const int32_t result = (condition) ? 0 : 1; \
+        top[-2].type = TYPE_INT; \
+        top[-2].int_val = result; \
+        --stack_pointer; \
+    }
+
+XENO_INT_ARITH(ADD_INT, OP_ADD, Add)
+XENO_INT_ARITH(SUB_INT, OP_SUB, Sub)
+XENO_INT_ARITH(MUL_INT, OP_MUL, Mul)
+XENO_FLOAT_ARITH(ADD_FLOAT, OP_ADD, +)
+XENO_FLOAT_ARITH(SUB_FLOAT, OP_SUB, -)
+XENO_FLOAT_ARITH(MUL_FLOAT, OP_MUL, *)
+
+XENO_TYPED_COMPARE(EQ_INT, OP_EQ, TYPE_INT, a.int_val == b.int_val)
+XENO_TYPED_COMPARE(NEQ_INT, OP_NEQ, TYPE_INT, a.int_val != b.int_val)
+XENO_TYPED_COMPARE(LT_INT, OP_LT, TYPE_INT, a.int_val < b.int_val)
+XENO_TYPED_COMPARE(GT_INT, OP_GT, TYPE_INT, a.int_val > b.int_val)
+XENO_TYPED_COMPARE(LTE_INT, OP_LTE, TYPE_INT, a.int_val <= b.int_val)
+XENO_TYPED_COMPARE(GTE_INT, OP_GTE, TYPE_INT, a.int_val >= b.int_val)
+XENO_TYPED_COMPARE(EQ_FLOAT, OP_EQ, TYPE_FLOAT, fabs(a.float_val - b.float_val) < 0.0001f)
+XENO_TYPED_COMPARE(NEQ_FLOAT, OP_NEQ, TYPE_FLOAT, fabs(a.float_val - b.float_val) >= 0.0001f)
+XENO_TYPED_COMPARE(LT_FLOAT, OP_LT, TYPE_FLOAT, a.float_val < b.float_val)
+XENO_TYPED_COMPARE(GT_FLOAT, OP_GT, TYPE_FLOAT, a.float_val > b.float_val)
+XENO_TYPED_COMPARE(LTE_FLOAT, OP_LTE, TYPE_FLOAT, a.float_val <= b.float_val)
+XENO_TYPED_COMPARE(GTE_FLOAT, OP_GTE, TYPE_FLOAT, a.float_val >= b.float_val)
+
+// Деление на ноль и MIN / -1 уходят в общую операцию ради сообщения об ошибке
+void XenoVM::handleDIV_INT(const XenoCompactInstruction& instr) {
+    XENO_TYPED_GUARD(TYPE_INT, OP_DIV)
+    const int32_t a = top[-2].int_val;
+    const int32_t b = top[-1].int_val;
+    if (b == 0 || (a == std::numeric_limits<int32_t>::min() && b == -1)) {
+        binaryOperation(OP_DIV);
+        return;
+    }
+    top[-2].int_val = a / b;
+    --stack_pointer;
+}
+
+void XenoVM::handleMOD_INT(const XenoCompactInstruction& instr) {
+    XENO_TYPED_GUARD(TYPE_INT, OP_MOD)
+    const int32_t b = top[-1].int_val;
+    if (b == 0 || b == -1) {
+        binaryOperation(OP_MOD);
+        return;
+    }
+    top[-2].int_val %= b;
+    --stack_pointer;
+}
+
+void XenoVM::handleDIV_FLOAT(const XenoCompactInstruction& instr) {
+    XENO_TYPED_GUARD(TYPE_FLOAT, OP_DIV)
+    if (top[-1].float_val == 0.0f) {
+        binaryOperation(OP_DIV);
+        return;
+    }
+    top[-2].float_val /= top[-1].float_val;
+    --stack_pointer;
+}
+
+#undef XENO_TYPED_COMPARE
+#undef XENO_FLOAT_ARITH
+#undef XENO_INT_ARITH
+#undef XENO_TYPED_GUARD
 
-void XenoVM::handlePRINT_NUM(const XenoInstruction& instr) {
+void XenoVM::handleEQ(const XenoCompactInstruction& instr) { handleComparisonOp(instr, OP_EQ); }
+void XenoVM::handleNEQ(const XenoCompactInstruction& instr) { handleComparisonOp(instr, OP_NEQ); }
+void XenoVM::handleLT(const XenoCompactInstruction& instr) { handleComparisonOp(instr, OP_LT); }
+void XenoVM::handleGT(const XenoCompactInstruction& instr) { handleComparisonOp(instr, OP_GT); }
+void XenoVM::handleLTE(const XenoCompactInstruction& instr) { handleComparisonOp(instr, OP_LTE); }
+void XenoVM::handleGTE(const XenoCompactInstruction& instr) { handleComparisonOp(instr, OP_GTE); }
+
+void XenoVM::handlePRINT_NUM(const XenoCompactInstruction& instr) {
+    (void)instr;
     XenoValue val;
     if (!Peek(val)) return;
+    outputValue(val);
+}
+
+// ---- Канал вывода print ----
+// Строка print: сразу в output, в кольцо (форматирование откладывается до flushOutput) или никуда
+void XenoVM::outputValue(const XenoValue& val) {
+    if (output_config.mode == XENO_OUTPUT_SILENT || !admitOutput()) return;
+    if (output_config.mode == XENO_OUTPUT_DIRECT) {
+        printRecord(val);
+        return;
+    }
+
+    // Строка кучи может быть собрана до выгрузки, поэтому копируется сразу
+    const bool heap_string = val.type == TYPE_STRING && val.string_index >= string_pool_size;
+    const size_t text_length = heap_string ? stringAt(val.string_index).length() : 0;
+    if (!output_buffer.hasRoom(text_length)) {
+        if (output_config.overflow == XENO_OUTPUT_DROP_WHEN_FULL) {
+            ++output_dropped;
+            return;
+        }
+        flushOutput();
+        if (!output_buffer.hasRoom(text_length)) {
+            printRecord(val);           // Текст длиннее всего кольца
+            return;
+        }
+    }
+    if (heap_string) {
+        const String& text = stringAt(val.string_index);
+        output_buffer.pushText(text.c_str(), text.length());
+    } else {
+        output_buffer.push(val);
+    }
+}
+
+void XenoVM::printRecord(const XenoValue& val) {
     switch (val.type) {
-        case TYPE_INT: Serial.println(val.int_val); break;
-        case TYPE_FLOAT: Serial.println(val.float_val, 2); break;
-        case TYPE_STRING: Serial.println(string_table[val.string_index]); break;
-        case TYPE_BOOL: Serial.println(val.bool_val ? "true" : "false"); break;
-        case TYPE_ARRAY: Serial.println("[array]"); break;
+        case TYPE_INT: output->println(val.int_val); break;
+        case TYPE_FLOAT: output->println(val.float_val, 2); break;
+        case TYPE_STRING: printString(val.string_index); break;
+        case TYPE_BOOL: output->println(val.bool_val ? "true" : "false"); break;
+        case TYPE_ARRAY: output->println("[array]"); break;
+        default: break;
     }
 }
 
-// ---- STORE с поддержкой локальных ----
-void XenoVM::handleSTORE(const XenoInstruction& instr) {
-    if (instr.arg1 >= string_table.size()) {
-        Serial.println("ERROR: Invalid variable name index in STORE");
-        running = false;
-        return;
+// Ограничение скорости: не больше max_lines_per_second строк за секунду, лишние отбрасываются
+bool XenoVM::admitOutput() {
+    if (output_config.max_lines_per_second == 0) return true;
+    const uint32_t now = millis();
+    if (now - output_window >= 1000) {
+        output_window = now;
+        output_window_lines = 0;
+    }
+    if (output_window_lines >= output_config.max_lines_per_second) {
+        ++output_dropped;
+        return false;
+    }
+    ++output_window_lines;
+    return true;
+}
+
+// Форматирует не больше max_lines строк кольца и отдаёт их output крупными блоками
+size_t XenoVM::flushOutput(size_t max_lines) {
+    if (output_buffer.empty()) return 0;
+    Print* target = output;
+    XenoChunkPrint chunk(*target);
+    output = &chunk;
+
+    size_t lines = 0;
+    XenoValue record;
+    while (lines < max_lines && output_buffer.pop(record)) {
+        if (record.type == TYPE_ANY) {
+            output_buffer.popText(chunk, record.int_val);
+            chunk.println();
+        } else {
+            printRecord(record);
+        }
+        ++lines;
+    }
+
+    chunk.flush();
+    output = target;
+    return lines;
+}
+
+// Накопленное уходит в прежнюю цель
+void XenoVM::setOutput(Print& target) {
+    flushOutput();
+    output = &target;
+}
+
+void XenoVM::setOutputConfig(const XenoOutputConfig& config) {
+    flushOutput();
+    output_config = config;
+    if (config.mode == XENO_OUTPUT_BUFFERED) {
+        output_buffer.allocate(config.records, config.text_bytes);
+    } else {
+        output_buffer.release();
     }
+}
+
+// ---- STORE/LOAD глобальных: слоты разрешены компилятором ----
+void XenoVM::handleSTORE(const XenoCompactInstruction& instr) {
     XenoValue value;
     if (!Pop(value)) return;
-    String var_name = string_table[instr.arg1];
-
-    // Проверяем локальные переменные текущего кадра
-    if (!call_stack.empty()) {
-        CallFrame& frame = call_stack.back();
-        auto it = frame.locals.find(var_name);
-        if (it != frame.locals.end()) {
-            it->second = value;
-            return;
-        }
+    globals[instr.arg1] = value;
+}
+
+void XenoVM::handleLOAD(const XenoCompactInstruction& instr) {
+    const XenoValue& value = globals[instr.arg1];
+    if (value.type == TYPE_ANY) {
+        Serial.print("ERROR: Variable not found: ");
+        Serial.println(globalName(instr.arg1));
+        if (!Push(XenoValue::makeInt(0))) return;
+        return;
     }
-    // Иначе глобальные
-    variables[var_name] = value;
+    if (!Push(value)) return;
 }
 
-// ---- LOAD с поддержкой локальных ----
-void XenoVM::handleLOAD(const XenoInstruction& instr) {
-    if (instr.arg1 >= string_table.size()) {
-        Serial.println("ERROR: Invalid variable name index in LOAD");
+// ---- STORE/LOAD локальных текущего кадра ----
+// Слот локальной переменной текущего кадра (окно на стеке операндов)
+XenoValue* XenoVM::localSlot(uint32_t slot, const char* error) {
+    if (call_depth == 0 || slot >= static_cast<uint32_t>(call_stack[call_depth - 1].function->arity)) {
+        Serial.println(error);
         running = false;
+        return nullptr;
+    }
+    return &stack[call_stack[call_depth - 1].base + slot];
+}
+
+void XenoVM::handleSTORE_LOCAL(const XenoCompactInstruction& instr) {
+    XenoValue* local = localSlot(instr.arg1, "ERROR: Invalid local variable slot in STORE_LOCAL");
+    if (!local) return;
+    XenoValue value;
+    if (!Pop(value)) return;
+    *local = value;
+}
+
+void XenoVM::handleLOAD_LOCAL(const XenoCompactInstruction& instr) {
+    XenoValue* local = localSlot(instr.arg1, "ERROR: Invalid local variable slot in LOAD_LOCAL");
+    if (!local) return;
+    if (!Push(*local)) return;
+}
+
+// ---- Без проверок границ: глубина стека доказана при загрузке (stack_verified) ----
+// Анализ гарантирует, что операнды есть и место под результат есть, так что остаются только
+// проверки смысла (необъявленная переменная, слот кадра)
+void XenoVM::fastPUSH(const XenoCompactInstruction& instr) {
+    stack[stack_pointer++] = XenoValue::makeInt(instr.arg1);
+}
+
+void XenoVM::fastPUSH_FLOAT(const XenoCompactInstruction& instr) {
+    float fval;
+    memcpy(&fval, &instr.arg1, sizeof(float));
+    stack[stack_pointer++] = XenoValue::makeFloat(fval);
+}
+
+void XenoVM::fastPUSH_STRING(const XenoCompactInstruction& instr) {
+    stack[stack_pointer++] = XenoValue::makeString(instr.arg1);
+}
+
+void XenoVM::fastPUSH_BOOL(const XenoCompactInstruction& instr) {
+    stack[stack_pointer++] = XenoValue::makeBool(instr.arg1);
+}
+
+void XenoVM::fastPOP(const XenoCompactInstruction& instr) {
+    (void)instr;
+    --stack_pointer;
+}
+
+void XenoVM::fastSTORE(const XenoCompactInstruction& instr) {
+    globals[instr.arg1] = stack[--stack_pointer];
+}
+
+void XenoVM::fastLOAD(const XenoCompactInstruction& instr) {
+    const XenoValue& value = globals[instr.arg1];
+    if (value.type == TYPE_ANY) {
+        handleLOAD(instr);
         return;
     }
-    String var_name = string_table[instr.arg1];
+    stack[stack_pointer++] = value;
+}
 
-    // Сначала локальные
-    if (!call_stack.empty()) {
-        CallFrame& frame = call_stack.back();
-        auto it = frame.locals.find(var_name);
-        if (it != frame.locals.end()) {
-            if (!Push(it->second)) return;
-            return;
+void XenoVM::fastSTORE_LOCAL(const XenoCompactInstruction& instr) {
+    XenoValue* local = localSlot(instr.arg1, "ERROR: Invalid local variable slot in STORE_LOCAL");
+    if (!local) return;
+    *local = stack[--stack_pointer];
+}
+
+void XenoVM::fastLOAD_LOCAL(const XenoCompactInstruction& instr) {
+    XenoValue* local = localSlot(instr.arg1, "ERROR: Invalid local variable slot in LOAD_LOCAL");
+    if (!local) return;
+    stack[stack_pointer++] = *local;
+}
+
+void XenoVM::fastJUMP_IF(const XenoCompactInstruction& instr) {
+    branchIf(stack[--stack_pointer], instr.arg1);
+}
+
+// ---- Суперинструкции var += шаг (эквивалент LOAD, PUSH, ADD, STORE) ----
+void XenoVM::incrementValue(XenoValue& value, int32_t step) {
+    if (value.type == TYPE_INT) {
+        int32_t result;
+        value.int_val = Add(value.int_val, step, result) ? result : 0;
+        return;
+    }
+    value = performAddition(value, XenoValue::makeInt(step));
+}
+
+void XenoVM::handleINC_GLOBAL(const XenoCompactInstruction& instr) {
+    uint16_t slot = instr.arg1 & 0xFFFF;
+    XenoValue& value = globals[slot];
+    if (value.type == TYPE_ANY) {
+        Serial.print("ERROR: Variable not found: ");
+        Serial.println(globalName(slot));
+        value = XenoValue::makeInt(0);
+    }
+    incrementValue(value, static_cast<int16_t>(instr.arg2));
+}
+
+void XenoVM::handleINC_LOCAL(const XenoCompactInstruction& instr) {
+    XenoValue* local = localSlot(instr.arg1 & 0xFFFF, "ERROR: Invalid local variable slot in INC_LOCAL");
+    if (!local) return;
+    incrementValue(*local, static_cast<int16_t>(instr.arg2));
+}
+
+// ---- Суперинструкции циклов: сравнение слота с константой и переход ----
+bool XenoVM::compareWithImmediate(const XenoValue& value, uint32_t operand) {
+    int32_t imm = slotCompareImm(operand);
+    uint8_t op = slotCompareOp(operand);
+    if (value.type == TYPE_INT) {
+        switch (op) {
+            case OP_EQ:  return value.int_val == imm;
+            case OP_NEQ: return value.int_val != imm;
+            case OP_LT:  return value.int_val < imm;
+            case OP_GT:  return value.int_val > imm;
+            case OP_LTE: return value.int_val <= imm;
+            case OP_GTE: return value.int_val >= imm;
+            default:     return false;
         }
     }
-    // Потом глобальные
-    auto it = variables.find(var_name);
-    if (it != variables.end()) {
-        if (!Push(it->second)) return;
-    } else {
+    return performComparison(value, XenoValue::makeInt(imm), op);
+}
+
+XenoValue* XenoVM::loopGlobal(const XenoCompactInstruction& instr) {
+    uint16_t slot = slotCompareSlot(instr.arg1);
+    XenoValue& value = globals[slot];
+    if (value.type == TYPE_ANY) {
         Serial.print("ERROR: Variable not found: ");
-        Serial.println(var_name);
-        if (!Push(XenoValue::makeInt(0))) return;
+        Serial.println(globalName(slot));
+        value = XenoValue::makeInt(0);
+    }
+    return &value;
+}
+
+XenoValue* XenoVM::loopLocal(const XenoCompactInstruction& instr) {
+    return localSlot(slotCompareSlot(instr.arg1), "ERROR: Invalid local variable slot in loop instruction");
+}
+
+void XenoVM::branchTo(uint32_t target) {
+    if (target < program_size) {
+        program_counter = target;
+    } else {
+        Serial.println("ERROR: Jump to invalid address");
+        running = false;
     }
 }
 
-void XenoVM::handleJUMP(const XenoInstruction& instr) {
-    if (instr.arg1 < program.size()) {
+void XenoVM::handleCMP_JUMP_GLOBAL(const XenoCompactInstruction& instr) {
+    if (!compareWithImmediate(*loopGlobal(instr), instr.arg1)) branchTo(instr.arg2);
+}
+
+void XenoVM::handleCMP_JUMP_LOCAL(const XenoCompactInstruction& instr) {
+    XenoValue* value = loopLocal(instr);
+    if (value && !compareWithImmediate(*value, instr.arg1)) branchTo(instr.arg2);
+}
+
+void XenoVM::handleINC_JUMP_GLOBAL(const XenoCompactInstruction& instr) {
+    XenoValue* value = loopGlobal(instr);
+    incrementValue(*value, 1);
+    if (compareWithImmediate(*value, instr.arg1)) branchTo(instr.arg2);
+}
+
+void XenoVM::handleINC_JUMP_LOCAL(const XenoCompactInstruction& instr) {
+    XenoValue* value = loopLocal(instr);
+    if (!value) return;
+    incrementValue(*value, 1);
+    if (compareWithImmediate(*value, instr.arg1)) branchTo(instr.arg2);
+}
+
+void XenoVM::handleLOOP_JUMP_GLOBAL(const XenoCompactInstruction& instr) {
+    if (compareWithImmediate(*loopGlobal(instr), instr.arg1)) branchTo(instr.arg2);
+}
+
+void XenoVM::handleLOOP_JUMP_LOCAL(const XenoCompactInstruction& instr) {
+    XenoValue* value = loopLocal(instr);
+    if (value && compareWithImmediate(*value, instr.arg1)) branchTo(instr.arg2);
+}
+
+void XenoVM::handleJUMP(const XenoCompactInstruction& instr) {
+    if (instr.arg1 < program_size) {
         program_counter = instr.arg1;
     } else {
         Serial.println("ERROR: Jump to invalid address");
@@ -883,30 +1736,37 @@ void XenoVM::handleJUMP(const XenoInstruction& instr) {
     }
 }
 
-void XenoVM::handleJUMP_IF(const XenoInstruction& instr) {
+void XenoVM::handleJUMP_IF(const XenoCompactInstruction& instr) {
     XenoValue condition_val;
     if (!Pop(condition_val)) return;
+    branchIf(condition_val, instr.arg1);
+}
 
+void XenoVM::branchIf(const XenoValue& condition_val, uint32_t target) {
     int condition = 0;
     switch (condition_val.type) {
         case TYPE_INT: condition = (condition_val.int_val != 0); break;
         case TYPE_FLOAT: condition = (condition_val.float_val != 0.0f); break;
-        case TYPE_STRING: condition = !string_table[condition_val.string_index].isEmpty(); break;
+        case TYPE_STRING: condition = !stringEmpty(condition_val.string_index); break;
         case TYPE_BOOL: condition = condition_val.bool_val; break;
         case TYPE_ARRAY: condition = (condition_val.array_index != 0); break;
+        case TYPE_ANY: break;
     }
 
-    if (condition && instr.arg1 < program.size()) {
-        program_counter = instr.arg1;
+    if (condition && target < program_size) {
+        program_counter = target;
     }
 }
 
-void XenoVM::handleHALT(const XenoInstruction& instr) {
+void XenoVM::handleHALT(const XenoCompactInstruction& instr) {
+    (void)instr;
+    program_counter = program_size;     // Как конец кода: дальше только обработчики событий
     running = false;
 }
 
 // ---- НОВЫЕ ОБРАБОТЧИКИ (AND, OR, NOT, NEG, ARRAY_*, ANALOG_*, CONVERT) ----
-void XenoVM::handleAND(const XenoInstruction& instr) {
+void XenoVM::handleAND(const XenoCompactInstruction& instr) {
+    (void)instr;
     XenoValue a, b;
     if (!PopTwo(a, b)) return;
     bool ba = false, bb = false;
@@ -914,21 +1774,24 @@ void XenoVM::handleAND(const XenoInstruction& instr) {
         case TYPE_INT: ba = (a.int_val != 0); break;
         case TYPE_FLOAT: ba = (a.float_val != 0.0f); break;
         case TYPE_BOOL: ba = a.bool_val; break;
-        case TYPE_STRING: ba = !string_table[a.string_index].isEmpty(); break;
+        case TYPE_STRING: ba = !stringEmpty(a.string_index); break;
         case TYPE_ARRAY: ba = true; break;
+        case TYPE_ANY: break;
     }
     switch (b.type) {
         case TYPE_INT: bb = (b.int_val != 0); break;
         case TYPE_FLOAT: bb = (b.float_val != 0.0f); break;
         case TYPE_BOOL: bb = b.bool_val; break;
-        case TYPE_STRING: bb = !string_table[b.string_index].isEmpty(); break;
+        case TYPE_STRING: bb = !stringEmpty(b.string_index); break;
         case TYPE_ARRAY: bb = true; break;
+        case TYPE_ANY: break;
     }
     bool result = ba && bb;
     if (!Push(XenoValue::makeBool(result))) return;
 }
 
-void XenoVM::handleOR(const XenoInstruction& instr) {
+void XenoVM::handleOR(const XenoCompactInstruction& instr) {
+    (void)instr;
     XenoValue a, b;
     if (!PopTwo(a, b)) return;
     bool ba = false, bb = false;
@@ -936,21 +1799,24 @@ void XenoVM::handleOR(const XenoInstruction& instr) {
         case TYPE_INT: ba = (a.int_val != 0); break;
         case TYPE_FLOAT: ba = (a.float_val != 0.0f); break;
         case TYPE_BOOL: ba = a.bool_val; break;
-        case TYPE_STRING: ba = !string_table[a.string_index].isEmpty(); break;
+        case TYPE_STRING: ba = !stringEmpty(a.string_index); break;
         case TYPE_ARRAY: ba = true; break;
+        case TYPE_ANY: break;
     }
     switch (b.type) {
         case TYPE_INT: bb = (b.int_val != 0); break;
         case TYPE_FLOAT: bb = (b.float_val != 0.0f); break;
         case TYPE_BOOL: bb = b.bool_val; break;
-        case TYPE_STRING: bb = !string_table[b.string_index].isEmpty(); break;
+        case TYPE_STRING: bb = !stringEmpty(b.string_index); break;
         case TYPE_ARRAY: bb = true; break;
+        case TYPE_ANY: break;
     }
     bool result = ba || bb;
     if (!Push(XenoValue::makeBool(result))) return;
 }
 
-void XenoVM::handleNOT(const XenoInstruction& instr) {
+void XenoVM::handleNOT(const XenoCompactInstruction& instr) {
+    (void)instr;
     XenoValue a;
     if (!Peek(a)) return;
     bool ba = false;
@@ -958,13 +1824,15 @@ void XenoVM::handleNOT(const XenoInstruction& instr) {
         case TYPE_INT: ba = (a.int_val != 0); break;
         case TYPE_FLOAT: ba = (a.float_val != 0.0f); break;
         case TYPE_BOOL: ba = a.bool_val; break;
-        case TYPE_STRING: ba = !string_table[a.string_index].isEmpty(); break;
+        case TYPE_STRING: ba = !stringEmpty(a.string_index); break;
         case TYPE_ARRAY: ba = true; break;
+        case TYPE_ANY: break;
     }
     stack[stack_pointer - 1] = XenoValue::makeBool(!ba);
 }
 
-void XenoVM::handleNEG(const XenoInstruction& instr) {
+void XenoVM::handleNEG(const XenoCompactInstruction& instr) {
+    (void)instr;
     XenoValue a;
     if (!Peek(a)) return;
     if (a.type == TYPE_INT) {
@@ -982,7 +1850,62 @@ void XenoVM::handleNEG(const XenoInstruction& instr) {
     }
 }
 
-void XenoVM::handleARRAY_NEW(const XenoInstruction& instr) {
+// ---- Массивы ----
+static uint8_t arrayElementSize(uint8_t kind) {
+    switch (kind) {
+        case ARRAY_INT32: return sizeof(int32_t);
+        case ARRAY_FLOAT: return sizeof(float);
+        case ARRAY_UINT8: return sizeof(uint8_t);
+        default:          return sizeof(XenoValue);
+    }
+}
+
+uint32_t XenoArray::bytes() const {
+    return static_cast<uint32_t>(length) * arrayElementSize(kind);
+}
+
+XenoValue XenoArray::get(uint16_t index) const {
+    switch (kind) {
+        case ARRAY_INT32: {
+            int32_t v;
+            memcpy(&v, &packed[index * sizeof(int32_t)], sizeof(int32_t));
+            return XenoValue::makeInt(v);
+        }
+        case ARRAY_FLOAT: {
+            float v;
+            memcpy(&v, &packed[index * sizeof(float)], sizeof(float));
+            return XenoValue::makeFloat(v);
+        }
+        case ARRAY_UINT8:
+            return XenoValue::makeInt(packed[index]);
+        default:
+            return values[index];
+    }
+}
+
+bool XenoArray::set(uint16_t index, const XenoValue& value) {
+    switch (kind) {
+        case ARRAY_INT32:
+            if (value.type != TYPE_INT) return false;
+            memcpy(&packed[index * sizeof(int32_t)], &value.int_val, sizeof(int32_t));
+            return true;
+        case ARRAY_FLOAT: {
+            if (value.type != TYPE_INT && value.type != TYPE_FLOAT) return false;
+            float v = (value.type == TYPE_INT) ? static_cast<float>(value.int_val) : value.float_val;
+            memcpy(&packed[index * sizeof(float)], &v, sizeof(float));
+            return true;
+        }
+        case ARRAY_UINT8:
+            if (value.type != TYPE_INT || value.int_val < 0 || value.int_val > 255) return false;
+            packed[index] = static_cast<uint8_t>(value.int_val);
+            return true;
+        default:
+            values[index] = value;
+            return true;
+    }
+}
+
+void XenoVM::handleARRAY_NEW(const XenoCompactInstruction& instr) {
     XenoValue sizeVal;
     if (!Pop(sizeVal)) return;
     if (sizeVal.type != TYPE_INT) {
@@ -996,107 +1919,162 @@ void XenoVM::handleARRAY_NEW(const XenoInstruction& instr) {
         running = false;
         return;
     }
-    std::vector<XenoValue> arr(size, XenoValue::makeInt(0));
-    uint16_t idx = arrays.size();
-    arrays.push_back(arr);
-    XenoValue arrVal = XenoValue::makeArray(idx);
-    if (!Push(arrVal)) return;
-}
 
-void XenoVM::handleARRAY_GET(const XenoInstruction& instr) {
-    XenoValue idxVal, arrVal;
-    if (!Pop(idxVal)) return;
-    if (!Pop(arrVal)) return;
-    if (arrVal.type != TYPE_ARRAY) {
-        Serial.println("ERROR: ARRAY_GET on non-array");
-        running = false;
-        return;
+    uint8_t kind = instr.arg1;
+    uint32_t bytes = static_cast<uint32_t>(size) * arrayElementSize(kind);
+    uint32_t limit = security_config.getMaxArrayMemory();
+    if (array_bytes + bytes > limit || arrays_since_collect >= ARRAY_COLLECT_INTERVAL) {
+        collectArrays();
     }
-    if (idxVal.type != TYPE_INT) {
-        Serial.println("ERROR: Array index must be integer");
+    if (array_bytes + bytes > limit) {
+        Serial.println("ERROR: Array memory limit exceeded");
         running = false;
         return;
     }
-    uint16_t arrIdx = arrVal.array_index;
-    if (arrIdx >= arrays.size()) {
-        Serial.println("ERROR: Invalid array reference");
+
+    uint16_t idx;
+    if (!free_arrays.empty()) {
+        idx = free_arrays.back();
+        free_arrays.pop_back();
+    } else if (arrays.size() < 65535) {
+        idx = arrays.size();
+        arrays.emplace_back();
+    } else {
+        Serial.println("ERROR: Too many arrays");
         running = false;
         return;
     }
-    int index = idxVal.int_val;
-    if (index < 0 || index >= (int)arrays[arrIdx].size()) {
-        Serial.println("ERROR: Array index out of bounds");
-        running = false;
-        return;
+
+    XenoArray& arr = arrays[idx];
+    arr.kind = kind;
+    arr.live = true;
+    arr.length = size;
+    if (kind == ARRAY_VALUES) {
+        arr.values.assign(size, XenoValue::makeInt(0));
+    } else {
+        arr.packed.assign(bytes, 0);
     }
-    XenoValue elem = arrays[arrIdx][index];
-    if (!Push(elem)) return;
+    array_bytes += bytes;
+    array_peak_bytes = max(array_peak_bytes, array_bytes);
+    arrays_since_collect++;
+
+    if (!Push(XenoValue::makeArray(idx))) return;
 }
 
-void XenoVM::handleARRAY_SET(const XenoInstruction& instr) {
-    XenoValue val, idxVal, arrVal;
-    if (!Pop(val)) return;
-    if (!Pop(idxVal)) return;
-    if (!Pop(arrVal)) return;
+XenoArray* XenoVM::resolveArray(const XenoValue& arrVal, const char* type_error) {
     if (arrVal.type != TYPE_ARRAY) {
-        Serial.println("ERROR: ARRAY_SET on non-array");
+        Serial.println(type_error);
         running = false;
-        return;
+        return nullptr;
+    }
+    uint16_t arrIdx = arrVal.array_index;
+    if (arrIdx >= arrays.size() || !arrays[arrIdx].live) {
+        Serial.println("ERROR: Invalid array reference");
+        running = false;
+        return nullptr;
     }
+    return &arrays[arrIdx];
+}
+
+bool XenoVM::checkArrayIndex(const XenoArray& arr, const XenoValue& idxVal) {
     if (idxVal.type != TYPE_INT) {
         Serial.println("ERROR: Array index must be integer");
         running = false;
-        return;
+        return false;
     }
-    uint16_t arrIdx = arrVal.array_index;
-    if (arrIdx >= arrays.size()) {
-        Serial.println("ERROR: Invalid array reference");
+    if (idxVal.int_val < 0 || idxVal.int_val >= arr.length) {
+        Serial.println("ERROR: Array index out of bounds");
         running = false;
-        return;
+        return false;
     }
-    int index = idxVal.int_val;
-    if (index < 0 || index >= (int)arrays[arrIdx].size()) {
-        Serial.println("ERROR: Array index out of bounds");
+    return true;
+}
+
+void XenoVM::handleARRAY_GET(const XenoCompactInstruction& instr) {
+    (void)instr;
+    XenoValue idxVal, arrVal;
+    if (!Pop(idxVal)) return;
+    if (!Pop(arrVal)) return;
+    XenoArray* arr = resolveArray(arrVal, "ERROR: ARRAY_GET on non-array");
+    if (!arr || !checkArrayIndex(*arr, idxVal)) return;
+    if (!Push(arr->get(idxVal.int_val))) return;
+}
+
+void XenoVM::handleARRAY_SET(const XenoCompactInstruction& instr) {
+    (void)instr;
+    XenoValue val, idxVal, arrVal;
+    if (!Pop(val)) return;
+    if (!Pop(idxVal)) return;
+    if (!Pop(arrVal)) return;
+    XenoArray* arr = resolveArray(arrVal, "ERROR: ARRAY_SET on non-array");
+    if (!arr || !checkArrayIndex(*arr, idxVal)) return;
+    if (!arr->set(idxVal.int_val, val)) {
+        Serial.println("ERROR: Value does not fit packed array element type");
         running = false;
-        return;
     }
-    arrays[arrIdx][index] = val;
 }
 
-void XenoVM::handleARRAY_LEN(const XenoInstruction& instr) {
+void XenoVM::handleARRAY_LEN(const XenoCompactInstruction& instr) {
+    (void)instr;
     XenoValue arrVal;
     if (!Peek(arrVal)) return;
-    if (arrVal.type != TYPE_ARRAY) {
-        Serial.println("ERROR: ARRAY_LEN on non-array");
-        running = false;
-        return;
+    XenoArray* arr = resolveArray(arrVal, "ERROR: ARRAY_LEN on non-array");
+    if (!arr) return;
+    stack[stack_pointer - 1] = XenoValue::makeInt(arr->length);
+}
+
+// ---- Сборка массивов (mark/sweep) ----
+// Массив жив, если на него ссылаются стек, переменные или живой массив XenoValue.
+// Освобождённые слоты переиспользуются, поэтому индексы живых массивов не меняются.
+void XenoVM::collectArrays() {
+    arrays_since_collect = 0;
+    if (arrays.empty()) return;
+
+    std::vector<bool> marked(arrays.size(), false);
+    std::vector<uint16_t> pending;
+    for (uint32_t i = 0; i < stack_pointer; ++i) {
+        markArray(stack[i], marked, pending);
+    }
+    for (const XenoValue& value : globals) {
+        markArray(value, marked, pending);
+    }
+    while (!pending.empty()) {
+        uint16_t idx = pending.back();
+        pending.pop_back();
+        for (const XenoValue& value : arrays[idx].values) {
+            markArray(value, marked, pending);
+        }
     }
-    uint16_t arrIdx = arrVal.array_index;
-    if (arrIdx >= arrays.size()) {
-        Serial.println("ERROR: Invalid array reference");
-        running = false;
-        return;
+
+    for (size_t i = 0; i < arrays.size(); ++i) {
+        XenoArray& arr = arrays[i];
+        if (!arr.live || marked[i]) continue;
+        array_bytes -= arr.bytes();
+        arr.live = false;
+        arr.length = 0;
+        std::vector<XenoValue>().swap(arr.values);
+        std::vector<uint8_t>().swap(arr.packed);
+        free_arrays.push_back(i);
     }
-    int len = arrays[arrIdx].size();
-    stack[stack_pointer - 1] = XenoValue::makeInt(len);
+    array_collections++;
 }
 
-void XenoVM::handleANALOG_READ(const XenoInstruction& instr) {
-    if (!security.isPinAllowed(instr.arg1)) {
-        Serial.print("ERROR: Pin not allowed: ");
-        Serial.println(instr.arg1);
-        return;
+void XenoVM::markArray(const XenoValue& value, std::vector<bool>& marked, std::vector<uint16_t>& pending) {
+    if (value.type != TYPE_ARRAY || value.array_index >= arrays.size()) return;
+    uint16_t idx = value.array_index;
+    if (marked[idx] || !arrays[idx].live) return;
+    marked[idx] = true;
+    if (arrays[idx].kind == ARRAY_VALUES) {
+        pending.push_back(idx);
     }
+}
+
+void XenoVM::handleANALOG_READ(const XenoCompactInstruction& instr) {
     int val = analogRead(instr.arg1);
     if (!Push(XenoValue::makeInt(val))) return;
 }
 
-void XenoVM::handleANALOG_WRITE(const XenoInstruction& instr) {
-    if (!security.isPinAllowed(instr.arg1)) {
-        Serial.print("ERROR: Pin not allowed: ");
-        Serial.println(instr.arg1);
-        return;
-    }
+void XenoVM::handleANALOG_WRITE(const XenoCompactInstruction& instr) {
     XenoValue val;
     if (!Pop(val)) return;
     int analogVal = 0;
@@ -1115,17 +2093,110 @@ void XenoVM::handleANALOG_WRITE(const XenoInstruction& instr) {
     analogWrite(instr.arg1, analogVal);
 }
 
-void XenoVM::handleDIGITAL_READ(const XenoInstruction& instr) {
-    if (!security.isPinAllowed(instr.arg1)) {
-        Serial.print("ERROR: Pin not allowed: ");
-        Serial.println(instr.arg1);
-        return;
-    }
+void XenoVM::handleDIGITAL_READ(const XenoCompactInstruction& instr) {
     int val = digitalRead(instr.arg1);
     if (!Push(XenoValue::makeInt(val))) return;
 }
 
-void XenoVM::handleCONVERT_TO_FLOAT(const XenoInstruction& instr) {
+// ---- Групповой ввод-вывод: банк из 32 пинов за одну операцию ----
+// На ESP32 банки 0 и 1 читаются и пишутся прямо регистрами GPIO, иначе - по пину через Arduino API
+static uint32_t xenoReadPins(uint8_t bank, uint32_t mask) {
+#if defined(ARDUINO_ARCH_ESP32) && defined(GPIO_IN_REG)
+    if (bank == 0) return REG_READ(GPIO_IN_REG) & mask;
+#if defined(GPIO_IN1_REG)
+    if (bank == 1) return REG_READ(GPIO_IN1_REG) & mask;
+#endif
+#endif
+    uint32_t levels = 0;
+    for (uint32_t rest = mask; rest != 0; rest &= rest - 1) {
+        const uint8_t bit = __builtin_ctz(rest);
+        if (digitalRead(bank * 32 + bit) == HIGH) levels |= 1u << bit;
+    }
+    return levels;
+}
+
+static void xenoWritePins(uint8_t bank, uint32_t mask, uint32_t levels) {
+    const uint32_t set = mask & levels;
+#if defined(ARDUINO_ARCH_ESP32) && defined(GPIO_OUT_W1TS_REG)
+    const uint32_t clear = mask & ~levels;
+    if (bank == 0) {
+        REG_WRITE(GPIO_OUT_W1TS_REG, set);
+        REG_WRITE(GPIO_OUT_W1TC_REG, clear);
+        return;
+    }
+#if defined(GPIO_OUT1_W1TS_REG)
+    if (bank == 1) {
+        REG_WRITE(GPIO_OUT1_W1TS_REG, set);
+        REG_WRITE(GPIO_OUT1_W1TC_REG, clear);
+        return;
+    }
+#endif
+#endif
+    for (uint32_t rest = mask; rest != 0; rest &= rest - 1) {
+        const uint8_t bit = __builtin_ctz(rest);
+        digitalWrite(bank * 32 + bit, (set >> bit) & 1 ? HIGH : LOW);
+    }
+}
+
+// pinMode(OUTPUT) - только при первой записи в пин после загрузки программы
+void XenoVM::configureOutputs(uint8_t bank, uint32_t mask) {
+    if (bank >= XENO_PIN_BANKS) return;
+    uint32_t fresh = mask & ~output_pins[bank];
+    if (fresh == 0) return;
+    output_pins[bank] |= fresh;
+    for (; fresh != 0; fresh &= fresh - 1) {
+        pinMode(bank * 32 + __builtin_ctz(fresh), OUTPUT);
+    }
+}
+
+void XenoVM::handleDIGITAL_READ_PINS(const XenoCompactInstruction& instr) {
+    const uint32_t levels = xenoReadPins(pinGroupBank(instr.arg2), instr.arg1);
+    Push(XenoValue::makeInt(static_cast<int32_t>(levels)));
+}
+
+void XenoVM::handleDIGITAL_WRITE_PINS(const XenoCompactInstruction& instr) {
+    XenoValue levels;
+    if (!Pop(levels)) return;
+    if (levels.type != TYPE_INT) {
+        Serial.println("ERROR: digitalWrite levels must be an integer bit mask");
+        running = false;
+        return;
+    }
+    const uint8_t bank = pinGroupBank(instr.arg2);
+    configureOutputs(bank, instr.arg1);
+    xenoWritePins(bank, instr.arg1, static_cast<uint32_t>(levels.int_val));
+}
+
+void XenoVM::handleANALOG_READ_PINS(const XenoCompactInstruction& instr) {
+    XenoValue arrVal;
+    if (!Pop(arrVal)) return;
+    XenoArray* arr = resolveArray(arrVal, "ERROR: analogRead target must be an array");
+    if (arr == nullptr) return;
+    if (arr->kind == ARRAY_UINT8) {
+        Serial.println("ERROR: analogRead needs an int, float or untyped array");
+        running = false;
+        return;
+    }
+
+    const uint8_t bank = pinGroupBank(instr.arg2);
+    const uint8_t samples = pinGroupSamples(instr.arg2);
+    const uint32_t count = static_cast<uint32_t>(__builtin_popcount(instr.arg1)) * samples;
+    if (count > arr->length) {
+        Serial.println("ERROR: Array too small for analogRead samples");
+        running = false;
+        return;
+    }
+
+    uint16_t index = 0;
+    for (uint8_t s = 0; s < samples; ++s) {
+        for (uint32_t rest = instr.arg1; rest != 0; rest &= rest - 1) {
+            arr->set(index++, XenoValue::makeInt(analogRead(bank * 32 + __builtin_ctz(rest))));
+        }
+    }
+}
+
+void XenoVM::handleCONVERT_TO_FLOAT(const XenoCompactInstruction& instr) {
+    (void)instr;
     XenoValue val;
     if (!Peek(val)) return;
     if (val.type == TYPE_INT) {
@@ -1140,27 +2211,17 @@ void XenoVM::handleCONVERT_TO_FLOAT(const XenoInstruction& instr) {
 }
 
 // ---- ОБРАБОТЧИК OP_CALL ----
-void XenoVM::handleCALL(const XenoInstruction& instr) {
-    if (instr.arg1 >= string_table.size()) {
-        Serial.println("ERROR: Invalid function name index in CALL");
+void XenoVM::handleCALL(const XenoCompactInstruction& instr) {
+    if (instr.arg1 >= function_table.size()) {
+        Serial.println("ERROR: Invalid function index in CALL");
         running = false;
         return;
     }
-    String funcName = string_table[instr.arg1];
-
-    auto it = function_table.find(funcName);
-    if (it == function_table.end()) {
-        Serial.print("ERROR: Function '");
-        Serial.print(funcName);
-        Serial.println("' not found in function table");
-        running = false;
-        return;
-    }
-    const FunctionInfo& funcInfo = it->second;
+    const FunctionInfo& funcInfo = function_table[instr.arg1];
 
     if (stack_pointer < (uint32_t)funcInfo.arity) {
         Serial.print("ERROR: Not enough arguments on stack for function '");
-        Serial.print(funcName);
+        Serial.print(funcInfo.name);
         Serial.print("' (expected ");
         Serial.print(funcInfo.arity);
         Serial.print(", got ");
@@ -1170,55 +2231,65 @@ void XenoVM::handleCALL(const XenoInstruction& instr) {
         return;
     }
 
-    uint32_t return_address = program_counter; // уже указывает на следующую инструкцию
-
-    CallFrame frame;
-    frame.return_address = return_address;
-
-    // Извлекаем аргументы
-    std::vector<XenoValue> args(funcInfo.arity);
-    for (int i = funcInfo.arity - 1; i >= 0; --i) {
-        XenoValue val;
-        if (!Pop(val)) {
-            running = false;
-            return;
-        }
-        args[i] = val;
+    if (call_depth >= max_call_depth) {
+        Serial.print("ERROR: Call depth limit exceeded (");
+        Serial.print(max_call_depth);
+        Serial.print(") calling '");
+        Serial.print(funcInfo.name);
+        Serial.println("'");
+        running = false;
+        return;
     }
 
-    // Заполняем локальные переменные параметрами
-    for (int i = 0; i < funcInfo.arity; ++i) {
-        const String& paramName = funcInfo.parameters[i];
-        frame.locals[paramName] = args[i];
+    // Обработчики без проверок не выйдут за стек, если в нём есть место под весь кадр
+    if (stack_verified && stack_pointer - funcInfo.arity + frame_stack_depth[instr.arg1] > stack_capacity) {
+        Serial.println("CRITICAL ERROR: Stack overflow - terminating execution");
+        running = false;
+        return;
     }
 
-    call_stack.push_back(frame);
+    // Аргументы остаются на стеке и становятся слотами параметров
+    CallFrame& frame = call_stack[call_depth++];
+    if (call_depth > call_peak) call_peak = call_depth;
+    frame.return_address = program_counter;  // уже указывает на следующую инструкцию
+    frame.function = &funcInfo;
+    frame.base = stack_pointer - funcInfo.arity;
+
     program_counter = funcInfo.address;
 }
 
 // ---- ОБРАБОТЧИК OP_RETURN ----
-void XenoVM::handleRETURN(const XenoInstruction& instr) {
-    if (call_stack.empty()) {
+void XenoVM::handleRETURN(const XenoCompactInstruction& instr) {
+    (void)instr;
+    if (call_depth == 0) {
         Serial.println("ERROR: RETURN without active call frame");
         running = false;
         return;
     }
 
-    // Извлекаем результат со стека (если есть)
-    XenoValue result = XenoValue::makeInt(0);
-    if (stack_pointer > 0) {
-        // Если на стеке есть значение, считаем его результатом
-        if (!Pop(result)) {
-            running = false;
-            return;
-        }
+    const CallFrame& frame = call_stack[--call_depth];
+
+    // Кадр обработчика события: результат не нужен, основной код продолжается с того же места
+    if (call_depth + 1 == event_depth) {
+        stack_pointer = frame.base;
+        program_counter = frame.return_address;
+        event_depth = 0;
+        wait_status = event_saved_status;
+        wake_time = event_saved_wake;
+        if (wait_status != XENO_YIELDED) running = false;
+        return;
     }
 
-    // Восстанавливаем кадр
-    CallFrame frame = call_stack.back();
-    call_stack.pop_back();
+    // Результат - вершина стека над окном локальных (если есть)
+    XenoValue result = XenoValue::makeInt(0);
+    if (stack_pointer > frame.base + frame.function->arity) {
+        result = stack[stack_pointer - 1];
+    }
 
-    // Восстанавливаем program_counter на адрес возврата
+    // Снимаем окно кадра вместе с временными значениями функции
+    if (stack_pointer > frame.base) {
+        stack_pointer = frame.base;
+    }
     program_counter = frame.return_address;
 
     // Помещаем результат обратно на стек (для вызывающего кода)
@@ -1226,8 +2297,217 @@ void XenoVM::handleRETURN(const XenoInstruction& instr) {
         running = false;
         return;
     }
+}
+
+// ---- ОБРАБОТЧИК OP_CALL_NATIVE ----
+// Функция хоста видит аргументы прямо на стеке и возвращает одно значение вместо них
+void XenoVM::handleCALL_NATIVE(const XenoCompactInstruction& instr) {
+    const uint16_t index = nativeCallIndex(instr.arg1);
+    const uint8_t arity = nativeCallArity(instr.arg1);
+    if (natives == nullptr || index >= natives->size()) {
+        Serial.println("ERROR: Invalid native function index in CALL_NATIVE");
+        running = false;
+        return;
+    }
+    if (stack_pointer < arity) {
+        Serial.println("CRITICAL ERROR: Stack underflow in native call - terminating execution");
+        running = false;
+        return;
+    }
+
+    const XenoNative& native = (*natives)[index];
+    XenoNativeCall call(*this, stack + stack_pointer - arity, arity, native.user);
+    const XenoValue result = native.function(call);
+    if (!running) return;
+    // Хосту не доверяем: строка и массив должны существовать, а тип - совпасть с объявленным,
+    // из которого компилятор вывел типы выражения
+    bool valid = result.type < TYPE_ANY && (native.result == TYPE_ANY || result.type == native.result);
+    if (result.type == TYPE_STRING) valid = valid && result.string_index < stringCount();
+    if (result.type == TYPE_ARRAY) {
+        valid = valid && result.array_index < arrays.size() && arrays[result.array_index].live;
+    }
+    if (!valid) {
+        Serial.print("ERROR: Native function '");
+        Serial.print(native.name);
+        Serial.println("' returned an invalid value");
+        running = false;
+        return;
+    }
+
+    stack_pointer -= arity;
+    Push(result);
+}
+
+// ---- СОБЫТИЯ (on pin / on timer) ----
+// Источник привязывается, когда основной код доходит до EVENT_BIND; повторная привязка того же
+// источника меняет только функцию. Обработчики вызывает runFor, в run() они не выполняются
+void XenoVM::handleEVENT_BIND(const XenoCompactInstruction& instr) {
+    if (instr.arg2 >= function_table.size() || function_table[instr.arg2].arity > 1) {
+        Serial.println("ERROR: Event handler must be a function with at most one parameter");
+        running = false;
+        return;
+    }
+    for (uint8_t i = 0; i < event_count; ++i) {
+        if (events[i].source == instr.arg1) {
+            events[i].function = instr.arg2;
+            return;
+        }
+    }
+    if (event_count >= XENO_MAX_EVENTS) {
+        Serial.print("ERROR: Too many event handlers (max ");
+        Serial.print(XENO_MAX_EVENTS);
+        Serial.println(")");
+        running = false;
+        return;
+    }
+    EventBinding& binding = events[event_count];
+    binding.vm = this;
+    binding.source = instr.arg1;
+    binding.function = instr.arg2;
+    binding.index = event_count;
+    binding.attached = false;
+    armEvent(binding);
+    ++event_count;
+}
+
+// Только кладёт событие в очередь: функция выполняется в задаче VM
+void IRAM_ATTR XenoVM::pinInterrupt(void* arg) {
+    EventBinding* binding = static_cast<EventBinding*>(arg);
+    const PendingEvent event = { binding->index, static_cast<uint32_t>(digitalRead(eventPin(binding->source))) };
+    if (!binding->vm->event_queue.push(event)) {
+        binding->vm->events_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void XenoVM::armEvent(EventBinding& binding) {
+    if (eventKind(binding.source) == XENO_EVENT_TIMER) {
+        binding.next_fire = millis() + eventPeriod(binding.source);
+        binding.fired = 0;
+        return;
+    }
+    const uint8_t pin = eventPin(binding.source);
+    pinMode(pin, INPUT);
+    binding.level = digitalRead(pin);
+#if defined(ARDUINO_ARCH_ESP32)
+    static const int modes[] = { CHANGE, RISING, FALLING };
+    attachInterruptArg(pin, pinInterrupt, &binding, modes[eventEdge(binding.source)]);
+    binding.attached = true;
+#endif
+}
+
+void XenoVM::releaseEvents() {
+#if defined(ARDUINO_ARCH_ESP32)
+    for (uint8_t i = 0; i < event_count; ++i) {
+        if (events[i].attached) detachInterrupt(eventPin(events[i].source));
+    }
+#endif
+    event_count = 0;
+    event_depth = 0;
+    PendingEvent stale;
+    while (event_queue.pop(stale)) {
+    }
+}
+
+// Без прерываний (не ESP32) фронт пина ловится опросом перед каждым квантом
+void XenoVM::pollEventPins() {
+    for (uint8_t i = 0; i < event_count; ++i) {
+        EventBinding& binding = events[i];
+        if (eventKind(binding.source) != XENO_EVENT_PIN || binding.attached) continue;
+        const uint8_t level = digitalRead(eventPin(binding.source));
+        if (level == binding.level) continue;
+        binding.level = level;
+        const uint8_t edge = eventEdge(binding.source);
+        if (edge == XENO_EDGE_CHANGE || (edge == XENO_EDGE_RISING) == (level == HIGH)) {
+            if (!event_queue.push(PendingEvent{ binding.index, level })) {
+                events_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+// Сначала пины в порядке срабатывания, затем таймеры. Пропущенные периоды таймера
+// не догоняются: после долгого обработчика срабатывание одно
+bool XenoVM::nextEvent(PendingEvent& event) {
+    if (event_queue.pop(event)) return true;
+    const uint32_t now = millis();
+    for (uint8_t i = 0; i < event_count; ++i) {
+        EventBinding& binding = events[i];
+        if (eventKind(binding.source) != XENO_EVENT_TIMER) continue;
+        if (static_cast<int32_t>(now - binding.next_fire) < 0) continue;
+        binding.next_fire += eventPeriod(binding.source);
+        if (static_cast<int32_t>(now - binding.next_fire) >= 0) {
+            binding.next_fire = now + eventPeriod(binding.source);
+        }
+        event = PendingEvent{ i, ++binding.fired };
+        return true;
+    }
+    return false;
+}
+
+// Кадр обработчика встаёт поверх стека основного кода, как при CALL с адресом возврата
+// в прерванном месте; состояние DELAY/INPUT восстанавливает RETURN обработчика
+bool XenoVM::dispatchEvent() {
+    PendingEvent event;
+    if (!nextEvent(event)) return false;
+    const uint16_t function = events[event.binding].function;
+    const FunctionInfo& handler = function_table[function];
+    const uint32_t frame = stack_verified ? frame_stack_depth[function] : handler.arity;
+    if (call_depth >= max_call_depth || stack_pointer + frame > stack_capacity) {
+        events_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (handler.arity == 1) {
+        stack[stack_pointer++] = XenoValue::makeInt(event.value);
+    }
+    CallFrame& call = call_stack[call_depth++];
+    if (call_depth > call_peak) call_peak = call_depth;
+    call.return_address = program_counter;
+    call.function = &handler;
+    call.base = stack_pointer - handler.arity;
+    event_depth = call_depth;
+    event_saved_status = wait_status;
+    event_saved_wake = wake_time;
+    wait_status = XENO_YIELDED;
+    running = true;
+    program_counter = handler.address;
+    return true;
+}
+
+bool XenoVM::eventReady() const {
+    if (event_count == 0 || event_depth != 0) return false;
+    if (!event_queue.empty()) return true;
+    const uint32_t now = millis();
+    for (uint8_t i = 0; i < event_count; ++i) {
+        const EventBinding& binding = events[i];
+        if (eventKind(binding.source) == XENO_EVENT_TIMER) {
+            if (static_cast<int32_t>(now - binding.next_fire) >= 0) return true;
+        } else if (!binding.attached && digitalRead(eventPin(binding.source)) != binding.level) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Каждый вызов должен совпасть с таблицей хоста по номеру, имени и арности:
+// образ, собранный с другим набором функций, не загружается
+bool XenoVM::bindNatives() {
+    for (uint32_t i = 0; i < program_size; ++i) {
+        const XenoCompactInstruction& instr = program_code[i];
+        if (instr.opcode != OP_CALL_NATIVE) continue;
+        const String& name = stringAt(instr.arg2);
+        if (!nativeBound(instr.arg1, name)) {
+            Serial.print("SECURITY: Native function '");
+            Serial.print(name);
+            Serial.println("' is not registered - refusing to load");
+            return false;
+        }
+    }
+    return true;
+}
 
-    // Локальные переменные уничтожаются автоматически при удалении frame
+bool XenoVM::nativeBound(uint32_t arg1, const String& name) const {
+    return natives != nullptr && natives->binds(arg1, name.c_str(), name.length());
 }
 
 // ------------------------------------------------------------------
@@ -1248,49 +2528,303 @@ void XenoVM::setMaxInstructions(uint32_t max_instr) {
     }
 }
 
+void XenoVM::useAttestation(XenoAttestation* program_attestation) {
+    if (program_attestation != nullptr) {
+        attestation = program_attestation;
+    } else {
+        own_attestation.reset();
+        attestation = &own_attestation;
+    }
+}
+
 void XenoVM::loadProgram(const std::vector<XenoInstruction>& bytecode,
-                        const std::vector<String>& strings, bool less_output) {
+                        const std::vector<String>& strings, bool less_output,
+                        XenoAttestation* program_attestation) {
+    flushOutput();              // Записи кольца ссылаются на строки прежней программы
     resetState();
+    useAttestation(program_attestation);
+
+    if (!security.attest(bytecode, strings, *attestation)) {
+        Serial.println("SECURITY: Bytecode verification failed - refusing to load");
+        running = false;
+        return;
+    }
 
-    std::vector<String> sanitized_strings;
-    sanitized_strings.reserve(strings.size());
+    // Упаковываем в буфер точного размера (без запаса vector)
+    XenoArenaVector<XenoCompactInstruction> packed(arena);
+    packed.reserve(bytecode.size());
+    for (const XenoInstruction& instr : bytecode) {
+        packed.push_back(XenoCompactInstruction::pack(instr));
+    }
+    program.swap(packed);
+    program_code = program.data();
+    program_size = program.size();
+    quickening = true;
+    // Строки компилятора уже прошли проверку: копия sanitizeString нужна только изменённым
+    string_table.clear();
+    string_table.reserve(strings.size());
     for (const String& str : strings) {
-        sanitized_strings.push_back(security.sanitizeString(str));
+        if (security.isSanitized(str.c_str(), str.length())) {
+            string_table.push_back(str);
+        } else {
+            string_table.push_back(security.sanitizeString(str));
+        }
+    }
+    string_pool_size = string_table.size();
+    internPoolStrings(0, string_pool_size);
+    if (attestation->native_calls && !bindNatives()) {
+        program_size = 0;
+        running = false;
+        return;
     }
 
-    if (!security.verifyBytecode(bytecode, sanitized_strings)) {
+    initializeGlobals();
+
+    running = true;
+    if (profile != nullptr) profile->reset(program_size);
+    if (trace != nullptr) trace->reset();
+    if (!less_output) Serial.println("\nProgram loaded and verified successfully");
+}
+
+// Выполнение на месте: инструкции и пул строк читаются прямо из образа,
+// в RAM - только стек, переменные, куча строк и таблица функций
+void XenoVM::loadProgram(const XenoImageView& image_view, bool less_output,
+                         XenoAttestation* program_attestation) {
+    flushOutput();
+    resetState();
+    useAttestation(program_attestation);
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    Serial.println("ERROR: In-place execution requires a little-endian target");
+    running = false;
+    return;
+#endif
+
+    if (!security.attest(image_view.code, image_view.code_count, image_view.string_count, *attestation)) {
         Serial.println("SECURITY: Bytecode verification failed - refusing to load");
         running = false;
         return;
     }
 
-    program = bytecode;
-    string_table = sanitized_strings;
+    XenoArenaVector<XenoCompactInstruction>(arena).swap(program);
+    program_code = image_view.code;
+    program_size = image_view.code_count;
+    image = &image_view;
+    string_pool_size = image_view.string_count;
+    string_base = image_view.string_count;
 
-    for (size_t i = 0; i < string_table.size(); ++i) {
-        string_lookup[string_table[i]] = i;
+    // Строки, которые sanitizeString изменил бы, копируются в RAM заранее
+    for (uint32_t i = 0; i < image_view.string_count; ++i) {
+        uint16_t length;
+        const char* str = image_view.string(i, length);
+        if (!security.isSanitized(str, length)) {
+            stringAt(i);
+        }
     }
+    internPoolStrings(0, string_pool_size);
+    if (attestation->native_calls && !bindNatives()) {
+        program_size = 0;
+        running = false;
+        return;
+    }
+
+    initializeGlobals();
 
     running = true;
-    if (!less_output) Serial.println("\nProgram loaded and verified successfully");
+    if (profile != nullptr) profile->reset(program_size);
+    if (trace != nullptr) trace->reset();
+    if (!less_output) Serial.println("\nProgram loaded in place and verified successfully");
+}
+
+// ------------------------------------------------------------------
+// Горячая замена функций
+// ------------------------------------------------------------------
+bool XenoVM::patchFunctions(const std::vector<XenoInstruction>& patch, const std::vector<String>& strings,
+                            const std::map<String, FunctionInfo>& functions, uint32_t from) {
+    if (image != nullptr || program_size == 0) {
+        Serial.println("ERROR: Functions of this program cannot be updated");
+        return false;
+    }
+    // Заменять уже загруженный код можно, только если он сейчас не выполняется
+    const bool replaces = from < program_size;
+    if (from > program_size ||
+        (replaces && (call_depth != 0 || (program_counter >= from && program_counter < program_size)))) {
+        Serial.println("ERROR: Function bodies in use cannot be replaced");
+        return false;
+    }
+    if (strings.size() < string_pool_size || stringCount() + (strings.size() - string_pool_size) > 65535) {
+        Serial.println("ERROR: String table overflow");
+        return false;
+    }
+
+    // Программа после замены проверяется целиком, как при загрузке; итог заменит прежний.
+    // Если программа растёт сверх места в арене, запас в полтора раза: иначе каждая замена
+    // оставляла бы в арене прежний блок
+    XenoAttestation patched;
+    XenoArenaVector<XenoCompactInstruction> code(arena);
+    const size_t size = from + patch.size();
+    code.reserve(size <= program.capacity() ? size : max(size, program.capacity() + program.capacity() / 2));
+    code.assign(program_code, program_code + from);
+    for (const XenoInstruction& instr : patch) {
+        code.push_back(XenoCompactInstruction::pack(instr));
+    }
+    if (!security.attest(code.data(), code.size(), strings.size(), patched)) {
+        Serial.println("SECURITY: Bytecode verification failed - refusing to update");
+        return false;
+    }
+    for (const XenoInstruction& instr : patch) {
+        if (instr.opcode == OP_CALL_NATIVE && !nativeBound(instr.arg1, security.sanitizeString(strings[instr.arg2]))) {
+            Serial.print("SECURITY: Native function '");
+            Serial.print(strings[instr.arg2]);
+            Serial.println("' is not registered - refusing to update");
+            return false;
+        }
+    }
+
+    std::vector<FunctionInfo> table(functions.size());
+    for (const auto& entry : functions) {
+        if (entry.second.index >= 0 && static_cast<size_t>(entry.second.index) < table.size()) {
+            table[entry.second.index] = entry.second;
+        }
+    }
+    // Прерванный вызов снимает при RETURN окно прежней арности
+    std::vector<size_t> frame_functions(call_depth);
+    for (uint16_t d = 0; d < call_depth; ++d) {
+        frame_functions[d] = call_stack[d].function - function_table.data();
+        if (frame_functions[d] >= table.size() || table[frame_functions[d]].arity != call_stack[d].function->arity) {
+            Serial.println("ERROR: A running function cannot change its parameter count");
+            return false;
+        }
+    }
+
+    security.attestStack(code.data(), code.size(), table, max_stack_size, patched);
+
+    // Временная копия - последний блок арены: если новая программа помещается в прежний,
+    // копия возвращается в арену целиком
+    const uint32_t old_size = program_size;
+    if (code.size() <= program.capacity()) {
+        program.assign(code.begin(), code.end());
+        XenoArenaVector<XenoCompactInstruction>(arena).swap(code);
+    } else {
+        program.swap(code);
+    }
+    program_code = program.data();
+    program_size = program.size();
+    // Конец программы (HALT, возврат обработчика события после неё) переезжает вместе с ней
+    if (program_counter >= old_size) program_counter = program_size;
+    for (uint16_t d = 0; d < call_depth; ++d) {
+        if (call_stack[d].return_address >= old_size) call_stack[d].return_address = program_size;
+    }
+    growStringPool(strings);
+    initializeGlobals(from);
+
+    function_table.swap(table);
+    for (uint16_t d = 0; d < call_depth; ++d) {
+        call_stack[d].function = &function_table[frame_functions[d]];
+    }
+    // Прежние тела активных кадров новым доказательством не покрыты: без проверок стека
+    // можно перейти только тогда, когда таких кадров нет
+    const bool was_verified = stack_verified;
+    *attestation = patched;
+    applyStackProof(false);
+    stack_verified = stack_verified && (was_verified || call_depth == 0);
+    if (profile != nullptr) {
+        profile->address_count.resize(from);
+        profile->address_cycles.resize(from);
+        profile->address_count.resize(program_size, 0);
+        profile->address_cycles.resize(program_size, 0);
+    }
+    return true;
+}
+
+// Новые строки пула встают перед кучей: индексы строк кучи сдвигаются на их число
+void XenoVM::growStringPool(const std::vector<String>& strings) {
+    const uint16_t added = strings.size() - string_pool_size;
+    if (added == 0) return;
+
+    std::vector<uint16_t> remap(getStringHeapCount());
+    for (size_t i = 0; i < remap.size(); ++i) {
+        remap[i] = i + added;
+    }
+    traceStringRoots(remap, true);
+    const uint16_t pool_end = string_pool_size;
+    string_index.remap([pool_end, added](uint16_t index) -> uint16_t {
+        return index >= pool_end ? index + added : index;
+    });
+
+    std::vector<String> pool_strings;
+    pool_strings.reserve(added);
+    for (size_t i = string_pool_size; i < strings.size(); ++i) {
+        pool_strings.push_back(security.sanitizeString(strings[i]));
+    }
+    string_table.insert(string_table.begin() + string_pool_size, pool_strings.begin(), pool_strings.end());
+    string_pool_size += added;
+    // Новая строка пула могла уже жить в куче: тогда она повтор, и сравнение идёт по тексту
+    internPoolStrings(pool_end, string_pool_size);
+}
+
+// Число глобальных слотов и их имена берутся из самой программы:
+// каждая инструкция доступа к глобальной переменной несёт индекс имени в arg2.
+// from != 0 - дописанный код: новые слоты добавляются, значения прежних сохраняются
+void XenoVM::initializeGlobals(uint32_t from) {
+    size_t global_count = globals.size();
+    for (uint32_t i = from; i < program_size; ++i) {
+        const XenoCompactInstruction& instr = program_code[i];
+        if (instr.opcode == OP_LOAD || instr.opcode == OP_STORE) {
+            global_count = max(global_count, static_cast<size_t>(instr.arg1) + 1);
+        } else if (instr.opcode == OP_INC_GLOBAL) {
+            global_count = max(global_count, static_cast<size_t>(instr.arg1 & 0xFFFF) + 1);
+        } else if (instr.opcode == OP_CMP_JUMP_GLOBAL || instr.opcode == OP_INC_JUMP_GLOBAL ||
+                   instr.opcode == OP_LOOP_JUMP_GLOBAL) {
+            global_count = max(global_count, static_cast<size_t>(slotCompareSlot(instr.arg1)) + 1);
+        } else if (instr.opcode == OP_INPUT) {
+            global_count = max(global_count, static_cast<size_t>(instr.arg2) + 1);
+        }
+    }
+
+    XenoValue unset;
+    unset.type = TYPE_ANY;
+    globals.resize(global_count, unset);
+    global_names.resize(global_count, static_cast<uint16_t>(NO_NAME));
+
+    for (uint32_t i = from; i < program_size; ++i) {
+        const XenoCompactInstruction& instr = program_code[i];
+        if (instr.opcode == OP_LOAD || instr.opcode == OP_STORE) {
+            global_names[instr.arg1] = instr.arg2;
+        } else if (instr.opcode == OP_INC_GLOBAL) {
+            global_names[instr.arg1 & 0xFFFF] = instr.arg1 >> 16;
+        } else if (instr.opcode == OP_INPUT) {
+            global_names[instr.arg2] = instr.arg1;
+        }
+    }
 }
 
 bool XenoVM::step() {
-    if (!running || program_counter >= program.size()) {
+    if (!running || program_counter >= program_size) {
         return false;
     }
 
-    if (++iteration_count > MAX_ITERATIONS) {
+    if (++iteration_count > iterationLimit()) {
         Serial.println("ERROR: Iteration limit exceeded - possible infinite loop");
         running = false;
         return false;
     }
 
-    const XenoInstruction& instr = program[program_counter++];
+    const XenoCompactInstruction& instr = program_code[program_counter++];
+#if XENO_TRACE
+    if (trace != nullptr) trace->record(program_counter - 1, instr.opcode, stack_pointer);
+#endif
 
     InstructionHandler handler = dispatch_table[instr.opcode];
     if (handler != nullptr) {
+#if XENO_PROFILE
+        const uint32_t address = program_counter - 1;
+        const uint32_t started = xenoCycleCount();
+        (this->*handler)(instr);
+        if (profile != nullptr) profile->record(address, instr.opcode, xenoCycleCount() - started);
+#else
         (this->*handler)(instr);
+#endif
     } else {
         Serial.print("ERROR: Unknown instruction ");
         Serial.println(instr.opcode);
@@ -1308,30 +2842,326 @@ bool XenoVM::step() {
     return running;
 }
 
+// ------------------------------------------------------------------
+// Быстрый цикл для run(): обработчики вызываются напрямую (и
+// встраиваются компилятором), а лимиты инструкций/итераций
+// проверяются только на обратных переходах и вызовах функций.
+// Прямолинейный участок кода конечен, поэтому превышение лимита
+// обнаруживается не позже следующего перехода назад или CALL.
+// slice != 0 - квант runFor: вместо лимитов действует сам квант,
+// по его исчерпании управление возвращается без ошибки.
+// ------------------------------------------------------------------
+void XenoVM::execute(uint32_t slice) {
+    const XenoCompactInstruction* code = program_code;
+    const uint32_t code_size = program_size;
+    const XenoCompactInstruction* instr = nullptr;
+    uint32_t executed = 0;
+    uint32_t branch_from = 0;
+
+    const uint32_t max_iterations = iterationLimit();
+    uint32_t iterations_left = (iteration_count < max_iterations) ? max_iterations - iteration_count : 0;
+    uint32_t instructions_left = (instruction_count < max_instructions) ? max_instructions - instruction_count : 0;
+    const uint32_t budget = slice != 0 ? slice : min(iterations_left, instructions_left);
+
+#define XENO_CHECK_BUDGET() \
+    if (executed > budget) goto budget_exceeded;
+
+    // Профиль: время инструкции считается от её выборки до выборки следующей
+#if XENO_PROFILE
+    uint32_t profile_pc = NO_PROFILE_PC;
+    uint32_t profile_start = 0;
+#define XENO_PROFILE_MARK(next_pc) \
+    if (profile != nullptr) { \
+        const uint32_t now = xenoCycleCount(); \
+        if (profile_pc != NO_PROFILE_PC) profile->record(profile_pc, code[profile_pc].opcode, now - profile_start); \
+        profile_pc = (next_pc); \
+        profile_start = now; \
+    }
+#else
+#define XENO_PROFILE_MARK(next_pc)
+#endif
+
+#if XENO_TRACE
+#define XENO_TRACE_RECORD() \
+    if (trace != nullptr) trace->record(program_counter - 1, instr->opcode, stack_pointer);
+#else
+#define XENO_TRACE_RECORD()
+#endif
+
+#if XENO_COMPUTED_GOTO
+    // Таблицы меток общие для всех VM (XenoLabelTables)
+#define XENO_LABEL_ENTRY(op, handler) {op, &&label_##op},
+    static const XenoLabelEntry label_entries[] = {
+        XENO_OPCODE_HANDLERS(XENO_LABEL_ENTRY)
+        XENO_BRANCH_HANDLERS(XENO_LABEL_ENTRY)
+    };
+#undef XENO_LABEL_ENTRY
+#define XENO_FAST_LABEL_ENTRY(op, handler) {op, &&fast_label_##op},
+    static const XenoLabelEntry fast_label_entries[] = {
+        XENO_FAST_HANDLERS(XENO_FAST_LABEL_ENTRY)
+        XENO_FAST_BRANCH_HANDLERS(XENO_FAST_LABEL_ENTRY)
+    };
+#undef XENO_FAST_LABEL_ENTRY
+    static const XenoLabelTables label_tables(&&op_unknown, label_entries, fast_label_entries);
+    void* const* const jump_table = stack_verified ? label_tables.fast_labels : label_tables.labels;
+
+#define XENO_NEXT() \
+    do { \
+        if (!running || program_counter >= code_size) goto finished; \
+        XENO_PROFILE_MARK(program_counter); \
+        instr = &code[program_counter++]; \
+        XENO_TRACE_RECORD(); \
+        ++executed; \
+        goto *jump_table[instr->opcode]; \
+    } while (0)
+#define XENO_CASE(op) label_##op:
+#define XENO_DEFAULT op_unknown:
+
+    XENO_NEXT();
+
+#define XENO_FAST_CASE(op, handler) \
+    fast_label_##op: \
+        handler(*instr); \
+        XENO_NEXT();
+#define XENO_FAST_BRANCH_CASE(op, handler) \
+    fast_label_##op: \
+        branch_from = program_counter; \
+        handler(*instr); \
+        if (program_counter < branch_from) { \
+            XENO_CHECK_BUDGET(); \
+        } \
+        XENO_NEXT();
+
+    XENO_FAST_HANDLERS(XENO_FAST_CASE)
+    XENO_FAST_BRANCH_HANDLERS(XENO_FAST_BRANCH_CASE)
+#undef XENO_FAST_CASE
+#undef XENO_FAST_BRANCH_CASE
+#else
+    // Без computed goto остаётся switch с проверяемыми обработчиками
+#define XENO_NEXT() continue
+#define XENO_CASE(op) case op:
+#define XENO_DEFAULT default:
+
+    for (;;) {
+        if (!running || program_counter >= code_size) goto finished;
+        XENO_PROFILE_MARK(program_counter);
+        instr = &code[program_counter++];
+        XENO_TRACE_RECORD();
+        ++executed;
+        switch (instr->opcode) {
+#endif
+
+#define XENO_HANDLER_CASE(op, handler) \
+    XENO_CASE(op) \
+        handler(*instr); \
+        XENO_NEXT();
+#define XENO_BRANCH_CASE(op, handler) \
+    XENO_CASE(op) \
+        branch_from = program_counter; \
+        handler(*instr); \
+        if (op == OP_CALL || program_counter < branch_from) { \
+            XENO_CHECK_BUDGET(); \
+        } \
+        XENO_NEXT();
+
+    XENO_OPCODE_HANDLERS(XENO_HANDLER_CASE)
+    XENO_BRANCH_HANDLERS(XENO_BRANCH_CASE)
+
+    XENO_DEFAULT
+        Serial.print("ERROR: Unknown instruction ");
+        Serial.println(instr->opcode);
+        running = false;
+        --executed;
+        goto finished;
+
+#if !XENO_COMPUTED_GOTO
+        }
+    }
+#endif
+
+budget_exceeded:
+    if (slice != 0) goto finished;
+    if (instruction_count + executed > max_instructions) {
+        Serial.println("ERROR: Instruction limit exceeded - possible infinite loop");
+    } else {
+        Serial.println("ERROR: Iteration limit exceeded - possible infinite loop");
+    }
+    running = false;
+
+finished:
+    XENO_PROFILE_MARK(NO_PROFILE_PC);
+    iteration_count += executed;
+    instruction_count += executed;
+
+#undef XENO_HANDLER_CASE
+#undef XENO_BRANCH_CASE
+#undef XENO_NEXT
+#undef XENO_CASE
+#undef XENO_DEFAULT
+#undef XENO_CHECK_BUDGET
+#undef XENO_PROFILE_MARK
+#undef XENO_TRACE_RECORD
+}
+
 void XenoVM::run(bool less_output) {
     if (!less_output) Serial.println("\nStarting Xeno VM...");
     Serial.println();
 
-    while (step()) {
-        // Continue execution
-    }
+    const uint32_t started = micros();
+    execute();
+    busy_us += micros() - started;
+    releaseEvents();
+    flushOutput();
+    collectArrays();
+    collectStrings();
     Serial.println();
     if (!less_output) Serial.println("Xeno VM finished");
 }
 
+// Один квант выполнения: не больше budget инструкций (с точностью до следующего
+// перехода назад или CALL), DELAY и INPUT возвращают управление вместо ожидания
+XenoRunStatus XenoVM::runFor(uint32_t budget) {
+    // Обработчик события начинается только между квантами и не прерывает другой обработчик
+    bool event_started = false;
+    if (event_count != 0 && event_depth == 0) {
+        pollEventPins();
+        event_started = dispatchEvent();
+    }
+    if (event_started) {
+        // Основной код ждёт возврата из обработчика
+    } else if (wait_status == XENO_SLEEPING) {
+        if (static_cast<int32_t>(millis() - wake_time) < 0) return XENO_SLEEPING;
+        wait_status = XENO_YIELDED;
+        running = true;
+    } else if (wait_status == XENO_WAITING_INPUT) {
+        running = true;
+    }
+    if (!running) return waitingForEvents() ? XENO_WAITING_EVENT : XENO_HALTED;
+
+    time_sliced = true;
+    const uint32_t started = micros();
+    execute(budget != 0 ? budget : 1);
+    busy_us += micros() - started;
+    time_sliced = false;
+
+    if (wait_status != XENO_YIELDED) return wait_status;
+    if (running && program_counter < program_size) return XENO_YIELDED;
+
+    // Основной код завершён, привязки остаются: дальше VM просыпается только по событиям
+    if (waitingForEvents()) {
+        running = false;
+        flushOutput();
+        return XENO_WAITING_EVENT;
+    }
+
+    running = false;
+    releaseEvents();
+    flushOutput();
+    collectArrays();
+    collectStrings();
+    return XENO_HALTED;
+}
+
+// Есть ли смысл вызывать runFor: не спит, не ждёт ввода впустую и не завершена
+bool XenoVM::canResume() const {
+    if (eventReady()) return true;
+    switch (wait_status) {
+        case XENO_SLEEPING:
+            return static_cast<int32_t>(millis() - wake_time) >= 0;
+        case XENO_WAITING_INPUT:
+            return input_ready || Serial.available() > 0 || millis() - input_started >= INPUT_TIMEOUT_MS;
+        default:
+            return running;
+    }
+}
+
+void XenoVM::setProfiling(bool enabled) {
+#if XENO_PROFILE
+    if (enabled && profile == nullptr) {
+        profile = new XenoProfile();
+        profile->reset(program_size);
+    } else if (!enabled) {
+        delete profile;
+        profile = nullptr;
+    }
+#else
+    (void)enabled;
+#endif
+}
+
+bool XenoVM::setTracing(uint16_t depth) {
+#if XENO_TRACE
+    if (depth > XenoTrace::MAX_DEPTH) {
+        Serial.println("ERROR: Trace depth too large");
+        return false;
+    }
+    delete trace;
+    trace = depth != 0 ? new XenoTrace(depth) : nullptr;
+    return true;
+#else
+    (void)depth;
+    return depth == 0;
+#endif
+}
+
+// Самый верхний слот, в который что-то писали с загрузки программы
+uint16_t XenoVM::getStackPeak() const {
+    uint32_t peak = stack_capacity;
+    while (peak > 0 && stack[peak - 1].type == UNTOUCHED_SLOT) --peak;
+    return peak;
+}
+
+XenoMetrics XenoVM::getMetrics() const {
+    XenoMetrics metrics;
+    const uint64_t active_us = busy_us > blocked_us ? busy_us - blocked_us : 0;
+    metrics.instructions = instruction_count;
+    metrics.instructions_per_second = active_us != 0 ? static_cast<uint32_t>(instruction_count * 1000000ULL / active_us) : 0;
+    metrics.busy_ms = active_us / 1000;
+    metrics.delay_ms = delay_ms;
+    metrics.input_ms = input_ms;
+    metrics.stack_depth = stack_pointer;
+    metrics.stack_peak = getStackPeak();
+    metrics.call_depth = call_depth;
+    metrics.call_peak = call_peak;
+    metrics.string_heap_bytes = string_heap_bytes;
+    metrics.array_bytes = array_bytes;
+    metrics.dropped_events = getDroppedEvents();
+    return metrics;
+}
+
+void XenoVM::provideInput(const String& input) {
+    pending_input = input;
+    input_ready = true;
+}
+
 void XenoVM::stop() {
+    releaseEvents();
     running = false;
+    wait_status = XENO_YIELDED;
     program_counter = 0;
     stack_pointer = 0;
 }
 
-bool XenoVM::isRunning() const { return running; }
+uint32_t XenoVM::getWakeTime() const {
+    const uint32_t now = millis();
+    bool found = wait_status == XENO_SLEEPING;
+    uint32_t wake = found ? wake_time : now;
+    for (uint8_t i = 0; i < event_count; ++i) {
+        if (eventKind(events[i].source) != XENO_EVENT_TIMER) continue;
+        if (!found || static_cast<int32_t>(events[i].next_fire - wake) < 0) wake = events[i].next_fire;
+        found = true;
+    }
+    return found ? wake : wake_time;
+}
+
+bool XenoVM::isRunning() const { return running || wait_status != XENO_YIELDED || waitingForEvents(); }
 uint32_t XenoVM::getPC() const { return program_counter; }
 uint32_t XenoVM::getSP() const { return stack_pointer; }
 uint32_t XenoVM::getInstructionCount() const { return instruction_count; }
 uint32_t XenoVM::getIterationCount() const { return iteration_count; }
 
 void XenoVM::dumpState() {
+#if XENO_FEATURE_DEBUG
     Serial.println("\n=== VM State ===");
 
     Serial.print("Program Counter: ");
@@ -1343,8 +3173,51 @@ void XenoVM::dumpState() {
     Serial.print("Max Stack Size: ");
     Serial.println(max_stack_size);
 
+    Serial.print("Stack Peak: ");
+    Serial.println(getStackPeak());
+
+    Serial.print("Program: ");
+    Serial.print(program_size);
+    Serial.print(" instructions, ");
+    Serial.print(program_size * sizeof(XenoInstruction));
+    Serial.print(" bytes as XenoInstruction -> ");
+    if (image != nullptr) {
+        Serial.print(program_size * sizeof(XenoCompactInstruction));
+        Serial.println(" bytes packed, executed in place (0 bytes in RAM)");
+    } else {
+        Serial.print(program.capacity() * sizeof(XenoCompactInstruction));
+        Serial.println(" bytes packed");
+    }
+
+    Serial.print("Strings: ");
+    Serial.print(string_pool_size);
+    Serial.print(" in program pool, heap ");
+    Serial.print(getStringHeapCount());
+    Serial.print(" live / ");
+    Serial.print(string_heap_bytes);
+    Serial.print(" bytes (peak ");
+    Serial.print(string_heap_peak);
+    Serial.print(", collections ");
+    Serial.print(string_collections);
+    Serial.println(")");
+
+    Serial.print("Arrays: ");
+    Serial.print(arrays.size() - free_arrays.size());
+    Serial.print(" live / ");
+    Serial.print(array_bytes);
+    Serial.print(" of ");
+    Serial.print(security_config.getMaxArrayMemory());
+    Serial.print(" bytes (peak ");
+    Serial.print(array_peak_bytes);
+    Serial.print(", collections ");
+    Serial.print(array_collections);
+    Serial.println(")");
+
     Serial.println("Stack: [");
-    for (uint32_t i = 0; i < stack_pointer && i < 10; ++i) {
+    // Верхние 10 значений: у вершины - то, с чем VM работала последним
+    const uint32_t shown_from = stack_pointer > 10 ? stack_pointer - 10 : 0;
+    if (shown_from > 0) Serial.println("  ...");
+    for (uint32_t i = shown_from; i < stack_pointer; ++i) {
         String type_str;
         String value_str;
         switch (stack[i].type) {
@@ -1358,7 +3231,7 @@ void XenoVM::dumpState() {
                 break;
             case TYPE_STRING:
                 type_str = "STRING";
-                value_str = "\"" + string_table[stack[i].string_index] + "\"";
+                value_str = "\"" + stringAt(stack[i].string_index) + "\"";
                 break;
             case TYPE_BOOL:
                 type_str = "BOOL";
@@ -1366,7 +3239,10 @@ void XenoVM::dumpState() {
                 break;
             case TYPE_ARRAY:
                 type_str = "ARRAY";
-                value_str = "idx=" + String(stack[i].array_index) + " len=" + String(arrays[stack[i].array_index].size());
+                value_str = "idx=" + String(stack[i].array_index) + " len=" + String(arrays[stack[i].array_index].length);
+                break;
+            case TYPE_ANY:
+                type_str = "ANY";
                 break;
         }
         Serial.print("  ");
@@ -1376,85 +3252,90 @@ void XenoVM::dumpState() {
         Serial.print(" ");
         Serial.println(value_str);
     }
-    if (stack_pointer > 10) Serial.println("  ...");
     Serial.println("]");
 
     Serial.println("Global Variables: {");
-    for (const auto& var : variables) {
-        String type_str;
-        String value_str;
-        switch (var.second.type) {
-            case TYPE_INT:
-                type_str = "INT";
-                value_str = String(var.second.int_val);
-                break;
-            case TYPE_FLOAT:
-                type_str = "FLOAT";
-                value_str = String(var.second.float_val, 4);
-                break;
-            case TYPE_STRING:
-                type_str = "STRING";
-                value_str = "\"" + string_table[var.second.string_index] + "\"";
-                break;
-            case TYPE_BOOL:
-                type_str = "BOOL";
-                value_str = var.second.bool_val ? "true" : "false";
-                break;
-            case TYPE_ARRAY:
-                type_str = "ARRAY";
-                value_str = "idx=" + String(var.second.array_index) + " len=" + String(arrays[var.second.array_index].size());
-                break;
-        }
-        Serial.print("  ");
-        Serial.print(var.first);
-        Serial.print(": ");
-        Serial.print(type_str);
-        Serial.print(" ");
-        Serial.println(value_str);
+    for (size_t i = 0; i < globals.size(); ++i) {
+        // Неприсвоенные слоты не показываем
+        if (globals[i].type == TYPE_ANY) continue;
+        printValue(globalName(i), globals[i]);
     }
     Serial.println("}");
 
-    if (!call_stack.empty()) {
-        Serial.println("Local variables (top frame): {");
-        const CallFrame& frame = call_stack.back();
-        for (const auto& var : frame.locals) {
-            String type_str;
-            String value_str;
-            switch (var.second.type) {
-                case TYPE_INT:
-                    type_str = "INT";
-                    value_str = String(var.second.int_val);
-                    break;
-                case TYPE_FLOAT:
-                    type_str = "FLOAT";
-                    value_str = String(var.second.float_val, 4);
-                    break;
-                case TYPE_STRING:
-                    type_str = "STRING";
-                    value_str = "\"" + string_table[var.second.string_index] + "\"";
-                    break;
-                case TYPE_BOOL:
-                    type_str = "BOOL";
-                    value_str = var.second.bool_val ? "true" : "false";
-                    break;
-                case TYPE_ARRAY:
-                    type_str = "ARRAY";
-                    value_str = "idx=" + String(var.second.array_index) + " len=" + String(arrays[var.second.array_index].size());
-                    break;
-            }
-            Serial.print("  ");
-            Serial.print(var.first);
-            Serial.print(": ");
-            Serial.print(type_str);
-            Serial.print(" ");
-            Serial.println(value_str);
+    if (call_depth > 0) {
+        Serial.print("Local variables (top frame, depth ");
+        Serial.print(call_depth);
+        Serial.println("): {");
+        const CallFrame& frame = call_stack[call_depth - 1];
+        for (int i = 0; i < frame.function->arity && frame.base + i < stack_pointer; ++i) {
+            printValue(frame.function->parameters[i], stack[frame.base + i]);
         }
         Serial.println("}");
     }
 
     Serial.println();
+#else
+    Serial.println("Debug output is not compiled in: build with -DXENO_FEATURE_DEBUG=1");
+#endif
 }
 
+#if XENO_FEATURE_DEBUG
+
+void XenoVM::printValue(const String& name, const XenoValue& val) {
+    String type_str;
+    String value_str;
+    switch (val.type) {
+        case TYPE_INT:
+            type_str = "INT";
+            value_str = String(val.int_val);
+            break;
+        case TYPE_FLOAT:
+            type_str = "FLOAT";
+            value_str = String(val.float_val, 4);
+            break;
+        case TYPE_STRING:
+            type_str = "STRING";
+            value_str = "\"" + stringAt(val.string_index) + "\"";
+            break;
+        case TYPE_BOOL:
+            type_str = "BOOL";
+            value_str = val.bool_val ? "true" : "false";
+            break;
+        case TYPE_ARRAY:
+            type_str = "ARRAY";
+            value_str = "idx=" + String(val.array_index) + " len=" + String(arrays[val.array_index].length);
+            break;
+        default:
+            break;
+    }
+    Serial.print("  ");
+    Serial.print(name);
+    Serial.print(": ");
+    Serial.print(type_str);
+    Serial.print(" ");
+    Serial.println(value_str);
+}
+#endif  // XENO_FEATURE_DEBUG
+
 void XenoVM::disassemble() {
-    Debugger::disassemble(program, string_table, "Disassembly");
+#if XENO_FEATURE_DEBUG
+    std::vector<XenoInstruction> unpacked;
+    unpacked.reserve(program_size);
+    for (uint32_t i = 0; i < program_size; ++i) {
+        unpacked.push_back(program_code[i].unpack());
+    }
+    if (image == nullptr) {
+        Debugger::disassemble(unpacked, string_table, "Disassembly");
+        return;
+    }
+    // Пул строк в образе: временная копия только для вывода
+    std::vector<String> strings;
+    strings.reserve(stringCount());
+    for (uint32_t i = 0; i < stringCount(); ++i) {
+        strings.push_back(stringAt(i));
+    }
+    Debugger::disassemble(unpacked, strings, "Disassembly");
+#else
+    Serial.println("Disassembler is not compiled in: build with -DXENO_FEATURE_DEBUG=1");
+#endif
 }
\ No newline at end of file
@@ -23,47 +23,191 @@
 #include "../xeno_common.h"
 #include "../security/xeno_security.h"
 #include "../security/xeno_security_config.h"
+#include "../image/xeno_image.h"
+#include "../debug/xeno_profile.h"
+#include "../debug/xeno_trace.h"
+#include "../output/xeno_output.h"
+#include "../native/xeno_native.h"
+#include "../rtos/xeno_spsc_queue.h"
+#include "../memory/xeno_string_index.h"
+
+// Массив VM: XenoValue на элемент или упакованные однородные значения
+struct XenoArray {
+    uint8_t kind = ARRAY_VALUES;        // XenoArrayKind
+    bool live = false;                  // false - слот свободен
+    uint16_t length = 0;
+    std::vector<XenoValue> values;      // для ARRAY_VALUES
+    std::vector<uint8_t> packed;        // для остальных видов: length * размер элемента
+
+    uint32_t bytes() const;
+    XenoValue get(uint16_t index) const;
+    bool set(uint16_t index, const XenoValue& value);
+};
+
+// Снимок для мониторинга (XenoLanguage::getMetrics): счётчики с последней загрузки программы
+struct XenoMetrics {
+    uint32_t instructions = 0;              // Выполнено инструкций
+    uint32_t instructions_per_second = 0;   // По времени работы VM, без ожидания delay и input
+    uint32_t busy_ms = 0;                   // Время работы VM
+    uint32_t delay_ms = 0;                  // Запрошено в delay
+    uint32_t input_ms = 0;                  // Ожидание input
+    uint16_t stack_depth = 0;
+    uint16_t stack_peak = 0;
+    uint16_t call_depth = 0;
+    uint16_t call_peak = 0;
+    uint32_t string_heap_bytes = 0;
+    uint32_t array_bytes = 0;
+    uint32_t dropped_events = 0;
+};
 
 class XenoVM {
  private:
-    std::vector<XenoInstruction> program;
-    std::vector<String> string_table;
-    std::map<String, uint16_t> string_lookup;
+    XenoArena* arena;                            // Память программы, стека и глобальных (nullptr - куча)
+    XenoArenaVector<XenoCompactInstruction> program; // Упакованный поток инструкций (если не на месте)
+    const XenoCompactInstruction* program_code;  // Исполняемый поток: program или образ во flash
+    uint32_t program_size;
+    bool quickening;                             // Код в своей памяти: общие опкоды переписываются на типизированные
+    static const uint32_t QUICKEN_OFF = 1;       // arg1 общего опкода: типы на этом месте менялись, не переписывать
+    const XenoImageView* image;                  // Образ при выполнении на месте, иначе nullptr
+    std::vector<String> string_table;            // Строки программы, затем куча строк времени выполнения
+    XenoStringIndex string_index;                // Интернирование: одинаковый текст - один индекс
+    bool strings_unique;                         // Нет повторов в пуле: равенство строк - равенство индексов
+    uint16_t string_pool_size;                   // Строки программы неизменяемы: индексы [0, pool)
+    uint16_t string_base;                        // Индекс строки string_table[0] (pool при выполнении на месте)
+    std::map<uint16_t, String> pool_cache;       // Копии строк образа, понадобившиеся как String
+    uint32_t string_heap_bytes;                  // Суммарная длина строк кучи
+    uint16_t string_heap_peak;                   // Максимум строк в куче
+    uint32_t string_collections;                 // Число сборок кучи строк
+    uint16_t string_collect_count;               // Порог сборки: число строк в куче
+    uint32_t string_collect_bytes;               // Порог сборки: байт в куче
+    static const uint16_t STRING_HEAP_MIN_COLLECT = 64;
+    static const uint32_t STRING_HEAP_MIN_COLLECT_BYTES = 4096;
     uint32_t program_counter;
 
     XenoValue* stack;
     uint32_t stack_pointer;
     const uint32_t max_stack_size;
+    uint32_t stack_capacity;                     // Размер stack: max_stack_size или доказанная граница программы
 
-    std::map<String, XenoValue> variables;       // Глобальные переменные
-    std::vector<std::vector<XenoValue>> arrays;
+    XenoArenaVector<XenoValue> globals;          // Глобальные переменные (по слотам)
+    std::vector<uint16_t> global_names;          // Индексы имён слотов в таблице строк
+    static const uint16_t NO_NAME = 0xFFFF;
+    std::vector<XenoArray> arrays;
+    std::vector<uint16_t> free_arrays;           // Освобождённые слоты arrays
+    uint32_t array_bytes;                        // Память элементов живых массивов
+    uint32_t array_peak_bytes;
+    uint32_t array_collections;
+    uint16_t arrays_since_collect;               // Создано массивов после последней сборки
+    static const uint16_t ARRAY_COLLECT_INTERVAL = 32;
     bool running;
     uint32_t instruction_count;
     uint32_t max_instructions;
     uint32_t iteration_count;
     static const uint32_t MAX_ITERATIONS = 100000;
+    // Выше лимита инструкций: setMaxInstructions больше 100000 иначе не действовал бы
+    uint32_t iterationLimit() const { return max_instructions >= MAX_ITERATIONS ? max_instructions + 1 : MAX_ITERATIONS; }
+
+    // Метрики (getMetrics): время в execute() и блокирующих delay/input внутри него
+    uint64_t busy_us;
+    uint64_t blocked_us;
+    uint32_t delay_ms;
+    uint32_t input_ms;
+    uint16_t call_peak;
+    // Слоты стека выше пика не тронуты: пик ищется по метке, а не считается на каждом PUSH
+    static const XenoDataType UNTOUCHED_SLOT = static_cast<XenoDataType>(0xFF);
+
+    // Выполнение квантами (runFor): DELAY и INPUT не блокируют, а возвращают управление хосту
+    bool time_sliced;
+    XenoRunStatus wait_status;                   // XENO_SLEEPING/XENO_WAITING_INPUT или XENO_YIELDED
+    uint32_t wake_time;                          // millis() окончания DELAY
+    uint32_t input_started;                      // millis() начала ожидания INPUT
+    String pending_input;                        // Строка из provideInput для следующего INPUT
+    bool input_ready;
+    static const uint32_t INPUT_TIMEOUT_MS = 30000;
     XenoSecurity security;
     XenoSecurityConfig& security_config;
 
-    // Стек вызовов
-    std::vector<CallFrame> call_stack;
+    // Стек вызовов: кадры выделяются один раз, локальные живут на стеке операндов
+    CallFrame* call_stack;
+    uint16_t call_depth;
+    const uint16_t max_call_depth;
 
-    // Таблица функций
-    std::map<String, FunctionInfo> function_table;
+    // Таблица функций по номеру (FunctionInfo::index)
+    std::vector<FunctionInfo> function_table;
 
-    friend class XenoLanguage;
+    // Глубина стека доказана статически (XenoSecurity::verifyStackDepth): горячие операции execute()
+    // идут без проверок границ, а место под весь кадр функции проверяется один раз в CALL
+    bool stack_verified;
+    std::vector<uint16_t> frame_stack_depth;     // Наибольшая глубина кадра функции по номеру
+
+    // Проверка текущей программы: внешняя (у владельца программы) или own_attestation
+    XenoAttestation* attestation;
+    XenoAttestation own_attestation;
 
-    typedef void (XenoVM::*InstructionHandler)(const XenoInstruction&);
-    InstructionHandler dispatch_table[256];
+    const XenoNativeTable* natives;              // Функции хоста (XenoLanguage или XenoScheduler), может быть nullptr
 
-    void initializeDispatchTable();
+    Print* output;                               // Вывод print (по умолчанию Serial), ошибки идут в Serial
+    XenoOutputConfig output_config;
+    XenoOutputBuffer output_buffer;              // Только в XENO_OUTPUT_BUFFERED
+    uint32_t output_window;                      // millis() начала секунды ограничения скорости
+    uint16_t output_window_lines;                // Строк в текущей секунде
+    uint32_t output_dropped;                     // Отброшено строк: полное кольцо или ограничение скорости
+
+    uint32_t output_pins[XENO_PIN_BANKS];        // Пины, уже переведённые в OUTPUT (по банкам)
+
+    // ---- События (on pin / on timer) ----
+    // Привязки в массиве фиксированного размера: адрес привязки - аргумент прерывания
+    struct EventBinding {
+        XenoVM* vm;
+        uint32_t source;                         // arg1 OP_EVENT_BIND
+        uint16_t function;
+        uint8_t index;
+        uint8_t level;                           // Пин: последний уровень (опрос без прерываний)
+        bool attached;                           // Пин: установлен обработчик прерывания
+        uint32_t next_fire;                      // Таймер: millis() следующего срабатывания
+        uint32_t fired;                          // Таймер: число срабатываний
+    };
+    struct PendingEvent {
+        uint8_t binding;
+        uint32_t value;                          // Аргумент обработчика
+    };
+    EventBinding events[XENO_MAX_EVENTS];
+    uint8_t event_count;
+    XenoSpscQueue<PendingEvent, 16> event_queue; // Прерывание -> VM
+    std::atomic<uint32_t> events_dropped;        // Полная очередь или нет места под кадр обработчика
+    uint16_t event_depth;                        // call_depth с кадром обработчика, 0 - обработчик не выполняется
+    XenoRunStatus event_saved_status;            // Состояние основного кода на время обработчика
+    uint32_t event_saved_wake;
+
+    XenoProfile* profile;                        // Только при XENO_PROFILE и setProfiling(true)
+    XenoTrace* trace;                            // Только при XENO_TRACE и setTracing(depth)
+    static const uint32_t NO_PROFILE_PC = 0xFFFFFFFF;
+
+    friend class XenoLanguage;
+    friend class XenoScheduler;
+    friend class XenoNativeCall;
+
+    typedef void (XenoVM::*InstructionHandler)(const XenoCompactInstruction&);
+    // Общая для всех экземпляров и константная: во flash, а не по 256 указателей в RAM на каждую VM
+    static const InstructionHandler dispatch_table[256];
+    static constexpr InstructionHandler handlerFor(uint8_t opcode);
     void resetState();
+    void initializeGlobals(uint32_t from = 0);
+    void useAttestation(XenoAttestation* program_attestation);
+    void resizeStack(uint32_t capacity);
+    XenoValue* allocateStack(uint32_t capacity);
+    void releaseStack();
+    // shrink = false: стек только растёт (горячая замена - прежний блок в арене не вернётся)
+    void applyStackProof(bool shrink = true);
+    void growStringPool(const std::vector<String>& strings);
+    void printValue(const String& name, const XenoValue& val);
     String convertToString(const XenoValue& val);
     float toFloat(const XenoValue& v);
     bool Push(const XenoValue& value);
     bool Pop(XenoValue& value);
     bool PopTwo(XenoValue& a, XenoValue& b);
     bool Peek(XenoValue& value);
+    XenoValue* localSlot(uint32_t slot, const char* error);
     bool Add(int32_t a, int32_t b, int32_t& result);
     bool Sub(int32_t a, int32_t b, int32_t& result);
     bool Mul(int32_t a, int32_t b, int32_t& result);
@@ -83,71 +227,199 @@ class XenoVM {
     XenoValue performAbs(const XenoValue& a);
     bool performComparison(const XenoValue& a, const XenoValue& b, uint8_t op);
     uint16_t addString(const String& str);
+    uint32_t stringCount() const { return string_base + string_table.size(); }
+    const String& stringAt(uint16_t index);
+    const char* stringData(uint16_t index, uint16_t& length) const;
+    void internPoolStrings(uint16_t from, uint16_t to);
+    const String& globalName(uint16_t slot);
+    void printString(uint16_t index);
+    bool stringEmpty(uint16_t index) const;
+    void collectStrings();
+    void collectArrays();
+    void markArray(const XenoValue& value, std::vector<bool>& marked, std::vector<uint16_t>& pending);
+    XenoArray* resolveArray(const XenoValue& arrVal, const char* type_error);
+    bool checkArrayIndex(const XenoArray& arr, const XenoValue& idxVal);
+    void traceStringRoots(std::vector<uint16_t>& remap, bool rewrite);
+    void traceString(XenoValue& value, std::vector<uint16_t>& remap, bool rewrite);
     bool isInteger(const String& str);
     bool isFloat(const String& str);
     bool isBool(const String& str);
+    bool pollInput(const String& var_name, String& input_str);
+    void outputValue(const XenoValue& val);
+    void printRecord(const XenoValue& val);
+    bool admitOutput();
+    void storeInput(uint16_t slot, String& input_str);
+    bool bindNatives();
+    bool nativeBound(uint32_t arg1, const String& name) const;
+    void configureOutputs(uint8_t bank, uint32_t mask);
+    static void pinInterrupt(void* arg);
+    void armEvent(EventBinding& binding);
+    void releaseEvents();
+    void pollEventPins();
+    bool nextEvent(PendingEvent& event);
+    bool dispatchEvent();
+    bool eventReady() const;
+    bool waitingForEvents() const {
+        return event_count != 0 && event_depth == 0 && program_counter >= program_size;
+    }
 
-    void handleNOP(const XenoInstruction& instr);
-    void handlePRINT(const XenoInstruction& instr);
-    void handleLED_ON(const XenoInstruction& instr);
-    void handleLED_OFF(const XenoInstruction& instr);
-    void handleDELAY(const XenoInstruction& instr);
-    void handlePUSH(const XenoInstruction& instr);
-    void handlePUSH_FLOAT(const XenoInstruction& instr);
-    void handlePUSH_BOOL(const XenoInstruction& instr);
-    void handlePUSH_STRING(const XenoInstruction& instr);
-    void handlePOP(const XenoInstruction& instr);
-    void handleINPUT(const XenoInstruction& instr);
-    void handleEQ(const XenoInstruction& instr);
-    void handleNEQ(const XenoInstruction& instr);
-    void handleLT(const XenoInstruction& instr);
-    void handleGT(const XenoInstruction& instr);
-    void handleLTE(const XenoInstruction& instr);
-    void handleGTE(const XenoInstruction& instr);
-    void handlePRINT_NUM(const XenoInstruction& instr);
-    void handleSTORE(const XenoInstruction& instr);
-    void handleLOAD(const XenoInstruction& instr);
-    void handleJUMP(const XenoInstruction& instr);
-    void handleJUMP_IF(const XenoInstruction& instr);
-    void handleUNARY_MATH(const XenoInstruction& instr);
-    void handleHALT(const XenoInstruction& instr);
-    void handleBINARY_OP(const XenoInstruction& instr);
-    void handleComparisonOp(const XenoInstruction& instr, uint8_t op);
-    void handlePushOp(const XenoInstruction& instr, XenoDataType type);
+    void handleNOP(const XenoCompactInstruction& instr);
+    void handlePRINT(const XenoCompactInstruction& instr);
+    void handleLED_ON(const XenoCompactInstruction& instr);
+    void handleLED_OFF(const XenoCompactInstruction& instr);
+    void handleDELAY(const XenoCompactInstruction& instr);
+    void handlePUSH(const XenoCompactInstruction& instr);
+    void handlePUSH_FLOAT(const XenoCompactInstruction& instr);
+    void handlePUSH_BOOL(const XenoCompactInstruction& instr);
+    void handlePUSH_STRING(const XenoCompactInstruction& instr);
+    void handlePOP(const XenoCompactInstruction& instr);
+    void handleINPUT(const XenoCompactInstruction& instr);
+    void handleEQ(const XenoCompactInstruction& instr);
+    void handleNEQ(const XenoCompactInstruction& instr);
+    void handleLT(const XenoCompactInstruction& instr);
+    void handleGT(const XenoCompactInstruction& instr);
+    void handleLTE(const XenoCompactInstruction& instr);
+    void handleGTE(const XenoCompactInstruction& instr);
+    void handlePRINT_NUM(const XenoCompactInstruction& instr);
+    void handleSTORE(const XenoCompactInstruction& instr);
+    void handleLOAD(const XenoCompactInstruction& instr);
+    void handleSTORE_LOCAL(const XenoCompactInstruction& instr);
+    void handleLOAD_LOCAL(const XenoCompactInstruction& instr);
+    void handleINC_GLOBAL(const XenoCompactInstruction& instr);
+    void handleINC_LOCAL(const XenoCompactInstruction& instr);
+    void incrementValue(XenoValue& value, int32_t step);
+    void handleCMP_JUMP_GLOBAL(const XenoCompactInstruction& instr);
+    void handleCMP_JUMP_LOCAL(const XenoCompactInstruction& instr);
+    void handleINC_JUMP_GLOBAL(const XenoCompactInstruction& instr);
+    void handleINC_JUMP_LOCAL(const XenoCompactInstruction& instr);
+    void handleLOOP_JUMP_GLOBAL(const XenoCompactInstruction& instr);
+    void handleLOOP_JUMP_LOCAL(const XenoCompactInstruction& instr);
+    bool compareWithImmediate(const XenoValue& value, uint32_t operand);
+    XenoValue* loopGlobal(const XenoCompactInstruction& instr);
+    XenoValue* loopLocal(const XenoCompactInstruction& instr);
+    void branchTo(uint32_t target);
+    void handleJUMP(const XenoCompactInstruction& instr);
+    void handleJUMP_IF(const XenoCompactInstruction& instr);
+    void branchIf(const XenoValue& condition_val, uint32_t target);
+    void handleUNARY_MATH(const XenoCompactInstruction& instr);
+    void handleHALT(const XenoCompactInstruction& instr);
+    void handleBINARY_OP(const XenoCompactInstruction& instr);
+    void handleComparisonOp(const XenoCompactInstruction& instr, uint8_t op);
+    void binaryOperation(uint8_t op);
+    void comparison(uint8_t op);
+    void quicken(const XenoCompactInstruction& instr);
+    void typeMiss(uint8_t generic_op);
+
+    // Типизированная арифметика и сравнения (OP_ADD_INT..OP_GTE_FLOAT)
+    void handleADD_INT(const XenoCompactInstruction& instr);
+    void handleSUB_INT(const XenoCompactInstruction& instr);
+    void handleMUL_INT(const XenoCompactInstruction& instr);
+    void handleDIV_INT(const XenoCompactInstruction& instr);
+    void handleMOD_INT(const XenoCompactInstruction& instr);
+    void handleADD_FLOAT(const XenoCompactInstruction& instr);
+    void handleSUB_FLOAT(const XenoCompactInstruction& instr);
+    void handleMUL_FLOAT(const XenoCompactInstruction& instr);
+    void handleDIV_FLOAT(const XenoCompactInstruction& instr);
+    void handleEQ_INT(const XenoCompactInstruction& instr);
+    void handleNEQ_INT(const XenoCompactInstruction& instr);
+    void handleLT_INT(const XenoCompactInstruction& instr);
+    void handleGT_INT(const XenoCompactInstruction& instr);
+    void handleLTE_INT(const XenoCompactInstruction& instr);
+    void handleGTE_INT(const XenoCompactInstruction& instr);
+    void handleEQ_FLOAT(const XenoCompactInstruction& instr);
+    void handleNEQ_FLOAT(const XenoCompactInstruction& instr);
+    void handleLT_FLOAT(const XenoCompactInstruction& instr);
+    void handleGT_FLOAT(const XenoCompactInstruction& instr);
+    void handleLTE_FLOAT(const XenoCompactInstruction& instr);
+    void handleGTE_FLOAT(const XenoCompactInstruction& instr);
+    void handlePushOp(const XenoCompactInstruction& instr, XenoDataType type);
 
     // Новые обработчики
-    void handleAND(const XenoInstruction& instr);
-    void handleOR(const XenoInstruction& instr);
-    void handleNOT(const XenoInstruction& instr);
-    void handleNEG(const XenoInstruction& instr);
-    void handleARRAY_NEW(const XenoInstruction& instr);
-    void handleARRAY_GET(const XenoInstruction& instr);
-    void handleARRAY_SET(const XenoInstruction& instr);
-    void handleARRAY_LEN(const XenoInstruction& instr);
-    void handleANALOG_READ(const XenoInstruction& instr);
-    void handleANALOG_WRITE(const XenoInstruction& instr);
-    void handleDIGITAL_READ(const XenoInstruction& instr);
-    void handleCONVERT_TO_FLOAT(const XenoInstruction& instr);
+    void handleAND(const XenoCompactInstruction& instr);
+    void handleOR(const XenoCompactInstruction& instr);
+    void handleNOT(const XenoCompactInstruction& instr);
+    void handleNEG(const XenoCompactInstruction& instr);
+    void handleARRAY_NEW(const XenoCompactInstruction& instr);
+    void handleARRAY_GET(const XenoCompactInstruction& instr);
+    void handleARRAY_SET(const XenoCompactInstruction& instr);
+    void handleARRAY_LEN(const XenoCompactInstruction& instr);
+    void handleANALOG_READ(const XenoCompactInstruction& instr);
+    void handleANALOG_WRITE(const XenoCompactInstruction& instr);
+    void handleDIGITAL_READ(const XenoCompactInstruction& instr);
+    void handleDIGITAL_READ_PINS(const XenoCompactInstruction& instr);
+    void handleDIGITAL_WRITE_PINS(const XenoCompactInstruction& instr);
+    void handleANALOG_READ_PINS(const XenoCompactInstruction& instr);
+    void handleCONVERT_TO_FLOAT(const XenoCompactInstruction& instr);
+    void handleEVENT_BIND(const XenoCompactInstruction& instr);
+
+    // Без проверок границ стека: только при stack_verified
+    void fastPUSH(const XenoCompactInstruction& instr);
+    void fastPUSH_FLOAT(const XenoCompactInstruction& instr);
+    void fastPUSH_STRING(const XenoCompactInstruction& instr);
+    void fastPUSH_BOOL(const XenoCompactInstruction& instr);
+    void fastPOP(const XenoCompactInstruction& instr);
+    void fastSTORE(const XenoCompactInstruction& instr);
+    void fastLOAD(const XenoCompactInstruction& instr);
+    void fastSTORE_LOCAL(const XenoCompactInstruction& instr);
+    void fastLOAD_LOCAL(const XenoCompactInstruction& instr);
+    void fastJUMP_IF(const XenoCompactInstruction& instr);
 
     // Обработчики функций
-    void handleCALL(const XenoInstruction& instr);
-    void handleRETURN(const XenoInstruction& instr);  // добавлен
+    void handleCALL(const XenoCompactInstruction& instr);
+    void handleRETURN(const XenoCompactInstruction& instr);  // добавлен
+    void handleCALL_NATIVE(const XenoCompactInstruction& instr);
 
  protected:
-    explicit XenoVM(XenoSecurityConfig& config);
+    // arena - память программы, стека операндов, кадров и глобальных; должна пережить VM
+    explicit XenoVM(XenoSecurityConfig& config, XenoArena* arena = nullptr);
     ~XenoVM();
     void setMaxInstructions(uint32_t max_instr);
+    // attestation - итог прежней проверки этой же программы (XenoSecurity::attest), его хранит владелец;
+    // без него программа проверяется при каждой загрузке
     void loadProgram(const std::vector<XenoInstruction>& bytecode,
-                    const std::vector<String>& strings, bool less_output = true);
+                    const std::vector<String>& strings, bool less_output = true,
+                    XenoAttestation* program_attestation = nullptr);
+    void loadProgram(const XenoImageView& image_view, bool less_output = true,
+                     XenoAttestation* program_attestation = nullptr);
     void setFunctionTable(const std::map<String, FunctionInfo>& functions);
+    // Горячая замена: patch заменяет программу с адреса from (адреса уже абсолютные), strings и
+    // functions - полные таблицы после замены. Стек, глобальные, массивы и кадры активных вызовов
+    // сохраняются: прерванный вызов доработает по прежнему телу. from - конец программы (тела
+    // дописываются) или, если ни одна функция не выполняется, конец основного кода (тела заменяются)
+    bool patchFunctions(const std::vector<XenoInstruction>& patch, const std::vector<String>& strings,
+                        const std::map<String, FunctionInfo>& functions, uint32_t from);
+    // Таблица функций хоста для следующих loadProgram; должна жить дольше VM
+    void setNatives(const XenoNativeTable* table) { natives = table; }
     bool step();
+    void execute(uint32_t slice = 0);
     void run(bool less_output = true);
+    XenoRunStatus runFor(uint32_t budget);
+    bool canResume() const;
+    void setOutput(Print& target);
+    void setOutputConfig(const XenoOutputConfig& config);
+    size_t flushOutput(size_t max_lines = SIZE_MAX);
+    size_t getPendingOutput() const { return output_buffer.size(); }
+    uint32_t getDroppedOutput() const { return output_dropped; }
+    void setProfiling(bool enabled);
+    const XenoProfile* getProfile() const { return profile; }
+    bool setTracing(uint16_t depth);
+    const XenoTrace* getTrace() const { return trace; }
+    XenoMetrics getMetrics() const;
+    uint16_t getStackPeak() const;
+    // Срок DELAY или ближайшего таймера on timer (millis), что раньше
+    uint32_t getWakeTime() const;
+    uint32_t getDroppedEvents() const { return events_dropped.load(std::memory_order_relaxed); }
+    void provideInput(const String& input);
     void stop();
     bool isRunning() const;
     uint32_t getPC() const;
     uint32_t getSP() const;
     uint32_t getInstructionCount() const;
     uint32_t getIterationCount() const;
+    uint16_t getCallDepth() const { return call_depth; }
+    uint16_t getStringHeapCount() const { return stringCount() - string_pool_size; }
+    uint32_t getStringHeapBytes() const { return string_heap_bytes; }
+    uint32_t getArrayBytes() const { return array_bytes; }
     void dumpState();
     void disassemble();
 };
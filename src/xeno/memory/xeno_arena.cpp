@@ -0,0 +1,57 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "xeno_arena.h"
+
+void XenoArena::attach(void* buffer, size_t size) {
+    base = (buffer != nullptr && size != 0) ? static_cast<uint8_t*>(buffer) : nullptr;
+    capacity = base != nullptr ? size : 0;
+    used = 0;
+    peak = 0;
+    overflow_bytes = 0;
+}
+
+void* XenoArena::allocate(size_t bytes, size_t align) {
+    const uintptr_t start = reinterpret_cast<uintptr_t>(base) + used;
+    const size_t padding = (align - start % align) % align;
+    if (base != nullptr && bytes <= capacity - used && padding <= capacity - used - bytes) {
+        void* block = base + used + padding;
+        used += padding + bytes;
+        if (used > peak) peak = used;
+        return block;
+    }
+    overflow_bytes += bytes;
+    return ::operator new(bytes);
+}
+
+void XenoArena::deallocate(void* block, size_t bytes) {
+    if (block == nullptr) return;
+    if (!owns(block)) {
+        ::operator delete(block);
+        return;
+    }
+    if (static_cast<uint8_t*>(block) + bytes == base + used) {
+        used = static_cast<uint8_t*>(block) - base;
+    }
+}
+
+void XenoArena::rewind(size_t position) {
+    if (position < used) used = position;
+}
+
+void XenoArena::reset() {
+    used = 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_MEMORY_XENO_ARENA_H_
+#define SRC_XENO_MEMORY_XENO_ARENA_H_
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+// Снимок арены (XenoLanguage::getMemoryUsage), байты
+struct XenoMemoryUsage {
+    size_t capacity = 0;                // 0 - арена не задана, всё из кучи
+    size_t used = 0;
+    size_t peak = 0;                    // С последнего setMemoryArena
+    size_t overflow = 0;                // Выдано из кучи сверх буфера
+};
+
+// Линейная арена поверх буфера хоста: выделение - сдвиг указателя, освобождение - откат к метке
+// (XenoArenaScope) или reset() целиком. Блок, не поместившийся в буфер, берётся из кучи и
+// учитывается в getOverflowBytes(). Не потокобезопасна: одна арена - один XenoLanguage
+class XenoArena {
+ public:
+    // nullptr или 0 - арены нет, всё из кучи. Прежний буфер должен быть уже не нужен
+    void attach(void* buffer, size_t size);
+    bool active() const { return base != nullptr; }
+
+    void* allocate(size_t bytes, size_t align);
+    // Внутри буфера место возвращается, только если блок последний; вне буфера - в кучу
+    void deallocate(void* block, size_t bytes);
+    bool owns(const void* block) const {
+        return block >= base && block < base + capacity;
+    }
+
+    size_t mark() const { return used; }
+    void rewind(size_t position);
+    void reset();
+
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return used; }
+    size_t getPeak() const { return peak; }
+    size_t getOverflowBytes() const { return overflow_bytes; }
+    XenoMemoryUsage usage() const {
+        XenoMemoryUsage result;
+        result.capacity = capacity;
+        result.used = used;
+        result.peak = peak;
+        result.overflow = overflow_bytes;
+        return result;
+    }
+
+ private:
+    uint8_t* base = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t peak = 0;
+    size_t overflow_bytes = 0;          // Выдано из кучи, потому что буфер был заполнен
+};
+
+// Временные буферы области (выражение, компиляция) возвращаются в арену при выходе из неё.
+// Контейнеры с памятью арены должны быть объявлены после области и умереть раньше неё
+class XenoArenaScope {
+ public:
+    explicit XenoArenaScope(XenoArena* arena) : arena(arena), saved(arena != nullptr ? arena->mark() : 0) {}
+    ~XenoArenaScope() {
+        if (arena != nullptr) arena->rewind(saved);
+    }
+    XenoArenaScope(const XenoArenaScope&) = delete;
+    XenoArenaScope& operator=(const XenoArenaScope&) = delete;
+
+ private:
+    XenoArena* arena;
+    size_t saved;
+};
+
+// Аллокатор контейнеров STL: из арены, если она задана и подключена, иначе из кучи
+template <typename T>
+struct XenoArenaAllocator {
+    typedef T value_type;
+
+    XenoArena* arena;
+
+    XenoArenaAllocator(XenoArena* arena = nullptr) noexcept : arena(arena) {}  // NOLINT: неявное из XenoArena*
+    template <typename U>
+    XenoArenaAllocator(const XenoArenaAllocator<U>& other) noexcept : arena(other.arena) {}  // NOLINT
+
+    T* allocate(size_t count) {
+        if (arena != nullptr && arena->active()) {
+            return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+    void deallocate(T* block, size_t count) {
+        if (arena != nullptr && arena->active()) {
+            arena->deallocate(block, count * sizeof(T));
+        } else {
+            ::operator delete(block);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const XenoArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const XenoArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using XenoArenaVector = std::vector<T, XenoArenaAllocator<T>>;
+
+#endif  // SRC_XENO_MEMORY_XENO_ARENA_H_
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "xeno_string_index.h"
+
+uint32_t XenoStringIndex::hash(const char* str, size_t length) {
+    uint32_t value = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        value ^= static_cast<uint8_t>(str[i]);
+        value *= 16777619u;
+    }
+    return value;
+}
+
+void XenoStringIndex::insert(uint32_t key, uint16_t length, uint16_t index) {
+    reserve(count + 1);
+    place(Slot{key, length, index});
+}
+
+void XenoStringIndex::reserve(size_t entries) {
+    size_t capacity = slots.empty() ? 16 : slots.size();
+    while (entries * 4 > capacity * 3) capacity *= 2;
+    if (capacity == slots.size()) return;
+
+    std::vector<Slot> old(capacity, Slot{0, 0, NONE});
+    old.swap(slots);
+    count = 0;
+    for (const Slot& slot : old) {
+        if (slot.index != NONE) place(slot);
+    }
+}
+
+void XenoStringIndex::clear() {
+    slots.clear();
+    count = 0;
+}
+
+void XenoStringIndex::place(const Slot& entry) {
+    const size_t mask = slots.size() - 1;
+    size_t i = entry.hash & mask;
+    while (slots[i].index != NONE) i = (i + 1) & mask;
+    slots[i] = entry;
+    count++;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_MEMORY_XENO_STRING_INDEX_H_
+#define SRC_XENO_MEMORY_XENO_STRING_INDEX_H_
+
+#include <Arduino.h>
+#include <string.h>
+#include <vector>
+
+// Хеш-индекс интернированных строк: текст -> номер в таблице строк владельца.
+// Открытая адресация с линейным пробированием; в ячейке хранятся хеш и длина,
+// поэтому сравнение текста нужно только при их совпадении, а рост таблицы
+// и перенумерация обходятся без повторного хеширования.
+class XenoStringIndex {
+ public:
+    static const uint16_t NONE = 0xFFFF;       // Номер 65535 таблицы строк не выдают
+
+    static uint32_t hash(const char* str, size_t length);     // FNV-1a
+    static uint32_t hash(const String& str) { return hash(str.c_str(), str.length()); }
+
+    // text(index) - начало строки владельца с этим номером
+    template <typename Text>
+    uint16_t find(const char* str, uint16_t length, uint32_t key, Text text) const {
+        if (count == 0) return NONE;
+        const size_t mask = slots.size() - 1;
+        for (size_t i = key & mask;; i = (i + 1) & mask) {
+            const Slot& slot = slots[i];
+            if (slot.index == NONE) return NONE;
+            if (slot.hash == key && slot.length == length &&
+                memcmp(text(slot.index), str, length) == 0) {
+                return slot.index;
+            }
+        }
+    }
+
+    // Строки с таким текстом в индексе быть не должно (сначала find)
+    void insert(uint32_t key, uint16_t length, uint16_t index);
+
+    // Перенумерация после сборки или сдвига кучи: map(index) - новый номер или NONE, чтобы удалить
+    template <typename Map>
+    void remap(Map map) {
+        std::vector<Slot> old;
+        old.swap(slots);
+        const size_t entries = count;
+        count = 0;
+        reserve(entries);
+        for (const Slot& slot : old) {
+            if (slot.index == NONE) continue;
+            const uint16_t index = map(slot.index);
+            if (index != NONE) place(Slot{slot.hash, slot.length, index});
+        }
+    }
+
+    void reserve(size_t entries);
+    void clear();
+    size_t size() const { return count; }
+
+ private:
+    struct Slot {
+        uint32_t hash;
+        uint16_t length;
+        uint16_t index;
+    };
+
+    void place(const Slot& entry);
+
+    std::vector<Slot> slots;                   // Размер - степень двойки, заполнение не выше 3/4
+    size_t count = 0;
+};
+
+#endif  // SRC_XENO_MEMORY_XENO_STRING_INDEX_H_
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "xeno_native.h"
+#include "../main/xeno_vm.h"
+
+int32_t XenoNativeCall::getInt(uint8_t i) const {
+    const XenoValue& v = args[i];
+    switch (v.type) {
+        case TYPE_INT: return v.int_val;
+        case TYPE_FLOAT: return static_cast<int32_t>(v.float_val);
+        case TYPE_BOOL: return v.bool_val ? 1 : 0;
+        default: return 0;
+    }
+}
+
+float XenoNativeCall::getFloat(uint8_t i) const {
+    const XenoValue& v = args[i];
+    switch (v.type) {
+        case TYPE_INT: return static_cast<float>(v.int_val);
+        case TYPE_FLOAT: return v.float_val;
+        case TYPE_BOOL: return v.bool_val ? 1.0f : 0.0f;
+        default: return 0.0f;
+    }
+}
+
+const String& XenoNativeCall::getString(uint8_t i) const {
+    static const String empty;
+    if (args[i].type != TYPE_STRING) return empty;
+    return vm.stringAt(args[i].string_index);
+}
+
+// Аргументы ещё на стеке: сборка кучи внутри addString их не потеряет
+XenoValue XenoNativeCall::makeString(const String& text) {
+    return XenoValue::makeString(vm.addString(text));
+}
+
+bool XenoNativeCall::checkPin(uint8_t pin) const {
+    if (vm.security.isPinAllowed(pin)) return true;
+    Serial.print("ERROR: Pin not allowed: ");
+    Serial.println(pin);
+    return false;
+}
+
+void XenoNativeCall::fail(const char* message) {
+    Serial.print("ERROR: ");
+    Serial.println(message);
+    vm.running = false;
+}
+
+bool XenoNativeTable::add(const String& name, uint8_t arity, XenoNativeFunction function, XenoDataType result,
+                          void* user) {
+    bool valid_name = !name.isEmpty() && (isalpha(name[0]) || name[0] == '_');
+    for (size_t i = 1; valid_name && i < name.length(); ++i) {
+        valid_name = isalnum(name[i]) || name[i] == '_';
+    }
+    if (!valid_name || function == nullptr || arity > MAX_ARITY || result > TYPE_ANY) {
+        Serial.print("ERROR: Invalid native function '");
+        Serial.print(name);
+        Serial.println("'");
+        return false;
+    }
+    if (find(name) != NOT_FOUND) {
+        Serial.print("ERROR: Native function '");
+        Serial.print(name);
+        Serial.println("' already registered");
+        return false;
+    }
+    if (natives.size() >= MAX_NATIVES) {
+        Serial.println("ERROR: Too many native functions");
+        return false;
+    }
+    natives.push_back({name, arity, result, function, user});
+    return true;
+}
+
+int16_t XenoNativeTable::find(const String& name) const {
+    return find(name.c_str(), name.length());
+}
+
+int16_t XenoNativeTable::find(const char* name, size_t length) const {
+    for (size_t i = 0; i < natives.size(); ++i) {
+        if (natives[i].name.length() == length && memcmp(natives[i].name.c_str(), name, length) == 0) {
+            return static_cast<int16_t>(i);
+        }
+    }
+    return NOT_FOUND;
+}
+
+bool XenoNativeTable::binds(uint32_t call, const char* name, size_t length) const {
+    const uint16_t index = nativeCallIndex(call);
+    return index < natives.size() && natives[index].arity == nativeCallArity(call) &&
+           natives[index].name.length() == length && memcmp(natives[index].name.c_str(), name, length) == 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_NATIVE_XENO_NATIVE_H_
+#define SRC_XENO_NATIVE_XENO_NATIVE_H_
+
+#include <Arduino.h>
+#include <vector>
+#include "../xeno_common.h"
+
+class XenoVM;
+
+// Аргументы нативной функции: окно [sp - arity, sp) стека операндов VM, без копирования.
+// Аргументы лежат в порядке объявления: call[0] - первый
+class XenoNativeCall {
+ public:
+    uint8_t count() const { return arity; }
+    const XenoValue& operator[](uint8_t i) const { return args[i]; }
+
+    // Число как int/float (bool - 0/1); не число - 0
+    int32_t getInt(uint8_t i) const;
+    float getFloat(uint8_t i) const;
+    // Текст строкового аргумента (не строка - пустая). Ссылка действительна до makeString
+    const String& getString(uint8_t i) const;
+    // Новая строка в куче VM; вернуть её можно только как результат этого вызова
+    XenoValue makeString(const String& text);
+
+    // Те же права, что у встроенных команд: false и сообщение об ошибке, если пин запрещён
+    bool checkPin(uint8_t pin) const;
+    // Остановить скрипт с ошибкой; результат функции тогда не используется
+    void fail(const char* message);
+    void* getUser() const { return user; }
+
+ private:
+    XenoVM& vm;
+    const XenoValue* args;
+    uint8_t arity;
+    void* user;
+
+    XenoNativeCall(XenoVM& machine, const XenoValue* values, uint8_t count, void* user_data)
+        : vm(machine), args(values), arity(count), user(user_data) {}
+
+    friend class XenoVM;
+};
+
+typedef XenoValue (*XenoNativeFunction)(XenoNativeCall& call);
+
+struct XenoNative {
+    String name;
+    uint8_t arity;
+    XenoDataType result;                // Тип результата для проверки типов выражений; TYPE_ANY - любой
+    XenoNativeFunction function;
+    void* user;
+};
+
+// Зарегистрированные функции хоста. Компилятор разрешает вызов name(...) в номер функции
+// (OP_CALL_NATIVE), VM при загрузке сверяет номер, имя и арность каждого вызова с таблицей
+class XenoNativeTable {
+ public:
+    static const uint8_t MAX_ARITY = 16;
+    static const uint16_t MAX_NATIVES = 256;
+    static const int16_t NOT_FOUND = -1;
+
+    bool add(const String& name, uint8_t arity, XenoNativeFunction function, XenoDataType result, void* user);
+    int16_t find(const String& name) const;
+    int16_t find(const char* name, size_t length) const;
+    // Вызов OP_CALL_NATIVE (arg1 и имя из arg2) совпадает с функцией таблицы по номеру, имени и арности
+    bool binds(uint32_t call, const char* name, size_t length) const;
+    size_t size() const { return natives.size(); }
+    const XenoNative& operator[](size_t i) const { return natives[i]; }
+
+ private:
+    std::vector<XenoNative> natives;
+};
+
+#endif  // SRC_XENO_NATIVE_XENO_NATIVE_H_
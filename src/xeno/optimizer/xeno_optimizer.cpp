@@ -0,0 +1,384 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits>
+#include <vector>
+#include "xeno_optimizer.h"
+
+// ------------------------------------------------------------------
+// Вспомогательные функции для работы с константами
+// ------------------------------------------------------------------
+static inline bool isConstant(const XenoInstruction& instr) {
+    return instr.opcode == OP_PUSH || instr.opcode == OP_PUSH_FLOAT;
+}
+
+static XenoValue constantValue(const XenoInstruction& instr) {
+    if (instr.opcode == OP_PUSH_FLOAT) {
+        float f;
+        memcpy(&f, &instr.arg1, sizeof(float));
+        return XenoValue::makeFloat(f);
+    }
+    return XenoValue::makeInt(static_cast<int32_t>(instr.arg1));
+}
+
+static XenoInstruction makeConstant(const XenoValue& value) {
+    if (value.type == TYPE_FLOAT) {
+        uint32_t fbits;
+        memcpy(&fbits, &value.float_val, sizeof(float));
+        return XenoInstruction(OP_PUSH_FLOAT, fbits);
+    }
+    return XenoInstruction(OP_PUSH, static_cast<uint32_t>(value.int_val));
+}
+
+// Замена инструкции с сохранением строки исходника (для профилировщика)
+static inline void rewrite(XenoInstruction& slot, const XenoInstruction& with) {
+    const uint16_t line = slot.line;
+    slot = with;
+    slot.line = line;
+}
+
+static inline float toFloat(const XenoValue& v) {
+    return v.type == TYPE_FLOAT ? v.float_val : static_cast<float>(v.int_val);
+}
+
+static inline bool fitsInt32(int64_t v) {
+    return v >= std::numeric_limits<int32_t>::min() && v <= std::numeric_limits<int32_t>::max();
+}
+
+// Вычисляет операцию так же, как это сделала бы VM. Возвращает false, если
+// результат нельзя получить без VM (деление на ноль, переполнение и т.п.) -
+// тогда операция остаётся в коде и ошибка выводится во время выполнения.
+static bool foldBinary(uint8_t op, const XenoValue& a, const XenoValue& b, XenoValue& result) {
+    op = genericOpcode(op);
+    if (a.type == TYPE_FLOAT || b.type == TYPE_FLOAT) {
+        float x = toFloat(a);
+        float y = toFloat(b);
+        switch (op) {
+            case OP_ADD: result = XenoValue::makeFloat(x + y); return true;
+            case OP_SUB: result = XenoValue::makeFloat(x - y); return true;
+            case OP_MUL: result = XenoValue::makeFloat(x * y); return true;
+            case OP_DIV:
+                if (y == 0.0f) return false;
+                result = XenoValue::makeFloat(x / y);
+                return true;
+            case OP_MAX: result = XenoValue::makeFloat(x > y ? x : y); return true;
+            case OP_MIN: result = XenoValue::makeFloat(x < y ? x : y); return true;
+            default: return false;
+        }
+    }
+
+    int64_t x = a.int_val;
+    int64_t y = b.int_val;
+    int64_t r;
+    switch (op) {
+        case OP_ADD: r = x + y; break;
+        case OP_SUB: r = x - y; break;
+        case OP_MUL: r = x * y; break;
+        case OP_DIV:
+            if (y == 0) return false;
+            r = x / y;
+            break;
+        case OP_MOD:
+            if (y == 0) return false;
+            r = x % y;
+            break;
+        case OP_POW:
+            if (y < 0 || y > 31) return false;
+            r = 1;
+            for (int64_t i = 0; i < y; ++i) {
+                r *= x;
+                if (!fitsInt32(r)) return false;
+            }
+            break;
+        case OP_MAX: r = x > y ? x : y; break;
+        case OP_MIN: r = x < y ? x : y; break;
+        // Сравнения кладут 0 для истины и 1 для лжи (как handleComparisonOp)
+        case OP_EQ:  r = (x == y) ? 0 : 1; break;
+        case OP_NEQ: r = (x != y) ? 0 : 1; break;
+        case OP_LT:  r = (x < y) ? 0 : 1; break;
+        case OP_GT:  r = (x > y) ? 0 : 1; break;
+        case OP_LTE: r = (x <= y) ? 0 : 1; break;
+        case OP_GTE: r = (x >= y) ? 0 : 1; break;
+        default: return false;
+    }
+    if (!fitsInt32(r)) return false;
+    result = XenoValue::makeInt(static_cast<int32_t>(r));
+    return true;
+}
+
+static bool foldUnary(uint8_t op, const XenoValue& a, XenoValue& result) {
+    bool is_int = (a.type == TYPE_INT);
+    switch (op) {
+        case OP_NEG:
+            if (is_int && a.int_val == std::numeric_limits<int32_t>::min()) return false;
+            result = is_int ? XenoValue::makeInt(-a.int_val) : XenoValue::makeFloat(-a.float_val);
+            return true;
+        case OP_ABS:
+            if (is_int && a.int_val == std::numeric_limits<int32_t>::min()) return false;
+            result = is_int ? XenoValue::makeInt(abs(a.int_val)) : XenoValue::makeFloat(fabs(a.float_val));
+            return true;
+        case OP_CONVERT_TO_FLOAT:
+            result = XenoValue::makeFloat(toFloat(a));
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Истинность константы для JUMP_IF (как в handleJUMP_IF)
+static bool constantCondition(const XenoInstruction& instr) {
+    if (instr.opcode == OP_PUSH_BOOL) return instr.arg1 != 0;
+    XenoValue value = constantValue(instr);
+    return value.type == TYPE_FLOAT ? value.float_val != 0.0f : value.int_val != 0;
+}
+
+static inline bool isTerminator(uint8_t opcode) {
+    return opcode == OP_HALT || opcode == OP_JUMP || opcode == OP_RETURN;
+}
+
+// HALT, которым компилятор завершает основной код (перед первой функцией); code.size() - его нет
+static size_t mainHalt(const std::vector<XenoInstruction>& code, const std::map<String, FunctionInfo>& functions) {
+    size_t main_end = code.size();
+    for (const auto& entry : functions) {
+        const size_t address = static_cast<size_t>(entry.second.address);
+        if (address < main_end) main_end = address;
+    }
+    return main_end > 0 && code[main_end - 1].opcode == OP_HALT ? main_end - 1 : code.size();
+}
+
+// ------------------------------------------------------------------
+// Реализация оптимизатора
+// ------------------------------------------------------------------
+
+void XenoOptimizer::optimize(std::vector<XenoInstruction>& code,
+                             std::map<String, FunctionInfo>& functions, uint8_t level) {
+    if (level == 0 || code.empty()) return;
+
+    std::vector<bool> targets;
+    for (uint8_t pass = 0; pass < MAX_PASSES; ++pass) {
+        markTargets(code, functions, targets);
+        bool changed = foldConstants(code, targets);
+        changed |= foldNegatedComparisons(code, targets);
+        if (level >= 2) {
+            changed |= fuseIncrements(code, targets);
+        }
+        changed |= threadJumps(code);
+
+        // Переходы могли измениться - пересчитываем цели перед удалением кода
+        markTargets(code, functions, targets);
+        changed |= removeDeadCode(code, targets, mainHalt(code, functions));
+        compact(code, functions);
+
+        if (!changed) break;
+    }
+}
+
+// Отмечает адреса, на которые можно попасть не по порядку: цели переходов и входы функций.
+// Шаблоны не склеиваются через такие адреса, а мёртвый код заканчивается на них.
+void XenoOptimizer::markTargets(const std::vector<XenoInstruction>& code,
+                                const std::map<String, FunctionInfo>& functions,
+                                std::vector<bool>& targets) {
+    targets.assign(code.size() + 1, false);
+    for (const XenoInstruction& instr : code) {
+        if (isJumpOpcode(instr.opcode) && getJumpTarget(instr) <= code.size()) {
+            targets[getJumpTarget(instr)] = true;
+        }
+    }
+    for (const auto& entry : functions) {
+        if (static_cast<size_t>(entry.second.address) <= code.size()) {
+            targets[entry.second.address] = true;
+        }
+    }
+}
+
+// Удаляет OP_NOP и пересчитывает адреса переходов и функций.
+// Переход на удалённую инструкцию уходит на следующую за ней.
+void XenoOptimizer::compact(std::vector<XenoInstruction>& code, std::map<String, FunctionInfo>& functions) {
+    std::vector<uint32_t> new_index(code.size() + 1);
+    uint32_t next = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        new_index[i] = next;
+        if (code[i].opcode != OP_NOP) next++;
+    }
+    new_index[code.size()] = next;
+
+    if (next == code.size()) return;
+
+    size_t out = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i].opcode == OP_NOP) continue;
+        XenoInstruction instr = code[i];
+        if (isJumpOpcode(instr.opcode) && getJumpTarget(instr) <= code.size()) {
+            setJumpTarget(instr, new_index[getJumpTarget(instr)]);
+        }
+        code[out++] = instr;
+    }
+    for (auto& entry : functions) {
+        if (static_cast<size_t>(entry.second.address) <= code.size()) {
+            entry.second.address = new_index[entry.second.address];
+        }
+    }
+    code.resize(out);
+}
+
+// PUSH a, PUSH b, OP -> PUSH (a OP b); PUSH a, NEG/ABS/CONVERT_TO_FLOAT -> PUSH f(a);
+// PUSH c, JUMP_IF -> JUMP или ничего
+bool XenoOptimizer::foldConstants(std::vector<XenoInstruction>& code, const std::vector<bool>& targets) {
+    bool changed = false;
+    size_t n = code.size();
+    for (size_t i = 0; i + 1 < n; ++i) {
+        bool is_const = isConstant(code[i]);
+        if ((!is_const && code[i].opcode != OP_PUSH_BOOL) || targets[i + 1]) continue;
+
+        if (code[i + 1].opcode == OP_JUMP_IF) {
+            bool condition = constantCondition(code[i]);
+            rewrite(code[i], condition ? XenoInstruction(OP_JUMP, code[i + 1].arg1) : XenoInstruction(OP_NOP));
+            code[i + 1] = XenoInstruction(OP_NOP);
+            changed = true;
+            i++;
+            continue;
+        }
+        if (!is_const) continue;
+
+        XenoValue result;
+        if (foldUnary(code[i + 1].opcode, constantValue(code[i]), result)) {
+            rewrite(code[i], makeConstant(result));
+            code[i + 1] = XenoInstruction(OP_NOP);
+            changed = true;
+            i++;
+            continue;
+        }
+
+        if (i + 2 < n && isConstant(code[i + 1]) && !targets[i + 2] &&
+            foldBinary(code[i + 2].opcode, constantValue(code[i]), constantValue(code[i + 1]), result)) {
+            rewrite(code[i], makeConstant(result));
+            code[i + 1] = XenoInstruction(OP_NOP);
+            code[i + 2] = XenoInstruction(OP_NOP);
+            changed = true;
+            i += 2;
+        }
+    }
+    return changed;
+}
+
+// EQ/NEQ, NOT, JUMP_IF -> NEQ/EQ, JUMP_IF. Для LT/GT и т.п. так нельзя:
+// при разных типах операндов оба сравнения дают ложь.
+bool XenoOptimizer::foldNegatedComparisons(std::vector<XenoInstruction>& code, const std::vector<bool>& targets) {
+    bool changed = false;
+    for (size_t i = 0; i + 2 < code.size(); ++i) {
+        uint8_t op = code[i].opcode;
+        uint8_t generic = genericOpcode(op);
+        if ((generic != OP_EQ && generic != OP_NEQ) || code[i + 1].opcode != OP_NOT ||
+            code[i + 2].opcode != OP_JUMP_IF || targets[i + 1] || targets[i + 2]) {
+            continue;
+        }
+        // EQ и NEQ соседние и в типизированных вариантах
+        code[i].opcode = (generic == OP_EQ) ? op + 1 : op - 1;
+        code[i + 1] = XenoInstruction(OP_NOP);
+        changed = true;
+        i++;
+    }
+    return changed;
+}
+
+// Переход на JUMP сразу ведёт к его цели; JUMP на HALT/RETURN заменяется ими;
+// переход на следующую инструкцию убирается (JUMP_IF -> POP условия)
+bool XenoOptimizer::threadJumps(std::vector<XenoInstruction>& code) {
+    bool changed = false;
+    size_t n = code.size();
+    for (size_t i = 0; i < n; ++i) {
+        if (!isJumpOpcode(code[i].opcode)) continue;
+
+        uint32_t target = getJumpTarget(code[i]);
+        size_t hops = 0;
+        while (target < n && code[target].opcode == OP_JUMP && code[target].arg1 != target && hops++ < n) {
+            target = code[target].arg1;
+        }
+        if (target != getJumpTarget(code[i])) {
+            setJumpTarget(code[i], target);
+            changed = true;
+        }
+
+        // Суперинструкции циклов только перенаправляются: у них есть побочные эффекты
+        if (target >= n || isSlotCompareJump(code[i].opcode)) continue;
+        if (code[i].opcode == OP_JUMP &&
+            (code[target].opcode == OP_HALT || code[target].opcode == OP_RETURN)) {
+            rewrite(code[i], XenoInstruction(code[target].opcode));
+            changed = true;
+        } else if (target == i + 1) {
+            rewrite(code[i], XenoInstruction(code[i].opcode == OP_JUMP ? OP_NOP : OP_POP));
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Код после HALT/JUMP/RETURN недостижим до ближайшей цели перехода или входа функции.
+// Завершающий HALT основного кода остаётся, даже если недостижим (цикл без выхода):
+// проверка при загрузке требует HALT в программе
+bool XenoOptimizer::removeDeadCode(std::vector<XenoInstruction>& code, const std::vector<bool>& targets,
+                                   size_t main_halt) {
+    bool changed = false;
+    size_t n = code.size();
+    for (size_t i = 0; i < n; ++i) {
+        if (!isTerminator(code[i].opcode)) continue;
+        size_t j = i + 1;
+        while (j < n && !targets[j]) {
+            if (code[j].opcode != OP_NOP && j != main_halt) {
+                code[j] = XenoInstruction(OP_NOP);
+                changed = true;
+            }
+            j++;
+        }
+        i = j - 1;
+    }
+    return changed;
+}
+
+// LOAD x, PUSH c, ADD, STORE x -> INC x c (для глобальных и локальных переменных)
+bool XenoOptimizer::fuseIncrements(std::vector<XenoInstruction>& code, const std::vector<bool>& targets) {
+    bool changed = false;
+    for (size_t i = 0; i + 3 < code.size(); ++i) {
+        const XenoInstruction& load = code[i];
+        const XenoInstruction& store = code[i + 3];
+        uint8_t fused;
+        if (load.opcode == OP_LOAD && store.opcode == OP_STORE) {
+            fused = OP_INC_GLOBAL;
+        } else if (load.opcode == OP_LOAD_LOCAL && store.opcode == OP_STORE_LOCAL) {
+            fused = OP_INC_LOCAL;
+        } else {
+            continue;
+        }
+        if (load.arg1 != store.arg1 || load.arg1 > 0xFFFF ||
+            code[i + 1].opcode != OP_PUSH || genericOpcode(code[i + 2].opcode) != OP_ADD ||
+            targets[i + 1] || targets[i + 2] || targets[i + 3]) {
+            continue;
+        }
+        int32_t step = static_cast<int32_t>(code[i + 1].arg1);
+        if (step < std::numeric_limits<int16_t>::min() || step > std::numeric_limits<int16_t>::max()) {
+            continue;
+        }
+
+        uint32_t operand = load.arg1 | (static_cast<uint32_t>(load.arg2) << 16);
+        rewrite(code[i], XenoInstruction(fused, operand, static_cast<uint16_t>(static_cast<int16_t>(step))));
+        code[i + 1] = XenoInstruction(OP_NOP);
+        code[i + 2] = XenoInstruction(OP_NOP);
+        code[i + 3] = XenoInstruction(OP_NOP);
+        changed = true;
+        i += 3;
+    }
+    return changed;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_OPTIMIZER_XENO_OPTIMIZER_H_
+#define SRC_XENO_OPTIMIZER_XENO_OPTIMIZER_H_
+
+#include <vector>
+#include <map>
+#include "../xeno_common.h"
+
+// Оптимизатор готового байткода (после compile(), до getBytecode()).
+// Уровни: 0 - выключен, 1 - свёртка констант, удаление мёртвого кода,
+// склейка переходов; 2 - дополнительно суперинструкции OP_INC_*.
+class XenoOptimizer {
+ public:
+    static const uint8_t MAX_LEVEL = 2;
+
+ protected:
+    friend class XenoCompiler;
+    static void optimize(std::vector<XenoInstruction>& code,
+                         std::map<String, FunctionInfo>& functions, uint8_t level);
+
+ private:
+    static const uint8_t MAX_PASSES = 8;
+
+    static void markTargets(const std::vector<XenoInstruction>& code,
+                            const std::map<String, FunctionInfo>& functions,
+                            std::vector<bool>& targets);
+    static void compact(std::vector<XenoInstruction>& code, std::map<String, FunctionInfo>& functions);
+
+    static bool foldConstants(std::vector<XenoInstruction>& code, const std::vector<bool>& targets);
+    static bool foldNegatedComparisons(std::vector<XenoInstruction>& code, const std::vector<bool>& targets);
+    static bool threadJumps(std::vector<XenoInstruction>& code);
+    static bool removeDeadCode(std::vector<XenoInstruction>& code, const std::vector<bool>& targets,
+                               size_t main_halt);
+    static bool fuseIncrements(std::vector<XenoInstruction>& code, const std::vector<bool>& targets);
+};
+
+#endif  // SRC_XENO_OPTIMIZER_XENO_OPTIMIZER_H_
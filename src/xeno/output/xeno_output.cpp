@@ -0,0 +1,95 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "xeno_output.h"
+
+void XenoOutputBuffer::allocate(uint16_t record_count, uint16_t text_capacity) {
+    records.assign(record_count, XenoValue());
+    text.assign(text_capacity, 0);
+    head = count = 0;
+    text_head = text_count = 0;
+}
+
+void XenoOutputBuffer::release() {
+    std::vector<XenoValue>().swap(records);
+    std::vector<uint8_t>().swap(text);
+    head = count = 0;
+    text_head = text_count = 0;
+}
+
+void XenoOutputBuffer::push(const XenoValue& record) {
+    records[(head + count) % records.size()] = record;
+    ++count;
+}
+
+void XenoOutputBuffer::pushText(const char* data, size_t length) {
+    XenoValue record;
+    record.type = TYPE_ANY;
+    record.int_val = length;
+    push(record);
+    if (length == 0) return;
+
+    size_t tail = (text_head + text_count) % text.size();
+    for (size_t i = 0; i < length; ++i) {
+        text[tail] = data[i];
+        if (++tail == text.size()) tail = 0;
+    }
+    text_count += length;
+}
+
+bool XenoOutputBuffer::pop(XenoValue& record) {
+    if (count == 0) return false;
+    record = records[head];
+    head = (head + 1) % records.size();
+    --count;
+    return true;
+}
+
+void XenoOutputBuffer::popText(Print& target, size_t length) {
+    // Текст может переходить через конец кольца: не больше двух кусков
+    while (length > 0) {
+        size_t part = text.size() - text_head;
+        if (part > length) part = length;
+        target.write(&text[text_head], part);
+        text_head = (text_head + part) % text.size();
+        text_count -= part;
+        length -= part;
+    }
+}
+
+size_t XenoChunkPrint::write(uint8_t c) {
+    if (used == sizeof(chunk)) flush();
+    chunk[used++] = c;
+    return 1;
+}
+
+size_t XenoChunkPrint::write(const uint8_t* buffer, size_t size) {
+    if (size >= sizeof(chunk)) {
+        flush();
+        return target.write(buffer, size);
+    }
+    if (used + size > sizeof(chunk)) flush();
+    memcpy(chunk + used, buffer, size);
+    used += size;
+    return size;
+}
+
+void XenoChunkPrint::flush() {
+    if (used == 0) return;
+    target.write(chunk, used);
+    used = 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_XENO_OUTPUT_XENO_OUTPUT_H_
+#define SRC_XENO_OUTPUT_XENO_OUTPUT_H_
+
+#include <Arduino.h>
+#include <vector>
+#include "../xeno_common.h"
+
+// Куда VM отдаёт вывод print
+enum XenoOutputMode : uint8_t {
+    XENO_OUTPUT_DIRECT = 0,         // Каждый print сразу форматируется в Print (по умолчанию)
+    XENO_OUTPUT_BUFFERED = 1,       // Значения копятся в кольце и форматируются только в flushOutput
+    XENO_OUTPUT_SILENT = 2          // print ничего не форматирует и не выводит (бенчмарки)
+};
+
+// Что делать, когда кольцо заполнено
+enum XenoOutputOverflow : uint8_t {
+    XENO_OUTPUT_FLUSH_WHEN_FULL = 0,    // Выгрузить кольцо целиком и продолжить
+    XENO_OUTPUT_DROP_WHEN_FULL = 1      // Отбросить новую строку (учитывается в getDroppedOutput)
+};
+
+// Настройки вывода; XenoLanguage хранит их и передаёт каждой новой VM
+struct XenoOutputConfig {
+    XenoOutputMode mode = XENO_OUTPUT_DIRECT;
+    XenoOutputOverflow overflow = XENO_OUTPUT_FLUSH_WHEN_FULL;
+    uint16_t records = 64;              // Строк в кольце
+    uint16_t text_bytes = 512;          // Байт под текст строк кучи
+    uint16_t max_lines_per_second = 0;  // Лишние строки отбрасываются; 0 - без ограничения
+
+    static const uint16_t MIN_RECORDS = 4;
+    static const uint16_t MAX_RECORDS = 4096;
+    static const uint16_t MAX_TEXT_BYTES = 16384;
+};
+
+// Кольцо отложенного вывода: одна запись - одна строка print. Запись - само значение без
+// форматирования; строка пула хранится индексом (пул неизменяем, пока программа загружена),
+// строка кучи копируется в кольцо текста, и запись TYPE_ANY несёт её длину в int_val.
+// Не потокобезопасно: VM и flushOutput работают в одной задаче (между задачами - XenoOutputQueue).
+class XenoOutputBuffer {
+ public:
+    void allocate(uint16_t record_count, uint16_t text_capacity);
+    void release();
+
+    bool hasRoom(size_t text_length) const {
+        return count < records.size() && text_length <= text.size() - text_count;
+    }
+    void push(const XenoValue& record);
+    void pushText(const char* data, size_t length);
+    bool pop(XenoValue& record);
+    // Текст только что снятой записи TYPE_ANY
+    void popText(Print& target, size_t length);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+ private:
+    std::vector<XenoValue> records;
+    size_t head = 0;                        // Самая старая запись
+    size_t count = 0;
+    std::vector<uint8_t> text;
+    size_t text_head = 0;
+    size_t text_count = 0;
+};
+
+// Собирает мелкие записи в блоки: цель получает крупные write вместо посимвольных
+class XenoChunkPrint : public Print {
+ public:
+    explicit XenoChunkPrint(Print& target) : target(target) {}
+    ~XenoChunkPrint() { flush(); }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    void flush() override;
+
+ private:
+    Print& target;
+    uint8_t chunk[128];
+    size_t used = 0;
+};
+
+// Вывод print в функцию пользователя
+typedef void (*XenoOutputCallback)(const uint8_t* data, size_t length, void* user);
+
+class XenoCallbackPrint : public Print {
+ public:
+    void setCallback(XenoOutputCallback new_callback, void* new_user) {
+        callback = new_callback;
+        user = new_user;
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (callback != nullptr) callback(buffer, size, user);
+        return size;
+    }
+    using Print::write;
+
+ private:
+    XenoOutputCallback callback = nullptr;
+    void* user = nullptr;
+};
+
+#endif  // SRC_XENO_OUTPUT_XENO_OUTPUT_H_
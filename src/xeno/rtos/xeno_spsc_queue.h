@@ -0,0 +1,121 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RTOS_XENO_SPSC_QUEUE_H_
+#define SRC_XENO_RTOS_XENO_SPSC_QUEUE_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include <utility>
+
+// Кольцевая очередь без блокировок: один производитель и один потребитель,
+// каждый индекс пишет только своя сторона. N - степень двойки.
+template <typename T, size_t N>
+class XenoSpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "XenoSpscQueue size must be a power of two");
+
+ public:
+    // Производитель
+    bool push(T value) {
+        const size_t head = write_index.load(std::memory_order_relaxed);
+        if (head - read_index.load(std::memory_order_acquire) >= N) return false;
+        slots[head & (N - 1)] = std::move(value);
+        write_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Сколько элементов из data поместилось
+    size_t write(const T* data, size_t count) {
+        const size_t head = write_index.load(std::memory_order_relaxed);
+        const size_t space = N - (head - read_index.load(std::memory_order_acquire));
+        if (count > space) count = space;
+        for (size_t i = 0; i < count; ++i) {
+            slots[(head + i) & (N - 1)] = data[i];
+        }
+        write_index.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // Потребитель
+    bool pop(T& out) {
+        const size_t tail = read_index.load(std::memory_order_relaxed);
+        if (tail == write_index.load(std::memory_order_acquire)) return false;
+        out = std::move(slots[tail & (N - 1)]);
+        read_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t read(T* data, size_t count) {
+        const size_t tail = read_index.load(std::memory_order_relaxed);
+        const size_t available = write_index.load(std::memory_order_acquire) - tail;
+        if (count > available) count = available;
+        for (size_t i = 0; i < count; ++i) {
+            data[i] = std::move(slots[(tail + i) & (N - 1)]);
+        }
+        read_index.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // С любой стороны: значение может устареть сразу после чтения
+    size_t size() const {
+        return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N; }
+
+ private:
+    T slots[N];
+    std::atomic<size_t> write_index{0};
+    std::atomic<size_t> read_index{0};
+};
+
+// Вывод print через очередь байтов: VM пишет из своей задачи, хост забирает drain().
+// При переполнении байты отбрасываются, VM не ждёт потребителя.
+template <size_t N>
+class XenoOutputQueue : public Print {
+ public:
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        const size_t written = bytes.write(buffer, size);
+        dropped.fetch_add(size - written, std::memory_order_relaxed);
+        return written;
+    }
+    using Print::write;
+
+    // Потребитель: переносит до max_bytes накопленного вывода в target
+    size_t drain(Print& target, size_t max_bytes = N) {
+        uint8_t chunk[64];
+        size_t total = 0;
+        while (total < max_bytes) {
+            size_t want = max_bytes - total;
+            if (want > sizeof(chunk)) want = sizeof(chunk);
+            const size_t count = bytes.read(chunk, want);
+            if (count == 0) break;
+            target.write(chunk, count);
+            total += count;
+        }
+        return total;
+    }
+
+    size_t pending() const { return bytes.size(); }
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+ private:
+    XenoSpscQueue<uint8_t, N> bytes;
+    std::atomic<uint32_t> dropped{0};
+};
+
+#endif  // SRC_XENO_RTOS_XENO_SPSC_QUEUE_H_
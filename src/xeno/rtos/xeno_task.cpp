@@ -0,0 +1,96 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "xeno_task.h"
+
+#if XENO_HAS_TASKS
+
+XenoTask::XenoTask(XenoScheduler& scheduler) : scheduler(scheduler) {}
+
+XenoTask::~XenoTask() {
+    stop();
+}
+
+bool XenoTask::start(uint8_t core, uint32_t stack_size, UBaseType_t priority) {
+    if (isRunning()) {
+        Serial.println("ERROR: Xeno task already running");
+        return false;
+    }
+    if (core >= portNUM_PROCESSORS) {
+        Serial.print("ERROR: Invalid core for Xeno task: ");
+        Serial.println(core);
+        return false;
+    }
+
+    // Вывод переключается до старта: дальше планировщик принадлежит задаче
+    scheduler.setOutput(output);
+    stop_requested.store(false, std::memory_order_relaxed);
+    running.store(true, std::memory_order_release);
+    if (xTaskCreatePinnedToCore(taskEntry, "xeno", stack_size, this, priority, &handle, core) != pdPASS) {
+        running.store(false, std::memory_order_release);
+        handle = nullptr;
+        Serial.println("ERROR: Cannot create Xeno task");
+        return false;
+    }
+    return true;
+}
+
+void XenoTask::stop() {
+    if (!isRunning()) return;
+    stop_requested.store(true, std::memory_order_release);
+    while (isRunning()) {
+        vTaskDelay(1);
+    }
+    handle = nullptr;
+}
+
+bool XenoTask::send(int16_t script, const String& text) {
+    Message message;
+    message.script = script;
+    message.text = text;
+    return inbox.push(std::move(message));
+}
+
+size_t XenoTask::flushOutput(Print& target, size_t max_bytes) {
+    return output.drain(target, max_bytes);
+}
+
+void XenoTask::taskEntry(void* arg) {
+    XenoTask* task = static_cast<XenoTask*>(arg);
+    task->loop();
+    task->running.store(false, std::memory_order_release);
+    vTaskDelete(nullptr);
+}
+
+// Скрипты без общих глобальных не требуют синхронизации: у каждой VM свои стек и переменные,
+// а образы программ только читаются
+void XenoTask::loop() {
+    Message message;
+    uint32_t last_rest = millis();
+    while (!stop_requested.load(std::memory_order_acquire)) {
+        while (inbox.pop(message)) {
+            scheduler.provideInput(message.script, message.text);
+        }
+        if (!scheduler.tick()) break;
+        // Без пауз задача отнимет ядро у IDLE, и сработает сторожевой таймер
+        if (scheduler.isIdle() || millis() - last_rest >= MAX_BUSY_MS) {
+            vTaskDelay(1);
+            last_rest = millis();
+        }
+    }
+}
+
+#endif  // XENO_HAS_TASKS
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RTOS_XENO_TASK_H_
+#define SRC_XENO_RTOS_XENO_TASK_H_
+
+#include <Arduino.h>
+#include "xeno_spsc_queue.h"
+#include "../scheduler/xeno_scheduler.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define XENO_HAS_TASKS 1
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#define XENO_HAS_TASKS 0
+#endif
+
+#if XENO_HAS_TASKS
+
+// Планировщик скриптов в своей задаче FreeRTOS, закреплённой за ядром.
+// С хостом задача общается только через две очереди SPSC без блокировок:
+// входящие строки попадают в INPUT скриптов, вывод print копится в очереди байтов.
+// Пока задача запущена, планировщик нельзя трогать из других задач.
+class XenoTask {
+ public:
+    static const size_t OUTPUT_QUEUE_SIZE = 2048;
+    static const size_t INBOX_SIZE = 8;
+    static const uint32_t MAX_BUSY_MS = 50;     // Дольше без паузы задача не работает
+
+    explicit XenoTask(XenoScheduler& scheduler);
+    ~XenoTask();
+
+    // core 0 - ядро WiFi/протоколов, loop() Arduino работает на ядре 1
+    bool start(uint8_t core = 0, uint32_t stack_size = 8192, UBaseType_t priority = 1);
+    void stop();                                // Ждёт конца текущего кванта
+    bool isRunning() const { return running.load(std::memory_order_acquire); }
+
+    // Хост -> скрипт: строка для ближайшего INPUT; false - очередь полна
+    bool send(int16_t script, const String& text);
+    // Скрипт -> хост: переносит накопленный вывод print, вызывать из loop()
+    size_t flushOutput(Print& target = Serial, size_t max_bytes = OUTPUT_QUEUE_SIZE);
+    uint32_t getDroppedOutput() const { return output.getDropped(); }
+
+ private:
+    struct Message {
+        int16_t script = XenoScheduler::NO_SCRIPT;
+        String text;
+    };
+
+    XenoScheduler& scheduler;
+    XenoOutputQueue<OUTPUT_QUEUE_SIZE> output;
+    XenoSpscQueue<Message, INBOX_SIZE> inbox;
+    TaskHandle_t handle = nullptr;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stop_requested{false};
+
+    static void taskEntry(void* arg);
+    void loop();
+
+    XenoTask(const XenoTask&) = delete;
+    XenoTask& operator=(const XenoTask&) = delete;
+};
+
+#endif  // XENO_HAS_TASKS
+
+#endif  // SRC_XENO_RTOS_XENO_TASK_H_
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "xeno_scheduler.h"
+#include "../../XenoLanguage.h"
+#include "../security/xeno_security.h"
+
+XenoScheduler::XenoScheduler(Policy policy) : policy(policy) {}
+
+XenoScheduler::~XenoScheduler() {
+    for (Script& script : scripts) {
+        release(script);
+    }
+    for (Program* program : programs) {
+        delete program;
+    }
+}
+
+void XenoScheduler::useSecurityConfig(const XenoLanguage& xeno) {
+    security_config = xeno.security_config;
+}
+
+void XenoScheduler::useNatives(const XenoLanguage& xeno) {
+    natives = xeno.natives;
+}
+
+int16_t XenoScheduler::addProgram(const XenoLanguage& xeno) {
+    Program* program = new Program();
+    program->attestation = xeno.attestation;    // Те же инструкции: прежняя проверка остаётся в силе
+    if (xeno.image_in_place) {
+        program->view = xeno.image_view;
+        return addProgram(program);
+    }
+
+    if (xeno.compiler->hasErrors() || xeno.compiler->getBytecode().empty()) {
+        Serial.println("ERROR: No compiled program to schedule");
+        delete program;
+        return NO_SCRIPT;
+    }
+    XenoImage::encode(xeno.compiler->getBytecode(), xeno.compiler->getStringTable(),
+                      xeno.compiler->getFunctions(), program->bytes);
+    if (!XenoImage::view(program->bytes.data(), program->bytes.size(), program->view)) {
+        delete program;
+        return NO_SCRIPT;
+    }
+    return addProgram(program);
+}
+
+int16_t XenoScheduler::addProgram(const uint8_t* image, size_t size) {
+    Program* program = new Program();
+    if (!XenoImage::view(image, size, program->view)) {
+        delete program;
+        return NO_SCRIPT;
+    }
+
+    XenoSecurity security(security_config);
+    if (!security.attest(program->view.code, program->view.code_count, program->view.string_count,
+                         program->attestation)) {
+        Serial.println("SECURITY: Bytecode image verification failed - refusing to load");
+        delete program;
+        return NO_SCRIPT;
+    }
+    return addProgram(program);
+}
+
+int16_t XenoScheduler::addProgram(Program* program) {
+    programs.push_back(program);
+    return static_cast<int16_t>(programs.size() - 1);
+}
+
+int16_t XenoScheduler::spawn(uint16_t program, uint8_t priority, uint32_t slice) {
+    if (program >= programs.size()) {
+        Serial.println("ERROR: Invalid program index in spawn");
+        return NO_SCRIPT;
+    }
+
+    size_t index = 0;
+    while (index < scripts.size() && scripts[index].used) {
+        ++index;
+    }
+    if (index == scripts.size()) {
+        if (scripts.size() >= static_cast<size_t>(INT16_MAX)) return NO_SCRIPT;
+        scripts.emplace_back();
+    }
+
+    Script& script = scripts[index];
+    script = Script();
+    script.used = true;
+    script.program = program;
+    script.priority = priority;
+    script.slice = slice != 0 ? slice : DEFAULT_SLICE;
+
+    const XenoImageView& view = programs[program]->view;
+    script.vm = new XenoVM(security_config);
+    script.vm->setOutput(*output);
+    script.vm->setNatives(&natives);
+    script.vm->loadProgram(view, true, &programs[program]->attestation);
+    script.vm->setFunctionTable(view.functions);
+    if (!script.vm->isRunning()) {
+        release(script);
+        script.used = false;
+        return NO_SCRIPT;
+    }
+    script.status = XENO_YIELDED;
+    return static_cast<int16_t>(index);
+}
+
+void XenoScheduler::kill(int16_t script) {
+    if (find(script) == nullptr) return;
+    release(scripts[script]);
+    scripts[script].used = false;
+}
+
+void XenoScheduler::release(Script& script) {
+    if (script.vm != nullptr) {
+        script.instructions = script.vm->getInstructionCount();
+        delete script.vm;
+        script.vm = nullptr;
+    }
+    script.status = XENO_HALTED;
+}
+
+const XenoScheduler::Script* XenoScheduler::find(int16_t script) const {
+    if (script < 0 || static_cast<size_t>(script) >= scripts.size() || !scripts[script].used) {
+        return nullptr;
+    }
+    return &scripts[script];
+}
+
+// Обход начинается со следующего за последним получившим квант: при равных
+// приоритетах скрипты чередуются, а спящие и ждущие ввода пропускаются
+int16_t XenoScheduler::pickNext() const {
+    const size_t count = scripts.size();
+    if (count == 0) return NO_SCRIPT;
+    int16_t best = NO_SCRIPT;
+    for (size_t offset = 1; offset <= count; ++offset) {
+        const size_t index = (cursor + offset) % count;
+        const Script& script = scripts[index];
+        if (script.vm == nullptr || !script.vm->canResume()) continue;
+        if (policy == ROUND_ROBIN) return static_cast<int16_t>(index);
+        if (best == NO_SCRIPT || script.priority > scripts[best].priority) {
+            best = static_cast<int16_t>(index);
+        }
+    }
+    return best;
+}
+
+void XenoScheduler::runSlice(Script& script) {
+    const uint32_t started = micros();
+    script.status = script.vm->runFor(script.slice);
+    script.cpu_us += micros() - started;
+    script.instructions = script.vm->getInstructionCount();
+    script.slices++;
+    if (script.status == XENO_HALTED) {
+        release(script);
+    }
+}
+
+bool XenoScheduler::tick() {
+    if (scripts.empty()) return false;
+    const int16_t next = pickNext();
+    if (next != NO_SCRIPT) {
+        cursor = next;
+        runSlice(scripts[next]);
+    }
+    return getScriptCount() > 0;
+}
+
+void XenoScheduler::setOutput(Print& target) {
+    output = &target;
+    for (Script& script : scripts) {
+        if (script.vm != nullptr) script.vm->setOutput(target);
+    }
+}
+
+uint16_t XenoScheduler::getScriptCount() const {
+    uint16_t count = 0;
+    for (const Script& script : scripts) {
+        if (script.vm != nullptr) count++;
+    }
+    return count;
+}
+
+XenoRunStatus XenoScheduler::getStatus(int16_t script) const {
+    const Script* found = find(script);
+    return found != nullptr ? found->status : XENO_HALTED;
+}
+
+void XenoScheduler::provideInput(int16_t script, const String& input) {
+    if (find(script) == nullptr || scripts[script].vm == nullptr) return;
+    scripts[script].vm->provideInput(input);
+}
+
+uint32_t XenoScheduler::getCpuTime(int16_t script) const {
+    const Script* found = find(script);
+    return found != nullptr ? found->cpu_us : 0;
+}
+
+uint32_t XenoScheduler::getInstructionCount(int16_t script) const {
+    const Script* found = find(script);
+    return found != nullptr ? found->instructions : 0;
+}
+
+uint32_t XenoScheduler::getSliceCount(int16_t script) const {
+    const Script* found = find(script);
+    return found != nullptr ? found->slices : 0;
+}
+
+void XenoScheduler::printStats() const {
+    static const char* const status_names[] = { "yielded", "sleeping", "waiting input", "halted", "waiting event" };
+    Serial.println("=== Xeno Scheduler ===");
+    for (size_t i = 0; i < scripts.size(); ++i) {
+        const Script& script = scripts[i];
+        if (!script.used) continue;
+        Serial.print("Script ");
+        Serial.print(i);
+        Serial.print(": program ");
+        Serial.print(script.program);
+        Serial.print(", priority ");
+        Serial.print(script.priority);
+        Serial.print(", ");
+        Serial.print(status_names[script.status]);
+        Serial.print(", ");
+        Serial.print(script.cpu_us);
+        Serial.print(" us, ");
+        Serial.print(script.instructions);
+        Serial.print(" instructions, ");
+        Serial.print(script.slices);
+        Serial.println(" slices");
+    }
+}
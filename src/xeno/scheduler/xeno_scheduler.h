@@ -0,0 +1,124 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_SCHEDULER_XENO_SCHEDULER_H_
+#define SRC_XENO_SCHEDULER_XENO_SCHEDULER_H_
+
+#include <Arduino.h>
+#include <vector>
+#include "../xeno_common.h"
+#include "../main/xeno_vm.h"
+#include "../image/xeno_image.h"
+#include "../security/xeno_security_config.h"
+
+class XenoLanguage;
+
+// Несколько скриптов на одном устройстве. Программа хранится один раз как неизменяемый
+// образ и выполняется на месте; у каждого экземпляра только своя VM (стек, глобальные,
+// куча строк) без компилятора. Скрипты получают кванты runFor по очереди или по приоритету.
+class XenoScheduler {
+ public:
+    enum Policy {
+        ROUND_ROBIN = 0,    // Готовые скрипты по кругу
+        PRIORITY = 1        // Готовый скрипт с наибольшим приоритетом, равные - по кругу
+    };
+
+    static const uint32_t DEFAULT_SLICE = 256;  // Инструкций за квант
+    static const int16_t NO_SCRIPT = -1;
+
+    explicit XenoScheduler(Policy policy = ROUND_ROBIN);
+    ~XenoScheduler();
+
+    // Общий образ программы; возвращает номер программы или NO_SCRIPT.
+    // Из XenoLanguage берётся последняя скомпилированная или загруженная программа,
+    // внешний буфер должен быть выровнен на 4 байта и жить, пока есть программа
+    int16_t addProgram(const XenoLanguage& xeno);
+    int16_t addProgram(const uint8_t* image, size_t size);
+
+    // Новый экземпляр программы; возвращает номер скрипта или NO_SCRIPT.
+    // Стек, глубина вызовов и разрешённые пины берутся из настроек ниже на момент запуска
+    int16_t spawn(uint16_t program, uint8_t priority = 0, uint32_t slice = DEFAULT_SLICE);
+    void kill(int16_t script);
+
+    // Один квант одному готовому скрипту; false - живых скриптов не осталось
+    bool tick();
+    // Все живые скрипты спят или ждут ввода - хост может уступить процессор
+    bool isIdle() const { return pickNext() == NO_SCRIPT; }
+    // Вывод print всех экземпляров (по умолчанию Serial)
+    void setOutput(Print& target);
+
+    void setPolicy(Policy new_policy) { policy = new_policy; }
+    Policy getPolicy() const { return policy; }
+
+    // Лимиты для новых экземпляров: маленький стек - меньше памяти на скрипт
+    void useSecurityConfig(const XenoLanguage& xeno);
+    bool setStackSize(uint16_t size) { return security_config.setMaxStackSize(size); }
+    bool setCallDepth(uint16_t depth) { return security_config.setMaxCallDepth(depth); }
+    bool setMaxInstructions(uint32_t max_instr) { return security_config.setCurrentMaxInstructions(max_instr); }
+    bool setArrayMemoryLimit(uint32_t bytes) { return security_config.setMaxArrayMemory(bytes); }
+    bool setAllowedPins(const std::vector<uint8_t>& pins) { return security_config.setAllowedPins(pins); }
+    // Копия функций хоста из registerNative; вызывать до spawn программ, которые их используют
+    void useNatives(const XenoLanguage& xeno);
+
+    uint16_t getScriptCount() const;            // Живые скрипты (не завершённые)
+    XenoRunStatus getStatus(int16_t script) const;
+    void provideInput(int16_t script, const String& input);
+    // Учёт процессора: время внутри runFor, выполненные инструкции и кванты
+    uint32_t getCpuTime(int16_t script) const;
+    uint32_t getInstructionCount(int16_t script) const;
+    uint32_t getSliceCount(int16_t script) const;
+    void printStats() const;
+
+ private:
+    // Неизменяемый образ: свой буфер (encode из компилятора) или внешний
+    struct Program {
+        std::vector<uint8_t> bytes;
+        XenoImageView view;
+        XenoAttestation attestation;        // Проверка образа: экземпляры её не повторяют
+    };
+
+    struct Script {
+        bool used = false;
+        XenoVM* vm = nullptr;               // nullptr после завершения: память возвращается сразу
+        uint16_t program = 0;
+        uint8_t priority = 0;
+        uint32_t slice = DEFAULT_SLICE;
+        XenoRunStatus status = XENO_HALTED;
+        uint32_t cpu_us = 0;
+        uint32_t instructions = 0;
+        uint32_t slices = 0;
+    };
+
+    Policy policy;
+    XenoSecurityConfig security_config;
+    std::vector<Program*> programs;             // Указатели: VM хранит адрес view
+    std::vector<Script> scripts;
+    uint16_t cursor = 0;                        // Последний получивший квант
+    Print* output = &Serial;
+    XenoNativeTable natives;
+
+    int16_t addProgram(Program* program);
+    const Script* find(int16_t script) const;
+    int16_t pickNext() const;
+    void runSlice(Script& script);
+    void release(Script& script);
+
+    // Запрещаем копирование и присваивание
+    XenoScheduler(const XenoScheduler&) = delete;
+    XenoScheduler& operator=(const XenoScheduler&) = delete;
+};
+
+#endif  // SRC_XENO_SCHEDULER_XENO_SCHEDULER_H_
@@ -14,18 +14,10 @@
  * limitations under the License.
  */
 
+#include <string.h>
 #include <vector>
 #include "xeno_security.h"
-
-bool XenoSecurity::isPinAllowed(uint8_t pin) {
-    const std::vector<uint8_t>& allowed_pins = config.getAllowedPins();
-    for (size_t i = 0; i < allowed_pins.size(); i++) {
-        if (pin == allowed_pins[i]) {
-            return true;
-        }
-    }
-    return false;
-}
+#include "../native/xeno_native.h"
 
 String XenoSecurity::sanitizeString(const String& input) {
     String sanitized;
@@ -54,71 +46,191 @@ String XenoSecurity::sanitizeString(const String& input) {
     return sanitized;
 }
 
-bool XenoSecurity::verifyBytecode(const std::vector<XenoInstruction>& bytecode,
-                                 const std::vector<String>& strings) {
-    if (bytecode.size() > 10000) {
+// true, если sanitizeString вернёт строку без изменений (строку можно не копировать)
+bool XenoSecurity::isSanitized(const char* str, size_t length) {
+    if (length >= config.getMaxStringLength()) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        char c = str[i];
+        bool printable = (c >= 32 && c <= 126 && c != '\\' && c != '"' && c != '\'' && c != '`');
+        if (!printable && c != '\t' && c != '\n' && c != '\r') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool XenoSecurity::verifyLimits(size_t code_size, size_t string_count) {
+    if (code_size > 10000) {
         Serial.println("SECURITY: Program too large");
         return false;
     }
 
-    if (strings.size() > 1000) {
+    if (string_count > 1000) {
         Serial.println("SECURITY: String table too large");
         return false;
     }
+    return true;
+}
 
-    for (size_t i = 0; i < bytecode.size(); i++) {
-        const XenoInstruction& instr = bytecode[i];
+bool XenoSecurity::verifyInstruction(const XenoInstruction& instr, size_t i, size_t code_size, size_t string_count) {
+    // Разрешаем все опкоды до XENO_LAST_OPCODE (включая суперинструкции и типизированные) и HALT (255)
+    if (instr.opcode > XENO_LAST_OPCODE && instr.opcode != OP_HALT) {
+        Serial.print("SECURITY: Invalid opcode at instruction ");
+        Serial.println(i);
+        return false;
+    }
+    if (!opcodeEnabled(instr.opcode)) {
+        Serial.print("SECURITY: Opcode not compiled into this build at instruction ");
+        Serial.println(i);
+        return false;
+    }
 
-        // Разрешаем все опкоды до 50 (включая OP_CALL = 49, OP_RETURN = 50) и HALT (255)
-        if (instr.opcode > 50 && instr.opcode != 255) {
-            Serial.print("SECURITY: Invalid opcode at instruction ");
+    if (isJumpOpcode(instr.opcode)) {
+        if (getJumpTarget(instr) >= code_size) {
+            Serial.print("SECURITY: Invalid jump target at instruction ");
             Serial.println(i);
             return false;
         }
+    }
 
-        if (instr.opcode == OP_JUMP || instr.opcode == OP_JUMP_IF) {
-            if (instr.arg1 >= bytecode.size()) {
-                Serial.print("SECURITY: Invalid jump target at instruction ");
-                Serial.println(i);
-                return false;
-            }
+    if (instr.opcode == OP_PRINT || instr.opcode == OP_PUSH_STRING ||
+        instr.opcode == OP_INPUT) {
+        if (instr.arg1 >= string_count) {
+            Serial.print("SECURITY: Invalid string index at instruction ");
+            Serial.println(i);
+            return false;
         }
+    }
 
-        if (instr.opcode == OP_PRINT || instr.opcode == OP_STORE ||
-            instr.opcode == OP_LOAD || instr.opcode == OP_PUSH_STRING ||
-            instr.opcode == OP_INPUT || instr.opcode == OP_CALL) {
-            if (instr.arg1 >= strings.size()) {
-                Serial.print("SECURITY: Invalid string index at instruction ");
-                Serial.println(i);
-                return false;
-            }
+    // Доступ к переменным: arg1 - слот, arg2 - имя (для INPUT наоборот)
+    if (instr.opcode == OP_STORE || instr.opcode == OP_LOAD ||
+        instr.opcode == OP_STORE_LOCAL || instr.opcode == OP_LOAD_LOCAL) {
+        if (instr.arg1 > 0xFFFF || instr.arg2 >= string_count) {
+            Serial.print("SECURITY: Invalid variable slot at instruction ");
+            Serial.println(i);
+            return false;
         }
+    }
 
-        if (instr.opcode == OP_LED_ON || instr.opcode == OP_LED_OFF ||
-            instr.opcode == OP_ANALOG_READ || instr.opcode == OP_ANALOG_WRITE ||
-            instr.opcode == OP_DIGITAL_READ) {
-            if (!isPinAllowed(instr.arg1)) {
-                Serial.print("SECURITY: Unauthorized pin access at instruction ");
-                Serial.println(i);
-                return false;
-            }
+    if (isSlotCompareJump(instr.opcode)) {
+        uint8_t compare_op = slotCompareOp(instr.arg1);
+        if (compare_op < OP_EQ || compare_op > OP_GTE) {
+            Serial.print("SECURITY: Invalid comparison at instruction ");
+            Serial.println(i);
+            return false;
         }
+    }
 
-        if (instr.opcode == OP_DELAY) {
-            if (instr.arg1 > 60000) {
-                Serial.print("SECURITY: Excessive delay at instruction ");
-                Serial.println(i);
-                return false;
-            }
+    // Инкремент: слот в младших 16 битах arg1, индекс имени - в старших
+    if (instr.opcode == OP_INC_GLOBAL || instr.opcode == OP_INC_LOCAL) {
+        if ((instr.arg1 >> 16) >= string_count) {
+            Serial.print("SECURITY: Invalid variable slot at instruction ");
+            Serial.println(i);
+            return false;
         }
     }
 
+    // CALL: arg1 - номер функции (проверяет VM), arg2 - имя
+    if (instr.opcode == OP_CALL && instr.arg2 >= string_count) {
+        Serial.print("SECURITY: Invalid function name index at instruction ");
+        Serial.println(i);
+        return false;
+    }
+
+    // CALL_NATIVE: номер сверяет VM с таблицей хоста, здесь - имя и арность
+    if (instr.opcode == OP_CALL_NATIVE &&
+        (instr.arg2 >= string_count || nativeCallArity(instr.arg1) > XenoNativeTable::MAX_ARITY ||
+         (instr.arg1 >> 24) != 0)) {
+        Serial.print("SECURITY: Invalid native call at instruction ");
+        Serial.println(i);
+        return false;
+    }
+
+    if (instr.opcode == OP_ARRAY_NEW && instr.arg1 > ARRAY_UINT8) {
+        Serial.print("SECURITY: Invalid array kind at instruction ");
+        Serial.println(i);
+        return false;
+    }
+
+    if (instr.opcode == OP_LED_ON || instr.opcode == OP_LED_OFF ||
+        instr.opcode == OP_ANALOG_READ || instr.opcode == OP_ANALOG_WRITE ||
+        instr.opcode == OP_DIGITAL_READ) {
+        // Номер пина - весь arg1: старшие биты не должны отбрасываться при проверке
+        if (instr.arg1 >= XENO_PIN_BANKS * 32u) {
+            Serial.print("SECURITY: Invalid pin number at instruction ");
+            Serial.println(i);
+            return false;
+        }
+        if (!isPinAllowed(static_cast<uint8_t>(instr.arg1))) {
+            Serial.print("SECURITY: Unauthorized pin access at instruction ");
+            Serial.println(i);
+            return false;
+        }
+    }
+
+    // Групповые опкоды: все пины маски разрешены, при выполнении они уже не проверяются
+    if (isPinGroupOpcode(instr.opcode)) {
+        const uint8_t bank = pinGroupBank(instr.arg2);
+        const uint8_t samples = pinGroupSamples(instr.arg2);
+        bool valid = bank < XENO_PIN_BANKS && instr.arg1 != 0 &&
+                     (instr.opcode == OP_ANALOG_READ_PINS ? samples != 0 : samples == 0);
+        if (!valid) {
+            Serial.print("SECURITY: Invalid pin group at instruction ");
+            Serial.println(i);
+            return false;
+        }
+        if ((instr.arg1 & ~config.getPinMask()[bank]) != 0) {
+            Serial.print("SECURITY: Unauthorized pin access at instruction ");
+            Serial.println(i);
+            return false;
+        }
+    }
+
+    // Источник события: пин проверяется так же, как у остальных команд, таймер - не чаще раза в мс
+    if (instr.opcode == OP_EVENT_BIND) {
+        const uint32_t source = instr.arg1;
+        bool valid = false;
+        if (eventKind(source) == XENO_EVENT_PIN) {
+            valid = eventEdge(source) <= XENO_EDGE_FALLING && (source & 0xFF0000) == 0;
+        } else if (eventKind(source) == XENO_EVENT_TIMER) {
+            valid = eventPeriod(source) != 0;
+        }
+        if (!valid) {
+            Serial.print("SECURITY: Invalid event source at instruction ");
+            Serial.println(i);
+            return false;
+        }
+        if (eventKind(source) == XENO_EVENT_PIN && !isPinAllowed(eventPin(source))) {
+            Serial.print("SECURITY: Unauthorized pin access at instruction ");
+            Serial.println(i);
+            return false;
+        }
+    }
+
+    if (instr.opcode == OP_DELAY) {
+        if (instr.arg1 > 60000) {
+            Serial.print("SECURITY: Excessive delay at instruction ");
+            Serial.println(i);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool XenoSecurity::verifyBytecode(const std::vector<XenoInstruction>& bytecode,
+                                 const std::vector<String>& strings) {
+    if (!verifyLimits(bytecode.size(), strings.size())) {
+        return false;
+    }
+
     bool has_halt = false;
-    for (const auto& instr : bytecode) {
-        if (instr.opcode == OP_HALT) {
-            has_halt = true;
-            break;
+    for (size_t i = 0; i < bytecode.size(); i++) {
+        if (!verifyInstruction(bytecode[i], i, bytecode.size(), strings.size())) {
+            return false;
         }
+        has_halt = has_halt || bytecode[i].opcode == OP_HALT;
     }
 
     if (!has_halt && bytecode.size() > 10) {
@@ -127,4 +239,280 @@ bool XenoSecurity::verifyBytecode(const std::vector<XenoInstruction>& bytecode,
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+// Тот же проверщик для упакованного потока, читаемого на месте (из flash)
+bool XenoSecurity::verifyBytecode(const XenoCompactInstruction* code, size_t code_size, size_t string_count) {
+    if (!verifyLimits(code_size, string_count)) {
+        return false;
+    }
+
+    bool has_halt = false;
+    for (size_t i = 0; i < code_size; i++) {
+        XenoInstruction instr = code[i].unpack();
+        if (!verifyInstruction(instr, i, code_size, string_count)) {
+            return false;
+        }
+        has_halt = has_halt || instr.opcode == OP_HALT;
+    }
+
+    if (!has_halt && code_size > 10) {
+        Serial.println("SECURITY: Program missing HALT instruction");
+        return false;
+    }
+
+    return true;
+}
+
+// ---- Запомненная проверка ----
+bool XenoSecurity::attested(const XenoAttestation& attestation) const {
+    return attestation.verified &&
+           memcmp(attestation.pin_mask, config.getPinMask(), sizeof(attestation.pin_mask)) == 0 &&
+           attestation.max_stack_size == config.getMaxStackSize() &&
+           attestation.max_call_depth == config.getMaxCallDepth() &&
+           attestation.max_string_length == config.getMaxStringLength() &&
+           attestation.max_instructions == config.getCurrentMaxInstructions();
+}
+
+void XenoSecurity::recordAttestation(XenoAttestation& attestation, bool native_calls) {
+    attestation.reset();
+    attestation.verified = true;
+    memcpy(attestation.pin_mask, config.getPinMask(), sizeof(attestation.pin_mask));
+    attestation.max_stack_size = config.getMaxStackSize();
+    attestation.max_call_depth = config.getMaxCallDepth();
+    attestation.max_string_length = config.getMaxStringLength();
+    attestation.max_instructions = config.getCurrentMaxInstructions();
+    attestation.native_calls = native_calls;
+}
+
+bool XenoSecurity::attest(const std::vector<XenoInstruction>& bytecode, const std::vector<String>& strings,
+                          XenoAttestation& attestation) {
+    if (attested(attestation)) return true;
+    attestation.reset();
+    if (!verifyBytecode(bytecode, strings)) return false;
+
+    bool native_calls = false;
+    for (const XenoInstruction& instr : bytecode) {
+        native_calls = native_calls || instr.opcode == OP_CALL_NATIVE;
+    }
+    recordAttestation(attestation, native_calls);
+    return true;
+}
+
+bool XenoSecurity::attest(const XenoCompactInstruction* code, size_t code_size, size_t string_count,
+                          XenoAttestation& attestation) {
+    if (attested(attestation)) return true;
+    attestation.reset();
+    if (!verifyBytecode(code, code_size, string_count)) return false;
+
+    bool native_calls = false;
+    for (size_t i = 0; i < code_size; ++i) {
+        native_calls = native_calls || code[i].opcode == OP_CALL_NATIVE;
+    }
+    recordAttestation(attestation, native_calls);
+    return true;
+}
+
+void XenoSecurity::attestStack(const XenoCompactInstruction* code, size_t code_size,
+                               const std::vector<FunctionInfo>& functions, uint32_t limit,
+                               XenoAttestation& attestation) {
+    if (attestation.stack_checked && attestation.stack_limit == limit &&
+        attestation.frame_depth.size() == functions.size()) {
+        return;
+    }
+    uint32_t main_depth = 0;
+    attestation.stack_proven = code_size != 0 &&
+        verifyStackDepth(code, code_size, functions, limit, main_depth, attestation.frame_depth,
+                         attestation.stack_bound);
+    if (!attestation.stack_proven) attestation.stack_bound = 0;
+    attestation.stack_checked = true;
+    attestation.stack_limit = limit;
+}
+
+// Сколько значений инструкция снимает со стека и сколько кладёт (CALL и CALL_NATIVE считаются отдельно).
+// false - действие неизвестно: такую программу анализ не пропускает
+static bool stackEffect(uint8_t opcode, uint32_t& pops, uint32_t& pushes) {
+    pops = 0;
+    pushes = 0;
+    if (isTypedOpcode(opcode) || isComparisonOpcode(opcode)) {
+        pops = 2;
+        pushes = 1;
+        return true;
+    }
+    switch (opcode) {
+        case OP_NOP: case OP_PRINT: case OP_LED_ON: case OP_LED_OFF: case OP_DELAY: case OP_INPUT:
+        case OP_INC_GLOBAL: case OP_INC_LOCAL: case OP_JUMP: case OP_HALT: case OP_RETURN:
+        case OP_CMP_JUMP_GLOBAL: case OP_CMP_JUMP_LOCAL: case OP_INC_JUMP_GLOBAL: case OP_INC_JUMP_LOCAL:
+        case OP_LOOP_JUMP_GLOBAL: case OP_LOOP_JUMP_LOCAL: case OP_EVENT_BIND:
+            return true;
+        case OP_PUSH: case OP_PUSH_FLOAT: case OP_PUSH_STRING: case OP_PUSH_BOOL:
+        case OP_LOAD: case OP_LOAD_LOCAL: case OP_ANALOG_READ: case OP_DIGITAL_READ: case OP_DIGITAL_READ_PINS:
+            pushes = 1;
+            return true;
+        case OP_POP: case OP_STORE: case OP_STORE_LOCAL: case OP_JUMP_IF: case OP_ANALOG_WRITE:
+        case OP_DIGITAL_WRITE_PINS: case OP_ANALOG_READ_PINS:
+            pops = 1;
+            return true;
+        // Заменяют вершину стека
+        case OP_PRINT_NUM: case OP_ABS: case OP_SQRT: case OP_SIN: case OP_COS: case OP_TAN:
+        case OP_NOT: case OP_NEG: case OP_ARRAY_NEW: case OP_ARRAY_LEN: case OP_CONVERT_TO_FLOAT:
+            pops = 1;
+            pushes = 1;
+            return true;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD: case OP_POW: case OP_MAX: case OP_MIN:
+        case OP_AND: case OP_OR: case OP_ARRAY_GET:
+            pops = 2;
+            pushes = 1;
+            return true;
+        case OP_ARRAY_SET:
+            pops = 3;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static const uint16_t XENO_STACK_UNSEEN = 0xFFFF;
+
+// Вызов внутри кода: глубина начала кадра вызываемой функции относительно кадра вызывающего
+struct XenoCallSite {
+    uint16_t context;
+    uint16_t callee;
+    uint32_t base;
+};
+
+// Глубина на входе в каждую инструкцию и владелец инструкции (0 - основная программа, i + 1 - функция i)
+struct XenoStackScan {
+    std::vector<uint16_t> depth;
+    std::vector<uint16_t> owner;
+    std::vector<uint32_t> pending;
+    std::vector<XenoCallSite> calls;
+    std::vector<uint16_t> handlers;         // Функции из OP_EVENT_BIND
+    uint32_t peak = 0;
+
+    // false - инструкция уже достигнута с другой глубиной или из другого кода
+    bool reach(uint32_t pc, uint32_t d, uint16_t context, uint32_t limit) {
+        if (pc >= depth.size()) return true;       // Конец кода: VM останавливается
+        if (d > limit || d >= XENO_STACK_UNSEEN) return false;
+        if (depth[pc] == XENO_STACK_UNSEEN) {
+            depth[pc] = d;
+            owner[pc] = context;
+            pending.push_back(pc);
+            if (d > peak) peak = d;
+            return true;
+        }
+        return depth[pc] == d && owner[pc] == context;
+    }
+};
+
+// Весь стек контекста с вложенными вызовами: need[c] = max(пик c, начало кадра + need[вызываемой]).
+// state: 0 - не посчитан, 1 - считается (повторный вход - цикл), 2 - готов
+static bool xenoStackNeed(uint16_t context, const std::vector<XenoCallSite>& calls,
+                          const std::vector<uint32_t>& peaks, std::vector<uint8_t>& state,
+                          std::vector<uint32_t>& need) {
+    if (state[context] == 2) return true;
+    if (state[context] == 1) return false;
+    state[context] = 1;
+    uint32_t total = peaks[context];
+    for (const XenoCallSite& call : calls) {
+        if (call.context != context) continue;
+        if (!xenoStackNeed(call.callee + 1, calls, peaks, state, need)) return false;
+        total = max(total, call.base + need[call.callee + 1]);
+    }
+    need[context] = total;
+    state[context] = 2;
+    return true;
+}
+
+bool XenoSecurity::verifyStackDepth(const XenoCompactInstruction* code, size_t code_size,
+                                    const std::vector<FunctionInfo>& functions, uint32_t limit,
+                                    uint32_t& main_depth, std::vector<uint16_t>& frame_depth) {
+    uint32_t stack_bound;
+    return verifyStackDepth(code, code_size, functions, limit, main_depth, frame_depth, stack_bound);
+}
+
+bool XenoSecurity::verifyStackDepth(const XenoCompactInstruction* code, size_t code_size,
+                                    const std::vector<FunctionInfo>& functions, uint32_t limit,
+                                    uint32_t& main_depth, std::vector<uint16_t>& frame_depth,
+                                    uint32_t& stack_bound) {
+    main_depth = 0;
+    stack_bound = 0;
+    frame_depth.assign(functions.size(), 0);
+    if (functions.size() >= XENO_STACK_UNSEEN) return false;
+
+    XenoStackScan scan;
+    scan.depth.assign(code_size, XENO_STACK_UNSEEN);
+    scan.owner.assign(code_size, 0);
+
+    for (size_t context = 0; context <= functions.size(); ++context) {
+        uint32_t entry = 0;
+        uint32_t entry_depth = 0;
+        if (context != 0) {
+            const FunctionInfo& function = functions[context - 1];
+            if (function.address < 0 || function.arity < 0) return false;
+            entry = function.address;
+            entry_depth = function.arity;
+        }
+        // RETURN кладёт результат в начало кадра, поэтому кадру нужно хотя бы одно место
+        scan.peak = context != 0 ? (entry_depth > 0 ? entry_depth : 1) : 0;
+        if (!scan.reach(entry, entry_depth, context, limit)) return false;
+
+        while (!scan.pending.empty()) {
+            const uint32_t pc = scan.pending.back();
+            scan.pending.pop_back();
+            const XenoCompactInstruction& instr = code[pc];
+            const uint32_t d = scan.depth[pc];
+
+            uint32_t pops, pushes;
+            if (instr.opcode == OP_CALL) {
+                if (instr.arg1 >= functions.size()) continue;  // VM остановится на неверном номере
+                pops = functions[instr.arg1].arity;
+                pushes = 1;
+                if (d >= pops) {
+                    scan.calls.push_back(XenoCallSite{static_cast<uint16_t>(context),
+                                                      static_cast<uint16_t>(instr.arg1), d - pops});
+                }
+            } else if (instr.opcode == OP_CALL_NATIVE) {
+                pops = nativeCallArity(instr.arg1);
+                pushes = 1;
+            } else if (instr.opcode == OP_EVENT_BIND) {
+                pops = pushes = 0;
+                if (instr.arg2 < functions.size()) scan.handlers.push_back(instr.arg2);
+            } else if (!stackEffect(instr.opcode, pops, pushes)) {
+                return false;
+            }
+            if (d < pops) return false;
+            const uint32_t after = d - pops + pushes;
+            if (after > limit) return false;
+            if (after > scan.peak) scan.peak = after;
+
+            if (instr.opcode == OP_HALT || instr.opcode == OP_RETURN) continue;
+            if (instr.opcode != OP_JUMP && !scan.reach(pc + 1, after, context, limit)) return false;
+            if (isJumpOpcode(instr.opcode) && !scan.reach(getJumpTarget(instr.unpack()), after, context, limit)) {
+                return false;
+            }
+        }
+
+        if (context == 0) {
+            main_depth = scan.peak;
+        } else {
+            frame_depth[context - 1] = scan.peak;
+        }
+    }
+
+    std::vector<uint32_t> peaks(functions.size() + 1, main_depth);
+    for (size_t i = 0; i < functions.size(); ++i) {
+        peaks[i + 1] = frame_depth[i];
+    }
+    std::vector<uint8_t> state(peaks.size(), 0);
+    std::vector<uint32_t> need(peaks.size(), 0);
+    if (!xenoStackNeed(0, scan.calls, peaks, state, need)) return true;
+    // Обработчик события встаёт поверх любого состояния основного кода
+    uint32_t handler_need = 0;
+    for (uint16_t handler : scan.handlers) {
+        if (!xenoStackNeed(handler + 1, scan.calls, peaks, state, need)) return true;
+        handler_need = max(handler_need, need[handler + 1]);
+    }
+    stack_bound = max(need[0] + handler_need, static_cast<uint32_t>(1));
+    return true;
+}
@@ -22,21 +22,72 @@
 #include "../xeno_common.h"
 #include "xeno_security_config.h"
 
+// Итог проверки программы, хранится рядом с ней (в XenoLanguage, у программы планировщика).
+// Пока программа не менялась, повторная загрузка с теми же пинами не проверяет её заново.
+// Владелец сбрасывает reset() при любой смене программы
+struct XenoAttestation {
+    bool verified = false;
+    uint32_t pin_mask[8] = { };         // Разрешённые пины на момент проверки
+    uint16_t max_stack_size = 0;        // Пределы конфигурации на момент проверки:
+    uint16_t max_call_depth = 0;        // при любом их изменении проверка повторяется
+    uint16_t max_string_length = 0;
+    uint32_t max_instructions = 0;
+    bool native_calls = false;          // Есть OP_CALL_NATIVE: VM сверяет их с таблицей хоста
+
+    // Глубина стека (verifyStackDepth) для предела stack_limit; функции - по номеру
+    bool stack_checked = false;
+    bool stack_proven = false;
+    uint32_t stack_limit = 0;
+    uint32_t stack_bound = 0;           // Весь стек программы с вложенными вызовами, 0 - есть рекурсия
+    std::vector<uint16_t> frame_depth;
+
+    void reset() { *this = XenoAttestation(); }
+};
+
 class XenoSecurity {
  private:
     XenoSecurityConfig& config;
 
  protected:
-    friend class XenoSecurity;
     friend class XenoLanguage;
+    friend class XenoScheduler;
     friend class XenoCompiler;
     friend class XenoVM;
+    friend class XenoNativeCall;
     explicit XenoSecurity(XenoSecurityConfig& cfg) : config(cfg) {}
 
-    bool isPinAllowed(uint8_t pin);
+    bool isPinAllowed(uint8_t pin) const { return config.isPinAllowed(pin); }
     String sanitizeString(const String& input);
+    bool isSanitized(const char* str, size_t length);
     bool verifyBytecode(const std::vector<XenoInstruction>& bytecode,
                        const std::vector<String>& strings);
+    bool verifyBytecode(const XenoCompactInstruction* code, size_t code_size, size_t string_count);
+    // Статическая глубина стека: в каждую инструкцию любой путь приходит с одной и той же глубиной,
+    // которая не превышает limit и не уходит ниже начала кадра. main_depth - максимум основной программы,
+    // frame_depth[i] - максимум кадра функции i от его начала (вместе с параметрами).
+    // false - доказать не удалось (стек тогда проверяется на каждой операции)
+    // stack_bound - наибольшая глубина всего стека с учётом вложенных вызовов (0 - в графе вызовов есть цикл)
+    bool verifyStackDepth(const XenoCompactInstruction* code, size_t code_size,
+                          const std::vector<FunctionInfo>& functions, uint32_t limit,
+                          uint32_t& main_depth, std::vector<uint16_t>& frame_depth);
+    bool verifyStackDepth(const XenoCompactInstruction* code, size_t code_size,
+                          const std::vector<FunctionInfo>& functions, uint32_t limit,
+                          uint32_t& main_depth, std::vector<uint16_t>& frame_depth, uint32_t& stack_bound);
+
+    // verifyBytecode с запоминанием в attestation: уже проверенная при тех же пинах программа - O(1)
+    bool attest(const std::vector<XenoInstruction>& bytecode, const std::vector<String>& strings,
+                XenoAttestation& attestation);
+    bool attest(const XenoCompactInstruction* code, size_t code_size, size_t string_count,
+                XenoAttestation& attestation);
+    // Глубина стека для предела limit, тоже один раз на программу
+    void attestStack(const XenoCompactInstruction* code, size_t code_size,
+                     const std::vector<FunctionInfo>& functions, uint32_t limit, XenoAttestation& attestation);
+
+ private:
+    bool verifyLimits(size_t code_size, size_t string_count);
+    bool verifyInstruction(const XenoInstruction& instr, size_t i, size_t code_size, size_t string_count);
+    bool attested(const XenoAttestation& attestation) const;
+    void recordAttestation(XenoAttestation& attestation, bool native_calls);
 };
 
 #endif  // SRC_XENO_SECURITY_XENO_SECURITY_H_
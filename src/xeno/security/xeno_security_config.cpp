@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <string.h>
 #include <vector>
 #include "xeno_security_config.h"
 
@@ -79,6 +80,14 @@ bool XenoSecurityConfig::setMaxStackSize(uint16_t size) {
     return true;
 }
 
+bool XenoSecurityConfig::setMaxCallDepth(uint16_t depth) {
+    if (!validateSizeLimit(depth, MIN_CALL_DEPTH, MAX_CALL_DEPTH_LIMIT, "MAX_CALL_DEPTH")) {
+        return false;
+    }
+    max_call_depth = depth;
+    return true;
+}
+
 bool XenoSecurityConfig::setCurrentMaxInstructions(uint32_t max_instr) {
     if (max_instr < MIN_INSTRUCTIONS_LIMIT || max_instr > MAX_INSTRUCTIONS_LIMIT) {
         Serial.print("SECURITY: max_instructions must be between ");
@@ -91,6 +100,18 @@ bool XenoSecurityConfig::setCurrentMaxInstructions(uint32_t max_instr) {
     return true;
 }
 
+bool XenoSecurityConfig::setMaxArrayMemory(uint32_t bytes) {
+    if (bytes < MIN_ARRAY_MEMORY || bytes > MAX_ARRAY_MEMORY_LIMIT) {
+        Serial.print("SECURITY: max_array_memory must be between ");
+        Serial.print(MIN_ARRAY_MEMORY);
+        Serial.print(" and ");
+        Serial.println(MAX_ARRAY_MEMORY_LIMIT);
+        return false;
+    }
+    max_array_memory = bytes;
+    return true;
+}
+
 bool XenoSecurityConfig::setAllowedPins(const std::vector<uint8_t>& pins) {
     for (uint8_t pin : pins) {
         if (pin < MIN_PIN_NUMBER || pin > MAX_PIN_NUMBER) {
@@ -104,6 +125,10 @@ bool XenoSecurityConfig::setAllowedPins(const std::vector<uint8_t>& pins) {
         }
     }
     allowed_pins = pins;
+    memset(pin_mask, 0, sizeof(pin_mask));
+    for (uint8_t pin : pins) {
+        pin_mask[pin >> 5] |= 1u << (pin & 31);
+    }
     return true;
 }
 
@@ -124,15 +149,6 @@ bool XenoSecurityConfig::setMaxImportCount(uint16_t count) {
     return true;
 }
 
-bool XenoSecurityConfig::isPinAllowed(uint8_t pin) const {
-    for (uint8_t allowed_pin : allowed_pins) {
-        if (pin == allowed_pin) {
-            return true;
-        }
-    }
-    return false;
-}
-
 bool XenoSecurityConfig::validateConfig() const {
     XenoSecurityConfig temp = *this;
     return temp.setMaxStringLength(max_string_length) &&
@@ -141,7 +157,9 @@ bool XenoSecurityConfig::validateConfig() const {
            temp.setMaxLoopDepth(max_loop_depth) &&
            temp.setMaxIfDepth(max_if_depth) &&
            temp.setMaxStackSize(max_stack_size) &&
+           temp.setMaxCallDepth(max_call_depth) &&
            temp.setCurrentMaxInstructions(current_max_instructions) &&
+           temp.setMaxArrayMemory(max_array_memory) &&
            temp.setAllowedPins(allowed_pins) &&
            temp.setMaxImportDepth(max_import_depth) &&
            temp.setMaxImportCount(max_import_count);
@@ -176,10 +194,18 @@ String XenoSecurityConfig::getSecurityLimitsInfo() const {
     info += MIN_STACK_SIZE;
     info += " - ";
     info += MAX_STACK_SIZE_LIMIT;
+    info += "\nCall Depth: ";
+    info += MIN_CALL_DEPTH;
+    info += " - ";
+    info += MAX_CALL_DEPTH_LIMIT;
     info += "\nInstructions: ";
     info += MIN_INSTRUCTIONS_LIMIT;
     info += " - ";
     info += MAX_INSTRUCTIONS_LIMIT;
+    info += "\nArray Memory: ";
+    info += MIN_ARRAY_MEMORY;
+    info += " - ";
+    info += MAX_ARRAY_MEMORY_LIMIT;
     info += "\nPin Numbers: ";
     info += MIN_PIN_NUMBER;
     info += " - ";
@@ -30,10 +30,13 @@ class XenoSecurityConfig {
     uint16_t max_loop_depth = 16;
     uint16_t max_if_depth = 16;
     uint16_t max_stack_size = 256;
+    uint16_t max_call_depth = 32;
 
     uint32_t current_max_instructions = 10000;
+    uint32_t max_array_memory = 16384;      // Байт под элементы всех живых массивов
 
     std::vector<uint8_t> allowed_pins = { };
+    uint32_t pin_mask[8] = { };             // Те же пины битами: проверка пина за O(1)
 
     uint16_t max_import_depth = XENO_MAX_IMPORT_DEPTH_DEFAULT;
     uint16_t max_import_count = XENO_MAX_IMPORT_COUNT_DEFAULT;
@@ -57,9 +60,15 @@ class XenoSecurityConfig {
     static constexpr uint16_t MIN_STACK_SIZE = 16;
     static constexpr uint16_t MAX_STACK_SIZE_LIMIT = 2048;
 
+    static constexpr uint16_t MIN_CALL_DEPTH = 1;
+    static constexpr uint16_t MAX_CALL_DEPTH_LIMIT = 256;
+
     static constexpr uint32_t MIN_INSTRUCTIONS_LIMIT = 1000;
     static constexpr uint32_t MAX_INSTRUCTIONS_LIMIT = 1000000;
 
+    static constexpr uint32_t MIN_ARRAY_MEMORY = 256;
+    static constexpr uint32_t MAX_ARRAY_MEMORY_LIMIT = 262144;
+
     static constexpr uint8_t MIN_PIN_NUMBER = 0;
     static constexpr uint8_t MAX_PIN_NUMBER = 255;
 
@@ -72,6 +81,7 @@ class XenoSecurityConfig {
 
  protected:
     friend class XenoLanguage;
+    friend class XenoScheduler;
     friend class XenoCompiler;
     friend class XenoVM;
     friend class XenoSecurity;
@@ -85,7 +95,9 @@ class XenoSecurityConfig {
     uint16_t getMaxLoopDepth() const { return max_loop_depth; }
     uint16_t getMaxIfDepth() const { return max_if_depth; }
     uint16_t getMaxStackSize() const { return max_stack_size; }
+    uint16_t getMaxCallDepth() const { return max_call_depth; }
     uint32_t getCurrentMaxInstructions() const { return current_max_instructions; }
+    uint32_t getMaxArrayMemory() const { return max_array_memory; }
     const std::vector<uint8_t>& getAllowedPins() const { return allowed_pins; }
     uint16_t getMaxImportDepth() const { return max_import_depth; }
     uint16_t getMaxImportCount() const { return max_import_count; }
@@ -97,12 +109,15 @@ class XenoSecurityConfig {
     bool setMaxLoopDepth(uint16_t depth);
     bool setMaxIfDepth(uint16_t depth);
     bool setMaxStackSize(uint16_t size);
+    bool setMaxCallDepth(uint16_t depth);
     bool setCurrentMaxInstructions(uint32_t max_instr);
+    bool setMaxArrayMemory(uint32_t bytes);
     bool setAllowedPins(const std::vector<uint8_t>& pins);
     bool setMaxImportDepth(uint16_t depth);
     bool setMaxImportCount(uint16_t count);
 
-    bool isPinAllowed(uint8_t pin) const;
+    bool isPinAllowed(uint8_t pin) const { return (pin_mask[pin >> 5] >> (pin & 31)) & 1; }
+    const uint32_t* getPinMask() const { return pin_mask; }
     bool validateConfig() const;
     String getSecurityLimitsInfo() const;
 
@@ -120,8 +135,12 @@ class XenoSecurityConfig {
     static constexpr uint16_t getMaxIfDepthLimit() { return MAX_IF_DEPTH_LIMIT; }
     static constexpr uint16_t getMinStackSize() { return MIN_STACK_SIZE; }
     static constexpr uint16_t getMaxStackSizeLimit() { return MAX_STACK_SIZE_LIMIT; }
+    static constexpr uint16_t getMinCallDepth() { return MIN_CALL_DEPTH; }
+    static constexpr uint16_t getMaxCallDepthLimit() { return MAX_CALL_DEPTH_LIMIT; }
     static constexpr uint32_t getMinInstructionsLimit() { return MIN_INSTRUCTIONS_LIMIT; }
     static constexpr uint32_t getMaxInstructionsLimitValue() { return MAX_INSTRUCTIONS_LIMIT; }
+    static constexpr uint32_t getMinArrayMemory() { return MIN_ARRAY_MEMORY; }
+    static constexpr uint32_t getMaxArrayMemoryLimit() { return MAX_ARRAY_MEMORY_LIMIT; }
     static constexpr uint8_t getMinPinNumber() { return MIN_PIN_NUMBER; }
     static constexpr uint8_t getMaxPinNumber() { return MAX_PIN_NUMBER; }
 
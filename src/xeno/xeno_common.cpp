@@ -16,42 +16,18 @@
 
 #include "xeno_common.h"
 
-XenoValue::XenoValue() : type(TYPE_INT), int_val(0) {}
-
-XenoValue XenoValue::makeInt(int32_t val) {
-    XenoValue v;
-    v.type = TYPE_INT;
-    v.int_val = val;
-    return v;
-}
-
-XenoValue XenoValue::makeFloat(float val) {
-    XenoValue v;
-    v.type = TYPE_FLOAT;
-    v.float_val = val;
-    return v;
-}
-
-XenoValue XenoValue::makeString(uint16_t str_idx) {
-    XenoValue v;
-    v.type = TYPE_STRING;
-    v.string_index = str_idx;
-    return v;
-}
-
-XenoValue XenoValue::makeBool(bool val) {
-    XenoValue v;
-    v.type = TYPE_BOOL;
-    v.bool_val = val;
-    return v;
+XenoInstruction::XenoInstruction(uint8_t op, uint32_t a1, uint16_t a2)
+    : opcode(op), arg1(a1), arg2(a2), line(0) {}
+
+XenoCompactInstruction XenoCompactInstruction::pack(const XenoInstruction& instr) {
+    XenoCompactInstruction packed;
+    packed.opcode = instr.opcode;
+    packed.reserved = 0;
+    packed.arg2 = instr.arg2;
+    packed.arg1 = instr.arg1;
+    return packed;
 }
 
-XenoValue XenoValue::makeArray(uint16_t arr_idx) {
-    XenoValue v;
-    v.type = TYPE_ARRAY;
-    v.array_index = arr_idx;
-    return v;
+XenoInstruction XenoCompactInstruction::unpack() const {
+    return XenoInstruction(opcode, arg1, arg2);
 }
-
-XenoInstruction::XenoInstruction(uint8_t op, uint32_t a1, uint16_t a2)
-    : opcode(op), arg1(a1), arg2(a2) {}
\ No newline at end of file
@@ -20,6 +20,8 @@
 #include <Arduino.h>
 #include <vector>
 #include <map>
+#include "xeno_features.h"
+#include "memory/xeno_arena.h"
 
 // Operation codes for Xeno bytecode
 enum XenoOpcodes {
@@ -37,8 +39,8 @@ enum XenoOpcodes {
     OP_JUMP = 11,
     OP_JUMP_IF = 12,
     OP_PRINT_NUM = 13,
-    OP_STORE = 14,
-    OP_LOAD = 15,
+    OP_STORE = 14,          // arg1 = слот глобальной переменной, arg2 = индекс имени
+    OP_LOAD = 15,           // arg1 = слот глобальной переменной, arg2 = индекс имени
     OP_MOD = 16,
     OP_ABS = 17,
     OP_POW = 18,
@@ -79,11 +81,226 @@ enum XenoOpcodes {
     OP_CALL       = 49,
     OP_RETURN     = 50,
 
+    // Локальные переменные функции (arg1 = слот в кадре, arg2 = индекс имени)
+    OP_LOAD_LOCAL  = 51,
+    OP_STORE_LOCAL = 52,
+
+    // Суперинструкции оптимизатора: var += шаг
+    // arg1 = слот | (индекс имени << 16), arg2 = шаг (int16)
+    OP_INC_GLOBAL = 53,
+    OP_INC_LOCAL  = 54,
+
+    // Суперинструкции циклов: arg1 = packSlotCompare(слот, сравнение, константа), arg2 = адрес перехода
+    OP_CMP_JUMP_GLOBAL = 55,    // переход, если НЕ (var cmp imm) - слитые LOAD, PUSH, cmp, JUMP_IF
+    OP_CMP_JUMP_LOCAL  = 56,
+    OP_INC_JUMP_GLOBAL = 57,    // var += 1, переход, если (var cmp imm) - шаг цикла for
+    OP_INC_JUMP_LOCAL  = 58,
+
+    // Арифметика и сравнения для операндов одного известного типа: компилятор выводит тип
+    // из выражения, VM - по первому выполнению общего опкода. Типы всё равно проверяются,
+    // при несовпадении выполняется общая операция.
+    OP_ADD_INT = 59,
+    OP_SUB_INT = 60,
+    OP_MUL_INT = 61,
+    OP_DIV_INT = 62,
+    OP_MOD_INT = 63,
+    OP_ADD_FLOAT = 64,
+    OP_SUB_FLOAT = 65,
+    OP_MUL_FLOAT = 66,
+    OP_DIV_FLOAT = 67,
+    OP_EQ_INT  = 68,        // EQ_INT..GTE_INT и EQ_FLOAT..GTE_FLOAT в порядке OP_EQ..OP_GTE
+    OP_NEQ_INT = 69,
+    OP_LT_INT  = 70,
+    OP_GT_INT  = 71,
+    OP_LTE_INT = 72,
+    OP_GTE_INT = 73,
+    OP_EQ_FLOAT  = 74,
+    OP_NEQ_FLOAT = 75,
+    OP_LT_FLOAT  = 76,
+    OP_GT_FLOAT  = 77,
+    OP_LTE_FLOAT = 78,
+    OP_GTE_FLOAT = 79,
+
+    // Вызов функции хоста: arg1 = packNativeCall(номер, арность), arg2 = индекс имени
+    OP_CALL_NATIVE = 80,
+
+    // Групповой ввод-вывод: arg1 = маска пинов банка, arg2 = packPinGroup(банк, замеры).
+    // Пины проверяет верификатор при загрузке, при выполнении проверок нет
+    OP_DIGITAL_READ_PINS  = 81,     // кладёт int: бит i - уровень пина банк * 32 + i
+    OP_DIGITAL_WRITE_PINS = 82,     // снимает int: бит i - уровень пина, одна запись в регистры set/clear
+    OP_ANALOG_READ_PINS   = 83,     // снимает массив: элемент s * N + k - замер s пина k (по возрастанию)
+
+    // Обработчик события: arg1 = packEventSource(...), arg2 = номер функции (0 или 1 параметр).
+    // Функцию вызывает VM между квантами runFor, основной код при этом не продолжается
+    OP_EVENT_BIND = 84,
+
+    // Обратный переход цикла while: переход, если (var cmp imm); операнды как у OP_CMP_JUMP_*
+    OP_LOOP_JUMP_GLOBAL = 85,
+    OP_LOOP_JUMP_LOCAL  = 86,
+
     OP_HALT = 255
 };
 
+// Последний опкод перед OP_HALT, который принимает верификатор
+static const uint8_t XENO_LAST_OPCODE = OP_LOOP_JUMP_LOCAL;
+
+// Опкод есть в этой сборке (xeno_features.h)
+inline bool opcodeEnabled(uint8_t opcode) {
+    switch (opcode) {
+        case OP_POW: case OP_SQRT: case OP_SIN: case OP_COS: case OP_TAN:
+            return XENO_FEATURE_MATH;
+        case OP_ARRAY_NEW: case OP_ARRAY_GET: case OP_ARRAY_SET: case OP_ARRAY_LEN:
+            return XENO_FEATURE_ARRAYS;
+        case OP_ANALOG_READ: case OP_ANALOG_WRITE:
+            return XENO_FEATURE_ANALOG;
+        case OP_ANALOG_READ_PINS:
+            return XENO_FEATURE_ANALOG && XENO_FEATURE_ARRAYS;
+        case OP_INPUT:
+            return XENO_FEATURE_INPUT;
+        case OP_EVENT_BIND:
+            return XENO_FEATURE_EVENTS;
+        default:
+            return true;
+    }
+}
+
+inline bool isComparisonOpcode(uint8_t opcode) {
+    return opcode >= OP_EQ && opcode <= OP_GTE;
+}
+
+inline bool isTypedOpcode(uint8_t opcode) {
+    return opcode >= OP_ADD_INT && opcode <= OP_GTE_FLOAT;
+}
+
+// Типизированный вариант общего опкода; OP_NOP - варианта нет
+inline uint8_t intOpcodeFor(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return OP_ADD_INT;
+        case OP_SUB: return OP_SUB_INT;
+        case OP_MUL: return OP_MUL_INT;
+        case OP_DIV: return OP_DIV_INT;
+        case OP_MOD: return OP_MOD_INT;
+        default: return isComparisonOpcode(opcode) ? OP_EQ_INT + (opcode - OP_EQ) : OP_NOP;
+    }
+}
+
+inline uint8_t floatOpcodeFor(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return OP_ADD_FLOAT;
+        case OP_SUB: return OP_SUB_FLOAT;
+        case OP_MUL: return OP_MUL_FLOAT;
+        case OP_DIV: return OP_DIV_FLOAT;
+        default: return isComparisonOpcode(opcode) ? OP_EQ_FLOAT + (opcode - OP_EQ) : OP_NOP;
+    }
+}
+
+// Общий опкод для типизированного; остальные опкоды возвращаются как есть
+inline uint8_t genericOpcode(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD_INT: case OP_ADD_FLOAT: return OP_ADD;
+        case OP_SUB_INT: case OP_SUB_FLOAT: return OP_SUB;
+        case OP_MUL_INT: case OP_MUL_FLOAT: return OP_MUL;
+        case OP_DIV_INT: case OP_DIV_FLOAT: return OP_DIV;
+        case OP_MOD_INT: return OP_MOD;
+        default: break;
+    }
+    if (opcode >= OP_EQ_INT && opcode <= OP_GTE_INT) return OP_EQ + (opcode - OP_EQ_INT);
+    if (opcode >= OP_EQ_FLOAT && opcode <= OP_GTE_FLOAT) return OP_EQ + (opcode - OP_EQ_FLOAT);
+    return opcode;
+}
+
+// Суперинструкции сравнения слота с константой хранят адрес перехода в arg2
+inline bool isSlotCompareJump(uint8_t opcode) {
+    return (opcode >= OP_CMP_JUMP_GLOBAL && opcode <= OP_INC_JUMP_LOCAL) ||
+           opcode == OP_LOOP_JUMP_GLOBAL || opcode == OP_LOOP_JUMP_LOCAL;
+}
+
+// Опкоды, у которых есть адрес перехода внутри байткода
+inline bool isJumpOpcode(uint8_t opcode) {
+    return opcode == OP_JUMP || opcode == OP_JUMP_IF || isSlotCompareJump(opcode);
+}
+
+// Операнд arg1 суперинструкций циклов: биты 0-11 - слот,
+// 12-15 - сравнение (смещение от OP_EQ), 16-31 - константа int16
+static const uint16_t XENO_MAX_COMPARE_SLOT = 0x0FFF;
+
+inline uint32_t packSlotCompare(uint16_t slot, uint8_t compare_op, int16_t imm) {
+    return (slot & XENO_MAX_COMPARE_SLOT) | (static_cast<uint32_t>(compare_op - OP_EQ) << 12) |
+           (static_cast<uint32_t>(static_cast<uint16_t>(imm)) << 16);
+}
+inline uint16_t slotCompareSlot(uint32_t arg1) { return arg1 & XENO_MAX_COMPARE_SLOT; }
+inline uint8_t slotCompareOp(uint32_t arg1) { return OP_EQ + ((arg1 >> 12) & 0xF); }
+inline int16_t slotCompareImm(uint32_t arg1) { return static_cast<int16_t>(arg1 >> 16); }
+
+// Операнд arg1 OP_CALL_NATIVE: биты 0-15 - номер в XenoNativeTable, 16-23 - арность.
+// Арность в самой инструкции: верификатор знает действие на стек без таблицы хоста
+inline uint32_t packNativeCall(uint16_t index, uint8_t arity) {
+    return index | (static_cast<uint32_t>(arity) << 16);
+}
+inline uint16_t nativeCallIndex(uint32_t arg1) { return arg1 & 0xFFFF; }
+inline uint8_t nativeCallArity(uint32_t arg1) { return (arg1 >> 16) & 0xFF; }
+
+// Операнд arg2 групповых опкодов ввода-вывода: биты 0-7 - банк из 32 пинов (как регистры GPIO),
+// 8-15 - число замеров на пин (только OP_ANALOG_READ_PINS)
+static const uint8_t XENO_PIN_BANKS = 8;
+
+inline uint16_t packPinGroup(uint8_t bank, uint8_t samples = 0) {
+    return bank | (static_cast<uint16_t>(samples) << 8);
+}
+inline uint8_t pinGroupBank(uint16_t arg2) { return arg2 & 0xFF; }
+inline uint8_t pinGroupSamples(uint16_t arg2) { return arg2 >> 8; }
+
+inline bool isPinGroupOpcode(uint8_t opcode) {
+    return opcode >= OP_DIGITAL_READ_PINS && opcode <= OP_ANALOG_READ_PINS;
+}
+
+// Источник события (arg1 у OP_EVENT_BIND): биты 24-31 - вид, у пина биты 0-7 - номер,
+// 8-15 - фронт; у таймера биты 0-23 - период в мс
+enum XenoEventKind : uint8_t {
+    XENO_EVENT_PIN = 0,         // Обработчик получает уровень пина
+    XENO_EVENT_TIMER = 1        // Обработчик получает номер срабатывания
+};
+
+enum XenoEventEdge : uint8_t {
+    XENO_EDGE_CHANGE = 0,
+    XENO_EDGE_RISING = 1,
+    XENO_EDGE_FALLING = 2
+};
+
+static const uint32_t XENO_MAX_EVENT_PERIOD = 0xFFFFFF;
+static const uint8_t XENO_MAX_EVENTS = 8;            // Привязок на одну VM
+
+inline uint32_t packEventSource(uint8_t kind, uint32_t value) {
+    return (static_cast<uint32_t>(kind) << 24) | (value & XENO_MAX_EVENT_PERIOD);
+}
+inline uint32_t packPinEvent(uint8_t pin, uint8_t edge) {
+    return packEventSource(XENO_EVENT_PIN, pin | (static_cast<uint32_t>(edge) << 8));
+}
+inline uint8_t eventKind(uint32_t arg1) { return arg1 >> 24; }
+inline uint32_t eventPeriod(uint32_t arg1) { return arg1 & XENO_MAX_EVENT_PERIOD; }
+inline uint8_t eventPin(uint32_t arg1) { return arg1 & 0xFF; }
+inline uint8_t eventEdge(uint32_t arg1) { return (arg1 >> 8) & 0xFF; }
+
+// Вид массива (arg1 у OP_ARRAY_NEW)
+enum XenoArrayKind {
+    ARRAY_VALUES = 0,       // элементы XenoValue любого типа
+    ARRAY_INT32  = 1,       // упакованные однородные элементы без тегов
+    ARRAY_FLOAT  = 2,
+    ARRAY_UINT8  = 3
+};
+
+// Почему runFor вернул управление хосту
+enum XenoRunStatus {
+    XENO_YIELDED = 0,           // Квант исчерпан, программу можно продолжить сразу
+    XENO_SLEEPING = 1,          // DELAY: продолжить не раньше getWakeTime() (millis)
+    XENO_WAITING_INPUT = 2,     // INPUT: ждёт строку из Serial или provideInput
+    XENO_HALTED = 3,            // HALT, конец кода, ошибка или stop()
+    XENO_WAITING_EVENT = 4      // Основной код завершён, VM ждёт прерывания или таймера (on pin/on timer)
+};
+
 // Data types
-enum XenoDataType {
+// Тег типа занимает один байт: XenoValue - 8 байт (тег и объединение по 4 байта)
+enum XenoDataType : uint8_t {
     TYPE_INT = 0,
     TYPE_FLOAT = 1,
     TYPE_STRING = 2,
@@ -103,26 +320,84 @@ struct XenoValue {
         uint16_t array_index;
     };
 
-    XenoValue();
+    XenoValue() : type(TYPE_INT), int_val(0) {}
 
-    static XenoValue makeInt(int32_t val);
-    static XenoValue makeFloat(float val);
-    static XenoValue makeString(uint16_t str_idx);
-    static XenoValue makeBool(bool val);
-    static XenoValue makeArray(uint16_t arr_idx);
+    // Встроенные: фабрики вызываются на каждой операции VM
+    static XenoValue makeInt(int32_t val) {
+        XenoValue v;
+        v.type = TYPE_INT;
+        v.int_val = val;
+        return v;
+    }
+    static XenoValue makeFloat(float val) {
+        XenoValue v;
+        v.type = TYPE_FLOAT;
+        v.float_val = val;
+        return v;
+    }
+    static XenoValue makeString(uint16_t str_idx) {
+        XenoValue v;
+        v.type = TYPE_STRING;
+        v.string_index = str_idx;
+        return v;
+    }
+    static XenoValue makeBool(bool val) {
+        XenoValue v;
+        v.type = TYPE_BOOL;
+        v.bool_val = val;
+        return v;
+    }
+    static XenoValue makeArray(uint16_t arr_idx) {
+        XenoValue v;
+        v.type = TYPE_ARRAY;
+        v.array_index = arr_idx;
+        return v;
+    }
 };
 
+static_assert(sizeof(XenoValue) == 8, "XenoValue must stay 8 bytes");
+
 // Bytecode instruction
 struct XenoInstruction {
     uint8_t opcode;
     uint32_t arg1;
     uint16_t arg2;
+    uint16_t line;          // Строка исходника (занимает бывшее выравнивание, в VM не попадает)
 
     explicit XenoInstruction(uint8_t op = OP_NOP,
                          uint32_t a1 = 0,
                          uint16_t a2 = 0);
 };
 
+// Внутренняя упакованная форма инструкции, в которой её исполняет VM.
+// XenoInstruction из-за выравнивания занимает 12 байт; здесь поля
+// переставлены так, что инструкция занимает ровно 8 байт без потерь.
+struct XenoCompactInstruction {
+    uint8_t opcode;
+    uint8_t reserved;
+    uint16_t arg2;
+    uint32_t arg1;
+
+    static XenoCompactInstruction pack(const XenoInstruction& instr);
+    XenoInstruction unpack() const;
+};
+
+static_assert(sizeof(XenoCompactInstruction) == 8, "XenoCompactInstruction must stay 8 bytes");
+static_assert(sizeof(XenoInstruction) <= 12, "XenoInstruction line must fit into padding");
+
+// Адрес перехода инструкции (для isJumpOpcode)
+inline uint32_t getJumpTarget(const XenoInstruction& instr) {
+    return isSlotCompareJump(instr.opcode) ? instr.arg2 : instr.arg1;
+}
+
+inline void setJumpTarget(XenoInstruction& instr, uint32_t target) {
+    if (isSlotCompareJump(instr.opcode)) {
+        instr.arg2 = target;
+    } else {
+        instr.arg1 = target;
+    }
+}
+
 // Loop info
 struct LoopInfo {
     String var_name;
@@ -133,8 +408,10 @@ struct LoopInfo {
 
 // If context
 struct IfContext {
-    std::vector<int> if_jumps;
-    std::vector<int> else_jumps;
+    XenoArenaVector<int> if_jumps;
+    XenoArenaVector<int> else_jumps;
+
+    explicit IfContext(XenoArena* arena = nullptr) : if_jumps(arena), else_jumps(arena) {}
 };
 
 // Function info (for compiler)
@@ -143,12 +420,15 @@ struct FunctionInfo {
     std::vector<String> parameters;
     int address;
     int arity;
+    int index;                          // Номер функции: arg1 у OP_CALL
 };
 
 // CallFrame for VM
+// Локальные (параметры) не копируются: это окно [base, base + arity) на стеке операндов
 struct CallFrame {
     uint32_t return_address;
-    std::map<String, XenoValue> locals;
+    const FunctionInfo* function;       // Для имён локальных в dumpState
+    uint32_t base;                      // Индекс первого локального слота в стеке
 };
 
 // Constants for import limits (used in XenoSecurityConfig)
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_XENO_FEATURES_H_
+#define SRC_XENO_XENO_FEATURES_H_
+
+// Состав сборки. Отключённое семейство опкодов убирается из таблиц компилятора и из
+// диспетчеризации VM; команда с ним - ошибка компиляции, образ с ним не пройдёт проверку.
+// Флаги задаются для всей библиотеки (build_flags в PlatformIO, -D в CMake):
+//
+//   -DXENO_MINIMAL=1                 все семейства ниже выключены
+//   -DXENO_MINIMAL=1 -DXENO_FEATURE_ARRAYS=1   минимальная сборка плюс массивы
+
+#ifndef XENO_MINIMAL
+#define XENO_MINIMAL 0
+#endif
+
+#if XENO_MINIMAL
+#define XENO_FEATURE_DEFAULT 0
+#else
+#define XENO_FEATURE_DEFAULT 1
+#endif
+
+// pow, sqrt, sin, cos, tan - тянут libm; abs, max, min остаются всегда
+#ifndef XENO_FEATURE_MATH
+#define XENO_FEATURE_MATH XENO_FEATURE_DEFAULT
+#endif
+
+// array, элементы массивов в выражениях, групповой analogread
+#ifndef XENO_FEATURE_ARRAYS
+#define XENO_FEATURE_ARRAYS XENO_FEATURE_DEFAULT
+#endif
+
+// analogread / analogwrite
+#ifndef XENO_FEATURE_ANALOG
+#define XENO_FEATURE_ANALOG XENO_FEATURE_DEFAULT
+#endif
+
+// input: разбор числа, строки и bool из Serial
+#ifndef XENO_FEATURE_INPUT
+#define XENO_FEATURE_INPUT XENO_FEATURE_DEFAULT
+#endif
+
+// on pin / on timer
+#ifndef XENO_FEATURE_EVENTS
+#define XENO_FEATURE_EVENTS XENO_FEATURE_DEFAULT
+#endif
+
+// disassemble, printCompiledCode, dumpState и имена опкодов для них
+#ifndef XENO_FEATURE_DEBUG
+#define XENO_FEATURE_DEBUG XENO_FEATURE_DEFAULT
+#endif
+
+#endif  // SRC_XENO_XENO_FEATURES_H_